@@ -0,0 +1,624 @@
+#include "bench_qvarianttree.h"
+
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include "qvarianttreepersistent.h"
+#include "qvarianttreeflat.h"
+#include "qvarianttreesearch.h"
+#include "qvarianttreekeyindex.h"
+#include "qvarianttreetextindex.h"
+#include "qvarianttreequery.h"
+#include "qvarianttreediff.h"
+#include "qvarianttreehashcache.h"
+#include "qvarianttreesizecache.h"
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+QTEST_APPLESS_MAIN(BenchQVariantTree)
+
+
+namespace {
+
+const int BenchDepth = 6;
+const int BenchWidth = 1000;
+const int BenchRecords = 20000;
+const int BenchReadRuns = 5;
+
+QList<uint> dispatchedTypes()
+{
+    QList<uint> types;
+    types << QVariant::Bool << QVariant::Int << QVariant::Double
+          << QVariant::String << QVariant::List << QVariant::StringList
+          << QVariant::Map << QVariant::Hash;
+    return types;
+}
+
+// drop the file pages from the page cache, as far as the system allows it
+void evictFromCache(const QString& filename)
+{
+#ifdef Q_OS_LINUX
+    QFile file(filename);
+    if (file.open(QFile::ReadOnly))
+        posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+#else
+    Q_UNUSED(filename)
+#endif
+}
+
+// recursive scan of the nested variants, as done before the flat tree
+int countText(const QVariant& value, const QString& text)
+{
+    int count = 0;
+    if (value.type() == QVariant::List) {
+        const QVariantList list = value.toList();
+        for (int i = 0; i < list.count(); i++)
+            count += countText(list.at(i), text);
+    }
+    else if (value.type() == QVariant::Map) {
+        const QVariantMap map = value.toMap();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            if (it.key().contains(text))
+                count++;
+            count += countText(it.value(), text);
+        }
+    }
+    else if (value.type() == QVariant::String && value.toString().contains(text)) {
+        count++;
+    }
+    return count;
+}
+
+}
+
+
+BenchQVariantTree::BenchQVariantTree() :
+    m_tree(),
+    m_deepContent(),
+    m_deepAddress(),
+    m_recordsFile(),
+    m_records()
+{
+}
+
+BenchQVariantTree::~BenchQVariantTree()
+{
+}
+
+
+void BenchQVariantTree::initTestCase()
+{
+    // built from the leaf up to the root
+    QVariant node = QVariant(QLatin1String("leaf"));
+    for (int depth = 0; depth < BenchDepth; depth++) {
+        QVariantMap map;
+        for (int i = 0; i < BenchWidth; i++)
+            map.insert(QString("key%1").arg(i), QVariant(i));
+        QString key = QString("key%1").arg(BenchWidth / 2);
+        map.insert(key, node);
+        m_deepAddress.prepend(QVariant(key));
+        node = map;
+    }
+    m_deepContent = node;
+    m_tree.setRootContent(m_deepContent);
+
+    QVariantList records;
+    for (int i = 0; i < BenchRecords; i++) {
+        QVariantMap record;
+        record.insert(QLatin1String("id"), QVariant(i));
+        record.insert(QLatin1String("label"), QVariant(QString("record %1").arg(i)));
+        record.insert(QLatin1String("values"), QVariant(QVariantList() << QVariant(i * 0.5) << QVariant(true)));
+        records.append(QVariant(record));
+    }
+    QVERIFY(m_recordsFile.open());
+    QVariantTree::toFile(&m_recordsFile, records);
+    m_recordsFile.close();
+    m_records = records;
+}
+
+
+void BenchQVariantTree::bench01DispatchMapKeys()
+{
+    // previous dispatch: a map of containers, with a key list per call
+    QMap<uint, QVariantTreeElementContainer*> containers;
+    containers.insert(QVariant::List, 0);
+    containers.insert(QVariant::StringList, 0);
+    containers.insert(QVariant::Hash, 0);
+    containers.insert(QVariant::Map, 0);
+
+    QList<uint> types = dispatchedTypes();
+    int found = 0;
+    QBENCHMARK {
+        for (int i = 0; i < types.count(); i++) {
+            if (containers.keys().contains(types.at(i)))
+                found++;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+void BenchQVariantTree::bench02DispatchTable()
+{
+    QList<uint> types = dispatchedTypes();
+    int found = 0;
+    QBENCHMARK {
+        for (int i = 0; i < types.count(); i++) {
+            if (m_tree.typeIsContainer(types.at(i)))
+                found++;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+void BenchQVariantTree::bench03PathLookup()
+{
+    bool isValid = false;
+    QBENCHMARK {
+        m_tree.getTreeValue(m_deepContent, m_deepAddress, &isValid);
+    }
+    QVERIFY(isValid);
+}
+
+void BenchQVariantTree::bench04ReadFile_data()
+{
+    QTest::addColumn<bool>("mapped");
+    QTest::addColumn<bool>("coldCache");
+
+    QTest::newRow("stream, warm cache") << false << false;
+    QTest::newRow("mapped, warm cache") << true << false;
+    QTest::newRow("stream, cold cache") << false << true;
+    QTest::newRow("mapped, cold cache") << true << true;
+}
+
+void BenchQVariantTree::bench04ReadFile()
+{
+    QFETCH(bool, mapped);
+    QFETCH(bool, coldCache);
+
+    const QString filename = m_recordsFile.fileName();
+    const qint64 size = QFileInfo(filename).size();
+
+    qint64 elapsed = 0;
+    for (int run = 0; run < BenchReadRuns; run++) {
+        if (coldCache)
+            evictFromCache(filename);
+        else
+            QVariantTree::fromFile(filename); // warm up
+
+        QElapsedTimer timer;
+        timer.start();
+        QVariant content = mapped
+                ? QVariantTree::fromFileMapped(filename)
+                : QVariantTree::fromFile(filename);
+        elapsed += timer.nsecsElapsed();
+
+        QVERIFY(content.toList().count() == BenchRecords);
+    }
+
+    QTest::setBenchmarkResult(size * BenchReadRuns * 1e9 / qMax(elapsed, (qint64)1),
+                              QTest::BytesPerSecond);
+}
+
+void BenchQVariantTree::bench05WriteFile_data()
+{
+    QTest::addColumn<int>("workerCount");
+
+    // 0 is the serial toFile()
+    QTest::newRow("serial") << 0;
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+    QTest::newRow("8 threads") << 8;
+}
+
+void BenchQVariantTree::bench05WriteFile()
+{
+    QFETCH(int, workerCount);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+
+    qint64 elapsed = 0;
+    for (int run = 0; run < BenchReadRuns; run++) {
+        QElapsedTimer timer;
+        timer.start();
+        if (workerCount == 0)
+            QVariantTree::toFile(file.fileName(), m_records);
+        else
+            QVariantTree::toFileParallel(file.fileName(), m_records, workerCount);
+        elapsed += timer.nsecsElapsed();
+    }
+
+    const qint64 size = QFileInfo(file.fileName()).size();
+    QVERIFY(size == m_recordsFile.size());
+    QTest::setBenchmarkResult(size * BenchReadRuns * 1e9 / qMax(elapsed, (qint64)1),
+                              QTest::BytesPerSecond);
+}
+
+void BenchQVariantTree::bench06CompressedFile_data()
+{
+    QTest::addColumn<bool>("write");
+    QTest::addColumn<int>("workerCount");
+
+    QTest::newRow("write, 1 thread") << true << 1;
+    QTest::newRow("write, 4 threads") << true << 4;
+    QTest::newRow("read cold cache, 1 thread") << false << 1;
+    QTest::newRow("read cold cache, 4 threads") << false << 4;
+}
+
+void BenchQVariantTree::bench06CompressedFile()
+{
+    QFETCH(bool, write);
+    QFETCH(int, workerCount);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+    QVariantTree::toCompressedFile(file.fileName(), m_records, workerCount);
+
+    qint64 elapsed = 0;
+    for (int run = 0; run < BenchReadRuns; run++) {
+        if (!write)
+            evictFromCache(file.fileName());
+
+        QElapsedTimer timer;
+        timer.start();
+        if (write) {
+            QVariantTree::toCompressedFile(file.fileName(), m_records, workerCount);
+        }
+        else {
+            QVariant content = QVariantTree::fromFileParallel(file.fileName(), workerCount);
+            QVERIFY(content.toList().count() == BenchRecords);
+        }
+        elapsed += timer.nsecsElapsed();
+    }
+
+    // uncompressed bytes, comparable with bench04ReadFile / bench05WriteFile
+    QVERIFY(QFileInfo(file.fileName()).size() < m_recordsFile.size());
+    QTest::setBenchmarkResult(m_recordsFile.size() * BenchReadRuns * 1e9 / qMax(elapsed, (qint64)1),
+                              QTest::BytesPerSecond);
+}
+
+void BenchQVariantTree::bench07PersistentEdit_data()
+{
+    QTest::addColumn<bool>("persistent");
+    QTest::addColumn<bool>("isMap");
+
+    QTest::newRow("plain list") << false << false;
+    QTest::newRow("persistent list") << true << false;
+    QTest::newRow("plain map") << false << true;
+    QTest::newRow("persistent map") << true << true;
+}
+
+void BenchQVariantTree::bench07PersistentEdit()
+{
+    QFETCH(bool, persistent);
+    QFETCH(bool, isMap);
+
+    QVariant content = m_records;
+    if (isMap) {
+        QVariantMap map;
+        QVariantList records = m_records.toList();
+        for (int i=0; i<records.count(); i++)
+            map.insert(QString::number(i), records.at(i));
+        content = map;
+    }
+
+    QVariantTree tree;
+    if (persistent) {
+        QVariantTreePersistent::install(tree);
+        content = QVariantTreePersistent::fromVariant(content);
+    }
+    tree.setRootContent(content);
+
+    // each edit keeps the previous version alive, as an undo history does
+    int edit = 0;
+    QBENCHMARK {
+        QVariant snapshot = tree.rootContent();
+        QVariant key = isMap ? QVariant(QString::number(edit % BenchRecords)) : QVariant(BenchRecords / 2);
+        if (edit % 2 == 0) {
+            tree.setTreeValue(QVariantList() << key, QVariant(edit));
+        }
+        else {
+            QVariantTreeTransaction transaction;
+            transaction.insertValue(QVariantList() << key, QVariant(edit));
+            tree.apply(transaction);
+        }
+        edit++;
+    }
+}
+
+void BenchQVariantTree::bench08FlatScan_data()
+{
+    QTest::addColumn<QString>("mode");
+
+    QTest::newRow("variant walk") << "walk";
+    QTest::newRow("flat build") << "build";
+    QTest::newRow("flat scan") << "scan";
+}
+
+void BenchQVariantTree::bench08FlatScan()
+{
+    QFETCH(QString, mode);
+
+    QVariantTree tree;
+    tree.setRootContent(m_records);
+    QVariantTreeFlat flat = QVariantTreeFlat::fromTree(tree);
+    const QString text = QLatin1String("record 1");
+
+    int found = 0;
+    QBENCHMARK {
+        if (mode == "walk")
+            found = countText(m_records, text);
+        else if (mode == "build")
+            found = QVariantTreeFlat::fromTree(tree).count();
+        else
+            found = flat.findText(text).count();
+    }
+    QVERIFY(found > 0);
+    if (mode != "build")
+        QCOMPARE(found, flat.findText(text).count());
+}
+
+void BenchQVariantTree::bench09Search_data()
+{
+    QTest::addColumn<int>("workerCount");
+    QTest::addColumn<bool>("isFlat");
+
+    QTest::newRow("1 thread") << 1 << false;
+    QTest::newRow("4 threads") << 4 << false;
+    QTest::newRow("flat, 1 thread") << 1 << true;
+    QTest::newRow("flat, 4 threads") << 4 << true;
+}
+
+void BenchQVariantTree::bench09Search()
+{
+    QFETCH(int, workerCount);
+    QFETCH(bool, isFlat);
+
+    QVariantTreeSearch search;
+    search.setText(QLatin1String("record 1"));
+
+    // the flat form is built once, then searched again
+    QVariantTreeFlat flat;
+    if (isFlat)
+        flat = QVariantTreeFlat::fromVariant(m_tree, m_records);
+
+    int found = 0;
+    QBENCHMARK {
+        if (isFlat)
+            found = search.find(flat, workerCount).count();
+        else
+            found = search.find(m_tree, m_records, workerCount).count();
+    }
+    QCOMPARE(found, countText(m_records, QLatin1String("record 1")));
+}
+
+void BenchQVariantTree::bench10KeyIndex_data()
+{
+    QTest::addColumn<QString>("mode");
+
+    QTest::newRow("key search") << "search";
+    QTest::newRow("index build") << "build";
+    QTest::newRow("index lookup") << "lookup";
+    QTest::newRow("followed edit") << "edit";
+}
+
+void BenchQVariantTree::bench10KeyIndex()
+{
+    QFETCH(QString, mode);
+
+    QVariantTree tree;
+    tree.setRootContent(m_records);
+    QVariantTreeKeyIndex index;
+    index.build(tree);
+
+    QVariantTreeSearch search;
+    search.setText(QLatin1String("label"), Qt::CaseSensitive);
+    search.setTargets(QVariantTreeSearch::KeyTarget);
+
+    if (mode == "edit") {
+        tree.addObserver(&index);
+        tree.moveToNode(BenchRecords / 2);
+    }
+
+    int found = 0;
+    int i = 0;
+    QBENCHMARK {
+        if (mode == "search")
+            found = search.find(tree, m_records, 1).count();
+        else if (mode == "build") {
+            index.build(tree);
+            found = index.count(QLatin1String("label"));
+        }
+        else if (mode == "lookup")
+            found = index.addresses(QLatin1String("label")).count();
+        else {
+            tree.setItemContainer(QLatin1String("label"), QVariant(QString("edited %1").arg(i++)));
+            found = index.count(QLatin1String("label"));
+        }
+    }
+    QCOMPARE(found, BenchRecords);
+}
+
+void BenchQVariantTree::bench11TextIndex_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::addColumn<int>("workerCount");
+
+    QTest::newRow("value search") << "search" << 1;
+    QTest::newRow("index build, 1 thread") << "build" << 1;
+    QTest::newRow("index build, 4 threads") << "build" << 4;
+    QTest::newRow("index query") << "query" << 1;
+}
+
+void BenchQVariantTree::bench11TextIndex()
+{
+    QFETCH(QString, mode);
+    QFETCH(int, workerCount);
+
+    QVariantTreeTextIndex index;
+    index.build(m_tree, m_records);
+    const QString text = QLatin1String("record 1234");
+
+    QVariantTreeSearch search;
+    search.setText(text);
+    search.setTargets(QVariantTreeSearch::ValueTarget);
+
+    int found = 0;
+    QBENCHMARK {
+        if (mode == "search")
+            found = search.find(m_tree, m_records, workerCount).count();
+        else if (mode == "build") {
+            index.build(m_tree, m_records, workerCount);
+            found = index.find(text).count();
+        }
+        else
+            found = index.find(text).count();
+    }
+    QCOMPARE(found, countText(m_records, text));
+}
+
+void BenchQVariantTree::bench12Query_data()
+{
+    QTest::addColumn<QString>("expression");
+    QTest::addColumn<int>("workerCount");
+    QTest::addColumn<int>("expected");
+
+    QTest::newRow("keyed index") << "$[12345].label" << 1 << 1;
+    QTest::newRow("predicate scan") << "$[?(@.id == 12345)].label" << 1 << 1;
+    QTest::newRow("wildcard, 1 thread") << "$[*].values[0]" << 1 << BenchRecords;
+    QTest::newRow("wildcard, 4 threads") << "$[*].values[0]" << 4 << BenchRecords;
+    QTest::newRow("descent, 1 thread") << "$..label" << 1 << BenchRecords;
+    QTest::newRow("descent, 4 threads") << "$..label" << 4 << BenchRecords;
+}
+
+void BenchQVariantTree::bench12Query()
+{
+    QFETCH(QString, expression);
+    QFETCH(int, workerCount);
+    QFETCH(int, expected);
+
+    QVariantTreeQuery query(expression);
+    QVERIFY(query.isValid());
+
+    int found = 0;
+    QBENCHMARK {
+        found = query.evaluate(m_tree, m_records, workerCount).count();
+    }
+    QCOMPARE(found, expected);
+}
+
+void BenchQVariantTree::bench13Diff_data()
+{
+    QTest::addColumn<bool>("isChanged");
+    QTest::addColumn<int>("workerCount");
+
+    QTest::newRow("identical, 1 thread") << false << 1;
+    QTest::newRow("identical, 4 threads") << false << 4;
+    QTest::newRow("one change, 1 thread") << true << 1;
+    QTest::newRow("one change, 4 threads") << true << 4;
+}
+
+void BenchQVariantTree::bench13Diff()
+{
+    QFETCH(bool, isChanged);
+    QFETCH(int, workerCount);
+
+    // a deep copy, nothing is shared with the records
+    QVariantList other = QVariantTree::fromFile(m_recordsFile.fileName()).toList();
+    QCOMPARE(other.count(), BenchRecords);
+    if (isChanged) {
+        QVariantMap record = other.at(BenchRecords / 2).toMap();
+        record.insert(QLatin1String("label"), QVariant(QString("changed")));
+        other[BenchRecords / 2] = record;
+    }
+
+    int found = 0;
+    QBENCHMARK {
+        found = QVariantTreeDiff::compare(m_tree, m_records, other, workerCount).count();
+    }
+    QCOMPARE(found, isChanged ? 1 : 0);
+}
+
+void BenchQVariantTree::bench14HashCache_data()
+{
+    QTest::addColumn<bool>("isCached");
+
+    QTest::newRow("full hash") << false;
+    QTest::newRow("cached, edited spine") << true;
+}
+
+void BenchQVariantTree::bench14HashCache()
+{
+    QFETCH(bool, isCached);
+
+    QVariantTree tree;
+    tree.setRootContent(m_records);
+    QVariantTreeHashCache cache;
+    cache.build(tree);
+    quint64 savedHash = cache.rootHash();
+    if (isCached)
+        tree.addObserver(&cache);
+
+    // an edit then its reverse, the modified state of each one
+    const QVariantList address = QVariantList() << BenchRecords / 2 << QLatin1String("label");
+    const QVariant label = tree.getTreeValue(m_records, address);
+    int modified = 0;
+    QBENCHMARK {
+        modified = 0;
+        tree.setTreeValue(address, QVariant(QString("changed")));
+        if (isCached)
+            modified += cache.rootHash() != savedHash;
+        else
+            modified += QVariantTreeDiff::hash(tree, tree.rootContent()).value != savedHash;
+
+        tree.setTreeValue(address, label);
+        if (isCached)
+            modified += cache.rootHash() != savedHash;
+        else
+            modified += QVariantTreeDiff::hash(tree, tree.rootContent()).value != savedHash;
+    }
+    QCOMPARE(modified, 1);
+    tree.removeObserver(&cache);
+}
+
+void BenchQVariantTree::bench15SizeCache_data()
+{
+    QTest::addColumn<bool>("isCached");
+
+    QTest::newRow("full measure") << false;
+    QTest::newRow("cached, edited spine") << true;
+}
+
+void BenchQVariantTree::bench15SizeCache()
+{
+    QFETCH(bool, isCached);
+
+    QVariantTree tree;
+    tree.setRootContent(m_records);
+    QVariantTreeSizeCache cache;
+    cache.build(tree);
+    qint64 savedSize = cache.size(QVariantList());
+    if (isCached)
+        tree.addObserver(&cache);
+
+    // an edit then its reverse, the size after each one
+    const QVariantList address = QVariantList() << BenchRecords / 2 << QLatin1String("label");
+    const QVariant label = tree.getTreeValue(m_records, address);
+    qint64 grown = 0;
+    QBENCHMARK {
+        tree.setTreeValue(address, QVariant(QString("a longer label")));
+        if (isCached)
+            grown = cache.size(QVariantList()) - savedSize;
+        else
+            grown = QVariantTreeSizeCache::serializedSize(tree.rootContent()) - savedSize;
+
+        tree.setTreeValue(address, label);
+    }
+    QCOMPARE(grown, (qint64)2 * (14 - QString("record %1").arg(BenchRecords / 2).length()));
+    tree.removeObserver(&cache);
+}
@@ -0,0 +1,56 @@
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryFile>
+
+#include "qvarianttree.h"
+
+
+class BenchQVariantTree : public QObject
+{
+    Q_OBJECT
+public:
+    BenchQVariantTree();
+    ~BenchQVariantTree();
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void bench01DispatchMapKeys();
+    void bench02DispatchTable();
+    void bench03PathLookup();
+    void bench04ReadFile_data();
+    void bench04ReadFile();
+    void bench05WriteFile_data();
+    void bench05WriteFile();
+    void bench06CompressedFile_data();
+    void bench06CompressedFile();
+    void bench07PersistentEdit_data();
+    void bench07PersistentEdit();
+    void bench08FlatScan_data();
+    void bench08FlatScan();
+    void bench09Search_data();
+    void bench09Search();
+    void bench10KeyIndex_data();
+    void bench10KeyIndex();
+    void bench11TextIndex_data();
+    void bench11TextIndex();
+    void bench12Query_data();
+    void bench12Query();
+    void bench13Diff_data();
+    void bench13Diff();
+    void bench14HashCache_data();
+    void bench14HashCache();
+    void bench15SizeCache_data();
+    void bench15SizeCache();
+
+private:
+    QVariantTree m_tree;
+
+    /** @brief Deep tree, each level is a wide map. */
+    QVariant m_deepContent;
+    QVariantList m_deepAddress;
+
+    /** @brief File of many top-level records. */
+    QTemporaryFile m_recordsFile;
+    QVariant m_records;
+};
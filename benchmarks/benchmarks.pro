@@ -0,0 +1,19 @@
+QT = core testlib
+
+TARGET   = bench_qvarianttree
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+HEADERS += \
+    bench_qvarianttree.h
+
+SOURCES += \
+    bench_qvarianttree.cpp
+
+
+INCLUDEPATH += "$$_PRO_FILE_PWD_/../qvarianttree"
+DEPENDPATH  += "$$_PRO_FILE_PWD_/../qvarianttree"
+LIBS += -L"$$OUT_PWD/../qvarianttree/" -lqvarianttree
@@ -3,20 +3,64 @@
 
 #include <QFileDialog>
 #include <QCloseEvent>
+#include <QListWidgetItem>
+#include <QRegExp>
+#include <QCompleter>
+#include <QStringListModel>
 
 #include "project.h"
 #include "qvarianttreeitemmodel.h"
 #include "qvariantitemdelegate.h"
+#include "qvarianttreequery.h"
 
 
+namespace {
+
+// order of the items of the search mode combo box
+enum SearchMode {
+    SearchKeysAndValues = 0,
+    SearchKeys,
+    SearchValues,
+    SearchRange,
+    SearchType,
+    SearchPath,
+    SearchIndexedText
+};
+
+const int MaxKeyCompletions = 50;
+
+}
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::mainwindow),
     _permanentMessage(),
-    _currentFilePath()
+    _currentFilePath(),
+    _editRevision(0),
+    _savingRevision(0),
+    _openProgress(NULL),
+    _keyCompleter(NULL),
+    _keyCompletions(NULL)
 {
     ui->setupUi(this);
 
+    _openProgress = new QProgressBar(this);
+    _openProgress->setRange(0, 1000);
+    _openProgress->setTextVisible(false);
+    _openProgress->setMaximumWidth(200);
+    _openProgress->hide();
+    statusBar()->addPermanentWidget(_openProgress);
+
+    ui->dockSearch->hide();
+    ui->dockDiff->hide();
+
+    // the completions are taken from the index as the key is typed
+    _keyCompletions = new QStringListModel(this);
+    _keyCompleter = new QCompleter(_keyCompletions, this);
+    _keyCompleter->setCaseSensitivity(Qt::CaseSensitive);
+    _keyCompleter->setMaxVisibleItems(12);
+    ui->goToKey->setCompleter(_keyCompleter);
+
     // init window
     clear();
     reloadUI();
@@ -27,15 +71,31 @@ MainWindow::MainWindow(QWidget *parent) :
             this, SLOT(new_()));
     connect(ui->actionOpen, SIGNAL(triggered()),
             this, SLOT(open()));
+    connect(ui->actionCancelOpen, SIGNAL(triggered()),
+            this, SLOT(cancelOpen()));
     connect(ui->actionSave, SIGNAL(triggered()),
             this, SLOT(save()));
     connect(ui->actionSaveAs, SIGNAL(triggered()),
             this, SLOT(saveAs()));
+    connect(ui->actionCompact, SIGNAL(triggered()),
+            this, SLOT(compact()));
+    connect(ui->actionCompare, SIGNAL(triggered()),
+            this, SLOT(compare()));
     connect(ui->actionClose, SIGNAL(triggered()),
             this, SLOT(close()));
     connect(ui->actionQuit, SIGNAL(triggered()),
             this, SLOT(quit()));
 
+    connect(ui->actionUndo, SIGNAL(triggered()),
+            this, SLOT(undo()));
+    connect(ui->actionRedo, SIGNAL(triggered()),
+            this, SLOT(redo()));
+    connect(ui->actionFind, SIGNAL(triggered()),
+            this, SLOT(find()));
+    connect(ui->actionIndexText, SIGNAL(toggled(bool)),
+            this, SLOT(setTextIndexEnabled(bool)));
+    connect(ui->actionShowSizes, SIGNAL(toggled(bool)),
+            this, SLOT(setSizeColumnVisible(bool)));
     connect(ui->actionAdd, SIGNAL(triggered()),
             ui->tableBrowser, SLOT(insertValue()));
     connect(ui->actionRemove, SIGNAL(triggered()),
@@ -52,18 +112,70 @@ MainWindow::MainWindow(QWidget *parent) :
             this, SLOT(modelChanged()));
     connect(model(), SIGNAL(valueContentChanged(QVariant)),
             this, SLOT(modelChanged()));
-    connect(model(), SIGNAL(valueTypeChanged(QVariant::Type,QVariant::Type)),
+    connect(model(), SIGNAL(valueTypeChanged(QVariant,uint,uint)),
             this, SLOT(modelChanged()));
     connect(model(), SIGNAL(insertedValue(QVariant)),
             this, SLOT(modelChanged()));
     connect(model(), SIGNAL(deletedValue(QVariant)),
             this, SLOT(modelChanged()));
+    connect(model(), SIGNAL(transactionApplied(QVariantTreeChangeSet)),
+            this, SLOT(modelChanged()));
+    connect(model(), SIGNAL(historyRestored()),
+            this, SLOT(historyRestored()));
+    connect(model(), SIGNAL(hashCacheReady()),
+            this, SLOT(updateModified()));
+
+    // signal of background save
+    connect(model(), SIGNAL(saveProgress(int,int)),
+            this, SLOT(saveProgress(int,int)));
+    connect(model(), SIGNAL(saved(QString,bool)),
+            this, SLOT(saveFinished(QString,bool)));
+
+    // signal of background open
+    connect(model(), SIGNAL(openProgress(qint64,qint64)),
+            this, SLOT(openProgress(qint64,qint64)));
+    connect(model(), SIGNAL(opened(QString,bool,bool)),
+            this, SLOT(openFinished(QString,bool,bool)));
+
+    // signal of background search
+    connect(ui->searchText, SIGNAL(returnPressed()),
+            this, SLOT(startSearch()));
+    connect(ui->buttonSearch, SIGNAL(clicked()),
+            this, SLOT(startSearch()));
+    connect(ui->buttonCancelSearch, SIGNAL(clicked()),
+            this, SLOT(cancelSearch()));
+    connect(ui->listSearchResults, SIGNAL(itemActivated(QListWidgetItem*)),
+            this, SLOT(openSearchResult(QListWidgetItem*)));
+    connect(model(), SIGNAL(searchFound(QVariantList)),
+            this, SLOT(searchFound(QVariantList)));
+    connect(model(), SIGNAL(searchFinished(int,bool)),
+            this, SLOT(searchFinished(int,bool)));
+
+    // signal of background comparison
+    connect(ui->listDifferences, SIGNAL(itemActivated(QListWidgetItem*)),
+            this, SLOT(openDifference(QListWidgetItem*)));
+    connect(model(), SIGNAL(compareFinished(QVariantList,bool,bool)),
+            this, SLOT(compareFinished(QVariantList,bool,bool)));
+
+    // signal of the key index
+    connect(ui->goToKey, SIGNAL(returnPressed()),
+            this, SLOT(goToKey()));
+    connect(ui->goToKey, SIGNAL(textEdited(QString)),
+            this, SLOT(completeKey(QString)));
+    connect(model(), SIGNAL(textIndexReady()),
+            this, SLOT(textIndexReady()));
+
+    // signal of the size cache
+    connect(model(), SIGNAL(sizeCacheReady()),
+            this, SLOT(sizeCacheReady()));
 
     // signal to update UI
     connect(ui->tableBrowser, SIGNAL(movedToChild(QVariant)),
             this, SLOT(fullReload()));
     connect(ui->tableBrowser, SIGNAL(movedToParent()),
             this, SLOT(fullReload()));
+    connect(ui->tableBrowser, SIGNAL(movedToAddress(QVariantList)),
+            this, SLOT(fullReload()));
 }
 
 MainWindow::~MainWindow()
@@ -127,6 +239,13 @@ void MainWindow::clearStatusPermanentMessage()
 
 void MainWindow::clear()
 {
+    model()->cancelOpen();
+    model()->cancelSearch();
+    ui->listSearchResults->clear();
+    ui->labelSearchStatus->clear();
+    model()->cancelCompare();
+    ui->listDifferences->clear();
+    ui->labelDiffStatus->clear();
     ui->tableBrowser->clearTree();
     _currentFilePath.clear();
 
@@ -176,19 +295,305 @@ void MainWindow::open()
         showStatusMessage(tr("Loading from \"%1\" ...").arg(_currentFilePath),
                           MainWindow::ShowTemporary);
 
-        model()->open(_currentFilePath);
-        ui->tableBrowser->adaptColumnWidth();
+        // rows are added while the file is read
+        model()->openInBackground(_currentFilePath);
+        _openProgress->setValue(0);
+        _openProgress->show();
+        ui->actionCancelOpen->setEnabled(true);
 
         setWindowModified(false);
         setTitle(QDir(_currentFilePath).dirName());
 
         reloadUI();
         reloadMenu();
+    }
+}
+
+void MainWindow::cancelOpen()
+{
+    model()->cancelOpen();
+}
+
+void MainWindow::openProgress(qint64 bytesRead, qint64 bytesTotal)
+{
+    _openProgress->setValue(bytesTotal > 0 ? bytesRead * 1000 / bytesTotal : 1000);
+}
+
+void MainWindow::openFinished(const QString& filename, bool success, bool cancelled)
+{
+    _openProgress->hide();
+    ui->actionCancelOpen->setEnabled(false);
 
+    ui->tableBrowser->adaptColumnWidth();
+    reloadUI();
+    reloadMenu();
+
+    if (cancelled)
+        showStatusMessage(tr("Loading cancelled."),
+                          MainWindow::ShowTemporary, 2000);
+    else if (!success)
+        showStatusMessage(tr("Cannot load \"%1\" entirely.")
+                          .arg(QDir(filename).dirName()),
+                          MainWindow::ShowTemporary, 5000);
+    else
         showStatusMessage(tr("\"%1\" loaded.")
-                          .arg(QDir(_currentFilePath).dirName()),
+                          .arg(QDir(filename).dirName()),
+                          MainWindow::ShowTemporary, 2000);
+}
+
+void MainWindow::find()
+{
+    ui->dockSearch->show();
+    ui->searchText->setFocus();
+    ui->searchText->selectAll();
+}
+
+void MainWindow::startSearch()
+{
+    QString text = ui->searchText->text().trimmed();
+    if (text.isEmpty() || model()->isEmpty())
+        return;
+
+    QVariantTreeSearch search;
+    switch (ui->searchMode->currentIndex()) {
+    case SearchKeysAndValues:
+        search.setText(text);
+        break;
+    case SearchKeys:
+        search.setText(text);
+        search.setTargets(QVariantTreeSearch::KeyTarget);
+        break;
+    case SearchValues:
+        search.setText(text);
+        search.setTargets(QVariantTreeSearch::ValueTarget);
+        break;
+    case SearchRange: {
+        // "min max", "min;max" or "min..max"
+        QStringList bounds = text.split(QRegExp("\\s*(\\.\\.|;|\\s)\\s*"),
+                                        QString::SkipEmptyParts);
+        bool minimumValid = false;
+        bool maximumValid = false;
+        double minimum = bounds.value(0).toDouble(&minimumValid);
+        double maximum = bounds.value(1).toDouble(&maximumValid);
+        if (bounds.count() != 2 || !minimumValid || !maximumValid) {
+            ui->labelSearchStatus->setText(tr("Give a minimum and a maximum."));
+            return;
+        }
+        search.setRange(qMin(minimum, maximum), qMax(minimum, maximum));
+        break;
+    }
+    case SearchType: {
+        int type = -1;
+        QHash<uint, QString> types = model()->typesToName();
+        for (QHash<uint, QString>::const_iterator it = types.constBegin(); it != types.constEnd(); ++it) {
+            if (it.value().compare(text, Qt::CaseInsensitive) == 0)
+                type = it.key();
+        }
+        if (type < 0) {
+            ui->labelSearchStatus->setText(tr("Unknown type \"%1\".").arg(text));
+            return;
+        }
+        search.setType(type);
+        break;
+    }
+    case SearchPath: {
+        // evaluated in the background, the branches in parallel
+        QVariantTreeQuery query(text);
+        if (!query.isValid()) {
+            ui->labelSearchStatus->setText(tr("%1, at character %2.")
+                                           .arg(query.errorString())
+                                           .arg(query.errorPosition() + 1));
+            return;
+        }
+        ui->listSearchResults->clear();
+        ui->labelSearchStatus->setText(tr("Searching ..."));
+        ui->buttonCancelSearch->setEnabled(true);
+        model()->searchInBackground(query);
+        return;
+    }
+    case SearchIndexedText: {
+        // string values only, ranked
+        if (!model()->textIndexIsReady()) {
+            ui->labelSearchStatus->setText(model()->textIndexIsEnabled()
+                                           ? tr("The text index is being built.")
+                                           : tr("Turn on \"Index text values\" first."));
+            return;
+        }
+        model()->cancelSearch();
+        QVariantList results;
+        foreach (const QVariantList& address, model()->textIndex().find(text))
+            results.append(QVariant(address));
+        ui->listSearchResults->clear();
+        searchFound(results);
+        ui->labelSearchStatus->setText(tr("%1 results (indexed).").arg(results.count()));
+        return;
+    }
+    }
+
+    ui->listSearchResults->clear();
+    ui->labelSearchStatus->setText(tr("Searching ..."));
+    ui->buttonCancelSearch->setEnabled(true);
+    model()->searchInBackground(search);
+}
+
+void MainWindow::cancelSearch()
+{
+    model()->cancelSearch();
+}
+
+void MainWindow::searchFound(const QVariantList& addresses)
+{
+    foreach (const QVariant& address, addresses) {
+        QStringList keys = displayableAddress(address.toList());
+        QListWidgetItem* item = new QListWidgetItem(
+                    keys.isEmpty() ? tr("<Root>") : keys.join(tr(" > ")));
+        item->setData(Qt::UserRole, address);
+        ui->listSearchResults->addItem(item);
+    }
+    ui->labelSearchStatus->setText(tr("Searching ... %1 results")
+                                   .arg(ui->listSearchResults->count()));
+}
+
+void MainWindow::searchFinished(int count, bool cancelled)
+{
+    ui->buttonCancelSearch->setEnabled(false);
+    if (cancelled)
+        ui->labelSearchStatus->setText(tr("Search stopped, %1 results.")
+                                       .arg(ui->listSearchResults->count()));
+    else
+        ui->labelSearchStatus->setText(tr("%1 results.").arg(count));
+}
+
+void MainWindow::openSearchResult(QListWidgetItem* item)
+{
+    if (!item || model()->isEmpty())
+        return;
+
+    ui->tableBrowser->openAddress(item->data(Qt::UserRole).toList());
+}
+
+void MainWindow::setTextIndexEnabled(bool enabled)
+{
+    model()->setTextIndexEnabled(enabled);
+    if (enabled && model()->isTextIndexing())
+        showStatusMessage(tr("Indexing the text values ..."),
+                          MainWindow::ShowTemporary, 2000);
+}
+
+void MainWindow::textIndexReady()
+{
+    const QVariantTreeTextIndex& index = model()->textIndex();
+    showStatusMessage(tr("%1 text values indexed, %2 MB.")
+                      .arg(index.count())
+                      .arg(index.memoryUsage() / (1024.0 * 1024.0), 0, 'f', 1),
+                      MainWindow::ShowTemporary, 5000);
+}
+
+void MainWindow::setSizeColumnVisible(bool visible)
+{
+    model()->setSizeColumnVisible(visible);
+    ui->tableBrowser->adaptColumnWidth();
+    if (visible && model()->isMeasuring())
+        showStatusMessage(tr("Measuring the values ..."),
+                          MainWindow::ShowTemporary, 2000);
+}
+
+void MainWindow::sizeCacheReady()
+{
+    ui->tableBrowser->adaptColumnWidth();
+    showStatusMessage(tr("%1 MB once saved.")
+                      .arg(model()->sizeCache().fileSize() / (1024.0 * 1024.0), 0, 'f', 1),
+                      MainWindow::ShowTemporary, 5000);
+}
+
+void MainWindow::compareFinished(const QVariantList& differences, bool success, bool cancelled)
+{
+    if (cancelled) {
+        ui->labelDiffStatus->setText(tr("Comparison stopped."));
+        return;
+    }
+    if (!success) {
+        ui->labelDiffStatus->setText(tr("Cannot read the compared file entirely."));
+        return;
+    }
+
+    foreach (const QVariant& difference, differences) {
+        QVariantList fields = difference.toList();
+        QString prefix;
+        switch (fields.at(0).toInt()) {
+        case QVariantTreeDiff::Added:
+            prefix = "+ ";
+            break;
+        case QVariantTreeDiff::Removed:
+            prefix = "- ";
+            break;
+        default:
+            prefix = "~ ";
+            break;
+        }
+        QStringList keys = displayableAddress(fields.at(1).toList());
+        QListWidgetItem* item = new QListWidgetItem(
+                    prefix + (keys.isEmpty() ? tr("<Root>") : keys.join(tr(" > "))));
+        item->setData(Qt::UserRole, difference);
+        ui->listDifferences->addItem(item);
+    }
+    ui->labelDiffStatus->setText(tr("%1 differences.").arg(differences.count()));
+}
+
+void MainWindow::openDifference(QListWidgetItem* item)
+{
+    if (!item || model()->isEmpty())
+        return;
+
+    QVariantList fields = item->data(Qt::UserRole).toList();
+    QVariantList address = fields.at(1).toList();
+    if (fields.at(0).toInt() == QVariantTreeDiff::Removed && !address.isEmpty())
+        address.removeLast();
+    ui->tableBrowser->openAddress(address);
+}
+
+void MainWindow::goToKey()
+{
+    QString key = ui->goToKey->text().trimmed();
+    if (key.isEmpty() || model()->isEmpty())
+        return;
+
+    if (!model()->keyIndexIsReady()) {
+        showStatusMessage(tr("The keys are still being indexed."),
+                          MainWindow::ShowTemporary, 2000);
+        return;
+    }
+
+    QList<QVariantList> addresses = model()->keyIndex().addresses(key);
+    if (addresses.isEmpty()) {
+        showStatusMessage(tr("No key \"%1\".").arg(key),
                           MainWindow::ShowTemporary, 2000);
+        return;
     }
+    if (addresses.count() == 1) {
+        ui->tableBrowser->openAddress(addresses.first());
+        return;
+    }
+
+    // several nodes: listed in the search panel
+    model()->cancelSearch();
+    QVariantList results;
+    foreach (const QVariantList& address, addresses)
+        results.append(QVariant(address));
+    ui->listSearchResults->clear();
+    searchFound(results);
+    ui->listSearchResults->sortItems();
+    ui->labelSearchStatus->setText(tr("%1 nodes with the key \"%2\".")
+                                   .arg(addresses.count()).arg(key));
+    ui->dockSearch->show();
+}
+
+void MainWindow::completeKey(const QString& text)
+{
+    QStringList completions;
+    if (!text.isEmpty() && model()->keyIndexIsReady())
+        completions = model()->keyIndex().complete(text, MaxKeyCompletions);
+    _keyCompletions->setStringList(completions);
 }
 
 void MainWindow::save(bool force)
@@ -201,19 +606,87 @@ void MainWindow::save(bool force)
         saveFilename = QFileDialog::getSaveFileName(this, tr("Save file"), saveFilename);
     }
     if (!saveFilename.isEmpty()) {
+        // only the edits are appended to the opened file
+        if (!force && model()->canSaveJournal(saveFilename)) {
+            if (model()->saveJournal()) {
+                setWindowModified(false);
+                showStatusMessage(tr("\"%1\" saved.")
+                                  .arg(QDir(saveFilename).dirName()),
+                                  MainWindow::ShowTemporary, 2000);
+                return;
+            }
+        }
+
         _currentFilePath = saveFilename;
 
         showStatusMessage(tr("Saving to \"%1\" ...").arg(_currentFilePath),
                           MainWindow::ShowTemporary);
 
-        model()->save(_currentFilePath);
-        setWindowModified(false);
+        // window modified state follows the saved snapshot
+        _savingRevision = _editRevision;
+        model()->saveInBackground(_currentFilePath);
         setTitle(QDir(_currentFilePath).dirName());
+    }
+}
 
-        showStatusMessage(tr("\"%1\" saved.")
-                          .arg(QDir(_currentFilePath).dirName()),
-                          MainWindow::ShowTemporary, 2000);
+void MainWindow::compact()
+{
+    if (model()->isEmpty() || _currentFilePath.isEmpty())
+        return;
+
+    showStatusMessage(tr("Compacting \"%1\" ...").arg(QDir(_currentFilePath).dirName()),
+                      MainWindow::ShowTemporary);
+
+    _savingRevision = _editRevision;
+    model()->saveInBackground(_currentFilePath);
+}
+
+void MainWindow::compare()
+{
+    if (model()->isEmpty())
+        return;
+
+    QString filename = QFileDialog::getOpenFileName(this, tr("Compare with file"), _currentFilePath);
+    if (filename.isEmpty())
+        return;
+
+    ui->dockDiff->show();
+    ui->listDifferences->clear();
+    ui->labelDiffStatus->setText(tr("Comparing with \"%1\" ...").arg(QDir(filename).dirName()));
+    model()->compareInBackground(filename);
+}
+
+void MainWindow::saveAndWait(bool force)
+{
+    save(force);
+    model()->waitForSave();
+}
+
+void MainWindow::saveProgress(int done, int total)
+{
+    showStatusMessage(tr("Saving to \"%1\" ... %2%")
+                      .arg(QDir(_currentFilePath).dirName())
+                      .arg(total > 0 ? done * 100 / total : 100),
+                      MainWindow::ShowTemporary);
+}
+
+void MainWindow::saveFinished(const QString& filename, bool success)
+{
+    if (!success) {
+        showStatusMessage(tr("Cannot save \"%1\".")
+                          .arg(QDir(filename).dirName()),
+                          MainWindow::ShowTemporary, 5000);
+        return;
     }
+
+    // edited during the save: still modified
+    if (_editRevision == _savingRevision)
+        setWindowModified(false);
+    updateModified();
+
+    showStatusMessage(tr("\"%1\" saved.")
+                      .arg(QDir(filename).dirName()),
+                      MainWindow::ShowTemporary, 2000);
 }
 
 void MainWindow::close()
@@ -234,6 +707,10 @@ bool MainWindow::quit()
                            tr("Do you want to save before quit ?"),
                            QMessageBox::Close) == QMessageBox::Cancel)
         return false;
+    model()->cancelOpen();
+    model()->cancelSearch();
+    model()->cancelCompare();
+    model()->waitForSave();
     qApp->quit();
     return true;
 }
@@ -251,7 +728,7 @@ QMessageBox::StandardButton MainWindow::askBeforeLoseDatas(
                                      actionButton,
                                      QMessageBox::Cancel);
         if (resp == QMessageBox::Save)
-            save();
+            saveAndWait();
     }
     return resp;
 }
@@ -275,6 +752,7 @@ void MainWindow::reloadUI()
     {
         ui->buttonBack->setEnabled(true);
         ui->labelNavigation->setEnabled(true);
+        ui->goToKey->setEnabled(true);
         ui->tableBrowser->setEnabled(true);
 
         // ADRESSE
@@ -292,6 +770,7 @@ void MainWindow::reloadUI()
         ui->labelNavigation->setText("");
         ui->buttonBack->setEnabled(false);
         ui->labelNavigation->setEnabled(false);
+        ui->goToKey->setEnabled(false);
         ui->tableBrowser->setEnabled(false);
     }
 
@@ -303,26 +782,40 @@ void MainWindow::reloadMenu()
     {
         ui->actionSave->setEnabled(true);
         ui->actionSaveAs->setEnabled(true);
+        ui->actionCompact->setEnabled(true);
+        ui->actionCompare->setEnabled(true);
         ui->actionClose->setEnabled(true);
 
         ui->actionAdd->setEnabled(true);
         ui->actionRemove->setEnabled(true);
+        ui->actionUndo->setEnabled(model()->canUndo());
+        ui->actionRedo->setEnabled(model()->canRedo());
+        ui->actionFind->setEnabled(true);
     }
     else
     {
         ui->actionSave->setEnabled(false);
         ui->actionSaveAs->setEnabled(false);
+        ui->actionCompact->setEnabled(false);
+        ui->actionCompare->setEnabled(false);
         ui->actionClose->setEnabled(false);
 
         ui->actionAdd->setEnabled(false);
         ui->actionRemove->setEnabled(false);
+        ui->actionUndo->setEnabled(false);
+        ui->actionRedo->setEnabled(false);
+        ui->actionFind->setEnabled(false);
     }
 }
 
 QStringList MainWindow::displayableAddress() const
+{
+    return displayableAddress(model()->tree().address());
+}
+
+QStringList MainWindow::displayableAddress(const QVariantList& address) const
 {
     QStringList list;
-    QVariantList address = model()->tree().address();
     for (int i=0; i<address.size(); i++) {
         QVariant key = address.value(i);
         QString strKey = model()->keyToString(key);
@@ -343,7 +836,37 @@ QVariantTreeItemModel* MainWindow::model() const
 
 void MainWindow::modelChanged()
 {
+    _editRevision++;
     setWindowModified(true);
+    updateModified();
+
+    ui->actionUndo->setEnabled(model()->canUndo());
+    ui->actionRedo->setEnabled(model()->canRedo());
+}
+
+void MainWindow::updateModified()
+{
+    // else the edit revisions tell
+    bool isKnown = false;
+    bool isModified = model()->isModified(&isKnown);
+    if (isKnown)
+        setWindowModified(isModified);
+}
+
+void MainWindow::undo()
+{
+    model()->undo();
+}
+
+void MainWindow::redo()
+{
+    model()->redo();
+}
+
+void MainWindow::historyRestored()
+{
+    modelChanged();
+    fullReload();
 }
 
 //------------------------------------------------------------------------------
@@ -4,9 +4,13 @@
 #include <QMainWindow>
 #include <QLabel>
 #include <QMessageBox>
+#include <QProgressBar>
 
 class QVariantTree;
 class QVariantTreeItemModel;
+class QListWidgetItem;
+class QCompleter;
+class QStringListModel;
 
 
 namespace Ui {
@@ -42,6 +46,19 @@ private slots:
      * @param force If true, it will ask where to save
      */
     void save(bool force = false);
+    /**
+     * @brief Save the current content, and wait for the end of the save.
+     * @param force If true, it will ask where to save
+     */
+    void saveAndWait(bool force = false);
+    /**
+     * @brief Rewrite the whole file, folding the journal of edits into it.
+     */
+    void compact();
+    /**
+     * @brief Ask for a file and list its differences with the current content.
+     */
+    void compare();
     /**
      * @brief Force asking to save if required.
      * Provided for convenience.
@@ -57,6 +74,19 @@ private slots:
      */
     bool quit();
 
+    /**
+     * @brief Undo the last edit.
+     */
+    void undo();
+    /**
+     * @brief Redo the last undone edit.
+     */
+    void redo();
+    /**
+     * @brief Reload the window after an undo / redo.
+     */
+    void historyRestored();
+
     /**
      * @brief Display the about window.
      */
@@ -67,12 +97,121 @@ private slots:
      * Called whenever there is a change in the tree.
      */
     void modelChanged();
+    /**
+     * @brief Set the modified state from the content hashes, once known.
+     * Reverting the edits clears it.
+     */
+    void updateModified();
 
     /**
      * @brief Reload the window after any movment into to tree.
      */
     void fullReload();
 
+    /**
+     * @brief Display the progress of the background save.
+     * @param done Number of records written
+     * @param total Number of records to write
+     */
+    void saveProgress(int done, int total);
+    /**
+     * @brief End of the background save.
+     * The window is not modified if nothing changed since the snapshot.
+     * @param filename The file saved into
+     * @param success True if the file is written
+     */
+    void saveFinished(const QString& filename, bool success);
+
+    /**
+     * @brief Stop the background open, keeping the rows already loaded.
+     */
+    void cancelOpen();
+    /**
+     * @brief Display the progress of the background open.
+     * @param bytesRead Number of bytes read
+     * @param bytesTotal Size of the file
+     */
+    void openProgress(qint64 bytesRead, qint64 bytesTotal);
+    /**
+     * @brief End of the background open.
+     * @param filename The file read from
+     * @param success True if the file is entirely read
+     * @param cancelled True if the loading was cancelled
+     */
+    void openFinished(const QString& filename, bool success, bool cancelled);
+
+    /**
+     * @brief Show the search panel.
+     */
+    void find();
+    /**
+     * @brief Start a search with the criteria of the search panel.
+     */
+    void startSearch();
+    /**
+     * @brief Stop the running search, keeping the results found.
+     */
+    void cancelSearch();
+    /**
+     * @brief Add a batch of hits to the results list.
+     * @param addresses List of the addresses, each one a QVariantList
+     */
+    void searchFound(const QVariantList& addresses);
+    /**
+     * @brief End of the search.
+     * @param count Number of hits
+     * @param cancelled True if the search was stopped
+     */
+    void searchFinished(int count, bool cancelled);
+    /**
+     * @brief Navigate the table to the node of a result.
+     * @param item The result to open
+     */
+    void openSearchResult(QListWidgetItem* item);
+    /**
+     * @brief Build or drop the index of the string values.
+     * @param enabled True to build it
+     */
+    void setTextIndexEnabled(bool enabled);
+    /**
+     * @brief Report the memory held by the text index, once built.
+     */
+    void textIndexReady();
+    /**
+     * @brief Show or hide the serialized size of the values.
+     * @param visible True to show the size column
+     */
+    void setSizeColumnVisible(bool visible);
+    /**
+     * @brief Report the size of the file once saved, when measured.
+     */
+    void sizeCacheReady();
+
+    /**
+     * @brief Fill the differences panel.
+     * @param differences List of the differences, each one a QVariantList
+     * with the QVariantTreeDiff::Type then the address
+     * @param success False if the compared file cannot be read entirely
+     * @param cancelled True if the comparison was stopped
+     */
+    void compareFinished(const QVariantList& differences, bool success, bool cancelled);
+    /**
+     * @brief Navigate the table to the node of a difference.
+     * A removed node is not in the tree, its parent is opened.
+     * @param item The difference to open
+     */
+    void openDifference(QListWidgetItem* item);
+
+    /**
+     * @brief Open the node of the typed key, or list them if several.
+     */
+    void goToKey();
+    /**
+     * @brief Complete the typed key with the keys of the tree.
+     * @param text The typed text
+     */
+    void completeKey(const QString& text);
+
 private:
     /**
      * @brief Clear all.
@@ -115,6 +254,12 @@ private:
      * @return Ordered keys of the address
      */
     QStringList displayableAddress() const;
+    /**
+     * @brief Return the ordered list of keys of the given address.
+     * @param address The address to display
+     * @return Ordered keys of the address
+     */
+    QStringList displayableAddress(const QVariantList& address) const;
 
     /**
      * @brief Enum to use when changing the status bar message.
@@ -169,6 +314,26 @@ private:
      * If empty, it may be a new file as nothing to edit.
      */
     QString _currentFilePath;
+
+    /**
+     * @brief Number of modifications since the window creation.
+     */
+    int _editRevision;
+    /**
+     * @brief Modification number of the snapshot being saved.
+     */
+    int _savingRevision;
+
+    /**
+     * @brief Progress of the background open, in the statusbar.
+     */
+    QProgressBar* _openProgress;
+
+    /**
+     * @brief Completion of the "go to key" field, from the key index.
+     */
+    QCompleter* _keyCompleter;
+    QStringListModel* _keyCompletions;
 };
 
 #endif // MAINWINDOW_H
@@ -137,8 +137,10 @@ void QTableVariantTree::openParent()
 
     _model.moveToParent();
 
+    // the path is unknown after an undo / redo moved the tree address
+    int row = _selectedRowsPath.isEmpty() ? 0 : _selectedRowsPath.takeLast();
     QModelIndex selectAndVisibleIndex = model()->index(
-                _selectedRowsPath.takeLast(),
+                row,
                 model()->columnValue());
     scrollTo(selectAndVisibleIndex, QAbstractItemView::PositionAtCenter);
     setCurrentIndex(selectAndVisibleIndex);
@@ -148,6 +150,37 @@ void QTableVariantTree::openParent()
     adaptColumnWidth();
 }
 
+void QTableVariantTree::openAddress(const QVariantList& address)
+{
+    selectionModel()->clear();
+    setCurrentIndex(QModelIndex());
+
+    // open the parent of the node, and select the node
+    _model.moveToRoot();
+    _selectedRowsPath.clear();
+    int row = -1;
+    for (int i=0; i<address.count(); i++) {
+        row = _model.rowOfKey(address.at(i));
+        // the tree changed since the address was taken
+        if (row < 0 || i == address.count() - 1)
+            break;
+        _selectedRowsPath.append(row);
+        _model.moveToChild(address.at(i));
+    }
+
+    if (row >= 0) {
+        QModelIndex selectAndVisibleIndex = model()->index(
+                    row,
+                    model()->columnValue());
+        scrollTo(selectAndVisibleIndex, QAbstractItemView::PositionAtCenter);
+        setCurrentIndex(selectAndVisibleIndex);
+    }
+
+    emit movedToAddress(address);
+
+    adaptColumnWidth();
+}
+
 //------------------------------------------------------------------------------
 // Calls for adaptColumnWidth
 
@@ -191,6 +224,10 @@ void QTableVariantTree::adaptColumnWidth()
     int width = viewport()->size().width() -
             columnWidth(model()->columnKey()) -
             columnWidth(model()->columnType());
+    if (model()->sizeColumnIsVisible()) {
+        resizeColumnToContents(model()->columnSize());
+        width -= columnWidth(model()->columnSize());
+    }
 
     int minWidth = horizontalHeader()->minimumSectionSize();
     if (width < minWidth)
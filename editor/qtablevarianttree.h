@@ -28,10 +28,12 @@ public slots:
     void openChild(int row);
     void openChild(const QModelIndex& index);
     void openParent();
+    void openAddress(const QVariantList& address);
 
 signals:
     void movedToChild(const QVariant& key);
     void movedToParent();
+    void movedToAddress(const QVariantList& address);
 
 protected slots:
     void dataChanged(const QModelIndex &topLeft,
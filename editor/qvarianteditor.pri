@@ -18,7 +18,31 @@ SOURCES += main.cpp\
     qvarianttreeitemmodel.cpp \
     qvariantitemdelegate.cpp \
     qtablevarianttree.cpp \
-    qvarianttreeelement.cpp
+    qvarianttreeelement.cpp \
+    qvarianttreetransaction.cpp \
+    qvarianttreerecordreader.cpp \
+    qvarianttreerecordindex.cpp \
+    qvarianttreecontainer.cpp \
+    qvarianttreecompressed.cpp \
+    qvarianttreejournal.cpp \
+    qvarianttreehistory.cpp \
+    qvarianttreepersistent.cpp \
+    qvarianttreeflat.cpp \
+    qvarianttreesearch.cpp \
+    qvarianttreeobserver.cpp \
+    qvarianttreekeyindex.cpp \
+    qvarianttreetextindex.cpp \
+    qvarianttreequery.cpp \
+    qvarianttreediff.cpp \
+    qvarianttreehashcache.cpp \
+    qvarianttreesizecache.cpp \
+    qvarianttreeworkers.cpp \
+    qvarianttreesavetask.cpp \
+    qvarianttreeloadtask.cpp \
+    qvarianttreerecordqueue.cpp \
+    qvarianttreesearchtask.cpp \
+    qvarianttreedifftask.cpp \
+    qvarianttreebuildtask.cpp
 
 HEADERS  += mainwindow.h \
     qvarianttree.h \
@@ -26,7 +50,31 @@ HEADERS  += mainwindow.h \
     qvariantitemdelegate.h \
     qtablevarianttree.h \
     project.h \
-    qvarianttreeelement.h
+    qvarianttreeelement.h \
+    qvarianttreetransaction.h \
+    qvarianttreerecordreader.h \
+    qvarianttreerecordindex.h \
+    qvarianttreecontainer.h \
+    qvarianttreecompressed.h \
+    qvarianttreejournal.h \
+    qvarianttreehistory.h \
+    qvarianttreepersistent.h \
+    qvarianttreeflat.h \
+    qvarianttreesearch.h \
+    qvarianttreeobserver.h \
+    qvarianttreekeyindex.h \
+    qvarianttreetextindex.h \
+    qvarianttreequery.h \
+    qvarianttreediff.h \
+    qvarianttreehashcache.h \
+    qvarianttreesizecache.h \
+    qvarianttreeworkers.h \
+    qvarianttreesavetask.h \
+    qvarianttreeloadtask.h \
+    qvarianttreerecordqueue.h \
+    qvarianttreesearchtask.h \
+    qvarianttreedifftask.h \
+    qvarianttreebuildtask.h
 
 FORMS    += mainwindow.ui
 
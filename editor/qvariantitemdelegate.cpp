@@ -427,7 +427,7 @@ void QVariantItemDelegate::setModelData(QWidget *editor,
                                 model->index(index.row(), model->columnCount()));
 
         // updating others
-        emit model->valueTypeChanged(newItemType,
+        emit model->valueTypeChanged(key, newItemType,
                                      itemInfos.value(model->columnType()).type());
 
     }
@@ -0,0 +1,34 @@
+#include "qvarianttreebuildtask.h"
+
+#include "qvarianttree.h"
+#include "qvarianttreekeyindex.h"
+
+
+QVariantTreeBuildTask::QVariantTreeBuildTask(Target* target,
+                                             const QVariant& root,
+                                             QAtomicInt* cancelled,
+                                             QObject *parent) :
+    QObject(parent),
+    _target(target),
+    _root(root),
+    _cancelled(cancelled)
+{
+}
+
+void QVariantTreeBuildTask::run()
+{
+    // default containers, the snapshot holds plain collections
+    QVariantTree tree;
+    bool completed = _target->build(tree, _root, _cancelled);
+    emit finished(!completed);
+}
+
+//------------------------------------------------------------------------------
+
+template<>
+bool QVariantTreeBuildTarget<QVariantTreeKeyIndex>::build(const QVariantTree& tree,
+                                                          const QVariant& root,
+                                                          const QAtomicInt* cancelled)
+{
+    return value.build(tree, root, cancelled);
+}
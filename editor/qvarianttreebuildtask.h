@@ -0,0 +1,86 @@
+#ifndef QVARIANTTREEBUILDTASK_H
+#define QVARIANTTREEBUILDTASK_H
+
+#include <QObject>
+#include <QVariant>
+#include <QAtomicInt>
+
+class QVariantTree;
+class QVariantTreeKeyIndex;
+
+
+/**
+ * @brief Build an index or a cache of a snapshot of a tree content, meant
+ * to run in a worker thread.
+ */
+class QVariantTreeBuildTask : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief The structure built by the task.
+     * @see QVariantTreeBuildTarget
+     */
+    class Target
+    {
+    public:
+        virtual ~Target() {}
+        /**
+         * @brief Build from a root content with the containers of a tree.
+         * @return False if cancelled
+         */
+        virtual bool build(const QVariantTree& tree, const QVariant& root,
+                           const QAtomicInt* cancelled) = 0;
+    };
+
+    /**
+     * @brief Prepare the build.
+     * @param target The structure to fill, not used by other threads until finished()
+     * @param root Snapshot of the root content, loaded
+     * @param cancelled Flag to stop the build, set from any thread
+     */
+    explicit QVariantTreeBuildTask(Target* target,
+                                   const QVariant& root,
+                                   QAtomicInt* cancelled,
+                                   QObject *parent = 0);
+
+public slots:
+    /**
+     * @brief Build from the whole root until its end or the cancellation.
+     */
+    void run();
+
+signals:
+    /**
+     * @brief Emitted once the build is over.
+     * @param cancelled True if the structure is empty
+     */
+    void finished(bool cancelled);
+
+private:
+    Target* _target;
+    QVariant _root;
+    QAtomicInt* _cancelled;
+};
+
+/**
+ * @brief Target holding a built structure, an index or a cache with a
+ * build(tree, root, workerCount, cancelled) function.
+ */
+template<typename T>
+class QVariantTreeBuildTarget : public QVariantTreeBuildTask::Target
+{
+public:
+    bool build(const QVariantTree& tree, const QVariant& root, const QAtomicInt* cancelled)
+    { return value.build(tree, root, 0, cancelled); }
+
+    T value;
+};
+
+// the key index is built in a single thread
+template<>
+bool QVariantTreeBuildTarget<QVariantTreeKeyIndex>::build(const QVariantTree& tree,
+                                                          const QVariant& root,
+                                                          const QAtomicInt* cancelled);
+
+#endif // QVARIANTTREEBUILDTASK_H
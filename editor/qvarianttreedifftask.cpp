@@ -0,0 +1,68 @@
+#include "qvarianttreedifftask.h"
+
+#include <QFile>
+
+#include "qvarianttree.h"
+#include "qvarianttreerecordreader.h"
+#include "qvarianttreejournal.h"
+
+
+QVariantTreeDiffTask::QVariantTreeDiffTask(const QString& filename,
+                                           const QVariant& root,
+                                           QAtomicInt* cancelled,
+                                           QObject *parent) :
+    QObject(parent),
+    _filename(filename),
+    _root(root),
+    _cancelled(cancelled)
+{
+}
+
+void QVariantTreeDiffTask::run()
+{
+    QVariantList result;
+    QFile file(_filename);
+    if (!file.open(QFile::ReadOnly)) {
+        emit finished(result, false, false);
+        return;
+    }
+
+    // the records of QVariantTree::fromFile(), a corrupted one is reported
+    QVariantList records;
+    QVariantTreeRecordReader reader(&file);
+    while (!isCancelled() && reader.readNext())
+        records << reader.record();
+    if (isCancelled()) {
+        emit finished(result, false, true);
+        return;
+    }
+    if (!reader.atEnd()) {
+        emit finished(result, false, false);
+        return;
+    }
+
+    // default containers, the snapshot holds plain collections
+    QVariantTree tree;
+    // the file as open() shows it: a single container is that container,
+    // other records are the items of a list
+    QVariant before = records.count() == 1 ? records.first() : QVariant(records);
+    before = tree.containerRoot(before);
+
+    // with the saved edits of its journal, as finishOpen() replays them
+    QVariantTreeJournal journal;
+    if (QVariantTreeJournal::read(_filename, &journal)) {
+        QVariantTree journaled;
+        journaled.setRootContent(before);
+        journaled.replay(journal);
+        before = journaled.rootContent();
+    }
+
+    QList<QVariantTreeDiff::Difference> differences =
+            QVariantTreeDiff::compare(tree, before, _root, 0, _cancelled);
+    result.reserve(differences.count());
+    foreach (const QVariantTreeDiff::Difference& difference, differences)
+        result.append(QVariant(QVariantList() << (int)difference.type << QVariant(difference.address)));
+
+    bool cancelled = isCancelled();
+    emit finished(cancelled ? QVariantList() : result, !cancelled, cancelled);
+}
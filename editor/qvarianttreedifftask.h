@@ -0,0 +1,52 @@
+#ifndef QVARIANTTREEDIFFTASK_H
+#define QVARIANTTREEDIFFTASK_H
+
+#include <QObject>
+#include <QAtomicInt>
+
+
+/**
+ * @brief Compare a file with a snapshot of a tree content, meant to run in a worker thread.
+ * The file is the first content, the snapshot the second one.
+ */
+class QVariantTreeDiffTask : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Prepare the comparison.
+     * @param filename File to compare with
+     * @param root Snapshot of the root content, loaded
+     * @param cancelled Flag to stop the comparison, set from any thread
+     */
+    explicit QVariantTreeDiffTask(const QString& filename,
+                                  const QVariant& root,
+                                  QAtomicInt* cancelled,
+                                  QObject *parent = 0);
+
+public slots:
+    /**
+     * @brief Read the file and compare it until the end or the cancellation.
+     */
+    void run();
+
+signals:
+    /**
+     * @brief Emitted once the comparison is over.
+     * @param differences List of the differences, each one a QVariantList
+     * with the QVariantTreeDiff::Type then the address
+     * @param success False if the file cannot be read entirely
+     * @param cancelled True if the comparison was cancelled
+     */
+    void finished(const QVariantList& differences, bool success, bool cancelled);
+
+private:
+    bool isCancelled() const { return _cancelled->loadAcquire() != 0; }
+
+private:
+    QString _filename;
+    QVariant _root;
+    QAtomicInt* _cancelled;
+};
+
+#endif // QVARIANTTREEDIFFTASK_H
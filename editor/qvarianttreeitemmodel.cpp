@@ -2,13 +2,52 @@
 
 #include <QSize>
 
+#include "qvarianttreesavetask.h"
+#include "qvarianttreeloadtask.h"
+#include "qvarianttreerecordqueue.h"
+#include "qvarianttreesearchtask.h"
+#include "qvarianttreedifftask.h"
+
 
 QVariantTreeItemModel::QVariantTreeItemModel(QObject *parent) :
     QAbstractTableModel(parent),
     _tree(),
     _content(),
     _isEmpty(true),
-    _typesName()
+    _typesName(),
+    _saveThread(),
+    _openThread(),
+    _openTask(NULL),
+    _openQueue(),
+    _openCancelled(0),
+    _searchThread(),
+    _searchTask(NULL),
+    _searchCancelled(0),
+    _searchFlat(),
+    _searchFlatRevision(0),
+    _compareThread(),
+    _compareTask(NULL),
+    _compareCancelled(0),
+    _keyIndex(),
+    _keyIndexBuild(),
+    _textIndexEnabled(false),
+    _textIndex(),
+    _textIndexBuild(),
+    _hashCache(),
+    _hashBuild(),
+    _hashBuildIsSaved(false),
+    _savedHashes(),
+    _savedHashesAreKnown(false),
+    _savingHashes(),
+    _savingHashesAreKnown(false),
+    _sizeColumnVisible(false),
+    _sizeCache(),
+    _sizeBuild(),
+    _contentRevision(0),
+    _savingRevision(0),
+    _journal(),
+    _journalBase(),
+    _history()
 {
 
     //
@@ -21,6 +60,29 @@ QVariantTreeItemModel::QVariantTreeItemModel(QObject *parent) :
     _typesName[QVariant::List]     = "List";
     _typesName[QVariant::Map]      = "Map";
     _typesName[QVariant::Hash]     = "Hash";
+
+    // edits recorded for the journal
+    connect(this, SIGNAL(valueKeyChanged(QVariant,QVariant)),
+            this, SLOT(journalValueKeyChanged(QVariant,QVariant)));
+    connect(this, SIGNAL(valueContentChanged(QVariant)),
+            this, SLOT(journalValueContentChanged(QVariant)));
+    connect(this, SIGNAL(valueTypeChanged(QVariant,uint,uint)),
+            this, SLOT(journalValueTypeChanged(QVariant)));
+    connect(this, SIGNAL(insertedValue(QVariant)),
+            this, SLOT(journalInsertedValue(QVariant)));
+    connect(this, SIGNAL(deletedValue(QVariant)),
+            this, SLOT(journalDeletedValue(QVariant)));
+    connect(this, SIGNAL(transactionApplied(QVariantTreeChangeSet)),
+            this, SLOT(journalTransactionApplied(QVariantTreeChangeSet)));
+}
+
+QVariantTreeItemModel::~QVariantTreeItemModel()
+{
+    cancelOpen();
+    cancelSearch();
+    cancelCompare();
+    resetIndexes();
+    waitForSave();
 }
 
 //------------------------------------------------------------------------------
@@ -28,32 +90,755 @@ QVariantTreeItemModel::QVariantTreeItemModel(QObject *parent) :
 
 void QVariantTreeItemModel::open(QIODevice* file)
 {
+    resetIndexes();
     _tree.setFromFile(file);
+    resetEdits();
 
     updateModelFromTree();
+    buildIndexes();
 }
 
 void QVariantTreeItemModel::open(QString filename)
 {
+    resetIndexes();
     _tree.setFromFile(filename);
 
     // root must be list/collection to work
-    if (!_content.type() == QVariant::List &&
-            !_tree.nodeIsCollection()) {
-        QVariantList list;
-        if (_tree.isValid())
-            list << _content;
-        _tree.setRootContent(list);
+    if (!_tree.typeIsContainer(_tree.nodeType()))
+        _tree.setRootContent(_tree.containerRoot(_tree.rootContent()));
+    resetEdits();
+
+    updateModelFromTree();
+    buildIndexes();
+}
+
+void QVariantTreeItemModel::openIndexed(QString filename)
+{
+    // no index: it would decode every record
+    resetIndexes();
+    _tree.setFromFileIndexed(filename);
+    // snapshots keep the records not loaded yet in the file
+    resetEdits();
+
+    updateModelFromTree();
+}
+
+void QVariantTreeItemModel::openInBackground(QString filename)
+{
+    cancelOpen();
+    clearTree();
+    setTreeContent(QVariantList());
+    // indexed once all the records are there
+    resetIndexes();
+
+    _openQueue.reset(new QVariantTreeRecordQueue);
+    _openCancelled.storeRelease(0);
+
+    QVariantTreeLoadTask* task = new QVariantTreeLoadTask(filename, _openQueue.data(),
+                                                          &_openCancelled);
+    QThread* thread = new QThread(this);
+    task->moveToThread(thread);
+
+    connect(thread, SIGNAL(started()), task, SLOT(run()));
+    connect(task, SIGNAL(recordsAvailable()), this, SLOT(fetchOpenedRecords()));
+    connect(task, SIGNAL(progress(qint64,qint64)), this, SIGNAL(openProgress(qint64,qint64)));
+    connect(task, SIGNAL(finished(QString,bool,bool)),
+            this, SLOT(openFinished(QString,bool,bool)));
+    // direct: waitForOpen() blocks the thread of the model
+    connect(task, SIGNAL(finished(QString,bool,bool)), thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(thread, SIGNAL(finished()), task, SLOT(deleteLater()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    _openTask = task;
+    _openThread = thread;
+    thread->start();
+}
+
+void QVariantTreeItemModel::cancelOpen()
+{
+    if (!isOpening())
+        return;
+
+    _openCancelled.storeRelease(1);
+    waitForOpen();
+
+    // the signals still queued are dropped, not the batches
+    finishOpen(QString(), false, true);
+}
+
+void QVariantTreeItemModel::waitForOpen()
+{
+    if (!_openThread.isNull())
+        _openThread->wait();
+}
+
+void QVariantTreeItemModel::fetchOpenedRecords()
+{
+    if (sender() != _openTask)
+        return;
+    appendOpenedRecords();
+}
+
+void QVariantTreeItemModel::appendOpenedRecords()
+{
+    if (_openQueue.isNull())
+        return;
+
+    QVariantList records;
+    QVariantList batch;
+    while (_openQueue->pop(batch))
+        records += batch;
+    if (records.isEmpty())
+        return;
+    _contentRevision++;
+
+    if (!_tree.nodeIsRoot()) {
+        _tree.appendRecords(records);
+        return;
+    }
+
+    // the model copy would make the tree detach the whole root for each batch
+    int oldNbRow = rowCount();
+    _content.clear();
+    _tree.appendRecords(records);
+    int newNbRow = valueRowCount(_tree.nodeValue());
+
+    beginInsertRows(QModelIndex(), oldNbRow, newNbRow-1);
+    _content = _tree.nodeValue();
+    endInsertRows();
+}
+
+void QVariantTreeItemModel::openFinished(const QString& filename, bool success, bool cancelled)
+{
+    if (sender() != _openTask)
+        return;
+    finishOpen(filename, success, cancelled);
+}
+
+void QVariantTreeItemModel::finishOpen(const QString& filename, bool success, bool cancelled)
+{
+    appendOpenedRecords();
+    _openTask = NULL;
+    _openQueue.reset();
+    bool editedWhileOpening = !_journal.isEmpty();
+
+    // same as open(): a file of a single container is that container
+    if (!cancelled) {
+        QVariantList records = _tree.rootContent().toList();
+        if (records.count() == 1 && _tree.typeIsContainer(records.first().userType())) {
+            QVariant root = records.first();
+            records.clear();
+            clearTree();
+            setTreeContent(root);
+        }
+    }
+
+    // saved edits, unless edited while loading
+    if (success && !cancelled && !editedWhileOpening) {
+        QVariantTreeJournal journal;
+        if (QVariantTreeJournal::read(filename, &journal)) {
+            _tree.replay(journal);
+            updateModelFromTree();
+        }
+        _journalBase = filename;
+    }
+    _history.reset(_tree);
+    buildIndexes(!editedWhileOpening);
+
+    emit opened(filename, success, cancelled);
+}
+
+void QVariantTreeItemModel::searchInBackground(const QVariantTreeSearch& search)
+{
+    cancelSearch();
+    waitForSearch();
+    _searchCancelled.storeRelease(0);
+
+    // the flat form of an unchanged content is scanned again
+    if (_searchFlat.isNull() || _searchFlatRevision != _contentRevision) {
+        _searchFlat.reset(new QVariantTreeFlat);
+        _searchFlatRevision = _contentRevision;
+    }
+
+    startSearchTask(new QVariantTreeSearchTask(search, _tree.rootContent(),
+                                               _searchFlat, &_searchCancelled));
+}
+
+void QVariantTreeItemModel::searchInBackground(const QVariantTreeQuery& query)
+{
+    cancelSearch();
+    waitForSearch();
+    _searchCancelled.storeRelease(0);
+
+    startSearchTask(new QVariantTreeSearchTask(query, _tree.rootContent(), &_searchCancelled));
+}
+
+void QVariantTreeItemModel::startSearchTask(QVariantTreeSearchTask* task)
+{
+    QThread* thread = new QThread(this);
+    task->moveToThread(thread);
+
+    connect(thread, SIGNAL(started()), task, SLOT(run()));
+    connect(task, SIGNAL(found(QVariantList)), this, SLOT(searchTaskFound(QVariantList)));
+    connect(task, SIGNAL(finished(int,bool)), this, SLOT(searchTaskFinished(int,bool)));
+    // direct: waitForSearch() blocks the thread of the model
+    connect(task, SIGNAL(finished(int,bool)), thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(thread, SIGNAL(finished()), task, SLOT(deleteLater()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    _searchTask = task;
+    _searchThread = thread;
+    thread->start();
+}
+
+void QVariantTreeItemModel::cancelSearch()
+{
+    if (!isSearching())
+        return;
+
+    _searchCancelled.storeRelease(1);
+    waitForSearch();
+
+    // hits still queued are dropped
+    _searchTask = NULL;
+    emit searchFinished(0, true);
+}
+
+void QVariantTreeItemModel::waitForSearch()
+{
+    if (!_searchThread.isNull())
+        _searchThread->wait();
+}
+
+void QVariantTreeItemModel::searchTaskFound(const QVariantList& addresses)
+{
+    if (sender() != _searchTask)
+        return;
+
+    emit searchFound(addresses);
+}
+
+void QVariantTreeItemModel::searchTaskFinished(int count, bool cancelled)
+{
+    if (sender() != _searchTask)
+        return;
+
+    _searchTask = NULL;
+    emit searchFinished(count, cancelled);
+}
+
+void QVariantTreeItemModel::compareInBackground(const QString& filename)
+{
+    cancelCompare();
+    _compareCancelled.storeRelease(0);
+
+    QVariantTreeDiffTask* task = new QVariantTreeDiffTask(filename, _tree.rootContent(),
+                                                          &_compareCancelled);
+    QThread* thread = new QThread(this);
+    task->moveToThread(thread);
+
+    connect(thread, SIGNAL(started()), task, SLOT(run()));
+    connect(task, SIGNAL(finished(QVariantList,bool,bool)),
+            this, SLOT(compareTaskFinished(QVariantList,bool,bool)));
+    // direct: waitForCompare() blocks the thread of the model
+    connect(task, SIGNAL(finished(QVariantList,bool,bool)), thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(thread, SIGNAL(finished()), task, SLOT(deleteLater()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    _compareTask = task;
+    _compareThread = thread;
+    thread->start();
+}
+
+void QVariantTreeItemModel::cancelCompare()
+{
+    if (!isComparing())
+        return;
+
+    _compareCancelled.storeRelease(1);
+    waitForCompare();
+
+    _compareTask = NULL;
+    emit compareFinished(QVariantList(), false, true);
+}
+
+void QVariantTreeItemModel::waitForCompare()
+{
+    if (!_compareThread.isNull())
+        _compareThread->wait();
+}
+
+void QVariantTreeItemModel::compareTaskFinished(const QVariantList& differences,
+                                                bool success, bool cancelled)
+{
+    if (sender() != _compareTask)
+        return;
+
+    _compareTask = NULL;
+    emit compareFinished(differences, success, cancelled);
+}
+
+void QVariantTreeItemModel::resetIndexes()
+{
+    resetKeyIndex();
+    resetTextIndex();
+    resetHashCache();
+    resetSizeCache();
+    _searchFlat.clear();
+
+    // the saved hashes are of the previous content
+    _savedHashes = QVariantTreeDiff::Hash();
+    _savedHashesAreKnown = false;
+}
+
+void QVariantTreeItemModel::buildIndexes(bool isSaved)
+{
+    buildKeyIndex();
+    if (_textIndexEnabled)
+        buildTextIndex();
+    buildHashCache(isSaved);
+    if (_sizeColumnVisible)
+        buildSizeCache();
+}
+
+template<typename T>
+void QVariantTreeItemModel::resetBuild(BackgroundBuild& build, T& structure)
+{
+    if (build.isRunning()) {
+        build.cancelled.storeRelease(1);
+        waitForBuild(build);
+    }
+    build.task = NULL;
+    build.target.reset();
+
+    _tree.removeObserver(&structure);
+    structure.clear();
+    build.isReady = false;
+}
+
+template<typename T>
+void QVariantTreeItemModel::startBuild(BackgroundBuild& build, T& structure,
+                                       const char* finishedSlot)
+{
+    resetBuild(build, structure);
+    build.cancelled.storeRelease(0);
+    build.revision = _contentRevision;
+
+    // implicitly shared snapshot, edits detach from it
+    build.target.reset(new QVariantTreeBuildTarget<T>);
+    QVariantTreeBuildTask* task = new QVariantTreeBuildTask(build.target.data(),
+                                                            _tree.rootContent(),
+                                                            &build.cancelled);
+    QThread* thread = new QThread(this);
+    task->moveToThread(thread);
+
+    connect(thread, SIGNAL(started()), task, SLOT(run()));
+    connect(task, SIGNAL(finished(bool)), this, finishedSlot);
+    // direct: waitForBuild() blocks the thread of the model
+    connect(task, SIGNAL(finished(bool)), thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(thread, SIGNAL(finished()), task, SLOT(deleteLater()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    build.task = task;
+    build.thread = thread;
+    thread->start();
+}
+
+void QVariantTreeItemModel::waitForBuild(BackgroundBuild& build)
+{
+    if (!build.thread.isNull())
+        build.thread->wait();
+}
+
+template<typename T>
+QVariantTreeItemModel::BuildResult QVariantTreeItemModel::finishBuild(BackgroundBuild& build,
+                                                                      bool cancelled,
+                                                                      T& structure)
+{
+    if (sender() != build.task)
+        return BuildDropped;
+    build.task = NULL;
+
+    QScopedPointer<QVariantTreeBuildTask::Target> target(build.target.take());
+    if (cancelled)
+        return BuildDropped;
+
+    // edited while building: the snapshot is outdated, built again once opened
+    if (build.revision != _contentRevision)
+        return isOpening() ? BuildDropped : BuildOutdated;
+
+    structure = static_cast<QVariantTreeBuildTarget<T>*>(target.data())->value;
+    build.isReady = true;
+    _tree.addObserver(&structure);
+    return BuildReady;
+}
+
+void QVariantTreeItemModel::resetKeyIndex()
+{
+    resetBuild(_keyIndexBuild, _keyIndex);
+}
+
+void QVariantTreeItemModel::buildKeyIndex()
+{
+    startBuild(_keyIndexBuild, _keyIndex, SLOT(keyIndexTaskFinished(bool)));
+}
+
+void QVariantTreeItemModel::waitForKeyIndex()
+{
+    waitForBuild(_keyIndexBuild);
+}
+
+void QVariantTreeItemModel::keyIndexTaskFinished(bool cancelled)
+{
+    BuildResult result = finishBuild(_keyIndexBuild, cancelled, _keyIndex);
+    if (result == BuildOutdated)
+        buildKeyIndex();
+    else if (result == BuildReady)
+        emit keyIndexReady();
+}
+
+void QVariantTreeItemModel::setTextIndexEnabled(bool enabled)
+{
+    if (enabled == _textIndexEnabled)
+        return;
+
+    // built at the end of a running open
+    _textIndexEnabled = enabled;
+    if (!enabled)
+        resetTextIndex();
+    else if (!isEmpty() && !isOpening())
+        buildTextIndex();
+}
+
+void QVariantTreeItemModel::resetTextIndex()
+{
+    resetBuild(_textIndexBuild, _textIndex);
+}
+
+void QVariantTreeItemModel::buildTextIndex()
+{
+    startBuild(_textIndexBuild, _textIndex, SLOT(textIndexTaskFinished(bool)));
+}
+
+void QVariantTreeItemModel::waitForTextIndex()
+{
+    waitForBuild(_textIndexBuild);
+}
+
+void QVariantTreeItemModel::textIndexTaskFinished(bool cancelled)
+{
+    BuildResult result = finishBuild(_textIndexBuild, cancelled, _textIndex);
+    if (result == BuildOutdated)
+        buildTextIndex();
+    else if (result == BuildReady)
+        emit textIndexReady();
+}
+
+void QVariantTreeItemModel::resetHashCache()
+{
+    resetBuild(_hashBuild, _hashCache);
+    _hashBuildIsSaved = false;
+}
+
+void QVariantTreeItemModel::buildHashCache(bool isSaved)
+{
+    startBuild(_hashBuild, _hashCache, SLOT(hashTaskFinished(bool)));
+    _hashBuildIsSaved = isSaved;
+}
+
+void QVariantTreeItemModel::waitForHashCache()
+{
+    waitForBuild(_hashBuild);
+}
+
+void QVariantTreeItemModel::hashTaskFinished(bool cancelled)
+{
+    // the snapshot is the saved content, even if edited since
+    if (sender() == _hashBuild.task && !cancelled && _hashBuildIsSaved) {
+        QVariantTreeBuildTarget<QVariantTreeHashCache>* target =
+                static_cast<QVariantTreeBuildTarget<QVariantTreeHashCache>*>(_hashBuild.target.data());
+        _savedHashes = target->value.snapshot();
+        _savedHashesAreKnown = true;
+        _hashBuildIsSaved = false;
+    }
+
+    BuildResult result = finishBuild(_hashBuild, cancelled, _hashCache);
+    if (result == BuildOutdated)
+        buildHashCache(false);
+    else if (result == BuildReady)
+        emit hashCacheReady();
+}
+
+bool QVariantTreeItemModel::isModified(bool* isKnown) const
+{
+    bool trueKnown = _hashBuild.isReady && _savedHashesAreKnown;
+    if (isKnown)
+        *isKnown = trueKnown;
+    return trueKnown && _hashCache.rootHash() != _savedHashes.value;
+}
+
+QList<QVariantList> QVariantTreeItemModel::modifiedAddresses() const
+{
+    if (!_hashBuild.isReady || !_savedHashesAreKnown)
+        return QList<QVariantList>();
+    return _hashCache.dirtyAddresses(_tree, _savedHashes);
+}
+
+void QVariantTreeItemModel::setSizeColumnVisible(bool visible)
+{
+    if (visible == _sizeColumnVisible)
+        return;
+
+    if (visible) {
+        beginInsertColumns(QModelIndex(), columnSize(), columnSize());
+        _sizeColumnVisible = true;
+        endInsertColumns();
+        // built at the end of a running open
+        if (!isEmpty() && !isOpening())
+            buildSizeCache();
+    }
+    else {
+        beginRemoveColumns(QModelIndex(), columnSize(), columnSize());
+        _sizeColumnVisible = false;
+        endRemoveColumns();
+        resetSizeCache();
+    }
+}
+
+void QVariantTreeItemModel::resetSizeCache()
+{
+    resetBuild(_sizeBuild, _sizeCache);
+}
+
+void QVariantTreeItemModel::buildSizeCache()
+{
+    startBuild(_sizeBuild, _sizeCache, SLOT(sizeTaskFinished(bool)));
+}
+
+void QVariantTreeItemModel::waitForSizeCache()
+{
+    waitForBuild(_sizeBuild);
+}
+
+void QVariantTreeItemModel::sizeTaskFinished(bool cancelled)
+{
+    BuildResult result = finishBuild(_sizeBuild, cancelled, _sizeCache);
+    if (result == BuildOutdated) {
+        buildSizeCache();
+        return;
     }
+    if (result != BuildReady)
+        return;
+
+    if (_sizeColumnVisible && rowCount() > 0)
+        emit dataChanged(index(0, columnSize()), index(rowCount()-1, columnSize()),
+                         QVector<int>() << Qt::DisplayRole);
+    emit sizeCacheReady();
+}
+
+void QVariantTreeItemModel::prepareSavedHashes()
+{
+    _savingRevision = _contentRevision;
+    _savingHashesAreKnown = _hashBuild.isReady;
+    _savingHashes = _hashBuild.isReady ? _hashCache.snapshot() : QVariantTreeDiff::Hash();
+}
+
+void QVariantTreeItemModel::setSavedHashes()
+{
+    _savedHashes = _savingHashes;
+    _savedHashesAreKnown = _savingHashesAreKnown;
+    _savingHashes = QVariantTreeDiff::Hash();
+
+    // a running build of the saved content gives them once done
+    _hashBuildIsSaved = isHashing() && _hashBuild.revision == _savingRevision;
+}
+
+void QVariantTreeItemModel::saveInBackground(QString filename)
+{
+    waitForSave();
+    prepareSavedHashes();
+
+    // the snapshot holds all the edits recorded so far
+    _journal.clear();
+    _journalBase.clear();
+
+    // implicitly shared snapshot, edits detach from it; a replaced file keeps its format
+    QVariantTreeSaveTask* task = new QVariantTreeSaveTask(filename, _tree.rootContent(),
+                                                          QVariantTree::fileFormat(filename));
+    QThread* thread = new QThread(this);
+    task->moveToThread(thread);
+
+    connect(thread, SIGNAL(started()), task, SLOT(run()));
+    connect(task, SIGNAL(progress(int,int)), this, SIGNAL(saveProgress(int,int)));
+    connect(task, SIGNAL(finished(QString,bool)), this, SLOT(saveFinished(QString,bool)));
+    // direct: waitForSave() blocks the thread of the model
+    connect(task, SIGNAL(finished(QString,bool)), thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(thread, SIGNAL(finished()), task, SLOT(deleteLater()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    _saveThread = thread;
+    thread->start();
+}
+
+void QVariantTreeItemModel::waitForSave()
+{
+    if (!_saveThread.isNull())
+        _saveThread->wait();
+}
+
+void QVariantTreeItemModel::saveFinished(const QString& filename, bool success)
+{
+    // the rewritten file includes the journal
+    if (success) {
+        QVariantTreeJournal::remove(filename);
+        _journalBase = filename;
+        setSavedHashes();
+    }
+
+    emit saved(filename, success);
+}
+
+bool QVariantTreeItemModel::saveJournal()
+{
+    if (_journal.isEmpty())
+        return true;
+    prepareSavedHashes();
+    if (!_journal.appendTo(_journalBase))
+        return false;
+
+    _journal.clear();
+    setSavedHashes();
+    return true;
+}
+
+void QVariantTreeItemModel::journalValueKeyChanged(const QVariant& key, const QVariant& oldKey)
+{
+    QVariantList address = _tree.address();
+    _journal.delValue(QVariantList(address) << oldKey);
+    if (_tree.nodeValue().type() == QVariant::List)
+        _journal.insertValue(QVariantList(address) << key, _tree.getItemContainer(key));
+    else
+        _journal.setValue(QVariantList(address) << key, _tree.getItemContainer(key));
+    recordEdit(address);
+}
+
+void QVariantTreeItemModel::journalValueContentChanged(const QVariant& key)
+{
+    _journal.setValue(QVariantList(_tree.address()) << key, _tree.getItemContainer(key));
+    recordEdit(_tree.address());
+}
 
+void QVariantTreeItemModel::journalValueTypeChanged(const QVariant& key)
+{
+    _journal.setValue(QVariantList(_tree.address()) << key, _tree.getItemContainer(key));
+    recordEdit(_tree.address());
+}
+
+void QVariantTreeItemModel::journalInsertedValue(const QVariant& key)
+{
+    QVariantList address = QVariantList(_tree.address()) << key;
+    if (_tree.nodeValue().type() == QVariant::List)
+        _journal.insertValue(address, _tree.getItemContainer(key));
+    else
+        _journal.setValue(address, _tree.getItemContainer(key));
+    recordEdit(_tree.address());
+}
+
+void QVariantTreeItemModel::journalDeletedValue(const QVariant& key)
+{
+    _journal.delValue(QVariantList(_tree.address()) << key);
+    recordEdit(_tree.address());
+}
+
+void QVariantTreeItemModel::journalTransactionApplied(const QVariantTreeChangeSet& changeSet)
+{
+    // only the operations themselves, in the order they were applied
+    QList<QVariantTreeTransaction::Operation> operations = changeSet.appliedOperations();
+    Q_FOREACH(const QVariantTreeTransaction::Operation& operation, operations) {
+        if (operation.type == QVariantTreeTransaction::SetOperation)
+            _journal.setValue(operation.address, operation.value);
+        else if (operation.type == QVariantTreeTransaction::InsertOperation)
+            _journal.insertValue(operation.address, operation.value);
+        else
+            _journal.delValue(operation.address);
+    }
+
+    QList<QVariantList> changed = changeSet.changedAddresses();
+
+    // the history step covers the common node of the changes
+    QVariantList common = changed.value(0);
+    Q_FOREACH(const QVariantList& address, changed) {
+        int depth = 0;
+        while (depth < common.count() && depth < address.count() &&
+               common.at(depth) == address.at(depth))
+            depth++;
+        common = common.mid(0, depth);
+    }
+    recordEdit(common);
+}
+
+void QVariantTreeItemModel::recordEdit(const QVariantList& address)
+{
+    _history.commit(_tree, address);
+    _contentRevision++;
+    rebuildStaleIndexes();
+}
+
+void QVariantTreeItemModel::rebuildStaleIndexes()
+{
+    if (_keyIndexBuild.isReady && _keyIndex.isStale())
+        buildKeyIndex();
+}
+
+void QVariantTreeItemModel::undo()
+{
+    if (!canUndo())
+        return;
+
+    QVariantTree::Snapshot before = _tree.snapshot();
+    journalRestoredNode(_history.undo(_tree), before.root);
+    _contentRevision++;
+    rebuildStaleIndexes();
+    updateModelFromTree();
+    emit historyRestored();
+}
+
+void QVariantTreeItemModel::redo()
+{
+    if (!canRedo())
+        return;
+
+    QVariantTree::Snapshot before = _tree.snapshot();
+    journalRestoredNode(_history.redo(_tree), before.root);
+    _contentRevision++;
+    rebuildStaleIndexes();
     updateModelFromTree();
+    emit historyRestored();
+}
+
+void QVariantTreeItemModel::journalRestoredNode(const QVariantList& address,
+                                                const QVariant& oldRoot)
+{
+    // the differing items only, the root is never journaled as a whole
+    bool isValid = false;
+    QVariant value = _tree.getTreeValue(address, &isValid);
+    _journal.setNodeChanges(address, _tree.getTreeValue(oldRoot, address),
+                            isValid ? value : QVariant());
 }
 
 void QVariantTreeItemModel::setTreeContent(QVariant content)
 {
+    resetIndexes();
     _tree.setRootContent(content);
+    _history.reset(_tree);
 
     updateModelFromTree();
+    buildIndexes();
 }
 
 void QVariantTreeItemModel::moveToChild(const QVariant& key)
@@ -70,6 +855,42 @@ void QVariantTreeItemModel::moveToParent()
     updateModelFromTree();
 }
 
+void QVariantTreeItemModel::moveToRoot()
+{
+    _tree.moveToRoot();
+
+    updateModelFromTree();
+}
+
+int QVariantTreeItemModel::rowOfKey(const QVariant& key) const
+{
+    if (_content.type() == QVariant::List) {
+        bool isIndex = false;
+        int row = key.toInt(&isIndex);
+        return (isIndex && row >= 0 && row < rowCount()) ? row : -1;
+    }
+    else if (_content.type() == QVariant::Map) {
+        return _content.toMap().keys().indexOf(key.toString());
+    }
+    else if (_content.type() == QVariant::Hash) {
+        return _content.toHash().keys().indexOf(key.toString());
+    }
+    return -1;
+}
+
+QVariantTreeChangeSet QVariantTreeItemModel::apply(const QVariantTreeTransaction& transaction)
+{
+    QVariantTreeChangeSet changeSet = _tree.apply(transaction);
+
+    if (changeSet.affects(_tree.address()))
+        updateModelFromTree();
+
+    if (!changeSet.isEmpty())
+        emit transactionApplied(changeSet);
+
+    return changeSet;
+}
+
 void QVariantTreeItemModel::updateModelFromTree()
 {
     int oldNbRow = rowCount();
@@ -102,7 +923,19 @@ void QVariantTreeItemModel::updateModelFromTree()
 void QVariantTreeItemModel::clearTree()
 {
     clear();
+    resetIndexes();
     _tree.clear();
+    _journal.clear();
+    _journalBase.clear();
+    _history.clear();
+}
+
+void QVariantTreeItemModel::resetEdits()
+{
+    // the edits of the previous content are not part of this one
+    _journal.clear();
+    _journalBase.clear();
+    _history.reset(_tree);
 }
 
 void QVariantTreeItemModel::clear()
@@ -150,7 +983,22 @@ QVariant QVariantTreeItemModel::data(const QModelIndex& index, int role) const
     if (!index.isValid())
         return result;
 
-    if (role == Qt::DisplayRole ||
+    if ((role == Qt::DisplayRole ||
+         role == Qt::EditRole) &&
+            rowIsIndexedRecord(index.row())) {
+        QVariantTreeRecordIndex::Record record =
+                _tree.recordIndex().record(index.row());
+
+        if (index.column() == columnType())
+            result = typeToString(record.type);
+        else if (index.column() == columnKey())
+            result = keyToString(index.row());
+        else if (index.column() == columnValue())
+            result = tr("<not loaded, %1 bytes>").arg(record.size);
+        else if (index.column() == columnSize())
+            result = sizeToString(record.size);
+    }
+    else if (role == Qt::DisplayRole ||
             role == Qt::EditRole) {
 
         result = rawData(index);
@@ -168,6 +1016,8 @@ QVariant QVariantTreeItemModel::data(const QModelIndex& index, int role) const
         }
         else if (index.column() == columnValue())
             result = valueToString(result);
+        else if (index.column() == columnSize())
+            result = sizeToString(result);
     }
     else if (role == Qt::TextAlignmentRole)
         result = Qt::AlignCenter;
@@ -199,6 +1049,8 @@ QVariant QVariantTreeItemModel::headerData(int section, Qt::Orientation orientat
                 result = tr("Key / Index");
             else if (section == columnValue())
                 result = tr("Value / Content");
+            else if (section == columnSize())
+                result = tr("Size");
         }
     }
     else
@@ -223,6 +1075,9 @@ QVariant QVariantTreeItemModel::rawData(const QModelIndex& index) const
     if (!index.isValid())
         return result;
 
+    if (index.column() == columnSize())
+        return rowSize(index.row());
+
     // if a simple list
     if (_content.type() == QVariant::List) {
         if (index.column() == columnType())
@@ -301,8 +1156,14 @@ QVariantList QVariantTreeItemModel::rawDatas(int row) const
             result << key;
         else if (columnValue() == i)
             result << value;
-        else if (columnType() == i)
-            result << value.type();
+        else if (columnType() == i) {
+            if (rowIsIndexedRecord(row))
+                result << _tree.recordIndex().record(row).type;
+            else
+                result << value.type();
+        }
+        else if (columnSize() == i)
+            result << rowSize(row);
     }
 
     return result;
@@ -317,8 +1178,10 @@ Qt::ItemFlags QVariantTreeItemModel::flags(const QModelIndex & index) const
             Qt::ItemNeverHasChildren;
     bool canEdit = true;
 
-    // key is editable, type is editable, value might not be
-    if (index.column() == columnValue())
+    // key is editable, type is editable, value might not be, size is not
+    if (index.column() == columnSize())
+        canEdit = false;
+    else if (index.column() == columnValue())
     {
         // if cell is list/collection -> cannot edit
         if (_content.type() == QVariant::List)
@@ -354,6 +1217,47 @@ QString QVariantTreeItemModel::valueToString(const QVariant& value) const
     return stringify(value, 3);
 }
 
+QString QVariantTreeItemModel::sizeToString(const QVariant& size) const
+{
+    if (!size.isValid())
+        return tr("...");
+
+    qint64 bytes = size.toLongLong();
+    QString result;
+    if (bytes < 1024)
+        result = tr("%1 B").arg(bytes);
+    else if (bytes < 1024 * 1024)
+        result = tr("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    else
+        result = tr("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+
+    // share of the current node, the largest items stand out
+    bool isValid = false;
+    qint64 total = _sizeBuild.isReady ? _sizeCache.size(_tree.address(), &isValid) : 0;
+    if (isValid && total > 0)
+        result += tr(" (%1%)").arg(bytes * 100.0 / total, 0, 'f', 1);
+    return result;
+}
+
+QVariant QVariantTreeItemModel::rowSize(int row) const
+{
+    // the record index knows the records not decoded yet
+    if (rowIsIndexedRecord(row))
+        return _tree.recordIndex().record(row).size;
+    if (!_sizeBuild.isReady)
+        return QVariant();
+
+    QVariantList address = _tree.address();
+    QVariant key = rawData(index(row, columnKey()));
+    // an atomic value is the current node itself
+    if (key.isValid())
+        address << key;
+
+    bool isValid = false;
+    qint64 size = _sizeCache.size(address, &isValid);
+    return isValid ? QVariant(size) : QVariant();
+}
+
 QString QVariantTreeItemModel::stringify(const QVariant& value, int depth) const
 {
     depth--;
@@ -2,8 +2,25 @@
 #define QVARIANTTREEITEMMODEL_H
 
 #include <QAbstractTableModel>
+#include <QPointer>
+#include <QThread>
+#include <QAtomicInt>
+#include <QScopedPointer>
+#include <QSharedPointer>
 
 #include "qvarianttree.h"
+#include "qvarianttreehistory.h"
+#include "qvarianttreesearch.h"
+#include "qvarianttreequery.h"
+#include "qvarianttreekeyindex.h"
+#include "qvarianttreetextindex.h"
+#include "qvarianttreehashcache.h"
+#include "qvarianttreesizecache.h"
+#include "qvarianttreebuildtask.h"
+
+class QVariantTreeRecordQueue;
+class QVariantTreeFlat;
+class QVariantTreeSearchTask;
 
 
 class QVariantTreeItemModel : public QAbstractTableModel
@@ -11,6 +28,7 @@ class QVariantTreeItemModel : public QAbstractTableModel
     Q_OBJECT
 public:
     explicit QVariantTreeItemModel(QObject *parent = 0);
+    ~QVariantTreeItemModel();
 
 
     // Tree
@@ -26,6 +44,201 @@ public:
      * @param filename The file to read from
      */
     void open(QString filename);
+    /**
+     * @brief Index the top-level records of the given file and replace the
+     * current tree content. A record is decoded only when it is opened.
+     * @param filename The file to read from
+     */
+    void openIndexed(QString filename);
+    /**
+     * @brief Read the given file from a worker thread. The tree is cleared,
+     * then the top-level records are added as rows while they are decoded.
+     * @param filename The file to read from
+     * @see QVariantTreeItemModel::openProgress()
+     * @see QVariantTreeItemModel::opened()
+     */
+    void openInBackground(QString filename);
+    /**
+     * @brief Stop the background open. The records already read are kept.
+     */
+    void cancelOpen();
+    /**
+     * @brief Check if a background open is running.
+     * @return True if opening
+     */
+    bool isOpening() const { return !_openThread.isNull() && !_openThread->isFinished(); }
+    /**
+     * @brief Block until the background open is over.
+     */
+    void waitForOpen();
+
+    /**
+     * @brief Search the whole tree from worker threads.
+     * The search runs on a snapshot of the content, a running search is
+     * cancelled first.
+     * @param search The criteria
+     * @see QVariantTreeItemModel::searchFound()
+     * @see QVariantTreeItemModel::searchFinished()
+     */
+    void searchInBackground(const QVariantTreeSearch& search);
+    /**
+     * @brief Evaluate a path query from worker threads, as a search.
+     * @param query A valid query
+     */
+    void searchInBackground(const QVariantTreeQuery& query);
+    /**
+     * @brief Stop the background search.
+     */
+    void cancelSearch();
+    /**
+     * @brief Check if a background search is running.
+     * @return True if searching
+     */
+    bool isSearching() const { return !_searchThread.isNull() && !_searchThread->isFinished(); }
+    /**
+     * @brief Block until the background search is over.
+     */
+    void waitForSearch();
+
+    /**
+     * @brief Compare a file with the tree from worker threads.
+     * The file is the first content, a snapshot of the tree the second one.
+     * A running comparison is cancelled first.
+     * @param filename File to compare with
+     * @see QVariantTreeItemModel::compareFinished()
+     */
+    void compareInBackground(const QString& filename);
+    /**
+     * @brief Stop the background comparison.
+     */
+    void cancelCompare();
+    /**
+     * @brief Check if a background comparison is running.
+     * @return True if comparing
+     */
+    bool isComparing() const { return !_compareThread.isNull() && !_compareThread->isFinished(); }
+    /**
+     * @brief Block until the background comparison is over.
+     */
+    void waitForCompare();
+
+    /**
+     * @brief Index of the map keys of the whole tree, built in a worker
+     * thread after each open, then updated with the edits.
+     * @return The index, empty until ready
+     * @see QVariantTreeItemModel::keyIndexReady()
+     */
+    const QVariantTreeKeyIndex& keyIndex() const { return _keyIndex; }
+    /**
+     * @brief Check if the key index covers the current content.
+     * @return True if ready
+     */
+    bool keyIndexIsReady() const { return _keyIndexBuild.isReady; }
+    /**
+     * @brief Check if the key index is being built.
+     * @return True if building
+     */
+    bool isIndexing() const { return _keyIndexBuild.isRunning(); }
+    /**
+     * @brief Block until the key index build is over.
+     */
+    void waitForKeyIndex();
+
+    /**
+     * @brief Build the trigram index of the string values in a worker
+     * thread, now and after each open. Disabling it frees its memory.
+     * @param enabled True to index
+     * @see QVariantTreeItemModel::textIndexReady()
+     */
+    void setTextIndexEnabled(bool enabled);
+    bool textIndexIsEnabled() const { return _textIndexEnabled; }
+    /**
+     * @brief Index of the string values of the whole tree, updated with
+     * the edits once built.
+     * @return The index, empty until ready
+     */
+    const QVariantTreeTextIndex& textIndex() const { return _textIndex; }
+    /**
+     * @brief Check if the text index covers the current content.
+     * @return True if ready
+     */
+    bool textIndexIsReady() const { return _textIndexBuild.isReady; }
+    /**
+     * @brief Check if the text index is being built.
+     * @return True if building
+     */
+    bool isTextIndexing() const { return _textIndexBuild.isRunning(); }
+    /**
+     * @brief Block until the text index build is over.
+     */
+    void waitForTextIndex();
+
+    /**
+     * @brief Hash of every subtree of the tree, built in a worker thread
+     * after each open, then updated with the edits.
+     * @return The cache, empty until ready
+     * @see QVariantTreeItemModel::hashCacheReady()
+     */
+    const QVariantTreeHashCache& hashCache() const { return _hashCache; }
+    /**
+     * @brief Check if the hash cache covers the current content.
+     * @return True if ready
+     */
+    bool hashCacheIsReady() const { return _hashBuild.isReady; }
+    /**
+     * @brief Check if the hash cache is being built.
+     * @return True if building
+     */
+    bool isHashing() const { return _hashBuild.isRunning(); }
+    /**
+     * @brief Block until the hash cache build is over.
+     */
+    void waitForHashCache();
+    /**
+     * @brief Compare the content with the one last opened or saved.
+     * An edit then its reverse leave the content unmodified.
+     * @param isKnown Set to false while the hashes are not ready, or if
+     * the saved content was not hashed
+     * @return True if the content differs
+     */
+    bool isModified(bool* isKnown = NULL) const;
+    /**
+     * @brief Topmost addresses of the subtrees that differ from the
+     * content last opened or saved.
+     * @return The addresses, empty if unknown
+     * @see QVariantTreeHashCache::dirtyAddresses()
+     */
+    QList<QVariantList> modifiedAddresses() const;
+
+    /**
+     * @brief Show the serialized size of each row in a column, measured
+     * in a worker thread now and after each open. Hiding it frees the sizes.
+     * @param visible True to show
+     * @see QVariantTreeItemModel::columnSize()
+     * @see QVariantTreeItemModel::sizeCacheReady()
+     */
+    void setSizeColumnVisible(bool visible);
+    bool sizeColumnIsVisible() const { return _sizeColumnVisible; }
+    /**
+     * @brief Serialized size of every subtree, updated with the edits
+     * once built.
+     * @return The cache, empty until ready
+     */
+    const QVariantTreeSizeCache& sizeCache() const { return _sizeCache; }
+    /**
+     * @brief Check if the size cache covers the current content.
+     * @return True if ready
+     */
+    bool sizeCacheIsReady() const { return _sizeBuild.isReady; }
+    /**
+     * @brief Check if the size cache is being built.
+     * @return True if building
+     */
+    bool isMeasuring() const { return _sizeBuild.isRunning(); }
+    /**
+     * @brief Block until the size cache build is over.
+     */
+    void waitForSizeCache();
 
     /**
      * @brief Save to the file the tree content.
@@ -37,6 +250,40 @@ public:
      * @param file The file to save into
      */
     void save(QString filename) const { _tree.toFile(filename); }
+    /**
+     * @brief Save a snapshot of the tree content from a worker thread.
+     * The tree remains editable during the save.
+     * An existing file is rewritten in its own format, a new one in the plain format.
+     * @param filename The file to save into
+     * @see QVariantTreeItemModel::saveProgress()
+     * @see QVariantTreeItemModel::saved()
+     */
+    void saveInBackground(QString filename);
+    /**
+     * @brief Check if a background save is running.
+     * @return True if saving
+     */
+    bool isSaving() const { return !_saveThread.isNull() && !_saveThread->isFinished(); }
+    /**
+     * @brief Block until the background save is over.
+     */
+    void waitForSave();
+
+    /**
+     * @brief Check if the edits can be appended to the journal of the file,
+     * instead of rewriting it.
+     * @param filename The file to save into
+     * @return True if the file is the base of the recorded edits
+     */
+    bool canSaveJournal(QString filename) const
+    { return !isSaving() && !_journalBase.isEmpty() && _journalBase == filename; }
+    /**
+     * @brief Append the edits done since the last save to the journal
+     * of the opened file.
+     * @return False if the journal cannot be written
+     * @see QVariantTreeJournal
+     */
+    bool saveJournal();
 
     /**
      * @brief Return the tree used by the model.
@@ -62,6 +309,42 @@ public:
      * @see QVariantTreeItemModel::moveToChild()
      */
     void moveToParent();
+    /**
+     * @brief Move up to the root.
+     */
+    void moveToRoot();
+    /**
+     * @brief Row of the given key in the current node.
+     * @param key The key to look for
+     * @return The row, -1 if the key is missing
+     */
+    int rowOfKey(const QVariant& key) const;
+
+    /**
+     * @brief Restore the tree before the last edit.
+     * @see QVariantTreeItemModel::historyRestored()
+     */
+    void undo();
+    /**
+     * @brief Restore the tree after the last undone edit.
+     * @see QVariantTreeItemModel::historyRestored()
+     */
+    void redo();
+    bool canUndo() const { return _history.canUndo(); }
+    bool canRedo() const { return _history.canRedo(); }
+    /**
+     * @brief Change the memory kept by the undo history.
+     * @param budget Bytes held only by the history
+     */
+    void setHistoryBudget(qint64 budget) { _history.setBudget(budget); }
+
+    /**
+     * @brief Apply all the operations of the transaction on the tree.
+     * The model is updated once, only if the current node is affected.
+     * @param transaction The operations to apply
+     * @return The changes done in the tree
+     */
+    QVariantTreeChangeSet apply(const QVariantTreeTransaction& transaction);
 
     /**
      * @brief Clear the tree and the model.
@@ -92,12 +375,18 @@ public:
      * @return Type's index
      */
     int columnType() const { return 2; }
+    /**
+     * @brief The column index / list index for the serialized size, if visible.
+     * @return Size's index
+     * @see QVariantTreeItemModel::setSizeColumnVisible()
+     */
+    int columnSize() const { return 3; }
 
 
     // Model
     int rowCount(const QModelIndex& index = QModelIndex()) const;
     int columnCount(const QModelIndex& index = QModelIndex()) const
-    { Q_UNUSED(index) return 3; }
+    { Q_UNUSED(index) return _sizeColumnVisible ? 4 : 3; }
     QVariant data(const QModelIndex& index, int role) const;
     Qt::ItemFlags flags(const QModelIndex & index) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
@@ -151,6 +440,12 @@ public:
      * @return Value's string representation
      */
     QString valueToString(const QVariant& value) const;
+    /**
+     * @brief Format to display the given serialized size.
+     * @param size The size in bytes, invalid if not measured yet
+     * @return Size's string representation, with its share of the current node
+     */
+    QString sizeToString(const QVariant& size) const;
     /**
      * @brief JSON like stringify method.
      * @param value The value to stringify
@@ -189,12 +484,145 @@ signals:
     void valueKeyChanged(const QVariant& key,
                          const QVariant& oldKey);
     void valueContentChanged(const QVariant &key);
-    void valueTypeChanged(const uint& type,
+    void valueTypeChanged(const QVariant& key,
+                          const uint& type,
                           const uint& oldType);
 
     void insertedValue(const QVariant& key);
     void deletedValue(const QVariant& key);
 
+    void transactionApplied(const QVariantTreeChangeSet& changeSet);
+    /**
+     * @brief Emitted after an undo / redo, the tree address may have changed.
+     */
+    void historyRestored();
+
+    void saveProgress(int done, int total);
+    void saved(const QString& filename, bool success);
+
+    void openProgress(qint64 bytesRead, qint64 bytesTotal);
+    void opened(const QString& filename, bool success, bool cancelled);
+
+    /**
+     * @brief Emitted for each batch of hits of the background search.
+     * @param addresses List of the addresses, each one a QVariantList
+     */
+    void searchFound(const QVariantList& addresses);
+    void searchFinished(int count, bool cancelled);
+
+    /**
+     * @brief Emitted once the background comparison is over.
+     * @param differences List of the differences, each one a QVariantList
+     * with the QVariantTreeDiff::Type then the address
+     * @param success False if the file cannot be read entirely
+     */
+    void compareFinished(const QVariantList& differences, bool success, bool cancelled);
+
+    /**
+     * @brief Emitted once the key index covers the current content.
+     */
+    void keyIndexReady();
+    /**
+     * @brief Emitted once the text index covers the current content.
+     */
+    void textIndexReady();
+    /**
+     * @brief Emitted once the hash cache covers the current content.
+     */
+    void hashCacheReady();
+    /**
+     * @brief Emitted once the size cache covers the current content.
+     */
+    void sizeCacheReady();
+
+private slots:
+    void fetchOpenedRecords();
+    void openFinished(const QString& filename, bool success, bool cancelled);
+    void saveFinished(const QString& filename, bool success);
+    void searchTaskFound(const QVariantList& addresses);
+    void searchTaskFinished(int count, bool cancelled);
+    void compareTaskFinished(const QVariantList& differences, bool success, bool cancelled);
+    void keyIndexTaskFinished(bool cancelled);
+    void textIndexTaskFinished(bool cancelled);
+    void hashTaskFinished(bool cancelled);
+    void sizeTaskFinished(bool cancelled);
+
+    // record the edits of the current node into the journal
+    void journalValueKeyChanged(const QVariant& key, const QVariant& oldKey);
+    void journalValueContentChanged(const QVariant& key);
+    void journalValueTypeChanged(const QVariant& key);
+    void journalInsertedValue(const QVariant& key);
+    void journalDeletedValue(const QVariant& key);
+    void journalTransactionApplied(const QVariantTreeChangeSet& changeSet);
+
+private:
+    // the batches read by the open task, as rows
+    void appendOpenedRecords();
+    // run a search task in its own thread
+    void startSearchTask(QVariantTreeSearchTask* task);
+    void finishOpen(const QString& filename, bool success, bool cancelled);
+    // forget the journal and the history of the replaced content
+    void resetEdits();
+    void recordEdit(const QVariantList& address);
+
+    // the indexes stop following the tree, before a new content
+    void resetIndexes();
+    // index the current content in worker threads
+    // isSaved: the content is the one of the file, its hashes are the saved ones
+    void buildIndexes(bool isSaved = true);
+    void resetKeyIndex();
+    void buildKeyIndex();
+    // after an edit, the key index is stale past a long list shift
+    void rebuildStaleIndexes();
+    void resetTextIndex();
+    void buildTextIndex();
+    void resetHashCache();
+    void buildHashCache(bool isSaved);
+    // the saved hashes, before a save and once it succeeded
+    void prepareSavedHashes();
+    void setSavedHashes();
+    void resetSizeCache();
+    void buildSizeCache();
+    void journalRestoredNode(const QVariantList& address, const QVariant& oldRoot);
+
+private:
+    /**
+     * @brief An index or a cache built from a snapshot in a worker thread,
+     * then kept up to date with the edits as an observer of the tree.
+     */
+    struct BackgroundBuild
+    {
+        BackgroundBuild() : thread(), task(NULL), target(), cancelled(0),
+            revision(0), isReady(false) {}
+        bool isRunning() const { return !thread.isNull() && !thread->isFinished(); }
+
+        QPointer<QThread> thread;
+        /** @brief The running task, signals of older tasks are ignored. */
+        QObject* task;
+        /** @brief Filled by the running task. */
+        QScopedPointer<QVariantTreeBuildTask::Target> target;
+        QAtomicInt cancelled;
+        /** @brief Content revision of the snapshot. */
+        int revision;
+        bool isReady;
+    };
+    enum BuildResult {
+        BuildDropped,
+        BuildOutdated,
+        BuildReady
+    };
+
+    // cancel a build and clear its structure, which stops following the tree
+    template<typename T>
+    void resetBuild(BackgroundBuild& build, T& structure);
+    // build a snapshot of the content into the structure in a worker thread
+    template<typename T>
+    void startBuild(BackgroundBuild& build, T& structure, const char* finishedSlot);
+    void waitForBuild(BackgroundBuild& build);
+    // the structure follows the tree once ready, an outdated one is built again
+    template<typename T>
+    BuildResult finishBuild(BackgroundBuild& build, bool cancelled, T& structure);
+
 private:
     /**
      * @brief Determine value size.
@@ -204,6 +632,21 @@ private:
      */
     int valueRowCount(const QVariant& value) const;
 
+    /**
+     * @brief Check if the row is a top-level record not decoded yet.
+     * @param row The row to check
+     * @return True if the row content is only known by the record index.
+     */
+    bool rowIsIndexedRecord(int row) const
+    { return _tree.nodeIsRoot() && !_tree.recordIsLoaded(row); }
+
+    /**
+     * @brief Serialized size of a row.
+     * @param row The row to measure
+     * @return The size in bytes, invalid until the sizes are ready
+     */
+    QVariant rowSize(int row) const;
+
 private:
     QVariantTree _tree;
 
@@ -212,6 +655,59 @@ private:
 
     QHash<uint, QString> _typesName;
 
+    QPointer<QThread> _saveThread;
+
+    QPointer<QThread> _openThread;
+    /** @brief The running load task, signals of older tasks are ignored. */
+    QObject* _openTask;
+    QScopedPointer<QVariantTreeRecordQueue> _openQueue;
+    QAtomicInt _openCancelled;
+
+    QPointer<QThread> _searchThread;
+    /** @brief The running search task, signals of older tasks are ignored. */
+    QObject* _searchTask;
+    QAtomicInt _searchCancelled;
+    // flat form of the content searched last, see QVariantTreeSearchTask
+    QSharedPointer<QVariantTreeFlat> _searchFlat;
+    int _searchFlatRevision;
+
+    QPointer<QThread> _compareThread;
+    /** @brief The running compare task, signals of older tasks are ignored. */
+    QObject* _compareTask;
+    QAtomicInt _compareCancelled;
+
+    QVariantTreeKeyIndex _keyIndex;
+    BackgroundBuild _keyIndexBuild;
+    bool _textIndexEnabled;
+    QVariantTreeTextIndex _textIndex;
+    BackgroundBuild _textIndexBuild;
+
+    QVariantTreeHashCache _hashCache;
+    BackgroundBuild _hashBuild;
+    /** @brief The running hash task builds the saved hashes. */
+    bool _hashBuildIsSaved;
+    /** @brief Hashes of the content last opened or saved. */
+    QVariantTreeDiff::Hash _savedHashes;
+    bool _savedHashesAreKnown;
+    /** @brief Hashes of the content being saved. */
+    QVariantTreeDiff::Hash _savingHashes;
+    bool _savingHashesAreKnown;
+
+    bool _sizeColumnVisible;
+    QVariantTreeSizeCache _sizeCache;
+    BackgroundBuild _sizeBuild;
+
+    /** @brief Edits counted while the index tasks run. */
+    int _contentRevision;
+    int _savingRevision;
+
+    /** @brief Edits not saved yet, relative to the base file. */
+    QVariantTreeJournal _journal;
+    /** @brief File the journal applies to, empty if a full save is needed. */
+    QString _journalBase;
+
+    QVariantTreeHistory _history;
+
 };
 
 #endif // QVARIANTTREEITEMMODEL_H
@@ -0,0 +1,78 @@
+#include "qvarianttreeloadtask.h"
+
+#include <QFile>
+#include <QThread>
+#include <QElapsedTimer>
+
+#include "qvarianttreerecordreader.h"
+#include "qvarianttreerecordqueue.h"
+
+
+namespace {
+
+const int BatchMaxRecords = 1024;
+const int BatchMaxDelay = 50; // ms
+
+}
+
+
+QVariantTreeLoadTask::QVariantTreeLoadTask(const QString& filename,
+                                           QVariantTreeRecordQueue* queue,
+                                           QAtomicInt* cancelled,
+                                           QObject *parent) :
+    QObject(parent),
+    _filename(filename),
+    _queue(queue),
+    _cancelled(cancelled)
+{
+}
+
+void QVariantTreeLoadTask::run()
+{
+    QFile file(_filename);
+    if (!file.open(QFile::ReadOnly)) {
+        emit finished(_filename, false, false);
+        return;
+    }
+
+    QVariantTreeRecordReader reader(&file);
+    QVariantList batch;
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+
+    while (!isCancelled() && reader.readNext()) {
+        batch << reader.record();
+
+        // small batches first, so rows appear quickly
+        if (batch.count() >= BatchMaxRecords ||
+                batchTimer.elapsed() >= BatchMaxDelay) {
+            if (!pushBatch(batch))
+                break;
+            emit progress(file.pos(), file.size());
+            batchTimer.restart();
+        }
+    }
+
+    bool cancelled = isCancelled();
+    if (!cancelled)
+        pushBatch(batch);
+    emit progress(file.pos(), file.size());
+    emit finished(_filename, !cancelled && reader.atEnd(), cancelled);
+}
+
+bool QVariantTreeLoadTask::pushBatch(QVariantList& batch)
+{
+    if (batch.isEmpty())
+        return true;
+
+    // the consumer is late: wait for a free slot
+    while (!_queue->push(batch)) {
+        if (isCancelled())
+            return false;
+        QThread::msleep(5);
+    }
+    batch.clear();
+
+    emit recordsAvailable();
+    return true;
+}
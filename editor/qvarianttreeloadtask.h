@@ -0,0 +1,64 @@
+#ifndef QVARIANTTREELOADTASK_H
+#define QVARIANTTREELOADTASK_H
+
+#include <QObject>
+#include <QAtomicInt>
+
+class QVariantTreeRecordQueue;
+
+
+/**
+ * @brief Decode the records of a file, meant to run in a worker thread.
+ * Records are handed by batches through a queue, while the file is read.
+ */
+class QVariantTreeLoadTask : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Prepare the loading.
+     * @param filename The file to read from
+     * @param queue The queue to fill with the decoded records
+     * @param cancelled Flag to stop the loading, set from any thread
+     */
+    explicit QVariantTreeLoadTask(const QString& filename,
+                                  QVariantTreeRecordQueue* queue,
+                                  QAtomicInt* cancelled,
+                                  QObject *parent = 0);
+
+public slots:
+    /**
+     * @brief Read the file until its end or the cancellation.
+     */
+    void run();
+
+signals:
+    /**
+     * @brief Emitted when a new batch is in the queue.
+     */
+    void recordsAvailable();
+    /**
+     * @brief Emitted while reading the file.
+     * @param bytesRead Number of bytes consumed
+     * @param bytesTotal Size of the file
+     */
+    void progress(qint64 bytesRead, qint64 bytesTotal);
+    /**
+     * @brief Emitted once the loading is over. The queue holds the last batch.
+     * @param filename The file read from
+     * @param success True if the file is entirely decoded
+     * @param cancelled True if the loading was cancelled
+     */
+    void finished(const QString& filename, bool success, bool cancelled);
+
+private:
+    bool isCancelled() const { return _cancelled->loadAcquire() != 0; }
+    bool pushBatch(QVariantList& batch);
+
+private:
+    QString _filename;
+    QVariantTreeRecordQueue* _queue;
+    QAtomicInt* _cancelled;
+};
+
+#endif // QVARIANTTREELOADTASK_H
@@ -0,0 +1,34 @@
+#include "qvarianttreerecordqueue.h"
+
+
+QVariantTreeRecordQueue::QVariantTreeRecordQueue(int capacity) :
+    _size(capacity + 1), // one slot stays empty to tell full from empty
+    _slots(new QVariantList[capacity + 1]),
+    _head(0),
+    _tail(0)
+{
+}
+
+bool QVariantTreeRecordQueue::push(const QVariantList& batch)
+{
+    int tail = _tail.load();
+    int next = (tail + 1) % _size;
+    if (next == _head.loadAcquire())
+        return false;
+
+    _slots[tail] = batch;
+    _tail.storeRelease(next);
+    return true;
+}
+
+bool QVariantTreeRecordQueue::pop(QVariantList& batch)
+{
+    int head = _head.load();
+    if (head == _tail.loadAcquire())
+        return false;
+
+    batch = _slots[head];
+    _slots[head] = QVariantList();
+    _head.storeRelease((head + 1) % _size);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef QVARIANTTREERECORDQUEUE_H
+#define QVARIANTTREERECORDQUEUE_H
+
+#include <QAtomicInt>
+#include <QScopedArrayPointer>
+#include <QVariant>
+
+
+/**
+ * @brief Lock-free queue of record batches, between one producer thread
+ * and one consumer thread.
+ */
+class QVariantTreeRecordQueue
+{
+public:
+    /**
+     * @brief Create an empty queue.
+     * @param capacity Maximal number of batches waiting in the queue
+     */
+    explicit QVariantTreeRecordQueue(int capacity = 64);
+
+    /**
+     * @brief Add a batch at the end. Producer thread only.
+     * @param batch The records to add
+     * @return False if the queue is full
+     */
+    bool push(const QVariantList& batch);
+    /**
+     * @brief Take the first batch. Consumer thread only.
+     * @param batch The records taken
+     * @return False if the queue is empty
+     */
+    bool pop(QVariantList& batch);
+
+private:
+    Q_DISABLE_COPY(QVariantTreeRecordQueue)
+
+    int _size;
+    QScopedArrayPointer<QVariantList> _slots;
+    /** @brief Next slot to read, only written by the consumer. */
+    QAtomicInt _head;
+    /** @brief Next slot to write, only written by the producer. */
+    QAtomicInt _tail;
+};
+
+#endif // QVARIANTTREERECORDQUEUE_H
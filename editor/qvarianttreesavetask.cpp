@@ -0,0 +1,84 @@
+#include "qvarianttreesavetask.h"
+
+#include <QSaveFile>
+#include <QDataStream>
+
+#include "qvarianttreecontainer.h"
+#include "qvarianttreecompressed.h"
+
+
+namespace {
+
+// same record layout as QVariantTree::toFile()
+class PlainWriter
+{
+public:
+    explicit PlainWriter(QIODevice* file) : _stream(file) {}
+    void write(const QVariant& record) { _stream << record; }
+    bool finish() { return _stream.status() == QDataStream::Ok; }
+
+private:
+    QDataStream _stream;
+};
+
+}
+
+
+QVariantTreeSaveTask::QVariantTreeSaveTask(const QString& filename,
+                                           const QVariant& content,
+                                           QVariantTree::FileFormat format,
+                                           QObject *parent) :
+    QObject(parent),
+    _filename(filename),
+    _content(content),
+    _format(format)
+{
+}
+
+template<typename Writer>
+bool QVariantTreeSaveTask::writeContent(Writer& writer)
+{
+    if (_content.type() == QVariant::List) {
+        const QVariantList list = _content.toList();
+        int lastPercent = -1;
+        for (int i=0; i<list.count(); i++) {
+            writer.write(list.at(i));
+
+            // no more than one signal per percent
+            int percent = (i+1) * 100 / list.count();
+            if (percent != lastPercent) {
+                lastPercent = percent;
+                emit progress(i+1, list.count());
+            }
+        }
+    }
+    else if (_content.isValid())
+        writer.write(_content);
+
+    return writer.finish();
+}
+
+void QVariantTreeSaveTask::run()
+{
+    QSaveFile file(_filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit finished(_filename, false);
+        return;
+    }
+
+    bool written = false;
+    if (_format == QVariantTree::ContainerFormat) {
+        QVariantTreeContainerWriter writer(&file);
+        written = writeContent(writer);
+    }
+    else if (_format == QVariantTree::CompressedFormat) {
+        QVariantTreeCompressedWriter writer(&file);
+        written = writeContent(writer);
+    }
+    else {
+        PlainWriter writer(&file);
+        written = writeContent(writer);
+    }
+
+    emit finished(_filename, written && file.commit());
+}
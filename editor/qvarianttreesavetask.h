@@ -0,0 +1,58 @@
+#ifndef QVARIANTTREESAVETASK_H
+#define QVARIANTTREESAVETASK_H
+
+#include <QObject>
+#include <QVariant>
+
+#include "qvarianttree.h"
+
+
+/**
+ * @brief Save a snapshot of a tree content, meant to run in a worker thread.
+ * The snapshot is implicitly shared with the tree, which stays editable.
+ */
+class QVariantTreeSaveTask : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Prepare the save.
+     * @param filename The file to save into
+     * @param content The snapshot to save
+     * @param format The format to write, the one of the file to replace
+     */
+    explicit QVariantTreeSaveTask(const QString& filename,
+                                  const QVariant& content,
+                                  QVariantTree::FileFormat format = QVariantTree::PlainFormat,
+                                  QObject *parent = 0);
+
+public slots:
+    /**
+     * @brief Write the snapshot. The file is replaced only once fully written.
+     */
+    void run();
+
+signals:
+    /**
+     * @brief Emitted while writing the records of the root list.
+     * @param done Number of records written
+     * @param total Number of records to write
+     */
+    void progress(int done, int total);
+    /**
+     * @brief Emitted once the save is over.
+     * @param filename The file saved into
+     * @param success True if the file is written
+     */
+    void finished(const QString& filename, bool success);
+
+private:
+    template<typename Writer>
+    bool writeContent(Writer& writer);
+
+    QString _filename;
+    QVariant _content;
+    QVariantTree::FileFormat _format;
+};
+
+#endif // QVARIANTTREESAVETASK_H
@@ -0,0 +1,90 @@
+#include "qvarianttreesearchtask.h"
+
+#include "qvarianttree.h"
+
+
+namespace {
+
+/**
+ * @brief Forward the hits of the search threads as signals of the task.
+ */
+class SearchReceiver : public QVariantTreeSearch::Receiver
+{
+public:
+    explicit SearchReceiver(QVariantTreeSearchTask* task) : _task(task) {}
+
+    void found(const QList<QVariantList>& addresses)
+    {
+        QVariantList batch;
+        batch.reserve(addresses.count());
+        foreach (const QVariantList& address, addresses)
+            batch.append(QVariant(address));
+        emit _task->found(batch);
+    }
+
+private:
+    QVariantTreeSearchTask* _task;
+};
+
+}
+
+
+QVariantTreeSearchTask::QVariantTreeSearchTask(const QVariantTreeSearch& search,
+                                               const QVariant& root,
+                                               QSharedPointer<QVariantTreeFlat> flat,
+                                               QAtomicInt* cancelled,
+                                               QObject *parent) :
+    QObject(parent),
+    _search(search),
+    _query(),
+    _isQuery(false),
+    _root(root),
+    _flat(flat),
+    _cancelled(cancelled)
+{
+}
+
+QVariantTreeSearchTask::QVariantTreeSearchTask(const QVariantTreeQuery& query,
+                                               const QVariant& root,
+                                               QAtomicInt* cancelled,
+                                               QObject *parent) :
+    QObject(parent),
+    _search(),
+    _query(query),
+    _isQuery(true),
+    _root(root),
+    _flat(),
+    _cancelled(cancelled)
+{
+}
+
+void QVariantTreeSearchTask::run()
+{
+    if (_isQuery) {
+        QVariantTree tree;
+        QList<QVariantTreeQuery::Match> matches = _query.evaluate(tree, _root, 0, _cancelled);
+        bool cancelled = _cancelled->loadAcquire() != 0;
+        if (!cancelled && !matches.isEmpty()) {
+            QVariantList addresses;
+            addresses.reserve(matches.count());
+            foreach (const QVariantTreeQuery::Match& match, matches)
+                addresses.append(QVariant(match.address));
+            emit found(addresses);
+        }
+        emit finished(cancelled ? 0 : matches.count(), cancelled);
+        return;
+    }
+
+    // default containers, the snapshot holds plain collections
+    // a cancelled flat form stays empty, built again by the next search
+    if (_flat->isEmpty() && _cancelled->loadAcquire() == 0) {
+        QVariantTree tree;
+        *_flat = QVariantTreeFlat::fromVariant(tree, _root, _cancelled);
+    }
+
+    SearchReceiver receiver(this);
+    QList<QVariantList> hits = _search.find(*_flat, 0, _cancelled, &receiver);
+
+    bool cancelled = _cancelled->loadAcquire() != 0;
+    emit finished(hits.count(), cancelled);
+}
@@ -0,0 +1,75 @@
+#ifndef QVARIANTTREESEARCHTASK_H
+#define QVARIANTTREESEARCHTASK_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QSharedPointer>
+
+#include "qvarianttreesearch.h"
+#include "qvarianttreeflat.h"
+#include "qvarianttreequery.h"
+
+
+/**
+ * @brief Search a snapshot of a tree content, meant to run in a worker thread.
+ * The hits are emitted by batches while the search goes on.
+ * The snapshot is searched in its flat form, kept for the next searches.
+ * A path query is evaluated on the snapshot itself, its hits are emitted
+ * at once.
+ */
+class QVariantTreeSearchTask : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Prepare the search.
+     * @param search The criteria
+     * @param root Snapshot of the root content, loaded
+     * @param flat Flat form of the snapshot, built from the root if empty
+     * @param cancelled Flag to stop the search, set from any thread
+     */
+    explicit QVariantTreeSearchTask(const QVariantTreeSearch& search,
+                                    const QVariant& root,
+                                    QSharedPointer<QVariantTreeFlat> flat,
+                                    QAtomicInt* cancelled,
+                                    QObject *parent = 0);
+    /**
+     * @brief Prepare the evaluation of a path query.
+     * @param query A valid query
+     * @param root Snapshot of the root content, loaded
+     * @param cancelled Flag to stop the evaluation, set from any thread
+     */
+    explicit QVariantTreeSearchTask(const QVariantTreeQuery& query,
+                                    const QVariant& root,
+                                    QAtomicInt* cancelled,
+                                    QObject *parent = 0);
+
+public slots:
+    /**
+     * @brief Search the whole root until its end or the cancellation.
+     */
+    void run();
+
+signals:
+    /**
+     * @brief Emitted from the search threads for each batch of hits.
+     * @param addresses List of the addresses, each one a QVariantList
+     */
+    void found(const QVariantList& addresses);
+    /**
+     * @brief Emitted once the search is over.
+     * @param count Number of hits
+     * @param cancelled True if the search was cancelled
+     */
+    void finished(int count, bool cancelled);
+
+private:
+    QVariantTreeSearch _search;
+    QVariantTreeQuery _query;
+    bool _isQuery;
+    QVariant _root;
+    QSharedPointer<QVariantTreeFlat> _flat;
+    QAtomicInt* _cancelled;
+};
+
+#endif // QVARIANTTREESEARCHTASK_H
@@ -2,6 +2,7 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     qvarianttree \
-    tests
+    tests \
+    benchmarks
 
 CONFIG += ordered
@@ -2,11 +2,279 @@
 
 #include <QIODevice>
 #include <QFile>
+#include <QSaveFile>
+#include <QBuffer>
 #include <QDataStream>
+#include <QHash>
+#include <QPair>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include "qvarianttreerecordreader.h"
+#include "qvarianttreecontainer.h"
+#include "qvarianttreecompressed.h"
+
+#include <algorithm>
+#include <climits>
+
+
+/**
+ * @brief Operations of a transaction grouped by address prefix.
+ */
+class QVariantTreeBatchNode
+{
+public:
+    explicit QVariantTreeBatchNode(const QVariant& nodeKey = QVariant()) :
+        key(nodeKey), operations(), children(), childByKey() {}
+    ~QVariantTreeBatchNode() { qDeleteAll(children); }
+
+    QVariantTreeBatchNode* child(const QVariant& childKey)
+    {
+        // the type is part of the key: 1 and "1" are not merged
+        ChildKey lookupKey(childKey.userType(), childKey.toString());
+        QVariantTreeBatchNode* node = childByKey.value(lookupKey, 0);
+        if (node == NULL) {
+            node = new QVariantTreeBatchNode(childKey);
+            children.append(node);
+            childByKey.insert(lookupKey, node);
+        }
+        return node;
+    }
+
+    void collectAddresses(const QVariantList& address, QList<QVariantList>& addresses) const
+    {
+        for (int i=0; i<operations.count(); i++)
+            addresses.append(address);
+        for (int i=0; i<children.count(); i++)
+            children.at(i)->collectAddresses(QVariantList(address) << children.at(i)->key,
+                                             addresses);
+    }
+
+    QVariant key;
+    QList<int> operations; // indexes of the operations on this exact address
+    QList<QVariantTreeBatchNode*> children;
+    typedef QPair<int, QString> ChildKey;
+    QHash<ChildKey, QVariantTreeBatchNode*> childByKey;
+
+private:
+    Q_DISABLE_COPY(QVariantTreeBatchNode)
+};
+
+namespace {
+
+struct StructuralOperation {
+    QVariant key;
+    int index;
+    bool isRemoval;
+};
+
+// processing order: last key first, so that the recorded list indexes stay valid
+// on the same list index: removal first, then insertions in reverse recorded order
+// on the same key of a map or a hash: recorded order, the last operation wins
+class StructuralOperationBefore
+{
+public:
+    explicit StructuralOperationBefore(bool isList) : _isList(isList) {}
+
+    bool operator()(const StructuralOperation& opA, const StructuralOperation& opB) const
+    {
+        if (keyLessThan(opB.key, opA.key))
+            return true;
+        if (keyLessThan(opA.key, opB.key))
+            return false;
+        if (!_isList)
+            return opA.index < opB.index;
+        if (opA.isRemoval != opB.isRemoval)
+            return opA.isRemoval;
+        return opA.index > opB.index;
+    }
+
+private:
+    // one order per container, a mixed order would not be a strict weak ordering
+    bool keyLessThan(const QVariant& keyA, const QVariant& keyB) const
+    {
+        if (_isList)
+            return keyA.toLongLong() < keyB.toLongLong();
+        return keyA.toString() < keyB.toString();
+    }
+
+    bool _isList;
+};
+
+/**
+ * @brief Decode a range of records from a memory buffer, with its own stream.
+ */
+class RecordRangeDecoder : public QRunnable
+{
+public:
+    // data holds the bytes from the offset base of the index
+    RecordRangeDecoder(const char* data, qint64 base,
+                       const QVariantTreeRecordIndex& index,
+                       int first, int count,
+                       QVariantList* output) :
+        _data(data), _base(base), _index(index), _first(first), _count(count), _output(output) {}
+
+    void run()
+    {
+        const QVariantTreeRecordIndex::Record& firstRecord = _index.record(_first);
+        const QVariantTreeRecordIndex::Record& lastRecord = _index.record(_first + _count - 1);
+        QByteArray slice = QByteArray::fromRawData(
+                    _data + (firstRecord.offset - _base),
+                    (int)(lastRecord.offset + lastRecord.size - firstRecord.offset));
+        QBuffer buffer(&slice);
+        buffer.open(QIODevice::ReadOnly);
+
+        QDataStream stream(&buffer);
+        _output->reserve(_count);
+        for (int i=0; i<_count; i++) {
+            QVariant record;
+            stream >> record;
+            _output->append(record);
+        }
+    }
+
+private:
+    const char* _data;
+    qint64 _base;
+    const QVariantTreeRecordIndex& _index;
+    int _first;
+    int _count;
+    QVariantList* _output;
+};
+
+/**
+ * @brief Serialize a range of records into a memory chunk, with its own stream.
+ */
+class RecordRangeEncoder : public QRunnable
+{
+public:
+    RecordRangeEncoder(const QVariantList& records,
+                       int first, int count,
+                       QByteArray* output) :
+        _records(records), _first(first), _count(count), _output(output) {}
+
+    void run()
+    {
+        QBuffer buffer(_output);
+        buffer.open(QIODevice::WriteOnly);
+
+        QDataStream stream(&buffer);
+        for (int i=_first; i<_first+_count; i++)
+            stream << _records.at(i);
+    }
+
+private:
+    const QVariantList& _records;
+    int _first;
+    int _count;
+    QByteArray* _output;
+};
+
+const int ParallelChunkRecords = 256;
+// a mapping is wrapped in a QByteArray, so a window cannot be larger
+const qint64 MappedWindowSize = INT_MAX;
+
+// decode records [first, first + count) of data, contiguous ranges, a few per
+// worker to balance uneven records
+void decodeRecords(const char* data, qint64 base, const QVariantTreeRecordIndex& index,
+                   int first, int count, int workerCount, QVariantList& list)
+{
+    int rangeCount = qMin(count, workerCount * 4);
+    QVector<QVariantList> ranges(rangeCount);
+    {
+        QThreadPool pool;
+        pool.setMaxThreadCount(workerCount);
+        int rangeFirst = first;
+        for (int i=0; i<rangeCount; i++) {
+            int rangeSize = (first + count - rangeFirst) / (rangeCount - i);
+            pool.start(new RecordRangeDecoder(data, base, index,
+                                              rangeFirst, rangeSize, &ranges[i]));
+            rangeFirst += rangeSize;
+        }
+        pool.waitForDone();
+    }
+
+    for (int i=0; i<rangeCount; i++)
+        list.append(ranges.at(i));
+}
+
+// a file too large for a single mapping: windows of whole records, mapped one
+// at a time, a record larger than a window is read on its own
+void decodeWindows(QFileDevice* file, int workerCount, QVariantList& list)
+{
+    QVariantTreeRecordIndex index = QVariantTreeRecordIndex::build(file);
+    list.reserve(index.count());
+
+    int first = 0;
+    while (first < index.count()) {
+        qint64 start = index.record(first).offset;
+        qint64 end = start;
+        int count = 0;
+        while (first + count < index.count()) {
+            QVariantTreeRecordIndex::Record record = index.record(first + count);
+            if (record.offset + record.size - start > MappedWindowSize)
+                break;
+            end = record.offset + record.size;
+            count++;
+        }
+
+        uchar* mapping = count > 0 ? file->map(start, end - start) : NULL;
+        if (mapping) {
+            decodeRecords(reinterpret_cast<const char*>(mapping), start, index,
+                          first, count, workerCount, list);
+            file->unmap(mapping);
+        }
+        else {
+            count = qMax(count, 1);
+            for (int i=first; i<first + count; i++)
+                list.append(index.load(file, i));
+        }
+        first += count;
+    }
+
+    if (!index.isEmpty()) {
+        QVariantTreeRecordIndex::Record last = index.record(index.count() - 1);
+        file->seek(last.offset + last.size);
+    }
+}
+
+bool addressStartsWith(const QVariantList& address, const QVariantList& prefix)
+{
+    if (prefix.count() > address.count())
+        return false;
+    for (int i=0; i<prefix.count(); i++) {
+        if (address.at(i) != prefix.at(i))
+            return false;
+    }
+    return true;
+}
+
+// an observed edit covers another one: a node covers its subtree, the items of
+// a list from an index cover the subtrees of those items
+bool observedCovers(const QVariantList& address, int index,
+                    const QVariantList& other, int otherIndex)
+{
+    if (!addressStartsWith(other, address))
+        return false;
+    if (index < 0)
+        return true;
+    if (other.count() == address.count())
+        return otherIndex >= index;
+    return other.at(address.count()).toInt() >= index;
+}
+
+}
 
 
 QVariantTree::QVariantTree() :
-    m_containers()
+    _lazyIndex(),
+    _lazyLoaded(),
+    _lazyPending(0),
+    _lazyDevice(NULL),
+    _lazyFile(),
+    m_containers(),
+    m_observers()
 {
     setContainer(QVariant::List, new QVariantTreeListContainer);
     setContainer(QVariant::StringList, new QVariantTreeListContainer);
@@ -24,20 +292,30 @@ QVariantTree::~QVariantTree()
 
 
 void QVariantTree::clear()
+{
+    resetContent();
+    notifyReset();
+}
+
+void QVariantTree::resetContent()
 {
     _root.clear();
     _address.clear();
+    _nodes.clear();
     _nodeType = QVariant::Invalid;
+    resetIndexed();
 }
 
 QVariantTreeElementContainer* QVariantTree::setContainer(
         uint type,
         QVariantTreeElementContainer* container)
 {
-    QVariantTreeElementContainer* oldContainer = NULL;
-    if (m_containers.contains(type))
-        oldContainer = m_containers.take(type);
-    m_containers.insert(type, container);
+    // dense table indexed by type id, unused types stay NULL
+    if (type >= (uint)m_containers.count())
+        m_containers.resize(type + 1);
+
+    QVariantTreeElementContainer* oldContainer = m_containers.at(type);
+    m_containers[type] = container;
     return oldContainer;
 }
 
@@ -45,53 +323,369 @@ QVariantTreeElementContainer* QVariantTree::setContainer(
 
 void QVariantTree::setRootContent(QVariant rootContent)
 {
-    clear();
+    resetContent();
     _root = rootContent;
-    _nodeType = _root.type();
+    _nodeType = _root.userType();
+    notifyReset();
+}
+
+void QVariantTree::setRootContent(QVariant rootContent, const QVariantList& changedAddress)
+{
+    QVariant oldValue;
+    if (!m_observers.isEmpty())
+        oldValue = getTreeValue(changedAddress);
+
+    resetContent();
+    _root = rootContent;
+    _nodeType = _root.userType();
+    notifyChanged(changedAddress, oldValue);
+}
+
+QVariant QVariantTree::containerRoot(const QVariant& content) const
+{
+    if (containerOf(content.userType()))
+        return content;
+
+    QVariantList records;
+    if (content.isValid())
+        records << content;
+    return records;
+}
+
+bool QVariantTree::appendRecords(const QVariantList& records)
+{
+    QVariantTreeElementContainer* containerType = containerOf(_root.userType());
+    if (containerType == NULL || !containerType->isList())
+        return false;
+    if (records.isEmpty())
+        return true;
+
+    // in place at the end of the root list: no item is shifted, so the records
+    // not loaded yet stay on their file, and the appended ones count as loaded
+    int count = containerType->size(_root);
+    int staleNodes = releaseNodes(QVariantList());
+    bool isAppended = true;
+    for (int i=0; i<records.count() && isAppended; i++)
+        isAppended = containerType->insertItem(_root, count + i, records.at(i));
+    refreshNodes(staleNodes);
+    notifyItemsChanged(QVariantList(), count, QVariantList());
+    return isAppended;
+}
+
+QVariant QVariantTree::rootContent(const QVariantList& address) const
+{
+    if (address.isEmpty())
+        loadAllRecords();
+    else
+        loadRecord(address.first().toInt());
+    return _root;
+}
+
+QVariantTree::Snapshot QVariantTree::snapshot() const
+{
+    Snapshot result;
+    result.root = _root;
+    if (_lazyPending > 0)
+        result.loadedRecords = _lazyLoaded;
+    return result;
+}
+
+void QVariantTree::restoreSnapshot(const Snapshot& snapshot, const QVariantList& changedAddress)
+{
+    QVariant oldValue;
+    if (!m_observers.isEmpty())
+        oldValue = getTreeValue(changedAddress);
+
+    // the index stays: records not loaded in the snapshot are read again
+    _address.clear();
+    _nodes.clear();
+    _root = snapshot.root;
+    _nodeType = _root.userType();
+    if (!snapshot.loadedRecords.isEmpty()
+            && snapshot.loadedRecords.count() == _lazyIndex.count()) {
+        _lazyLoaded = snapshot.loadedRecords;
+        _lazyPending = _lazyLoaded.count(false);
+    }
+    else
+        markRecordsLoaded();
+    notifyChanged(changedAddress, oldValue);
 }
 
 void QVariantTree::setNodeValue(QVariant value)
 {
-    _root = internalSetTreeValue(_root, _address, value);
+    prepareEdit(_address);
+    QVariantList address = _address;
+    QVariant oldValue;
+    if (!m_observers.isEmpty())
+        oldValue = getTreeValue(_root, address);
+
+    int staleNodes = releaseNodes(address);
+    internalSetTreeValue(_root, address, 0, value);
+    if (address.isEmpty())
+        markRecordsLoaded();
+    refreshNodes(staleNodes);
+    notifyChanged(address, oldValue);
 }
 
 //------------------------------------------------------------------------------
 
 void QVariantTree::moveToNode(const QVariant& key)
 {
+    if (nodeIsRoot())
+        loadRecord(key.toInt());
+
+    QVariant node = nodeValue();
+    QVariantTreeElementContainer* containerType = containerOf(node.userType());
+
     _address.append(QVariant(key));
-    _nodeType = nodeValue().type();
+    if (containerType && containerType->contains(node, key))
+        _nodes.append(containerType->item(node, key));
+    else
+        _nodes.append(QVariant());
+    _nodeType = nodeValue().userType();
 }
 
 void QVariantTree::moveToParent()
 {
     if (!nodeIsRoot()) {
         _address.removeLast();
-        _nodeType = nodeValue().type();
+        _nodes.removeLast();
+        _nodeType = nodeValue().userType();
     }
 }
 
 void QVariantTree::moveToRoot()
 {
     _address.clear();
-    _nodeType = _root.type();
+    _nodes.clear();
+    _nodeType = _root.userType();
+}
+
+//------------------------------------------------------------------------------
+
+int QVariantTree::releaseNodes(const QVariantList& address, bool isRemoval)
+{
+    // a removal may shift all the siblings (list), so the whole parent is edited
+    int editDepth = address.count();
+    if (isRemoval && editDepth > 0)
+        editDepth--;
+
+    int commonDepth = 0;
+    while (commonDepth < editDepth && commonDepth < _address.count()
+           && address.at(commonDepth) == _address.at(commonDepth))
+        commonDepth++;
+
+    // the edit replaces a node of the address (or one of its ancestors):
+    // every node below is stale too
+    // otherwise, only the common ancestors are modified
+    int staleNodes = _nodes.count();
+    if (commonDepth < editDepth)
+        staleNodes = qMin(commonDepth, _nodes.count());
+
+    // no reference must remain on the edited spine, or it would be detached
+    for (int i=0; i<staleNodes; i++)
+        _nodes[i].clear();
+
+    return staleNodes;
+}
+
+void QVariantTree::refreshNodes(int count)
+{
+    for (int i=0; i<count; i++) {
+        const QVariant& parent = (i == 0) ? _root : _nodes.at(i-1);
+        const QVariant& key = _address.at(i);
+        QVariantTreeElementContainer* containerType = containerOf(parent.userType());
+        if (containerType && containerType->contains(parent, key))
+            _nodes[i] = containerType->item(parent, key);
+        else
+            _nodes[i].clear();
+    }
+    _nodeType = nodeValue().userType();
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTree::setFromFileIndexed(QString filename)
+{
+    QScopedPointer<QFile> file(new QFile(filename));
+    if (!file->open(QFile::ReadOnly)) {
+        clear();
+        return;
+    }
+
+    setFromFileIndexed(file.data());
+    if (_lazyPending > 0)
+        _lazyFile.reset(file.take());
+}
+
+void QVariantTree::setFromFileIndexed(QIODevice* file)
+{
+    resetContent();
+    if (file == NULL) {
+        notifyReset();
+        return;
+    }
+
+    // cannot seek back to a record: full loading
+    if (file->isSequential()) {
+        setFromFile(file);
+        return;
+    }
+
+    qint64 start = file->pos();
+    QVariantTreeRecordIndex index = QVariantTreeRecordIndex::build(file);
+
+    // a single record is the root itself
+    if (index.count() <= 1) {
+        file->seek(start);
+        setFromFile(file);
+        return;
+    }
+
+    QVariantList records;
+    records.reserve(index.count());
+    for (int i=0; i<index.count(); i++)
+        records.append(QVariant());
+    _root = records;
+    _nodeType = _root.userType();
+
+    _lazyIndex = index;
+    _lazyLoaded.fill(false, index.count());
+    _lazyPending = index.count();
+    _lazyDevice = file;
+    notifyReset();
+}
+
+bool QVariantTree::recordIsLoaded(int index) const
+{
+    return _lazyPending == 0 || index < 0 || index >= _lazyLoaded.count()
+            || _lazyLoaded.at(index);
+}
+
+void QVariantTree::loadRecord(int index) const
+{
+    if (recordIsLoaded(index))
+        return;
+
+    QVariant record = _lazyIndex.load(_lazyDevice, index);
+    (*static_cast<QVariantList*>(_root.data()))[index] = record;
+    _lazyLoaded[index] = true;
+    // the index is kept for the snapshots of the tree, see restoreSnapshot()
+    _lazyPending--;
+}
+
+void QVariantTree::loadAllRecords() const
+{
+    for (int i=0; _lazyPending > 0 && i<_lazyLoaded.count(); i++)
+        loadRecord(i);
+}
+
+void QVariantTree::prepareEdit(const QVariantList& address, bool isStructural) const
+{
+    // root is replaced: records are dropped once it is, see markRecordsLoaded()
+    if (_lazyPending == 0 || address.isEmpty())
+        return;
+
+    // root list is reshaped, records would be shifted
+    if (isStructural && address.count() == 1)
+        loadAllRecords();
+    else
+        loadRecord(address.first().toInt());
+}
+
+void QVariantTree::markRecordsLoaded() const
+{
+    _lazyLoaded.fill(true);
+    _lazyPending = 0;
+}
+
+void QVariantTree::resetIndexed() const
+{
+    _lazyIndex.clear();
+    _lazyLoaded.clear();
+    _lazyPending = 0;
+    _lazyDevice = NULL;
+    _lazyFile.reset();
 }
 
 //------------------------------------------------------------------------------
 
 bool QVariantTree::typeIsContainer(uint type) const
 {
-    return m_containers.keys().contains(type);
+    return containerOf(type) != NULL;
 }
 
 bool QVariantTree::nodeIsContainer() const
 {
-    return m_containers.keys().contains(nodeType());
+    return containerOf(nodeType()) != NULL;
 }
 
 QVariantTreeElementContainer* QVariantTree::containerOf(uint type) const
 {
-    return m_containers.value(type, 0);
+    if (type < (uint)m_containers.count())
+        return m_containers.at(type);
+    return NULL;
+}
+
+void QVariantTree::addObserver(QVariantTreeObserver* observer)
+{
+    if (observer && !m_observers.contains(observer))
+        m_observers.append(observer);
+}
+
+void QVariantTree::removeObserver(QVariantTreeObserver* observer)
+{
+    m_observers.removeAll(observer);
+}
+
+QVariantList QVariantTree::observedAddress(const QVariantList& address, bool isStructural,
+                                          int* index) const
+{
+    *index = -1;
+    if (!isStructural || address.isEmpty())
+        return address;
+
+    // list items after an insertion or a removal change their index
+    QVariantList listAddress = address.mid(0, address.count() - 1);
+    QVariant list = getTreeValue(_root, listAddress);
+    QVariantTreeElementContainer* containerType = containerOf(list.userType());
+    if (containerType == NULL || !containerType->isList())
+        return address;
+    *index = qBound(0, address.last().toInt(), containerType->size(list));
+    return listAddress;
+}
+
+QVariantList QVariantTree::observedItems(const QVariantList& address, int index) const
+{
+    QVariantList result;
+    QVariant list = getTreeValue(_root, address);
+    QVariantTreeElementContainer* containerType = containerOf(list.userType());
+    if (containerType == NULL)
+        return result;
+
+    int count = containerType->size(list);
+    for (int i=index; i<count; i++)
+        result.append(containerType->item(list, i));
+    return result;
+}
+
+void QVariantTree::notifyReset()
+{
+    foreach (QVariantTreeObserver* observer, m_observers)
+        observer->treeReset(*this);
+}
+
+void QVariantTree::notifyChanged(const QVariantList& address, const QVariant& oldValue)
+{
+    foreach (QVariantTreeObserver* observer, m_observers)
+        observer->nodeChanged(*this, address, oldValue);
+}
+
+void QVariantTree::notifyItemsChanged(const QVariantList& address, int index,
+                                      const QVariantList& oldItems)
+{
+    foreach (QVariantTreeObserver* observer, m_observers)
+        observer->itemsChanged(*this, address, index, oldItems);
 }
 
 //------------------------------------------------------------------------------
@@ -110,6 +704,8 @@ QVariant QVariantTree::getItemContainer(const QVariant& key,
     Q_ASSERT(nodeIsContainer());
     QVariantTreeElementContainer* containerType = containerOf(nodeType());
     Q_ASSERT_X(containerType != 0, "QVariantTree", "cannot find container of type");
+    if (nodeIsRoot())
+        loadRecord(key.toInt());
     return containerType->item(nodeValue(), key, defaultValue);
 }
 
@@ -121,7 +717,15 @@ void QVariantTree::setItemContainer(const QVariant& key, const QVariant& value)
 
     QVariantList collItemAddress = _address;
     collItemAddress << QVariant(key);
-    _root = internalSetTreeValue(_root, collItemAddress, value);
+    prepareEdit(collItemAddress);
+    QVariant oldValue;
+    if (!m_observers.isEmpty())
+        oldValue = getTreeValue(_root, collItemAddress);
+
+    int staleNodes = releaseNodes(collItemAddress);
+    internalSetTreeValue(_root, collItemAddress, 0, value);
+    refreshNodes(staleNodes);
+    notifyChanged(collItemAddress, oldValue);
 }
 
 void QVariantTree::delItemContainer(const QVariant& key)
@@ -132,7 +736,26 @@ void QVariantTree::delItemContainer(const QVariant& key)
 
     QVariantList collItemAddress = _address;
     collItemAddress << QVariant(key);
-    _root = internalDelTreeValue(_root, collItemAddress);
+    prepareEdit(collItemAddress, true);
+    int index = -1;
+    QVariantList observed;
+    QVariant oldValue;
+    QVariantList oldItems;
+    if (!m_observers.isEmpty()) {
+        observed = observedAddress(collItemAddress, true, &index);
+        if (index >= 0)
+            oldItems = observedItems(observed, index);
+        else
+            oldValue = getTreeValue(_root, observed);
+    }
+
+    int staleNodes = releaseNodes(collItemAddress, true);
+    internalDelTreeValue(_root, collItemAddress, 0);
+    refreshNodes(staleNodes);
+    if (index >= 0)
+        notifyItemsChanged(observed, index, oldItems);
+    else
+        notifyChanged(observed, oldValue);
 }
 
 //------------------------------------------------------------------------------
@@ -149,9 +772,8 @@ QVariant QVariantTree::getTreeValue(const QVariant& root,
         QVariantTreeElementContainer* containerType = NULL;
         QVariant key = address.value(indexAddress++);
 
-        trueValid = typeIsContainer(result.type())
-                && (containerType = containerOf(result.type()))
-                && containerType->keys(result).contains(key);
+        trueValid = (containerType = containerOf(result.userType()))
+                && containerType->contains(result, key);
 
         if (trueValid)
             result = containerType->item(result, key);
@@ -165,106 +787,382 @@ QVariant QVariantTree::getTreeValue(const QVariant& root,
     return result;
 }
 
+QVariant QVariantTree::getTreeValue(const QVariantList& address, bool* isValid) const
+{
+    return getTreeValue(rootContent(address), address, isValid);
+}
+
 void QVariantTree::setTreeValue(const QVariant& root,
                                     const QVariantList& address,
                                     const QVariant& value,
                                     bool* isValid)
 {
-    _root = internalSetTreeValue(root, address, value, isValid);
+    QVariant result = root;
+    bool trueValid = internalSetTreeValue(result, address, 0, value);
+    resetIndexed();
+    _root = result;
+    refreshNodes(_nodes.count());
+    notifyReset();
+
+    if (isValid)
+        *isValid = trueValid;
 }
 
 void QVariantTree::delTreeValue(const QVariant& root,
                                     const QVariantList& address,
                                     bool* isValid)
 {
-    _root = internalDelTreeValue(root, address, isValid);
+    QVariant result = root;
+    bool trueValid = internalDelTreeValue(result, address, 0);
+    resetIndexed();
+    _root = result;
+    refreshNodes(_nodes.count());
+    notifyReset();
+
+    if (isValid)
+        *isValid = trueValid;
 }
 
-QVariant QVariantTree::internalSetTreeValue(const QVariant& root,
-                                    const QVariantList& address,
-                                    const QVariant& value,
-                                    bool* isValid) const
+void QVariantTree::setTreeValue(const QVariantList& address,
+                                const QVariant& value,
+                                bool* isValid)
 {
-    QVariant result = root;
-    bool trueValid = true;
+    prepareEdit(address);
+    QVariant oldValue;
+    if (!m_observers.isEmpty())
+        oldValue = getTreeValue(_root, address);
 
-    if (address.isEmpty())
-        result = value;
-    else {
-        QVariantTreeElementContainer* containerType = containerOf(result.type());
-        if (containerType && containerType->keys(result).contains(address.first())) {
-            result = containerType->item(result, address.first());
-            result = internalSetTreeValue(result, address.mid(1), value);
-            result = containerType->setItem(root, address.first(), result);
-        }
+    int staleNodes = releaseNodes(address);
+    bool trueValid = internalSetTreeValue(_root, address, 0, value);
+    if (trueValid && address.isEmpty())
+        markRecordsLoaded();
+    refreshNodes(staleNodes);
+    if (trueValid)
+        notifyChanged(address, oldValue);
+    if (isValid)
+        *isValid = trueValid;
+}
+
+void QVariantTree::delTreeValue(const QVariantList& address,
+                                bool* isValid)
+{
+    prepareEdit(address, true);
+    int index = -1;
+    QVariantList observed;
+    QVariant oldValue;
+    QVariantList oldItems;
+    if (!m_observers.isEmpty()) {
+        observed = observedAddress(address, true, &index);
+        if (index >= 0)
+            oldItems = observedItems(observed, index);
         else
-            trueValid = false;
+            oldValue = getTreeValue(_root, observed);
     }
 
+    int staleNodes = releaseNodes(address, true);
+    bool trueValid = internalDelTreeValue(_root, address, 0);
+    if (trueValid && address.isEmpty())
+        markRecordsLoaded();
+    refreshNodes(staleNodes);
+    if (trueValid && index >= 0)
+        notifyItemsChanged(observed, index, oldItems);
+    else if (trueValid)
+        notifyChanged(observed, oldValue);
     if (isValid)
         *isValid = trueValid;
+}
 
-    return result;
+bool QVariantTree::internalSetTreeValue(QVariant& node,
+                                        const QVariantList& address,
+                                        int depth,
+                                        const QVariant& value) const
+{
+    if (depth == address.count()) {
+        node = value;
+        return true;
+    }
+
+    const QVariant& key = address.at(depth);
+    QVariantTreeElementContainer* containerType = containerOf(node.userType());
+    if (containerType == NULL || !containerType->contains(node, key))
+        return false;
+
+    // walk down by reference, only the address spine is detached
+    QVariant* item = containerType->itemReference(node, key);
+    if (item)
+        return internalSetTreeValue(*item, address, depth+1, value);
+
+    // fallback on the copy semantic of the container
+    QVariant itemCopy = containerType->item(node, key);
+    if (!internalSetTreeValue(itemCopy, address, depth+1, value))
+        return false;
+    node = containerType->setItem(node, key, itemCopy);
+    return true;
 }
 
-QVariant QVariantTree::internalDelTreeValue(const QVariant& root,
-                                    const QVariantList& address,
-                                    bool* isValid) const
+bool QVariantTree::internalDelTreeValue(QVariant& node,
+                                        const QVariantList& address,
+                                        int depth) const
 {
-    QVariant result = root;
-    bool trueValid = true;
+    // if no address -> invalid
+    if (address.isEmpty()) {
+        node.clear();
+        return true;
+    }
 
-    if (address.isEmpty())
-        result.clear(); // if no address -> invalid
-    else if (address.count() == 1) {
-        QVariantTreeElementContainer* containerType = containerOf(result.type());
-        if (containerType == NULL)
-            trueValid = false;
-        else
-            result = containerType->delItem(result, address.first());
+    const QVariant& key = address.at(depth);
+    QVariantTreeElementContainer* containerType = containerOf(node.userType());
+    if (containerType == NULL)
+        return false;
+
+    if (depth == address.count()-1) {
+        containerType->removeItem(node, key);
+        return true;
     }
-    else {
-        QVariantTreeElementContainer* containerType = containerOf(result.type());
-        if (containerType && containerType->keys(result).contains(address.first())) {
-            result = containerType->item(result, address.first());
-            result = internalDelTreeValue(result, address.mid(1));
-            result = containerType->setItem(root, address.first(), result);
+
+    if (!containerType->contains(node, key))
+        return false;
+
+    // walk down by reference, only the address spine is detached
+    QVariant* item = containerType->itemReference(node, key);
+    if (item)
+        return internalDelTreeValue(*item, address, depth+1);
+
+    // fallback on the copy semantic of the container
+    QVariant itemCopy = containerType->item(node, key);
+    if (!internalDelTreeValue(itemCopy, address, depth+1))
+        return false;
+    node = containerType->setItem(node, key, itemCopy);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+QVariantTreeChangeSet QVariantTree::apply(const QVariantTreeTransaction& transaction)
+{
+    QList<QVariantTreeTransaction::Operation> operations = transaction.operations();
+    QVariantTreeChangeSet changeSet;
+
+    // group operations by shared address prefix
+    QVariantTreeBatchNode batch;
+    for (int i=0; i<operations.count(); i++) {
+        QVariantTreeBatchNode* node = &batch;
+        const QVariantList& address = operations.at(i).address;
+        for (int depth=0; depth<address.count(); depth++)
+            node = node->child(address.at(depth));
+        node->operations.append(i);
+
+        prepareEdit(address, operations.at(i).type != QVariantTreeTransaction::SetOperation);
+    }
+
+    // each observer is notified once per replaced subtree, nested edits included
+    QList<QVariantList> observed;
+    QList<int> observedIndexes;
+    QVariantList oldValues;
+    if (!m_observers.isEmpty()) {
+        for (int i=0; i<operations.count(); i++) {
+            int index = -1;
+            QVariantList address = observedAddress(operations.at(i).address,
+                                                   operations.at(i).type != QVariantTreeTransaction::SetOperation,
+                                                   &index);
+            bool isCovered = false;
+            for (int j=observed.count()-1; j>=0 && !isCovered; j--) {
+                if (observedCovers(observed.at(j), observedIndexes.at(j), address, index))
+                    isCovered = true;
+                else if (observedCovers(address, index, observed.at(j), observedIndexes.at(j))) {
+                    observed.removeAt(j);
+                    observedIndexes.removeAt(j);
+                }
+            }
+            if (!isCovered) {
+                observed.append(address);
+                observedIndexes.append(index);
+            }
+        }
+        // the shifted items of a list, or the replaced node
+        for (int i=0; i<observed.count(); i++) {
+            if (observedIndexes.at(i) >= 0)
+                oldValues.append(QVariant(observedItems(observed.at(i), observedIndexes.at(i))));
+            else
+                oldValues.append(getTreeValue(_root, observed.at(i)));
         }
+    }
+
+    int staleNodes = releaseNodes(QVariantList());
+
+    // operations on the root itself
+    for (int i=0; i<batch.operations.count(); i++) {
+        const QVariantTreeTransaction::Operation& operation = operations.at(batch.operations.at(i));
+        if (operation.type == QVariantTreeTransaction::SetOperation)
+            _root = operation.value;
+        else if (operation.type == QVariantTreeTransaction::DelOperation)
+            _root.clear();
+        else {
+            changeSet._failed.append(QVariantList());
+            continue;
+        }
+        markRecordsLoaded();
+        changeSet._applied.append(operation);
+        if (!changeSet._changed.contains(QVariantList()))
+            changeSet._changed.append(QVariantList());
+    }
+
+    internalApplyBatch(_root, QVariantList(), batch, operations, changeSet);
+    refreshNodes(staleNodes);
+
+    for (int i=0; i<observed.count(); i++) {
+        if (observedIndexes.at(i) >= 0)
+            notifyItemsChanged(observed.at(i), observedIndexes.at(i), oldValues.at(i).toList());
         else
-            trueValid = false;
+            notifyChanged(observed.at(i), oldValues.at(i));
     }
 
-    if (isValid)
-        *isValid = trueValid;
+    return changeSet;
+}
 
-    return result;
+bool QVariantTree::replay(const QVariantTreeJournal& journal)
+{
+    bool isValid = true;
+    QList<QVariantTreeTransaction::Operation> operations = journal.operations();
+    QList<QVariantTreeTransaction::Operation>::const_iterator it = operations.constBegin();
+    for (; it != operations.constEnd(); ++it) {
+        // each address depends on the previous operations
+        QVariantTreeTransaction transaction;
+        if (it->type == QVariantTreeTransaction::SetOperation)
+            transaction.setValue(it->address, it->value);
+        else if (it->type == QVariantTreeTransaction::InsertOperation)
+            transaction.insertValue(it->address, it->value);
+        else
+            transaction.delValue(it->address);
+
+        if (!apply(transaction).failedAddresses().isEmpty())
+            isValid = false;
+    }
+    return isValid;
 }
 
-//------------------------------------------------------------------------------
+QList<QVariantTreeDiff::Difference> QVariantTree::diff(const QVariant& other, int workerCount) const
+{
+    return QVariantTreeDiff::compare(*this, rootContent(), other, workerCount);
+}
 
-QVariant QVariantTree::fromFile(QIODevice *file)
+void QVariantTree::internalApplyBatch(QVariant& node,
+                                      const QVariantList& address,
+                                      const QVariantTreeBatchNode& batch,
+                                      const QList<QVariantTreeTransaction::Operation>& operations,
+                                      QVariantTreeChangeSet& changeSet) const
 {
-    QVariant result;
-    QDataStream stream(file);
+    if (batch.children.isEmpty())
+        return;
 
-    if (!stream.atEnd()) {
-        stream >> result;
+    QVariantTreeElementContainer* containerType = containerOf(node.userType());
+    if (containerType == NULL) {
+        for (int i=0; i<batch.children.count(); i++)
+            batch.children.at(i)->collectAddresses(QVariantList(address) << batch.children.at(i)->key,
+                                                   changeSet._failed);
+        return;
+    }
 
-        // si plus d'un seul element
-        if (!stream.atEnd()) {
-            QVariantList list;
-            list << result;
+    QList<StructuralOperation> structuralOperations;
 
-            while (!stream.atEnd()) {
-                stream >> result;
-                list << result;
+    // values first: each touched item is reached once, by reference if possible
+    for (int i=0; i<batch.children.count(); i++) {
+        const QVariantTreeBatchNode* child = batch.children.at(i);
+        QVariantList childAddress = address;
+        childAddress << child->key;
+
+        QList<int> setOperations;
+        for (int j=0; j<child->operations.count(); j++) {
+            int index = child->operations.at(j);
+            if (operations.at(index).type == QVariantTreeTransaction::SetOperation)
+                setOperations.append(index);
+            else {
+                StructuralOperation structural;
+                structural.key = child->key;
+                structural.index = index;
+                structural.isRemoval = (operations.at(index).type == QVariantTreeTransaction::DelOperation);
+                structuralOperations.append(structural);
             }
+        }
+
+        if (setOperations.isEmpty() && child->children.isEmpty())
+            continue;
+
+        if (!containerType->contains(node, child->key)) {
+            for (int j=0; j<setOperations.count(); j++)
+                changeSet._failed.append(childAddress);
+            for (int j=0; j<child->children.count(); j++)
+                child->children.at(j)->collectAddresses(QVariantList(childAddress) << child->children.at(j)->key,
+                                                        changeSet._failed);
+            continue;
+        }
+
+        QVariant itemCopy;
+        QVariant* item = containerType->itemReference(node, child->key);
+        if (item == NULL) {
+            itemCopy = containerType->item(node, child->key);
+            item = &itemCopy;
+        }
+
+        for (int j=0; j<setOperations.count(); j++) {
+            *item = operations.at(setOperations.at(j)).value;
+            changeSet._applied.append(operations.at(setOperations.at(j)));
+        }
+        if (!setOperations.isEmpty())
+            changeSet._changed.append(childAddress);
 
-            result = list;
+        internalApplyBatch(*item, childAddress, *child, operations, changeSet);
+
+        // fallback on the copy semantic of the container
+        if (item == &itemCopy)
+            node = containerType->setItem(node, child->key, itemCopy);
+    }
+
+    // then the structure of the container itself
+    std::sort(structuralOperations.begin(), structuralOperations.end(),
+              StructuralOperationBefore(containerType->isList()));
+
+    bool structureChanged = false;
+    for (int i=0; i<structuralOperations.count(); i++) {
+        const StructuralOperation& structural = structuralOperations.at(i);
+        const QVariantTreeTransaction::Operation& operation = operations.at(structural.index);
+
+        if (structural.isRemoval) {
+            // the same item is removed only once
+            bool alreadyRemoved = (i > 0)
+                    && structuralOperations.at(i-1).isRemoval
+                    && structuralOperations.at(i-1).key == structural.key;
+            if (!alreadyRemoved) {
+                containerType->removeItem(node, structural.key);
+                changeSet._applied.append(operation);
+            }
+            structureChanged = true;
+        }
+        else if (containerType->insertItem(node, structural.key, operation.value)) {
+            changeSet._applied.append(operation);
+            structureChanged = true;
         }
+        else
+            changeSet._failed.append(operation.address);
     }
 
-    return result;
+    if (structureChanged)
+        changeSet._changed.append(address);
+}
+
+//------------------------------------------------------------------------------
+
+QVariant QVariantTree::fromFile(QIODevice *file)
+{
+    QVariantList list;
+    QVariantTreeRecordReader reader(file);
+    while (reader.readNext())
+        list << reader.record();
+
+    // si plus d'un seul element
+    if (list.count() > 1)
+        return list;
+    return list.value(0);
 }
 
 void QVariantTree::toFile(QIODevice *file, QVariant value)
@@ -283,6 +1181,149 @@ void QVariantTree::toFile(QIODevice *file, QVariant value)
         stream << value;
 }
 
+void QVariantTree::toContainerFile(QIODevice *file, QVariant value)
+{
+    QVariantTreeContainerWriter writer(file);
+
+    if (value.type() == QVariant::List) {
+        QVariantList list = value.toList();
+        QVariantList::const_iterator it = list.constBegin();
+        for (; it != list.constEnd(); ++it)
+            writer.write(*it);
+    }
+    else if (value.isValid())
+        writer.write(value);
+
+    writer.finish();
+}
+
+void QVariantTree::toContainerFile(QString filename, QVariant value)
+{
+    QFile file(filename);
+    if (file.open(QIODevice::WriteOnly |
+                  QIODevice::Truncate)) {
+        QVariantTree::toContainerFile(&file, value);
+        file.flush();
+        file.close();
+    }
+}
+
+void QVariantTree::toCompressedFile(QIODevice *file, QVariant value, int workerCount)
+{
+    QVariantTreeCompressedWriter writer(file, workerCount);
+
+    if (value.type() == QVariant::List) {
+        QVariantList list = value.toList();
+        QVariantList::const_iterator it = list.constBegin();
+        for (; it != list.constEnd(); ++it)
+            writer.write(*it);
+    }
+    else if (value.isValid())
+        writer.write(value);
+
+    writer.finish();
+}
+
+void QVariantTree::toCompressedFile(QString filename, QVariant value, int workerCount)
+{
+    QFile file(filename);
+    if (file.open(QIODevice::WriteOnly |
+                  QIODevice::Truncate)) {
+        QVariantTree::toCompressedFile(&file, value, workerCount);
+        file.flush();
+        file.close();
+    }
+}
+
+QVariantTree::FileFormat QVariantTree::fileFormat(QString filename)
+{
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly))
+        return PlainFormat;
+    return QVariantTree::fileFormat(&file);
+}
+
+QVariantTree::FileFormat QVariantTree::fileFormat(QIODevice *file)
+{
+    if (QVariantTreeContainer::isContainer(file))
+        return ContainerFormat;
+    if (QVariantTreeCompressed::isCompressed(file))
+        return CompressedFormat;
+    return PlainFormat;
+}
+
+void QVariantTree::setFromFileJournaled(QString filename)
+{
+    setFromFile(filename);
+
+    QVariantTreeJournal journal;
+    if (QVariantTreeJournal::read(filename, &journal))
+        replay(journal);
+}
+
+bool QVariantTree::compactFile(QString filename)
+{
+    QVariantTreeJournal journal;
+    if (!QVariantTreeJournal::read(filename, &journal))
+        return QVariantTreeJournal::remove(filename);
+
+    QVariantTree tree;
+    tree.setFromFile(filename);
+    tree.replay(journal);
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    FileFormat format = QVariantTree::fileFormat(filename);
+    if (format == ContainerFormat)
+        QVariantTree::toContainerFile(&file, tree.rootContent());
+    else if (format == CompressedFormat)
+        QVariantTree::toCompressedFile(&file, tree.rootContent());
+    else
+        QVariantTree::toFile(&file, tree.rootContent());
+
+    // the new base file invalidates the journal anyway
+    return file.commit() && QVariantTreeJournal::remove(filename);
+}
+
+bool QVariantTree::convertFile(QString source, QString destination, FileFormat format)
+{
+    QFile input(source);
+    if (!input.open(QFile::ReadOnly))
+        return false;
+
+    // the source is replaced only once completely converted
+    QSaveFile output(destination);
+    if (!output.open(QIODevice::WriteOnly))
+        return false;
+
+    QVariantTreeRecordReader reader(&input);
+    if (format == ContainerFormat) {
+        QVariantTreeContainerWriter writer(&output);
+        while (reader.readNext())
+            writer.write(reader.record());
+        if (!writer.finish())
+            return false;
+    }
+    else if (format == CompressedFormat) {
+        QVariantTreeCompressedWriter writer(&output);
+        while (reader.readNext())
+            writer.write(reader.record());
+        if (!writer.finish())
+            return false;
+    }
+    else {
+        QDataStream stream(&output);
+        while (reader.readNext())
+            stream << reader.record();
+    }
+
+    if (!reader.atEnd() || reader.status() != QDataStream::Ok)
+        return false;
+    return output.commit();
+}
+
 QVariant QVariantTree::fromFile(QString filename)
 {
     QVariant result;
@@ -294,6 +1335,156 @@ QVariant QVariantTree::fromFile(QString filename)
     return result;
 }
 
+QVariant QVariantTree::fromFileMapped(QString filename)
+{
+    QVariant result;
+    QFile file(filename);
+    if (file.open(QFile::ReadOnly)) {
+        result = QVariantTree::fromFileMapped(&file);
+        file.close();
+    }
+    return result;
+}
+
+QVariant QVariantTree::fromFileMapped(QIODevice *file)
+{
+    QFileDevice* fileDevice = qobject_cast<QFileDevice*>(file);
+    qint64 offset = file->pos();
+    qint64 size = fileDevice ? fileDevice->size() - offset : 0;
+
+    // not a file, larger than a mapping, or cannot be mapped: buffered reading
+    uchar* data = NULL;
+    if (fileDevice && size > 0 && size <= MappedWindowSize)
+        data = fileDevice->map(offset, size);
+    if (data == NULL)
+        return QVariantTree::fromFile(file);
+
+    // decoded values never point into the mapping, it can be unmapped after
+    QVariant result;
+    {
+        QByteArray rawData = QByteArray::fromRawData(reinterpret_cast<const char*>(data), (int)size);
+        QBuffer buffer(&rawData);
+        buffer.open(QIODevice::ReadOnly);
+        result = QVariantTree::fromFile(&buffer);
+    }
+
+    fileDevice->unmap(data);
+    file->seek(offset + size);
+    return result;
+}
+
+QVariant QVariantTree::fromFileParallel(QString filename, int workerCount)
+{
+    QVariant result;
+    QFile file(filename);
+    if (file.open(QFile::ReadOnly)) {
+        result = QVariantTree::fromFileParallel(&file, workerCount);
+        file.close();
+    }
+    return result;
+}
+
+QVariant QVariantTree::fromFileParallel(QIODevice *file, int workerCount)
+{
+    // blocks decompressed in parallel
+    if (QVariantTreeCompressed::isCompressed(file)) {
+        QVariantList list = QVariantTreeCompressed::read(file, workerCount);
+        if (list.count() > 1)
+            return list;
+        return list.value(0);
+    }
+
+    if (workerCount <= 0)
+        workerCount = QThread::idealThreadCount();
+
+    QFileDevice* fileDevice = qobject_cast<QFileDevice*>(file);
+    qint64 offset = file->pos();
+    qint64 size = fileDevice ? fileDevice->size() - offset : 0;
+    QVariantList list;
+    if (size > MappedWindowSize) {
+        decodeWindows(fileDevice, workerCount, list);
+        if (list.count() > 1)
+            return list;
+        return list.value(0);
+    }
+
+    // whole content in memory: mapped if possible, else read
+    uchar* mapping = NULL;
+    if (fileDevice && size > 0)
+        mapping = fileDevice->map(offset, size);
+
+    QByteArray content;
+    if (mapping)
+        content = QByteArray::fromRawData(reinterpret_cast<const char*>(mapping), (int)size);
+    else
+        content = file->readAll();
+
+    // record boundaries, without decoding
+    QVariantTreeRecordIndex index;
+    {
+        QBuffer buffer(&content);
+        buffer.open(QIODevice::ReadOnly);
+        index = QVariantTreeRecordIndex::build(&buffer);
+    }
+
+    list.reserve(index.count());
+    decodeRecords(content.constData(), 0, index, 0, index.count(), workerCount, list);
+
+    content.clear();
+    if (mapping) {
+        fileDevice->unmap(mapping);
+        file->seek(offset + size);
+    }
+
+    // si plus d'un seul element
+    if (list.count() > 1)
+        return list;
+    return list.value(0);
+}
+
+void QVariantTree::toFileParallel(QString filename, QVariant value, int workerCount)
+{
+    QFile file(filename);
+    if (file.open(QIODevice::WriteOnly |
+                  QIODevice::Truncate)) {
+        QVariantTree::toFileParallel(&file, value, workerCount);
+        file.flush();
+        file.close();
+    }
+}
+
+void QVariantTree::toFileParallel(QIODevice *file, QVariant value, int workerCount)
+{
+    if (value.type() != QVariant::List) {
+        QVariantTree::toFile(file, value);
+        return;
+    }
+
+    if (workerCount <= 0)
+        workerCount = QThread::idealThreadCount();
+
+    const QVariantList list = value.toList();
+    QThreadPool pool;
+    pool.setMaxThreadCount(workerCount);
+
+    // by waves of one chunk per worker, written in order: the memory stays bounded
+    QVector<QByteArray> chunks(workerCount);
+    int first = 0;
+    while (first < list.count()) {
+        int waveChunks = 0;
+        for (; waveChunks<workerCount && first<list.count(); waveChunks++) {
+            int count = qMin(ParallelChunkRecords, list.count() - first);
+            chunks[waveChunks].clear();
+            pool.start(new RecordRangeEncoder(list, first, count, &chunks[waveChunks]));
+            first += count;
+        }
+        pool.waitForDone();
+
+        for (int i=0; i<waveChunks; i++)
+            file->write(chunks.at(i));
+    }
+}
+
 void QVariantTree::toFile(QString filename, QVariant value)
 {
     QFile file(filename);
@@ -2,20 +2,51 @@
 #define QVARIANTTREE_H
 
 #include <QVariant>
+#include <QVector>
+#include <QScopedPointer>
 
 #include "qvarianttreeelement.h"
+#include "qvarianttreetransaction.h"
+#include "qvarianttreerecordindex.h"
+#include "qvarianttreejournal.h"
+#include "qvarianttreeobserver.h"
+#include "qvarianttreediff.h"
+
+class QFile;
+class QVariantTreeBatchNode;
 
 
 class QVariantTree
 {
 public:
+    enum FileFormat {
+        PlainFormat,      // bare sequence of records
+        ContainerFormat,  // records with a footer index, see QVariantTreeContainer
+        CompressedFormat  // compressed blocks of records, see QVariantTreeCompressed
+    };
+
     explicit QVariantTree();
     virtual ~QVariantTree();
 
     void clear();
 
     void setRootContent(QVariant rootContent);
-    QVariant rootContent() const { return _root; }
+    // replace the root by a version which differs only under the address,
+    // observers are notified of that node only
+    void setRootContent(QVariant rootContent, const QVariantList& changedAddress);
+    QVariant rootContent() const { loadAllRecords(); return _root; }
+    // root content with only the indexed record holding the address loaded
+    QVariant rootContent(const QVariantList& address) const;
+
+    // root content as is: the indexed records not loaded yet stay in the file
+    struct Snapshot
+    {
+        QVariant root;
+        QVector<bool> loadedRecords; // empty if every record is loaded
+    };
+    Snapshot snapshot() const;
+    // restore a snapshot of this tree, observers are notified of the address only
+    void restoreSnapshot(const Snapshot& snapshot, const QVariantList& changedAddress);
 
     QVariantList address() const { return _address; }
 
@@ -26,7 +57,7 @@ public:
     void moveToRoot();
 
     uint nodeType() const { return _nodeType; }
-    QVariant nodeValue() const { return getTreeValue(_root, _address); }
+    QVariant nodeValue() const { return _nodes.isEmpty() ? _root : _nodes.last(); }
     void setNodeValue(QVariant value);
 
     bool typeIsContainer(uint type) const;
@@ -39,23 +70,87 @@ public:
 
     bool isValid() const { return _root.isValid(); }
 
+    // content as a root container: any other value is the single item of a list
+    QVariant containerRoot(const QVariant& content) const;
+    // append records at the end of a root list, false if the root is not a list
+    bool appendRecords(const QVariantList& records);
+
     static void toFile(QString filename, QVariant value);
     static void toFile(QIODevice *file, QVariant value);
     void toFile(QString filename) const { QVariantTree::toFile(filename, rootContent()); }
     void toFile(QIODevice *file) const { QVariantTree::toFile(file, rootContent()); }
 
+    // serialize the root list items on a thread pool, same bytes as toFile()
+    static void toFileParallel(QString filename, QVariant value, int workerCount = 0);
+    static void toFileParallel(QIODevice *file, QVariant value, int workerCount = 0);
+    void toFileParallel(QString filename, int workerCount = 0) const
+    { QVariantTree::toFileParallel(filename, rootContent(), workerCount); }
+
+    // same records as toFile(), with a footer index for random access
+    static void toContainerFile(QString filename, QVariant value);
+    static void toContainerFile(QIODevice *file, QVariant value);
+    void toContainerFile(QString filename) const { QVariantTree::toContainerFile(filename, rootContent()); }
+
+    // same records as toFile(), in blocks compressed on a thread pool
+    static void toCompressedFile(QString filename, QVariant value, int workerCount = 0);
+    static void toCompressedFile(QIODevice *file, QVariant value, int workerCount = 0);
+    void toCompressedFile(QString filename, int workerCount = 0) const
+    { QVariantTree::toCompressedFile(filename, rootContent(), workerCount); }
+
+    // the plain, container and compressed formats are all read by every
+    // fromFile*() / setFromFile*()
+    static FileFormat fileFormat(QString filename);
+    static FileFormat fileFormat(QIODevice *file);
+    // rewrite the records of a file in the given format, one at a time
+    static bool convertFile(QString source, QString destination, FileFormat format);
+
     static QVariant fromFile(QString filename);
     static QVariant fromFile(QIODevice *file);
     void setFromFile(QString filename) { setRootContent(QVariantTree::fromFile(filename)); }
     void setFromFile(QIODevice *file) { setRootContent(QVariantTree::fromFile(file)); }
 
+    // read through a memory mapping of the file, fallback on buffered reading,
+    // as for a file past 2 GB
+    static QVariant fromFileMapped(QString filename);
+    static QVariant fromFileMapped(QIODevice *file);
+    void setFromFileMapped(QString filename) { setRootContent(QVariantTree::fromFileMapped(filename)); }
+
+    // decode the top-level records on a thread pool, workerCount <= 0 for the ideal count
+    // a file past 2 GB is mapped in windows of whole records, one at a time
+    static QVariant fromFileParallel(QString filename, int workerCount = 0);
+    static QVariant fromFileParallel(QIODevice *file, int workerCount = 0);
+    void setFromFileParallel(QString filename, int workerCount = 0)
+    { setRootContent(QVariantTree::fromFileParallel(filename, workerCount)); }
+
+    // read the file, then replay its journal of edits if any
+    void setFromFileJournaled(QString filename);
+    // rewrite the file with its journal applied, in the same format, and drop the journal
+    static bool compactFile(QString filename);
+
+    // index the top-level records, each one is decoded on first access
+    // the device must remain open while records or snapshots are not loaded
+    void setFromFileIndexed(QString filename);
+    void setFromFileIndexed(QIODevice *file);
+    bool isIndexed() const { return _lazyPending > 0; }
+    QVariantTreeRecordIndex recordIndex() const { return _lazyIndex; }
+    bool recordIsLoaded(int index) const;
+
     QVariantTreeElementContainer* setContainer(
             uint type,
             QVariantTreeElementContainer* container);
+    // container of a type, NULL for leaf values
+    QVariantTreeElementContainer* containerOf(uint type) const;
+
+    // observers are notified after each edit, they are not owned
+    void addObserver(QVariantTreeObserver* observer);
+    void removeObserver(QVariantTreeObserver* observer);
 
     QVariant getTreeValue(const QVariant& root,
                           const QVariantList& address,
                           bool* isValid = 0) const;
+    // value in the root content, only its indexed record is loaded
+    QVariant getTreeValue(const QVariantList& address,
+                          bool* isValid = 0) const;
     void setTreeValue(const QVariant& root,
                       const QVariantList& address,
                       const QVariant& value,
@@ -64,23 +159,75 @@ public:
                       const QVariantList& address,
                       bool* isValid = 0);
 
-private:
-    QVariantTreeElementContainer* containerOf(uint type) const;
+    // edit the tree content in place, without copying untouched containers
+    void setTreeValue(const QVariantList& address,
+                      const QVariant& value,
+                      bool* isValid = 0);
+    void delTreeValue(const QVariantList& address,
+                      bool* isValid = 0);
 
-    QVariant internalSetTreeValue(const QVariant& root,
-                                  const QVariantList& address,
-                                  const QVariant& value,
-                                  bool* isValid = 0) const;
-    QVariant internalDelTreeValue(const QVariant& root,
-                                  const QVariantList& address,
-                                  bool* isValid = 0) const;
+    // apply all the operations in a single traversal
+    QVariantTreeChangeSet apply(const QVariantTreeTransaction& transaction);
+    // apply the operations one after the other, false if one failed
+    bool replay(const QVariantTreeJournal& journal);
+
+    // differences from the root content to another one, workerCount <= 0 for the ideal count
+    QList<QVariantTreeDiff::Difference> diff(const QVariant& other, int workerCount = 0) const;
+
+private:
+    void resetContent();
+
+    // address of the subtree replaced by an edit at the given address
+    // index of the first shifted item if it is the insertion or the removal
+    // of a list item, the address is the one of the list, -1 otherwise
+    QVariantList observedAddress(const QVariantList& address, bool isStructural,
+                                 int* index) const;
+    // items of the list at the address, from the index
+    QVariantList observedItems(const QVariantList& address, int index) const;
+    void notifyReset();
+    void notifyChanged(const QVariantList& address, const QVariant& oldValue);
+    void notifyItemsChanged(const QVariantList& address, int index,
+                            const QVariantList& oldItems);
+
+    // cursor nodes invalidated by an edit at the given address
+    int releaseNodes(const QVariantList& address, bool isRemoval = false);
+    void refreshNodes(int count);
+
+    // indexed root records
+    void loadRecord(int index) const;
+    void loadAllRecords() const;
+    void prepareEdit(const QVariantList& address, bool isStructural = false) const;
+    // the root was replaced: no record is read from the file any more
+    void markRecordsLoaded() const;
+    void resetIndexed() const;
+
+    bool internalSetTreeValue(QVariant& node,
+                              const QVariantList& address,
+                              int depth,
+                              const QVariant& value) const;
+    bool internalDelTreeValue(QVariant& node,
+                              const QVariantList& address,
+                              int depth) const;
+    void internalApplyBatch(QVariant& node,
+                            const QVariantList& address,
+                            const QVariantTreeBatchNode& batch,
+                            const QList<QVariantTreeTransaction::Operation>& operations,
+                            QVariantTreeChangeSet& changeSet) const;
 
 private:
-    QVariant _root;
+    mutable QVariant _root; // indexed records are loaded in place
     QVariantList _address;
+    QVariantList _nodes; // resolved node values along the address
     uint _nodeType;
 
-    QMap<uint, QVariantTreeElementContainer*> m_containers;
+    mutable QVariantTreeRecordIndex _lazyIndex;
+    mutable QVector<bool> _lazyLoaded;
+    mutable int _lazyPending;
+    mutable QIODevice* _lazyDevice;
+    mutable QScopedPointer<QFile> _lazyFile;
+
+    QVector<QVariantTreeElementContainer*> m_containers;
+    QList<QVariantTreeObserver*> m_observers;
 };
 
 #endif // QVARIANTTREE_H
@@ -7,8 +7,44 @@ CONFIG += static
 
 SOURCES += \
     qvarianttree.cpp \
-    qvarianttreeelement.cpp
+    qvarianttreeelement.cpp \
+    qvarianttreetransaction.cpp \
+    qvarianttreerecordreader.cpp \
+    qvarianttreerecordindex.cpp \
+    qvarianttreecontainer.cpp \
+    qvarianttreecompressed.cpp \
+    qvarianttreejournal.cpp \
+    qvarianttreehistory.cpp \
+    qvarianttreepersistent.cpp \
+    qvarianttreeflat.cpp \
+    qvarianttreesearch.cpp \
+    qvarianttreeobserver.cpp \
+    qvarianttreekeyindex.cpp \
+    qvarianttreetextindex.cpp \
+    qvarianttreequery.cpp \
+    qvarianttreediff.cpp \
+    qvarianttreehashcache.cpp \
+    qvarianttreesizecache.cpp \
+    qvarianttreeworkers.cpp
 
 HEADERS  += \
     qvarianttree.h \
-    qvarianttreeelement.h
+    qvarianttreeelement.h \
+    qvarianttreetransaction.h \
+    qvarianttreerecordreader.h \
+    qvarianttreerecordindex.h \
+    qvarianttreecontainer.h \
+    qvarianttreecompressed.h \
+    qvarianttreejournal.h \
+    qvarianttreehistory.h \
+    qvarianttreepersistent.h \
+    qvarianttreeflat.h \
+    qvarianttreesearch.h \
+    qvarianttreeobserver.h \
+    qvarianttreekeyindex.h \
+    qvarianttreetextindex.h \
+    qvarianttreequery.h \
+    qvarianttreediff.h \
+    qvarianttreehashcache.h \
+    qvarianttreesizecache.h \
+    qvarianttreeworkers.h
@@ -0,0 +1,319 @@
+#include "qvarianttreecompressed.h"
+
+#include <QIODevice>
+#include <QBuffer>
+#include <QRunnable>
+#include <QThread>
+#include <QtEndian>
+
+#include "qvarianttreerecordreader.h"
+
+#include <climits>
+
+
+namespace {
+
+/**
+ * @brief Compress one block of serialized records.
+ */
+class BlockCompressor : public QRunnable
+{
+public:
+    BlockCompressor(const QByteArray& raw, int level, QByteArray* output) :
+        _raw(raw), _level(level), _output(output) {}
+
+    void run() { *_output = qCompress(_raw, _level); }
+
+private:
+    const QByteArray& _raw;
+    int _level;
+    QByteArray* _output;
+};
+
+/**
+ * @brief Decompress and decode one block from the file content in memory,
+ * the content starts at the given device position.
+ */
+class BlockDecoder : public QRunnable
+{
+public:
+    BlockDecoder(const char* data, qint64 start,
+                 const QVariantTreeCompressed::Block& block,
+                 QVariantList* output) :
+        _data(data), _start(start), _block(block), _output(output) {}
+
+    void run()
+    {
+        QByteArray compressed = QByteArray::fromRawData(
+                    _data + (_block.offset - _start) + QVariantTreeCompressed::BlockHeaderSize,
+                    _block.size);
+        *_output = QVariantTreeCompressed::decodeBlock(compressed, _block.recordCount);
+    }
+
+private:
+    const char* _data;
+    qint64 _start;
+    QVariantTreeCompressed::Block _block;
+    QVariantList* _output;
+};
+
+}
+
+
+bool QVariantTreeCompressed::isCompressed(QIODevice* device)
+{
+    QByteArray magic = device->peek(sizeof(quint32));
+    if (magic.size() != sizeof(quint32))
+        return false;
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(magic.constData())) == Magic;
+}
+
+int QVariantTreeCompressed::readHeader(QDataStream& stream)
+{
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != Magic ||
+            version > Version || count > INT_MAX)
+        return -1;
+    return (int)count;
+}
+
+bool QVariantTreeCompressed::readIndex(QIODevice* device, QVector<Block>* blocks)
+{
+    Q_ASSERT_X(!device->isSequential(), "QVariantTreeCompressed", "cannot index a sequential device");
+
+    qint64 start = device->pos();
+    qint64 end = device->size();
+    if (end - start < HeaderSize + TrailerSize)
+        return false;
+
+    QDataStream stream(device);
+    int count = readHeader(stream);
+    if (count < 0 || !device->seek(end - TrailerSize))
+        return false;
+
+    qint64 indexOffset = 0;
+    quint32 trailerCount = 0;
+    quint32 trailerMagic = 0;
+    stream >> indexOffset >> trailerCount >> trailerMagic;
+    if (stream.status() != QDataStream::Ok || trailerMagic != Magic ||
+            trailerCount != (quint32)count ||
+            indexOffset < HeaderSize ||
+            start + indexOffset + (qint64)count * IndexBlockSize != end - TrailerSize ||
+            !device->seek(start + indexOffset))
+        return false;
+
+    QVector<Block> result;
+    result.reserve(count);
+    int firstRecord = 0;
+    for (int i=0; i<count; i++) {
+        Block block;
+        quint32 size = 0;
+        quint32 recordCount = 0;
+        stream >> block.offset >> size >> recordCount;
+        if (size > INT_MAX || recordCount > (quint32)(INT_MAX - firstRecord) ||
+                block.offset < HeaderSize ||
+                block.offset + BlockHeaderSize + size > indexOffset)
+            return false;
+        // device position, as the records of QVariantTreeContainer
+        block.offset += start;
+        block.size = (int)size;
+        block.firstRecord = firstRecord;
+        block.recordCount = (int)recordCount;
+        firstRecord += block.recordCount;
+        result.append(block);
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    device->seek(end);
+    *blocks = result;
+    return true;
+}
+
+int QVariantTreeCompressed::blockOf(const QVector<Block>& blocks, int record)
+{
+    int low = 0;
+    int high = blocks.count() - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const Block& block = blocks.at(middle);
+        if (record < block.firstRecord)
+            high = middle - 1;
+        else if (record >= block.firstRecord + block.recordCount)
+            low = middle + 1;
+        else
+            return middle;
+    }
+    return -1;
+}
+
+QVariantList QVariantTreeCompressed::readBlock(QIODevice* device, const Block& block)
+{
+    if (!device->seek(block.offset + BlockHeaderSize))
+        return QVariantList();
+    return decodeBlock(device->read(block.size), block.recordCount);
+}
+
+QVariantList QVariantTreeCompressed::decodeBlock(const QByteArray& data, int recordCount)
+{
+    QVariantList records;
+    QByteArray raw = qUncompress(data);
+    QBuffer buffer(&raw);
+    buffer.open(QIODevice::ReadOnly);
+
+    QDataStream stream(&buffer);
+    records.reserve(recordCount);
+    for (int i=0; i<recordCount; i++) {
+        QVariant record;
+        stream >> record;
+        if (stream.status() != QDataStream::Ok)
+            break;
+        records.append(record);
+    }
+    return records;
+}
+
+QVariantList QVariantTreeCompressed::read(QIODevice* device, int workerCount)
+{
+    QVariantList list;
+    qint64 start = device->pos();
+
+    // no footer: block after block
+    QVector<Block> blocks;
+    if (device->isSequential() || !readIndex(device, &blocks)) {
+        if (!device->isSequential())
+            device->seek(start);
+        QVariantTreeRecordReader reader(device);
+        while (reader.readNext())
+            list << reader.record();
+        return list;
+    }
+
+    if (workerCount <= 0)
+        workerCount = QThread::idealThreadCount();
+
+    // compressed content is small enough to be read at once
+    device->seek(start);
+    QByteArray content = device->readAll();
+
+    QVector<QVariantList> decoded(blocks.count());
+    {
+        QThreadPool pool;
+        pool.setMaxThreadCount(workerCount);
+        for (int i=0; i<blocks.count(); i++)
+            pool.start(new BlockDecoder(content.constData(), start, blocks.at(i), &decoded[i]));
+        pool.waitForDone();
+    }
+
+    if (!blocks.isEmpty())
+        list.reserve(blocks.last().firstRecord + blocks.last().recordCount);
+    for (int i=0; i<decoded.count(); i++)
+        list.append(decoded.at(i));
+    return list;
+}
+
+//==============================================================================
+
+QVariantTreeCompressedWriter::QVariantTreeCompressedWriter(QIODevice* device,
+                                                           int workerCount,
+                                                           int compressionLevel) :
+    _device(device),
+    _stream(device),
+    _start(device->pos()),
+    _workerCount(workerCount > 0 ? workerCount : QThread::idealThreadCount()),
+    _compressionLevel(compressionLevel),
+    _pool(),
+    _raw(),
+    _rawRecords(0),
+    _pending(),
+    _pendingRecords(),
+    _blocks(),
+    _recordCount(0)
+{
+    Q_ASSERT_X(!device->isSequential(), "QVariantTreeCompressedWriter", "cannot write a sequential device");
+    _pool.setMaxThreadCount(_workerCount);
+
+    // block count completed by finish()
+    _stream << QVariantTreeCompressed::Magic
+            << QVariantTreeCompressed::Version
+            << (quint32)0;
+}
+
+void QVariantTreeCompressedWriter::write(const QVariant& record)
+{
+    {
+        QBuffer buffer(&_raw);
+        buffer.open(QIODevice::WriteOnly | QIODevice::Append);
+        QDataStream stream(&buffer);
+        stream << record;
+    }
+    _rawRecords++;
+
+    if (_raw.size() >= QVariantTreeCompressed::BlockRawSize)
+        closeBlock();
+}
+
+bool QVariantTreeCompressedWriter::finish()
+{
+    closeBlock();
+    flushBlocks();
+
+    qint64 indexOffset = _device->pos() - _start;
+    for (int i=0; i<_blocks.count(); i++) {
+        const QVariantTreeCompressed::Block& block = _blocks.at(i);
+        _stream << block.offset << (quint32)block.size << (quint32)block.recordCount;
+    }
+    _stream << indexOffset
+            << (quint32)_blocks.count()
+            << QVariantTreeCompressed::Magic;
+
+    qint64 end = _device->pos();
+    if (!_device->seek(_start + 2 * sizeof(quint32)))
+        return false;
+    _stream << (quint32)_blocks.count();
+    _device->seek(end);
+
+    return _stream.status() == QDataStream::Ok;
+}
+
+void QVariantTreeCompressedWriter::closeBlock()
+{
+    if (_rawRecords == 0)
+        return;
+
+    _pending.append(_raw);
+    _pendingRecords.append(_rawRecords);
+    _raw.clear();
+    _rawRecords = 0;
+
+    if (_pending.count() >= _workerCount)
+        flushBlocks();
+}
+
+void QVariantTreeCompressedWriter::flushBlocks()
+{
+    QVector<QByteArray> compressed(_pending.count());
+    for (int i=0; i<_pending.count(); i++)
+        _pool.start(new BlockCompressor(_pending.at(i), _compressionLevel, &compressed[i]));
+    _pool.waitForDone();
+
+    // written in order, whatever the compression order
+    for (int i=0; i<compressed.count(); i++) {
+        QVariantTreeCompressed::Block block;
+        block.offset = _device->pos() - _start;
+        block.size = compressed.at(i).size();
+        block.firstRecord = _recordCount;
+        block.recordCount = _pendingRecords.at(i);
+        _stream << (quint32)block.size << (quint32)block.recordCount;
+        _stream.writeRawData(compressed.at(i).constData(), block.size);
+
+        _blocks.append(block);
+        _recordCount += block.recordCount;
+    }
+
+    _pending.clear();
+    _pendingRecords.clear();
+}
@@ -0,0 +1,124 @@
+#ifndef QVARIANTTREECOMPRESSED_H
+#define QVARIANTTREECOMPRESSED_H
+
+#include <QVariant>
+#include <QVector>
+#include <QDataStream>
+#include <QThreadPool>
+
+class QIODevice;
+
+
+/**
+ * @brief Block-compressed layout of a QVariant file.
+ * A header with the block count, then the blocks: each one is a size, a
+ * record count and the qCompress() of consecutive records as written by
+ * QDataStream. A footer index of the blocks ends with a fixed size trailer,
+ * so a single block can be found and decompressed for random access.
+ * Offsets are relative to the start of the header.
+ */
+class QVariantTreeCompressed
+{
+public:
+    static const quint32 Magic = 0x5156545A; // "QVTZ"
+    static const quint32 Version = 1;
+    static const int HeaderSize = 12;       // magic, version, block count
+    static const int BlockHeaderSize = 8;   // compressed size, record count
+    static const int IndexBlockSize = 16;   // offset, compressed size, record count
+    static const int TrailerSize = 16;      // index offset, block count, magic
+    static const int BlockRawSize = 64 * 1024;
+
+    struct Block {
+        qint64 offset; // of the block header, in the device
+        int size;      // compressed data, without the block header
+        int firstRecord;
+        int recordCount;
+    };
+
+    /**
+     * @brief Check the header at the current position, without reading it.
+     */
+    static bool isCompressed(QIODevice* device);
+    /**
+     * @brief Read the header.
+     * @return The block count, -1 if not a compressed file.
+     */
+    static int readHeader(QDataStream& stream);
+    /**
+     * @brief Read the footer index of the file at the current position.
+     * The device must not be sequential.
+     * @return False if there is no valid footer.
+     */
+    static bool readIndex(QIODevice* device, QVector<Block>* blocks);
+    /**
+     * @brief Find the block holding the given record.
+     * @return The block index, -1 if out of range.
+     */
+    static int blockOf(const QVector<Block>& blocks, int record);
+
+    /**
+     * @brief Read and decompress a single block.
+     */
+    static QVariantList readBlock(QIODevice* device, const Block& block);
+    /**
+     * @brief Decompress the records of a block data.
+     */
+    static QVariantList decodeBlock(const QByteArray& data, int recordCount);
+
+    /**
+     * @brief Read all the records, blocks are decompressed on a thread pool.
+     * Without a valid footer, the blocks are read one after the other.
+     * @param workerCount Number of threads, <= 0 for the ideal count
+     */
+    static QVariantList read(QIODevice* device, int workerCount = 0);
+};
+
+//==============================================================================
+
+/**
+ * @brief Write records into a block-compressed file, one at a time.
+ * Full blocks are compressed on a thread pool, then written in order.
+ * The device must not be sequential: the header is completed at the end.
+ */
+class QVariantTreeCompressedWriter
+{
+public:
+    /**
+     * @param workerCount Number of threads, <= 0 for the ideal count
+     * @param compressionLevel zlib level, -1 for the default one
+     */
+    explicit QVariantTreeCompressedWriter(QIODevice* device,
+                                          int workerCount = 0,
+                                          int compressionLevel = -1);
+
+    void write(const QVariant& record);
+    /**
+     * @brief Write the last blocks and the footer index, complete the header.
+     * @return False if the device failed.
+     */
+    bool finish();
+
+private:
+    void closeBlock();
+    void flushBlocks();
+
+private:
+    QIODevice* _device;
+    QDataStream _stream;
+    qint64 _start;
+    int _workerCount;
+    int _compressionLevel;
+    QThreadPool _pool;
+
+    QByteArray _raw;
+    int _rawRecords;
+
+    /** @brief Closed blocks, compressed by waves of one per worker. */
+    QVector<QByteArray> _pending;
+    QVector<int> _pendingRecords;
+
+    QVector<QVariantTreeCompressed::Block> _blocks;
+    int _recordCount;
+};
+
+#endif // QVARIANTTREECOMPRESSED_H
@@ -0,0 +1,115 @@
+#include "qvarianttreecontainer.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+#include <climits>
+
+
+bool QVariantTreeContainer::isContainer(QIODevice* device)
+{
+    QByteArray magic = device->peek(sizeof(quint32));
+    if (magic.size() != sizeof(quint32))
+        return false;
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(magic.constData())) == Magic;
+}
+
+int QVariantTreeContainer::readHeader(QDataStream& stream)
+{
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != Magic ||
+            version > Version || count > INT_MAX)
+        return -1;
+    return (int)count;
+}
+
+bool QVariantTreeContainer::readIndex(QIODevice* device, QVariantTreeRecordIndex* index)
+{
+    Q_ASSERT_X(!device->isSequential(), "QVariantTreeContainer", "cannot index a sequential device");
+
+    qint64 start = device->pos();
+    qint64 end = device->size();
+    if (end - start < HeaderSize + TrailerSize)
+        return false;
+
+    QDataStream stream(device);
+    int count = readHeader(stream);
+    if (count < 0 || !device->seek(end - TrailerSize))
+        return false;
+
+    qint64 indexOffset = 0;
+    quint32 trailerCount = 0;
+    quint32 trailerMagic = 0;
+    stream >> indexOffset >> trailerCount >> trailerMagic;
+    if (stream.status() != QDataStream::Ok || trailerMagic != Magic ||
+            trailerCount != (quint32)count ||
+            indexOffset < HeaderSize ||
+            start + indexOffset + (qint64)count * IndexRecordSize != end - TrailerSize ||
+            !device->seek(start + indexOffset))
+        return false;
+
+    QVariantTreeRecordIndex result;
+    for (int i=0; i<count; i++) {
+        QVariantTreeRecordIndex::Record record;
+        quint32 type = 0;
+        stream >> record.offset >> record.size >> type;
+        record.offset += start;
+        record.type = type;
+        result.append(record);
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    device->seek(end);
+    *index = result;
+    return true;
+}
+
+//==============================================================================
+
+QVariantTreeContainerWriter::QVariantTreeContainerWriter(QIODevice* device) :
+    _device(device),
+    _stream(device),
+    _start(device->pos()),
+    _index()
+{
+    Q_ASSERT_X(!device->isSequential(), "QVariantTreeContainerWriter", "cannot write a sequential device");
+
+    // count completed by finish()
+    _stream << QVariantTreeContainer::Magic
+            << QVariantTreeContainer::Version
+            << (quint32)0;
+}
+
+void QVariantTreeContainerWriter::write(const QVariant& record)
+{
+    QVariantTreeRecordIndex::Record entry;
+    entry.offset = _device->pos() - _start;
+    entry.type = record.userType();
+    _stream << record;
+    entry.size = _device->pos() - _start - entry.offset;
+    _index.append(entry);
+}
+
+bool QVariantTreeContainerWriter::finish()
+{
+    qint64 indexOffset = _device->pos() - _start;
+    for (int i=0; i<_index.count(); i++) {
+        QVariantTreeRecordIndex::Record entry = _index.record(i);
+        _stream << entry.offset << entry.size << (quint32)entry.type;
+    }
+    _stream << indexOffset
+            << (quint32)_index.count()
+            << QVariantTreeContainer::Magic;
+
+    qint64 end = _device->pos();
+    if (!_device->seek(_start + 2 * sizeof(quint32)))
+        return false;
+    _stream << (quint32)_index.count();
+    _device->seek(end);
+
+    return _stream.status() == QDataStream::Ok;
+}
@@ -0,0 +1,71 @@
+#ifndef QVARIANTTREECONTAINER_H
+#define QVARIANTTREECONTAINER_H
+
+#include <QVariant>
+#include <QDataStream>
+
+#include "qvarianttreerecordindex.h"
+
+class QIODevice;
+
+
+/**
+ * @brief Random-access layout of a QVariant file.
+ * A header with the record count, the records as written by QDataStream,
+ * then a footer index of the records offset, size and type. The footer
+ * ends with a fixed size trailer, so the index is found from the end of
+ * the file with a single seek.
+ * Offsets are relative to the start of the header.
+ */
+class QVariantTreeContainer
+{
+public:
+    static const quint32 Magic = 0x51565443; // "QVTC"
+    static const quint32 Version = 1;
+    static const int HeaderSize = 12;       // magic, version, count
+    static const int IndexRecordSize = 20;  // offset, size, type
+    static const int TrailerSize = 16;      // index offset, count, magic
+
+    /**
+     * @brief Check the header at the current position, without reading it.
+     */
+    static bool isContainer(QIODevice* device);
+    /**
+     * @brief Read the header.
+     * @return The record count, -1 if not a container.
+     */
+    static int readHeader(QDataStream& stream);
+    /**
+     * @brief Read the footer index of the container at the current position.
+     * The device must not be sequential. On success, the device is at its end.
+     * @return False if there is no valid footer.
+     */
+    static bool readIndex(QIODevice* device, QVariantTreeRecordIndex* index);
+};
+
+//==============================================================================
+
+/**
+ * @brief Write records into a container, one at a time.
+ * The device must not be sequential: the header is completed at the end.
+ */
+class QVariantTreeContainerWriter
+{
+public:
+    explicit QVariantTreeContainerWriter(QIODevice* device);
+
+    void write(const QVariant& record);
+    /**
+     * @brief Write the footer index and complete the header.
+     * @return False if the device failed.
+     */
+    bool finish();
+
+private:
+    QIODevice* _device;
+    QDataStream _stream;
+    qint64 _start;
+    QVariantTreeRecordIndex _index;
+};
+
+#endif // QVARIANTTREECONTAINER_H
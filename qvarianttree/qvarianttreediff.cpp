@@ -0,0 +1,271 @@
+#include "qvarianttreediff.h"
+
+#include <string.h>
+
+#include <QRunnable>
+#include <QDataStream>
+#include <QHash>
+
+#include "qvarianttree.h"
+#include "qvarianttreeworkers.h"
+
+
+namespace {
+
+// splitmix64 finalizer
+quint64 mix(quint64 value)
+{
+    value ^= value >> 30;
+    value *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+    value ^= value >> 27;
+    value *= Q_UINT64_C(0x94d049bb133111eb);
+    value ^= value >> 31;
+    return value;
+}
+
+quint64 combine(quint64 seed, quint64 value)
+{
+    return mix(seed ^ (value + Q_UINT64_C(0x9e3779b97f4a7c15) + (seed << 6) + (seed >> 2)));
+}
+
+quint64 textHash(const QString& text)
+{
+    return ((quint64)qHash(text, 0x243f6a88) << 32) | qHash(text, 0x85a308d3);
+}
+
+}
+
+/**
+ * @brief Hash the subtrees of a range of top-level keys.
+ */
+class QVariantTreeDiff::HashChunk : public QRunnable
+{
+public:
+    HashChunk(const QVariantTree& tree,
+              const QVariant& root,
+              const QVariantList& keys,
+              Hash* items,
+              const QAtomicInt* cancelled) :
+        _tree(tree), _root(root), _keys(keys),
+        _items(items), _cancelled(cancelled) {}
+
+    void run()
+    {
+        QVariantTreeElementContainer* container = _tree.containerOf(_root.userType());
+        for (int i=0; i<_keys.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+            _items[i] = QVariantTreeDiff::hash(_tree, container->item(_root, _keys.at(i)));
+            _items[i].key = QVariantTreeDiff::keyHash(_keys.at(i));
+        }
+    }
+
+private:
+    const QVariantTree& _tree;
+    QVariant _root;
+    QVariantList _keys;
+    Hash* _items;
+    const QAtomicInt* _cancelled;
+};
+
+//==============================================================================
+
+quint64 QVariantTreeDiff::leafHash(const QVariant& value)
+{
+    quint64 result = 0;
+    switch (value.userType()) {
+    case QVariant::Invalid:
+        break;
+    case QVariant::Bool:
+    case QVariant::Int:
+    case QVariant::LongLong:
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        result = mix(value.toULongLong());
+        break;
+    case QVariant::Double: {
+        double real = value.toDouble();
+        memcpy(&result, &real, sizeof(result));
+        result = mix(result);
+        break;
+    }
+    case QVariant::String:
+        result = textHash(value.toString());
+        break;
+    default: {
+        // other types are compared by their serialization
+        QByteArray bytes;
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream << value;
+        result = ((quint64)qHash(bytes, 0x243f6a88) << 32) | qHash(bytes, 0x85a308d3);
+        break;
+    }
+    }
+    return combine(value.userType(), result);
+}
+
+quint64 QVariantTreeDiff::keyHash(const QVariant& key)
+{
+    if (key.userType() == QVariant::Int)
+        return mix((quint64)key.toInt());
+    return textHash(key.toString());
+}
+
+quint64 QVariantTreeDiff::itemHash(const Hash& item)
+{
+    return combine(item.key, item.value);
+}
+
+quint64 QVariantTreeDiff::containerHash(uint type, int count, quint64 itemsSum)
+{
+    return combine(combine(type, count), itemsSum);
+}
+
+void QVariantTreeDiff::sumItems(const QVariant& value, Hash& result)
+{
+    // a sum does not depend on the order of the items
+    result.itemsSum = 0;
+    for (int i=0; i<result.items.count(); i++)
+        result.itemsSum += itemHash(result.items.at(i));
+    result.value = containerHash(value.userType(), result.items.count(), result.itemsSum);
+}
+
+QVariantTreeDiff::Hash QVariantTreeDiff::hash(const QVariantTree& tree, const QVariant& value)
+{
+    Hash result;
+    QVariantTreeElementContainer* container = tree.containerOf(value.userType());
+    if (!container) {
+        result.value = leafHash(value);
+        return result;
+    }
+
+    QVariantList keys = container->keys(value);
+    result.items.resize(keys.count());
+    for (int i=0; i<keys.count(); i++) {
+        result.items[i] = hash(tree, container->item(value, keys.at(i)));
+        result.items[i].key = keyHash(keys.at(i));
+    }
+    sumItems(value, result);
+    indexItems(result, container->isList());
+    return result;
+}
+
+QVariantTreeDiff::Hash QVariantTreeDiff::hashParallel(const QVariantTree& tree, const QVariant& value,
+                                                      int workerCount,
+                                                      const QAtomicInt* cancelled)
+{
+    workerCount = QVariantTreeWorkers::threadCount(workerCount);
+
+    QVariantTreeElementContainer* container = tree.containerOf(value.userType());
+    if (!container || workerCount <= 1)
+        return hash(tree, value);
+
+    Hash result;
+    QVariantList keys = container->keys(value);
+    result.items.resize(keys.count());
+    QVariantTreeWorkers workers(workerCount, keys.count());
+    for (int i=0; i<workers.chunkCount(); i++)
+        workers.start(new HashChunk(tree, value, keys.mid(workers.chunkStart(i), workers.chunkSize()),
+                                    result.items.data() + workers.chunkStart(i), cancelled));
+    workers.waitForDone();
+    sumItems(value, result);
+    indexItems(result, container->isList());
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+QList<QVariantTreeDiff::Difference> QVariantTreeDiff::compare(const QVariantTree& tree,
+                                                              const QVariant& before,
+                                                              const QVariant& after,
+                                                              int workerCount,
+                                                              const QAtomicInt* cancelled)
+{
+    QList<Difference> result;
+
+    // both sides share the pool size, one after the other
+    Hash beforeHash = hashParallel(tree, before, workerCount, cancelled);
+    Hash afterHash = hashParallel(tree, after, workerCount, cancelled);
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        return result;
+
+    QVariantList address;
+    compareNodes(tree, before, beforeHash, after, afterHash, address, result, cancelled);
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        result.clear();
+    return result;
+}
+
+void QVariantTreeDiff::compareNodes(const QVariantTree& tree,
+                                    const QVariant& before, const Hash& beforeHash,
+                                    const QVariant& after, const Hash& afterHash,
+                                    QVariantList& address, QList<Difference>& differences,
+                                    const QAtomicInt* cancelled)
+{
+    if (beforeHash.value == afterHash.value || QVariantTreeWorkers::isCancelled(cancelled))
+        return;
+
+    Difference difference;
+    difference.type = Changed;
+    difference.address = address;
+
+    QVariantTreeElementContainer* container = tree.containerOf(before.userType());
+    if (!container || before.userType() != after.userType()) {
+        differences.append(difference);
+        return;
+    }
+
+    QVariantList beforeKeys = container->keys(before);
+    QVariantList afterKeys = container->keys(after);
+    if (container->isList()) {
+        // by position, the tail is added or removed
+        int common = qMin(beforeKeys.count(), afterKeys.count());
+        for (int i=0; i<common; i++) {
+            address.append(i);
+            compareNodes(tree, container->item(before, i), beforeHash.items.at(i),
+                         container->item(after, i), afterHash.items.at(i),
+                         address, differences, cancelled);
+            address.removeLast();
+        }
+        difference.type = beforeKeys.count() > common ? Removed : Added;
+        int count = qMax(beforeKeys.count(), afterKeys.count());
+        for (int i=common; i<count; i++) {
+            difference.address = address;
+            difference.address.append(i);
+            differences.append(difference);
+        }
+        return;
+    }
+
+    // only the keys of a differing node are indexed
+    QHash<QString, int> afterIndexes;
+    afterIndexes.reserve(afterKeys.count());
+    for (int i=0; i<afterKeys.count(); i++)
+        afterIndexes.insert(afterKeys.at(i).toString(), i);
+
+    QVector<bool> isMatched(afterKeys.count(), false);
+    for (int i=0; i<beforeKeys.count(); i++) {
+        const QVariant& key = beforeKeys.at(i);
+        QHash<QString, int>::const_iterator it = afterIndexes.constFind(key.toString());
+        address.append(key);
+        if (it == afterIndexes.constEnd()) {
+            difference.type = Removed;
+            difference.address = address;
+            differences.append(difference);
+        }
+        else {
+            isMatched[it.value()] = true;
+            compareNodes(tree, container->item(before, key), beforeHash.items.at(i),
+                         container->item(after, key), afterHash.items.at(it.value()),
+                         address, differences, cancelled);
+        }
+        address.removeLast();
+    }
+
+    difference.type = Added;
+    for (int i=0; i<afterKeys.count(); i++) {
+        if (isMatched.at(i))
+            continue;
+        difference.address = address;
+        difference.address.append(afterKeys.at(i));
+        differences.append(difference);
+    }
+}
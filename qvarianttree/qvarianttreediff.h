@@ -0,0 +1,189 @@
+#ifndef QVARIANTTREEDIFF_H
+#define QVARIANTTREEDIFF_H
+
+#include <QVariant>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QAtomicInt>
+
+class QVariantTree;
+
+
+/**
+ * @brief Structural difference between two root contents.
+ * Each side is first hashed bottom-up, the top-level items in parallel.
+ * The comparison then walks both sides together and skips the subtrees of
+ * equal hashes, so only the changed paths are visited.
+ * List items are compared by index, map and hash items by key. Equal hashes
+ * are taken as equal subtrees: 64 bits make a collision unlikely.
+ * @code
+ * QList<QVariantTreeDiff::Difference> differences =
+ *         QVariantTreeDiff::compare(tree, yesterday, today);
+ * @endcode
+ */
+class QVariantTreeDiff
+{
+public:
+    enum Type {
+        Added,   // only in the second content
+        Removed, // only in the first content
+        Changed  // another value or type
+    };
+
+    struct Difference
+    {
+        Type type;
+        QVariantList address;
+    };
+
+    /**
+     * @brief Hash of a subtree and of each of its items, in keys() order.
+     * A container hash only depends on its type, its size and the sum of
+     * its item hashes: an edited item updates it without the others.
+     * The edits of a cache may reorder the items of a map or a hash.
+     */
+    struct Hash
+    {
+        quint64 value;
+        quint64 key;      // hash of the key in the parent, 0 for a root
+        quint64 itemsSum; // sum of the item hashes of a container
+        QVector<Hash> items;
+        QHash<quint64, int> positions; // see indexItems()
+
+        Hash() : value(0), key(0), itemsSum(0) {}
+    };
+
+    // a map or a hash with more items gets a table of their positions
+    static const int IndexedItems = 16;
+
+    /**
+     * @brief Differences between two contents, with the containers of the tree.
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param cancelled Flag to stop the comparison, set from any thread
+     * @return The differences in depth-first order, nothing below a changed node
+     */
+    static QList<Difference> compare(const QVariantTree& tree,
+                                     const QVariant& before,
+                                     const QVariant& after,
+                                     int workerCount = 0,
+                                     const QAtomicInt* cancelled = NULL);
+
+    /**
+     * @brief Hash a subtree, in the calling thread.
+     * Each item is hashed with its key: maps and hashes do not depend on the
+     * order of their items, lists do.
+     */
+    static Hash hash(const QVariantTree& tree, const QVariant& value);
+    /**
+     * @brief Hash a subtree, the top-level items from a thread pool.
+     */
+    static Hash hashParallel(const QVariantTree& tree, const QVariant& value,
+                             int workerCount = 0,
+                             const QAtomicInt* cancelled = NULL);
+
+    // hash of a key, list indexes included
+    static quint64 keyHash(const QVariant& key);
+    // contribution of an item to the sum of its container
+    static quint64 itemHash(const Hash& item);
+    static quint64 containerHash(uint type, int count, quint64 itemsSum);
+
+    /**
+     * @brief Position of an item of a cached node, -1 if missing.
+     * The node is a Hash or any struct with the same items, key and
+     * positions members. List items are at their index, the items of a
+     * large map or hash are looked up by key hash in their table, the
+     * items of a small one are scanned.
+     */
+    template<typename Node>
+    static int itemOf(const Node& node, const QVariant& key, quint64 keyHash);
+    /**
+     * @brief Fill the positions table of a map or a hash of more than
+     * IndexedItems items, lists are never indexed.
+     */
+    template<typename Node>
+    static void indexItems(Node& node, bool isList);
+    // add or remove an item of a cached node, keeping its table
+    // the last item of a map or a hash takes the place of a removed one
+    template<typename Node>
+    static void appendItem(Node& node, const Node& item, bool isList);
+    template<typename Node>
+    static void removeItem(Node& node, int position, bool isList);
+
+private:
+    class HashChunk;
+
+    static quint64 leafHash(const QVariant& value);
+    static void sumItems(const QVariant& value, Hash& result);
+    static void compareNodes(const QVariantTree& tree,
+                             const QVariant& before, const Hash& beforeHash,
+                             const QVariant& after, const Hash& afterHash,
+                             QVariantList& address, QList<Difference>& differences,
+                             const QAtomicInt* cancelled);
+};
+
+//==============================================================================
+
+template<typename Node>
+int QVariantTreeDiff::itemOf(const Node& node, const QVariant& key, quint64 keyHash)
+{
+    if (!node.positions.isEmpty())
+        return node.positions.value(keyHash, -1);
+
+    // list items are at their index
+    if (key.userType() == QVariant::Int) {
+        int index = key.toInt();
+        if (index >= 0 && index < node.items.count() && node.items.at(index).key == keyHash)
+            return index;
+    }
+
+    // a larger node without a table is a list
+    if (node.items.count() > IndexedItems)
+        return -1;
+    for (int i=0; i<node.items.count(); i++) {
+        if (node.items.at(i).key == keyHash)
+            return i;
+    }
+    return -1;
+}
+
+template<typename Node>
+void QVariantTreeDiff::indexItems(Node& node, bool isList)
+{
+    node.positions.clear();
+    if (isList || node.items.count() <= IndexedItems)
+        return;
+    node.positions.reserve(node.items.count());
+    for (int i=0; i<node.items.count(); i++)
+        node.positions.insert(node.items.at(i).key, i);
+}
+
+template<typename Node>
+void QVariantTreeDiff::appendItem(Node& node, const Node& item, bool isList)
+{
+    node.items.append(item);
+    if (!node.positions.isEmpty())
+        node.positions.insert(item.key, node.items.count()-1);
+    else if (!isList && node.items.count() > IndexedItems)
+        indexItems(node, isList);
+}
+
+template<typename Node>
+void QVariantTreeDiff::removeItem(Node& node, int position, bool isList)
+{
+    if (isList || node.positions.isEmpty()) {
+        node.items.remove(position);
+        return;
+    }
+
+    // the order of keyed items does not matter
+    int last = node.items.count()-1;
+    node.positions.remove(node.items.at(position).key);
+    if (position != last) {
+        node.items[position] = node.items.at(last);
+        node.positions.insert(node.items.at(position).key, position);
+    }
+    node.items.remove(last);
+}
+
+#endif // QVARIANTTREEDIFF_H
@@ -1,6 +1,41 @@
 #include "qvarianttreeelement.h"
 
 
+bool QVariantTreeElementContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    return keys(content).contains(key);
+}
+
+int QVariantTreeElementContainer::size(const QVariant& content) const
+{
+    return keys(content).count();
+}
+
+bool QVariantTreeElementContainer::isList() const
+{
+    return false;
+}
+
+QVariant* QVariantTreeElementContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    Q_UNUSED(content)
+    Q_UNUSED(key)
+    return NULL;
+}
+
+void QVariantTreeElementContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    content = delItem(content, key);
+}
+
+bool QVariantTreeElementContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    content = setItem(content, key, value);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
 QVariantList QVariantTreeElementContainer::fromSize(const int size)
 {
     QVariantList listKeys;
@@ -23,7 +58,77 @@ QVariantList QVariantTreeElementContainer::fromStringList(const QStringList& lis
 
 QVariantList QVariantTreeListContainer::keys(const QVariant& content) const
 {
-    return fromSize(content.toList().count());
+    return fromSize(size(content));
+}
+
+bool QVariantTreeListContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    bool isIndex = false;
+    int index = key.toInt(&isIndex);
+    return isIndex && index >= 0 && index < size(content);
+}
+
+int QVariantTreeListContainer::size(const QVariant& content) const
+{
+    // avoid converting a string list into a variant list only to count it
+    if (content.type() == QVariant::StringList)
+        return content.toStringList().count();
+    return content.toList().count();
+}
+
+bool QVariantTreeListContainer::isList() const
+{
+    return true;
+}
+
+QVariant* QVariantTreeListContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    // a string list doesn't hold variants
+    if (content.type() != QVariant::List)
+        return NULL;
+
+    QVariantList* listContent = static_cast<QVariantList*>(content.data());
+    int index = key.toInt();
+    if (index >= 0 && index < listContent->count())
+        return &(*listContent)[index];
+    return NULL;
+}
+
+void QVariantTreeListContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    if (content.type() != QVariant::List) {
+        content = delItem(content, key);
+        return;
+    }
+
+    QVariantList* listContent = static_cast<QVariantList*>(content.data());
+    int index = key.toInt();
+    if (index >= 0 && index < listContent->count())
+        listContent->removeAt(index);
+}
+
+bool QVariantTreeListContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    bool isIndex = false;
+    int index = key.toInt(&isIndex);
+    // inserting at the size appends the item
+    if (!isIndex || index < 0 || index > size(content))
+        return false;
+
+    if (content.type() == QVariant::List) {
+        static_cast<QVariantList*>(content.data())->insert(index, value);
+    }
+    else if (content.type() == QVariant::StringList) {
+        QStringList listContent = content.toStringList();
+        listContent.insert(index, value.toString());
+        content = listContent;
+    }
+    else {
+        QVariantList listContent = content.toList();
+        listContent.insert(index, value);
+        content = listContent;
+    }
+    return true;
 }
 
 QVariant QVariantTreeListContainer::item(const QVariant& content, const QVariant& key, const QVariant& defaultValue) const
@@ -56,6 +161,54 @@ QVariantList QVariantTreeMapContainer::keys(const QVariant& content) const
     return fromStringList(content.toMap().keys());
 }
 
+bool QVariantTreeMapContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    return content.toMap().contains(key.toString());
+}
+
+int QVariantTreeMapContainer::size(const QVariant& content) const
+{
+    return content.toMap().count();
+}
+
+bool QVariantTreeMapContainer::isList() const
+{
+    return false;
+}
+
+QVariant* QVariantTreeMapContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    if (content.type() != QVariant::Map)
+        return NULL;
+
+    QVariantMap* mapContent = static_cast<QVariantMap*>(content.data());
+    QVariantMap::iterator it = mapContent->find(key.toString());
+    if (it != mapContent->end())
+        return &it.value();
+    return NULL;
+}
+
+void QVariantTreeMapContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    if (content.type() != QVariant::Map) {
+        content = delItem(content, key);
+        return;
+    }
+
+    static_cast<QVariantMap*>(content.data())->remove(key.toString());
+}
+
+bool QVariantTreeMapContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    if (content.type() != QVariant::Map) {
+        content = setItem(content, key, value);
+        return true;
+    }
+
+    static_cast<QVariantMap*>(content.data())->insert(key.toString(), value);
+    return true;
+}
+
 QVariant QVariantTreeMapContainer::item(const QVariant& content, const QVariant& key, const QVariant& defaultValue) const
 {
     return content.toMap().value(key.toString(), defaultValue);
@@ -82,6 +235,54 @@ QVariantList QVariantTreeHashContainer::keys(const QVariant& content) const
     return fromStringList(content.toHash().keys());
 }
 
+bool QVariantTreeHashContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    return content.toHash().contains(key.toString());
+}
+
+int QVariantTreeHashContainer::size(const QVariant& content) const
+{
+    return content.toHash().count();
+}
+
+bool QVariantTreeHashContainer::isList() const
+{
+    return false;
+}
+
+QVariant* QVariantTreeHashContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    if (content.type() != QVariant::Hash)
+        return NULL;
+
+    QVariantHash* hashContent = static_cast<QVariantHash*>(content.data());
+    QVariantHash::iterator it = hashContent->find(key.toString());
+    if (it != hashContent->end())
+        return &it.value();
+    return NULL;
+}
+
+void QVariantTreeHashContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    if (content.type() != QVariant::Hash) {
+        content = delItem(content, key);
+        return;
+    }
+
+    static_cast<QVariantHash*>(content.data())->remove(key.toString());
+}
+
+bool QVariantTreeHashContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    if (content.type() != QVariant::Hash) {
+        content = setItem(content, key, value);
+        return true;
+    }
+
+    static_cast<QVariantHash*>(content.data())->insert(key.toString(), value);
+    return true;
+}
+
 QVariant QVariantTreeHashContainer::item(const QVariant& content, const QVariant& key, const QVariant& defaultValue) const
 {
     return content.toHash().value(key.toString(), defaultValue);
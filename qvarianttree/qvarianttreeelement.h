@@ -14,6 +14,20 @@ public:
     virtual QVariant setItem(const QVariant& content, const QVariant& key, const QVariant& value) const = 0;
     virtual QVariant delItem(const QVariant& content, const QVariant& key) const = 0;
 
+    // membership and size without building the list of keys
+    // default implementations fallback on keys(), containers should override them
+    virtual bool contains(const QVariant& content, const QVariant& key) const;
+    virtual int size(const QVariant& content) const;
+    // items keyed by their index, shifted by insertions and removals
+    virtual bool isList() const;
+
+    // in-place edition, the content is detached but not copied
+    // itemReference() returns NULL if the item cannot be reached by reference
+    virtual QVariant* itemReference(QVariant& content, const QVariant& key) const;
+    virtual void removeItem(QVariant& content, const QVariant& key) const;
+    // insert a new item, before the key for a list
+    virtual bool insertItem(QVariant& content, const QVariant& key, const QVariant& value) const;
+
 protected:
     static QVariantList fromSize(const int size);
     static QVariantList fromStringList(const QStringList& list);
@@ -29,6 +43,12 @@ class QVariantTree ## TYPE ## Container : public QVariantTreeElementContainer \
     QVariant item(const QVariant& content, const QVariant& key, const QVariant& defaultValue = QVariant()) const; \
     QVariant setItem(const QVariant& content, const QVariant& key, const QVariant& value) const; \
     QVariant delItem(const QVariant& content, const QVariant& key) const; \
+    bool contains(const QVariant& content, const QVariant& key) const; \
+    int size(const QVariant& content) const; \
+    bool isList() const; \
+    QVariant* itemReference(QVariant& content, const QVariant& key) const; \
+    void removeItem(QVariant& content, const QVariant& key) const; \
+    bool insertItem(QVariant& content, const QVariant& key, const QVariant& value) const; \
 };
 
 QVARIANTTREEELEMENTCONTAINER_IMPL(List)
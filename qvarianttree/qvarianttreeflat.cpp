@@ -0,0 +1,313 @@
+#include "qvarianttreeflat.h"
+
+#include <string.h>
+
+#include "qvarianttree.h"
+#include "qvarianttreeworkers.h"
+
+
+class QVariantTreeFlat::Builder
+{
+public:
+    Builder(const QVariantTree& tree, QVariantTreeFlat& flat, const QAtomicInt* cancelled) :
+        _tree(tree),
+        _flat(flat),
+        _cancelled(cancelled)
+    {
+    }
+
+    int append(const QVariant& value, int parent, const QVariant& key)
+    {
+        Node node;
+        memset(&node, 0, sizeof(Node));
+        node.type = value.userType();
+        node.parent = parent;
+        node.firstChild = -1;
+        node.nextSibling = -1;
+        setKey(node, key);
+
+        int index = _flat._nodes.count();
+        _flat._nodes.append(node);
+
+        QVariantTreeElementContainer* container = _tree.containerOf(node.type);
+        if (container) {
+            _flat._nodes[index].payload.variant = -1;
+            QVariantList keys = container->keys(value);
+            int previous = -1;
+            for (int i=0; i<keys.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+                int child = append(container->item(value, keys.at(i)), index, keys.at(i));
+                if (previous < 0)
+                    _flat._nodes[index].firstChild = child;
+                else
+                    _flat._nodes[previous].nextSibling = child;
+                previous = child;
+            }
+            _flat._nodes[index].childCount = keys.count();
+        }
+        else {
+            setPayload(_flat._nodes[index], value);
+        }
+
+        _flat._nodes[index].subtreeEnd = _flat._nodes.count();
+        return index;
+    }
+
+private:
+    void setKey(Node& node, const QVariant& key)
+    {
+        if (!key.isValid()) {
+            node.keyOffset = -1;
+            node.keyLength = -1;
+        }
+        else if (key.userType() == QVariant::Int) {
+            node.keyOffset = key.toInt();
+            node.keyLength = -1;
+        }
+        else {
+            // keys repeat across records, store each one once
+            QString text = key.toString();
+            QHash<QString, qint32>::const_iterator it = _keys.constFind(text);
+            if (it == _keys.constEnd())
+                it = _keys.insert(text, appendText(text));
+            node.keyOffset = it.value();
+            node.keyLength = text.length();
+        }
+    }
+
+    void setPayload(Node& node, const QVariant& value)
+    {
+        switch (value.userType()) {
+        case QVariant::Invalid:
+            break;
+        case QVariant::Bool:
+            node.payload.boolean = value.toBool();
+            break;
+        case QVariant::Int:
+        case QVariant::LongLong:
+            node.payload.integer = value.toLongLong();
+            break;
+        case QVariant::UInt:
+        case QVariant::ULongLong:
+            node.payload.unsignedInteger = value.toULongLong();
+            break;
+        case QVariant::Double:
+            node.payload.real = value.toDouble();
+            break;
+        case QVariant::String: {
+            QString text = value.toString();
+            node.payload.text.offset = appendText(text);
+            node.payload.text.length = text.length();
+            break;
+        }
+        default:
+            node.payload.variant = _flat._variants.count();
+            _flat._variants.append(value);
+            break;
+        }
+    }
+
+    qint32 appendText(const QString& text)
+    {
+        qint32 offset = _flat._arena.length();
+        _flat._arena.append(text);
+        return offset;
+    }
+
+private:
+    const QVariantTree& _tree;
+    QVariantTreeFlat& _flat;
+    const QAtomicInt* _cancelled;
+    QHash<QString, qint32> _keys;
+};
+
+//==============================================================================
+
+QVariantTreeFlat::QVariantTreeFlat() :
+    _nodes(),
+    _arena(),
+    _variants()
+{
+}
+
+QVariantTreeFlat QVariantTreeFlat::fromTree(const QVariantTree& tree)
+{
+    return fromVariant(tree, tree.rootContent());
+}
+
+QVariantTreeFlat QVariantTreeFlat::fromVariant(const QVariantTree& tree, const QVariant& root,
+                                               const QAtomicInt* cancelled)
+{
+    QVariantTreeFlat flat;
+    Builder builder(tree, flat, cancelled);
+    builder.append(root, -1, QVariant());
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        return QVariantTreeFlat();
+    flat._nodes.squeeze();
+    flat._arena.squeeze();
+    return flat;
+}
+
+//------------------------------------------------------------------------------
+
+QVariant QVariantTreeFlat::key(int index) const
+{
+    const Node& node = _nodes.at(index);
+    if (node.parent < 0)
+        return QVariant();
+    if (node.keyIsIndex())
+        return QVariant(node.keyOffset);
+    return arenaText(node.keyOffset, node.keyLength).toString();
+}
+
+QString QVariantTreeFlat::keyText(int index) const
+{
+    const Node& node = _nodes.at(index);
+    if (node.parent < 0)
+        return QString();
+    if (node.keyIsIndex())
+        return QString::number(node.keyOffset);
+    return arenaText(node.keyOffset, node.keyLength).toString();
+}
+
+QString QVariantTreeFlat::text(int index) const
+{
+    const Node& node = _nodes.at(index);
+    if (node.type != QVariant::String)
+        return QString();
+    return arenaText(node.payload.text.offset, node.payload.text.length).toString();
+}
+
+QVariant QVariantTreeFlat::value(int index) const
+{
+    const Node& node = _nodes.at(index);
+    switch (node.type) {
+    case QVariant::Invalid:
+        return QVariant();
+    case QVariant::Bool:
+        return QVariant(node.payload.boolean);
+    case QVariant::Int:
+        return QVariant((int)node.payload.integer);
+    case QVariant::LongLong:
+        return QVariant(node.payload.integer);
+    case QVariant::UInt:
+        return QVariant((uint)node.payload.unsignedInteger);
+    case QVariant::ULongLong:
+        return QVariant(node.payload.unsignedInteger);
+    case QVariant::Double:
+        return QVariant(node.payload.real);
+    case QVariant::String:
+        return QVariant(text(index));
+    default:
+        // containers have no payload
+        if (node.payload.variant < 0)
+            return QVariant();
+        return _variants.at(node.payload.variant);
+    }
+}
+
+bool QVariantTreeFlat::isContainer(int index) const
+{
+    const Node& node = _nodes.at(index);
+    switch (node.type) {
+    case QVariant::Invalid:
+    case QVariant::Bool:
+    case QVariant::Int:
+    case QVariant::LongLong:
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+    case QVariant::String:
+        return false;
+    default:
+        return node.payload.variant < 0;
+    }
+}
+
+QStringRef QVariantTreeFlat::keyRef(int index) const
+{
+    const Node& node = _nodes.at(index);
+    if (node.parent < 0 || node.keyIsIndex())
+        return QStringRef();
+    return arenaText(node.keyOffset, node.keyLength);
+}
+
+QStringRef QVariantTreeFlat::textRef(int index) const
+{
+    const Node& node = _nodes.at(index);
+    if (node.type != QVariant::String)
+        return QStringRef();
+    return arenaText(node.payload.text.offset, node.payload.text.length);
+}
+
+QVariantList QVariantTreeFlat::address(int index) const
+{
+    QVariantList result;
+    for (int i = index; i >= 0 && _nodes.at(i).parent >= 0; i = _nodes.at(i).parent)
+        result.prepend(key(i));
+    return result;
+}
+
+int QVariantTreeFlat::indexOf(const QVariantList& address) const
+{
+    if (_nodes.isEmpty())
+        return -1;
+
+    int index = 0;
+    for (int depth=0; depth<address.count(); depth++) {
+        const QVariant& key = address.at(depth);
+        int child = _nodes.at(index).firstChild;
+        while (child >= 0 && this->key(child) != key)
+            child = _nodes.at(child).nextSibling;
+        if (child < 0)
+            return -1;
+        index = child;
+    }
+    return index;
+}
+
+//------------------------------------------------------------------------------
+
+QHash<uint, int> QVariantTreeFlat::typeCounts() const
+{
+    QHash<uint, int> result;
+    const Node* node = _nodes.constData();
+    for (int i=0; i<_nodes.count(); i++)
+        result[node[i].type]++;
+    return result;
+}
+
+QVector<int> QVariantTreeFlat::findText(const QString& text, Qt::CaseSensitivity cs) const
+{
+    QVector<int> result;
+    // each distinct key is matched once
+    QHash<qint32, bool> keyMatches;
+
+    const Node* node = _nodes.constData();
+    for (int i=0; i<_nodes.count(); i++) {
+        bool match = false;
+        if (node[i].parent >= 0 && !node[i].keyIsIndex()) {
+            QHash<qint32, bool>::const_iterator it = keyMatches.constFind(node[i].keyOffset);
+            if (it == keyMatches.constEnd())
+                it = keyMatches.insert(node[i].keyOffset,
+                                       arenaText(node[i].keyOffset, node[i].keyLength).contains(text, cs));
+            match = it.value();
+        }
+        if (!match && node[i].type == QVariant::String)
+            match = arenaText(node[i].payload.text.offset, node[i].payload.text.length).contains(text, cs);
+        if (match)
+            result.append(i);
+    }
+    return result;
+}
+
+qint64 QVariantTreeFlat::memoryUsage() const
+{
+    return (qint64)_nodes.capacity() * sizeof(Node)
+            + (qint64)_arena.capacity() * sizeof(QChar)
+            + (qint64)_variants.capacity() * sizeof(QVariant);
+}
+
+QStringRef QVariantTreeFlat::arenaText(qint32 offset, qint32 length) const
+{
+    return QStringRef(&_arena, offset, length);
+}
@@ -0,0 +1,116 @@
+#ifndef QVARIANTTREEFLAT_H
+#define QVARIANTTREEFLAT_H
+
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+
+class QVariantTree;
+
+
+/**
+ * @brief Read-only flat copy of a tree, for whole-tree scans.
+ * Nodes are stored contiguously in depth-first order: the subtree of a node
+ * is the range [index, subtreeEnd). Scalar values are stored inline, keys
+ * and strings in a single arena with each distinct key stored once.
+ * The flat tree is a snapshot, the QVariant content stays the editable form.
+ * @code
+ * QVariantTreeFlat flat = QVariantTreeFlat::fromTree(tree);
+ * for (int i=0; i<flat.count(); i++)
+ *     if (flat.node(i).type == QVariant::String && flat.text(i).contains(text))
+ *         hits << flat.address(i);
+ * @endcode
+ */
+class QVariantTreeFlat
+{
+public:
+    struct Node
+    {
+        uint type;
+        qint32 parent;      // -1 for the root
+        qint32 firstChild;  // -1 for leaf values and empty containers
+        qint32 nextSibling; // -1 for the last item
+        qint32 subtreeEnd;  // index past the last node of the subtree
+        qint32 childCount;
+        // key of the node in its parent: arena text if keyLength >= 0,
+        // list index in keyOffset otherwise
+        qint32 keyOffset;
+        qint32 keyLength;
+        union {
+            bool boolean;
+            qint64 integer;
+            quint64 unsignedInteger;
+            double real;
+            struct {
+                qint32 offset;
+                qint32 length;
+            } text;
+            qint32 variant; // other leaf types, index of the stored QVariant, -1 for containers
+        } payload;
+
+        bool keyIsIndex() const { return keyLength < 0; }
+    };
+
+    QVariantTreeFlat();
+
+    /**
+     * @brief Flatten the root content, with the containers of the tree.
+     * Indexed records of the tree are loaded.
+     */
+    static QVariantTreeFlat fromTree(const QVariantTree& tree);
+    /**
+     * @brief Flatten a root content, with the containers of the tree.
+     * @param cancelled Flag to stop between two items, set from any thread.
+     * A cancelled flat tree is empty.
+     */
+    static QVariantTreeFlat fromVariant(const QVariantTree& tree, const QVariant& root,
+                                        const QAtomicInt* cancelled = NULL);
+
+    int count() const { return _nodes.count(); }
+    bool isEmpty() const { return _nodes.isEmpty(); }
+    const Node& node(int index) const { return _nodes.at(index); }
+    /** @brief Contiguous nodes, for linear scans. */
+    const Node* nodes() const { return _nodes.constData(); }
+
+    /** @brief Key in the parent: int for a list item, string otherwise, invalid for the root. */
+    QVariant key(int index) const;
+    /** @brief Key text, a list index as a number. */
+    QString keyText(int index) const;
+    /** @brief Text of a string value, empty for other types. */
+    QString text(int index) const;
+    /** @brief Leaf value, invalid for containers. */
+    QVariant value(int index) const;
+    /** @brief True for a container, even without items. */
+    bool isContainer(int index) const;
+    /** @brief Key text in the arena, empty for a list index or the root. */
+    QStringRef keyRef(int index) const;
+    /** @brief Text of a string value in the arena, empty for other types. */
+    QStringRef textRef(int index) const;
+
+    QVariantList address(int index) const;
+    /** @brief Node at the address, -1 if missing. */
+    int indexOf(const QVariantList& address) const;
+
+    /** @brief Number of nodes of each type. */
+    QHash<uint, int> typeCounts() const;
+    /** @brief Nodes whose key or string value contains the text. */
+    QVector<int> findText(const QString& text, Qt::CaseSensitivity cs = Qt::CaseSensitive) const;
+
+    /** @brief Bytes held by the nodes and the arena. */
+    qint64 memoryUsage() const;
+
+private:
+    class Builder;
+
+    QStringRef arenaText(qint32 offset, qint32 length) const;
+
+private:
+    QVector<Node> _nodes;
+    QString _arena;
+    QVector<QVariant> _variants;
+};
+
+Q_DECLARE_TYPEINFO(QVariantTreeFlat::Node, Q_PRIMITIVE_TYPE);
+
+#endif // QVARIANTTREEFLAT_H
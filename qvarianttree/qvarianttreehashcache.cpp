@@ -0,0 +1,266 @@
+#include "qvarianttreehashcache.h"
+
+#include <QHash>
+#include <QVector>
+
+#include "qvarianttree.h"
+
+
+QVariantTreeHashCache::QVariantTreeHashCache() :
+    _root(),
+    _isEmpty(true)
+{
+}
+
+void QVariantTreeHashCache::build(const QVariantTree& tree)
+{
+    build(tree, tree.rootContent());
+}
+
+bool QVariantTreeHashCache::build(const QVariantTree& tree, const QVariant& root,
+                                  int workerCount, const QAtomicInt* cancelled)
+{
+    clear();
+    QVariantTreeDiff::Hash hash = QVariantTreeDiff::hashParallel(tree, root, workerCount, cancelled);
+    if (cancelled && cancelled->loadAcquire() != 0)
+        return false;
+
+    _root = hash;
+    _isEmpty = false;
+    return true;
+}
+
+void QVariantTreeHashCache::clear()
+{
+    _root = QVariantTreeDiff::Hash();
+    _isEmpty = true;
+}
+
+//------------------------------------------------------------------------------
+
+quint64 QVariantTreeHashCache::hash(const QVariantList& address, bool* isValid) const
+{
+    const QVariantTreeDiff::Hash* node = &_root;
+    bool trueValid = !_isEmpty;
+    for (int depth=0; depth<address.count() && trueValid; depth++) {
+        const QVariant& key = address.at(depth);
+        int position = QVariantTreeDiff::itemOf(*node, key, QVariantTreeDiff::keyHash(key));
+        if (position < 0)
+            trueValid = false;
+        else
+            node = &node->items.at(position);
+    }
+
+    if (isValid)
+        *isValid = trueValid;
+    return trueValid ? node->value : 0;
+}
+
+//------------------------------------------------------------------------------
+
+QList<QVariantList> QVariantTreeHashCache::dirtyAddresses(const QVariantTree& tree,
+                                                          const QVariantTreeDiff::Hash& baseline) const
+{
+    QList<QVariantList> result;
+    if (_isEmpty)
+        return result;
+
+    QVariantList address;
+    addDirty(tree, tree.rootContent(), _root, baseline, address, result);
+    return result;
+}
+
+void QVariantTreeHashCache::addDirty(const QVariantTree& tree, const QVariant& value,
+                                     const QVariantTreeDiff::Hash& current,
+                                     const QVariantTreeDiff::Hash& baseline,
+                                     QVariantList& address, QList<QVariantList>& result)
+{
+    if (current.value == baseline.value)
+        return;
+
+    int count = result.count();
+    QVariantTreeElementContainer* container = tree.containerOf(value.userType());
+    if (container && !current.items.isEmpty() && current.items.count() == baseline.items.count()) {
+        // the items are matched by key, only the keys of a dirty node are read
+        QHash<quint64, int> baselineItems;
+        baselineItems.reserve(baseline.items.count());
+        for (int i=0; i<baseline.items.count(); i++)
+            baselineItems.insert(baseline.items.at(i).key, i);
+
+        QVector<int> matches(current.items.count(), -1);
+        bool isSameKeys = true;
+        for (int i=0; i<current.items.count() && isSameKeys; i++) {
+            QHash<quint64, int>::const_iterator it = baselineItems.constFind(current.items.at(i).key);
+            if (it == baselineItems.constEnd())
+                isSameKeys = false;
+            else
+                matches[i] = it.value();
+        }
+
+        if (isSameKeys) {
+            QHash<quint64, QVariant> keys;
+            QVariantList keyList = container->keys(value);
+            keys.reserve(keyList.count());
+            foreach (const QVariant& key, keyList)
+                keys.insert(QVariantTreeDiff::keyHash(key), key);
+
+            for (int i=0; i<current.items.count(); i++) {
+                const QVariantTreeDiff::Hash& item = current.items.at(i);
+                if (item.value == baseline.items.at(matches.at(i)).value)
+                    continue;
+                QVariant key = keys.value(item.key);
+                address.append(key);
+                addDirty(tree, container->item(value, key), item,
+                         baseline.items.at(matches.at(i)), address, result);
+                address.removeLast();
+            }
+        }
+    }
+
+    // same items with another hash: the type changed
+    if (result.count() == count)
+        result.append(address);
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeHashCache::nodeChanged(const QVariantTree& tree,
+                                        const QVariantList& address,
+                                        const QVariant& oldValue)
+{
+    Q_UNUSED(oldValue)
+    if (_isEmpty)
+        return;
+    QVector<QVariantTreeDiff::Hash*> spine;
+    QVector<uint> types;
+    QVariant node;
+    if (address.isEmpty() || !findSpine(tree, address, address.count()-1, spine, types, node)) {
+        build(tree);
+        return;
+    }
+
+    // the changed node is replaced, added or removed
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    QVariantTreeDiff::Hash* parent = spine.last();
+    const QVariant& key = address.last();
+    quint64 keyHash = QVariantTreeDiff::keyHash(key);
+    int position = QVariantTreeDiff::itemOf(*parent, key, keyHash);
+    bool isPresent = container->contains(node, key);
+    if (position < 0 && !isPresent)
+        return;
+
+    if (position >= 0)
+        parent->itemsSum -= QVariantTreeDiff::itemHash(parent->items.at(position));
+    if (isPresent) {
+        QVariantTreeDiff::Hash item = QVariantTreeDiff::hash(tree, container->item(node, key));
+        item.key = keyHash;
+        parent->itemsSum += QVariantTreeDiff::itemHash(item);
+        if (position >= 0)
+            parent->items[position] = item;
+        else
+            QVariantTreeDiff::appendItem(*parent, item, container->isList());
+    }
+    else {
+        QVariantTreeDiff::removeItem(*parent, position, container->isList());
+    }
+    updateSpine(spine, types);
+}
+
+void QVariantTreeHashCache::itemsChanged(const QVariantTree& tree,
+                                         const QVariantList& address,
+                                         int index,
+                                         const QVariantList& oldItems)
+{
+    if (_isEmpty)
+        return;
+    QVector<QVariantTreeDiff::Hash*> spine;
+    QVector<uint> types;
+    QVariant node;
+    if (!findSpine(tree, address, address.count(), spine, types, node)) {
+        build(tree);
+        return;
+    }
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    QVariantTreeDiff::Hash* list = spine.last();
+    int count = container->size(node);
+    if (!container->isList() || index > count || list->items.count() != index + oldItems.count()) {
+        build(tree);
+        return;
+    }
+
+    // the items equal at both ends are kept, shared items compare at once
+    int oldCount = oldItems.count();
+    int newCount = count - index;
+    int suffix = 0;
+    while (suffix < oldCount && suffix < newCount
+           && oldItems.at(oldCount-1-suffix) == container->item(node, count-1-suffix))
+        suffix++;
+    int prefix = 0;
+    while (prefix < oldCount-suffix && prefix < newCount-suffix
+           && oldItems.at(prefix) == container->item(node, index+prefix))
+        prefix++;
+
+    // only the items in between are hashed
+    int first = index + prefix;
+    int removed = oldCount - suffix - prefix;
+    int added = newCount - suffix - prefix;
+    for (int i=first; i<first+removed; i++)
+        list->itemsSum -= QVariantTreeDiff::itemHash(list->items.at(i));
+    list->items.remove(first, removed);
+    list->items.insert(first, added, QVariantTreeDiff::Hash());
+    for (int i=first; i<first+added; i++) {
+        QVariantTreeDiff::Hash& item = list->items[i];
+        item = QVariantTreeDiff::hash(tree, container->item(node, i));
+        item.key = QVariantTreeDiff::keyHash(i);
+        list->itemsSum += QVariantTreeDiff::itemHash(item);
+    }
+
+    // the shifted ones are keyed again by their index
+    if (added != removed) {
+        for (int i=first+added; i<list->items.count(); i++) {
+            QVariantTreeDiff::Hash& item = list->items[i];
+            list->itemsSum -= QVariantTreeDiff::itemHash(item);
+            item.key = QVariantTreeDiff::keyHash(i);
+            list->itemsSum += QVariantTreeDiff::itemHash(item);
+        }
+    }
+    updateSpine(spine, types);
+}
+
+bool QVariantTreeHashCache::findSpine(const QVariantTree& tree, const QVariantList& address, int depth,
+                                      QVector<QVariantTreeDiff::Hash*>& spine, QVector<uint>& types,
+                                      QVariant& node)
+{
+    QVariantTreeDiff::Hash* hash = &_root;
+    node = tree.rootContent(address);
+    for (int i=0; i<=depth; i++) {
+        QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+        if (!container)
+            return false;
+        spine.append(hash);
+        types.append(node.userType());
+        if (i == depth)
+            break;
+
+        const QVariant& key = address.at(i);
+        int position = QVariantTreeDiff::itemOf(*hash, key, QVariantTreeDiff::keyHash(key));
+        if (position < 0)
+            return false;
+        hash = &hash->items[position];
+        node = container->item(node, key);
+    }
+    return true;
+}
+
+void QVariantTreeHashCache::updateSpine(const QVector<QVariantTreeDiff::Hash*>& spine,
+                                        const QVector<uint>& types)
+{
+    // each ancestor from its updated item
+    for (int i=spine.count()-1; i>=0; i--) {
+        QVariantTreeDiff::Hash* hash = spine.at(i);
+        quint64 oldItemHash = QVariantTreeDiff::itemHash(*hash);
+        hash->value = QVariantTreeDiff::containerHash(types.at(i), hash->items.count(), hash->itemsSum);
+        if (i > 0)
+            spine.at(i-1)->itemsSum += QVariantTreeDiff::itemHash(*hash) - oldItemHash;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef QVARIANTTREEHASHCACHE_H
+#define QVARIANTTREEHASHCACHE_H
+
+#include <QVariant>
+#include <QVector>
+#include <QAtomicInt>
+
+#include "qvarianttreeobserver.h"
+#include "qvarianttreediff.h"
+
+class QVariantTree;
+
+
+/**
+ * @brief Hash of every subtree of a tree, kept up to date with the edits.
+ * Once built, the cache follows the edits of the tree as an observer: the
+ * replaced subtree is hashed again, then only the hashes of its ancestors
+ * are updated. The items shifted in a list are only keyed again. A
+ * snapshot shares the hashes with the cache until they are edited, it is
+ * a cheap baseline to compare with later.
+ * @code
+ * QVariantTreeHashCache cache;
+ * cache.build(tree);
+ * tree.addObserver(&cache);
+ * QVariantTreeDiff::Hash saved = cache.snapshot();
+ * // edits...
+ * bool isModified = cache.rootHash() != saved.value;
+ * QList<QVariantList> dirty = cache.dirtyAddresses(tree, saved);
+ * @endcode
+ */
+class QVariantTreeHashCache : public QVariantTreeObserver
+{
+public:
+    QVariantTreeHashCache();
+
+    /**
+     * @brief Hash the root content, indexed records of the tree are loaded.
+     */
+    void build(const QVariantTree& tree);
+    /**
+     * @brief Hash a root content with the containers of the tree.
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param cancelled Flag to stop the build, set from any thread.
+     * A cancelled cache is empty.
+     * @return False if cancelled
+     */
+    bool build(const QVariantTree& tree, const QVariant& root,
+               int workerCount = 0, const QAtomicInt* cancelled = NULL);
+    void clear();
+
+    bool isEmpty() const { return _isEmpty; }
+    quint64 rootHash() const { return _root.value; }
+    /**
+     * @brief Hash of the subtree at an address.
+     * @param isValid Set to false if there is no node at the address
+     */
+    quint64 hash(const QVariantList& address, bool* isValid = NULL) const;
+    /**
+     * @brief All the hashes, shared with the cache until the next edit.
+     */
+    QVariantTreeDiff::Hash snapshot() const { return _root; }
+
+    /**
+     * @brief Topmost addresses of the subtrees that differ from a snapshot.
+     * A node is dirty as a whole if its type or its keys changed, else only
+     * its differing items are. Untouched subtrees are skipped.
+     * @param tree The tree the cache follows, for the keys of the addresses
+     * @param baseline A snapshot of the cache, of the same tree or not
+     */
+    QList<QVariantList> dirtyAddresses(const QVariantTree& tree,
+                                       const QVariantTreeDiff::Hash& baseline) const;
+
+    void nodeChanged(const QVariantTree& tree,
+                     const QVariantList& address,
+                     const QVariant& oldValue);
+    // the shifted items keep their hashes under their new keys
+    void itemsChanged(const QVariantTree& tree,
+                      const QVariantList& address,
+                      int index,
+                      const QVariantList& oldItems);
+
+private:
+    // the cached containers from the root down to the depth of the
+    // address, the edited vectors detach from the snapshots
+    // false if it is not the hashed tree
+    bool findSpine(const QVariantTree& tree, const QVariantList& address, int depth,
+                   QVector<QVariantTreeDiff::Hash*>& spine, QVector<uint>& types,
+                   QVariant& node);
+    // the hashes of the spine from its updated last node
+    static void updateSpine(const QVector<QVariantTreeDiff::Hash*>& spine,
+                            const QVector<uint>& types);
+    static void addDirty(const QVariantTree& tree, const QVariant& value,
+                         const QVariantTreeDiff::Hash& current,
+                         const QVariantTreeDiff::Hash& baseline,
+                         QVariantList& address, QList<QVariantList>& result);
+
+private:
+    QVariantTreeDiff::Hash _root;
+    bool _isEmpty;
+};
+
+#endif // QVARIANTTREEHASHCACHE_H
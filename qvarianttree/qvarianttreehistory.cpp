@@ -0,0 +1,258 @@
+#include "qvarianttreehistory.h"
+
+#include <QStringList>
+
+#include "qvarianttree.h"
+
+
+namespace {
+
+// items of a node of the persistent containers
+const int PathWidth = 32;
+
+// deep cost of the items not found as such in the previous container
+template<typename Container>
+qint64 changedItemsCost(const Container& items, const Container& previousItems)
+{
+    qint64 cost = 0;
+    typename Container::const_iterator it = items.constBegin();
+    for (; it != items.constEnd(); ++it) {
+        typename Container::const_iterator previousIt = previousItems.constFind(it.key());
+        if (previousIt == previousItems.constEnd() || !(previousIt.value() == it.value()))
+            cost += QVariantTreeHistory::deepCost(it.value());
+    }
+    return cost;
+}
+
+}
+
+
+QVariantTreeHistory::QVariantTreeHistory(qint64 budget) :
+    _budget(budget),
+    _usedBytes(0),
+    _states(),
+    _current(-1)
+{
+}
+
+void QVariantTreeHistory::setBudget(qint64 budget)
+{
+    _budget = budget;
+    applyBudget();
+}
+
+void QVariantTreeHistory::reset(const QVariantTree& tree)
+{
+    clear();
+
+    State state;
+    state.snapshot = tree.snapshot();
+    state.cursor = tree.address();
+    state.cost = 0;
+    _states.append(state);
+    _current = 0;
+}
+
+void QVariantTreeHistory::clear()
+{
+    _states.clear();
+    _current = -1;
+    _usedBytes = 0;
+}
+
+void QVariantTreeHistory::commit(const QVariantTree& tree, const QVariantList& address)
+{
+    if (_current < 0) {
+        reset(tree);
+        return;
+    }
+
+    while (_states.count() > _current + 1)
+        _usedBytes -= _states.takeLast().cost;
+
+    State state;
+    state.snapshot = tree.snapshot();
+    state.cursor = tree.address();
+    state.address = address;
+    state.cost = spineCost(tree, _states.at(_current).snapshot.root, state.snapshot.root, address);
+    _states.append(state);
+    _current++;
+    _usedBytes += state.cost;
+
+    applyBudget();
+}
+
+QVariantList QVariantTreeHistory::undo(QVariantTree& tree)
+{
+    if (!canUndo())
+        return QVariantList();
+
+    // back to the state before the edit, the cursor of the edit time
+    QVariantList address = _states.at(_current).address;
+    State state = _states.at(_current - 1);
+    state.cursor = _states.at(_current).cursor;
+    _current--;
+
+    restore(tree, state, address);
+    return address;
+}
+
+QVariantList QVariantTreeHistory::redo(QVariantTree& tree)
+{
+    if (!canRedo())
+        return QVariantList();
+
+    _current++;
+    const State& state = _states.at(_current);
+    restore(tree, state, state.address);
+    return state.address;
+}
+
+void QVariantTreeHistory::restore(QVariantTree& tree, const State& state,
+                                  const QVariantList& changedAddress) const
+{
+    // the states differ under the changed address only
+    tree.restoreSnapshot(state.snapshot, changedAddress);
+    for (int i=0; i<state.cursor.count(); i++)
+        tree.moveToNode(state.cursor.at(i));
+}
+
+void QVariantTreeHistory::applyBudget()
+{
+    // oldest undo steps first, then the farthest redo steps
+    while (_usedBytes > _budget && _states.count() > 1) {
+        if (_current > 0) {
+            _states.removeFirst();
+            _usedBytes -= _states.first().cost;
+            _states.first().cost = 0;
+            _states.first().address.clear();
+            _current--;
+        }
+        else
+            _usedBytes -= _states.takeLast().cost;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+qint64 QVariantTreeHistory::spineCost(const QVariantTree& tree,
+                                      const QVariant& previousRoot, const QVariant& root,
+                                      const QVariantList& address)
+{
+    qint64 cost = 0;
+    QVariant previous = previousRoot;
+    QVariant node = root;
+    for (int depth=0; depth<address.count(); depth++) {
+        cost += copyCost(tree, node);
+        previous = childValue(tree, previous, address.at(depth));
+        node = childValue(tree, node, address.at(depth));
+    }
+
+    // the edited items are new, whatever their size
+    if (node.type() == QVariant::List) {
+        const QVariantList list = node.toList();
+        const QVariantList previousList = previous.type() == QVariant::List
+                ? previous.toList() : QVariantList();
+        cost += shallowCost(node);
+
+        // items shifted by an insertion or a removal are still shared
+        int first = 0;
+        while (first < list.count() && first < previousList.count()
+               && previousList.at(first) == list.at(first))
+            first++;
+        int last = list.count();
+        int previousLast = previousList.count();
+        while (last > first && previousLast > first
+               && previousList.at(previousLast - 1) == list.at(last - 1)) {
+            last--;
+            previousLast--;
+        }
+        for (int i=first; i<last; i++)
+            cost += deepCost(list.at(i));
+    }
+    else if (node.type() == QVariant::Map) {
+        cost += shallowCost(node);
+        cost += changedItemsCost(node.toMap(), previous.type() == QVariant::Map
+                                 ? previous.toMap() : QVariantMap());
+    }
+    else if (node.type() == QVariant::Hash) {
+        cost += shallowCost(node);
+        cost += changedItemsCost(node.toHash(), previous.type() == QVariant::Hash
+                                 ? previous.toHash() : QVariantHash());
+    }
+    else if (node.type() == QVariant::UserType && tree.containerOf(node.userType()))
+        cost += copyCost(tree, node);
+    else if (!(previous == node))
+        cost += deepCost(node);
+    return cost;
+}
+
+qint64 QVariantTreeHistory::deepCost(const QVariant& value)
+{
+    qint64 cost = shallowCost(value);
+    if (value.type() == QVariant::List) {
+        const QVariantList list = value.toList();
+        for (int i=0; i<list.count(); i++)
+            cost += deepCost(list.at(i));
+    }
+    else if (value.type() == QVariant::Map)
+        cost += changedItemsCost(value.toMap(), QVariantMap());
+    else if (value.type() == QVariant::Hash)
+        cost += changedItemsCost(value.toHash(), QVariantHash());
+    return cost;
+}
+
+QVariant QVariantTreeHistory::childValue(const QVariantTree& tree, const QVariant& node,
+                                        const QVariant& key)
+{
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container == NULL)
+        return QVariant();
+    return container->item(node, key);
+}
+
+qint64 QVariantTreeHistory::copyCost(const QVariantTree& tree, const QVariant& node)
+{
+    switch (node.type())
+    {
+    case QVariant::List:
+    case QVariant::Map:
+    case QVariant::Hash:
+        return shallowCost(node);
+    default:
+        break;
+    }
+
+    // the nodes on the path of the item, for a user type container
+    QVariantTreeElementContainer* container = node.type() == QVariant::UserType
+            ? tree.containerOf(node.userType()) : NULL;
+    if (container == NULL)
+        return shallowCost(node);
+    qint64 cost = PathWidth * (qint64)sizeof(QVariant);
+    for (int count = container->size(node); count > PathWidth; count /= PathWidth)
+        cost += PathWidth * (qint64)sizeof(QVariant);
+    return cost;
+}
+
+qint64 QVariantTreeHistory::shallowCost(const QVariant& value)
+{
+    // item storage of the Qt containers, the items themselves stay shared
+    switch (value.type())
+    {
+    case QVariant::List:
+        return value.toList().count() * (qint64)(sizeof(void*) + sizeof(QVariant));
+    case QVariant::StringList:
+        return value.toStringList().count() * (qint64)sizeof(QString);
+    case QVariant::Map:
+        return value.toMap().count() * (qint64)(3 * sizeof(void*) + sizeof(QString) + sizeof(QVariant));
+    case QVariant::Hash:
+        return value.toHash().count() * (qint64)(2 * sizeof(void*) + sizeof(uint) +
+                                                 sizeof(QString) + sizeof(QVariant));
+    case QVariant::String:
+        return value.toString().size() * (qint64)sizeof(QChar);
+    case QVariant::ByteArray:
+        return value.toByteArray().size();
+    default:
+        return sizeof(QVariant);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef QVARIANTTREEHISTORY_H
+#define QVARIANTTREEHISTORY_H
+
+#include <QVariant>
+#include <QList>
+
+#include "qvarianttree.h"
+
+
+/**
+ * @brief Undo / redo history of a QVariantTree, as root snapshots.
+ * Containers are implicitly shared: an edit after a snapshot only copies
+ * the containers along the edited address, every other subtree stays shared
+ * between the snapshots. Those unshared bytes are estimated for each step,
+ * the oldest steps are dropped beyond the memory budget.
+ * The history records the state after each edit, starting from reset().
+ */
+class QVariantTreeHistory
+{
+public:
+    explicit QVariantTreeHistory(qint64 budget = 64 * 1024 * 1024);
+
+    qint64 budget() const { return _budget; }
+    void setBudget(qint64 budget);
+    /** @brief Estimated bytes held only by the history. */
+    qint64 usedBytes() const { return _usedBytes; }
+
+    /**
+     * @brief Forget the steps, the tree state is the new starting point.
+     */
+    void reset(const QVariantTree& tree);
+    void clear();
+
+    /**
+     * @brief Record the tree state after an edit, the redo steps are dropped.
+     * Indexed records of the tree are not loaded, see QVariantTree::snapshot().
+     * @param tree The edited tree
+     * @param address Address of the node holding every change of the edit
+     */
+    void commit(const QVariantTree& tree, const QVariantList& address);
+
+    bool canUndo() const { return _current > 0; }
+    bool canRedo() const { return _current >= 0 && _current < _states.count() - 1; }
+    int undoCount() const { return qMax(0, _current); }
+    int redoCount() const { return canRedo() ? _states.count() - 1 - _current : 0; }
+
+    /**
+     * @brief Restore the tree state before the last edit, in O(depth).
+     * The cursor of the tree goes back to its address at the edit time.
+     * @return Address of the node changed by the undone edit, empty if none
+     */
+    QVariantList undo(QVariantTree& tree);
+    /**
+     * @brief Restore the tree state after the next edit, in O(depth).
+     * @return Address of the node changed by the redone edit, empty if none
+     */
+    QVariantList redo(QVariantTree& tree);
+
+    /**
+     * @brief Estimate the bytes copied by an edit of the node at the address:
+     * every container from the root to that node is copied, not their items,
+     * and the items of that node that differ from the previous root are new.
+     * The containers are read with those of the tree. A container other
+     * than a Qt collection, as a persistent one, only copies the path of the
+     * edited item: its new items are not counted.
+     */
+    static qint64 spineCost(const QVariantTree& tree,
+                            const QVariant& previousRoot, const QVariant& root,
+                            const QVariantList& address);
+    /** @brief Estimate the bytes of a value and of all its items. */
+    static qint64 deepCost(const QVariant& value);
+
+private:
+    struct State {
+        QVariantTree::Snapshot snapshot;
+        QVariantList cursor;
+        /** @brief Node changed from the previous state. */
+        QVariantList address;
+        /** @brief Bytes unshared from the previous state. */
+        qint64 cost;
+    };
+
+    static qint64 shallowCost(const QVariant& value);
+    // bytes copied by an edit below the node
+    static qint64 copyCost(const QVariantTree& tree, const QVariant& node);
+    static QVariant childValue(const QVariantTree& tree, const QVariant& node, const QVariant& key);
+    void restore(QVariantTree& tree, const State& state,
+                 const QVariantList& changedAddress) const;
+    void applyBudget();
+
+private:
+    qint64 _budget;
+    qint64 _usedBytes;
+    QList<State> _states;
+    int _current;
+};
+
+#endif // QVARIANTTREEHISTORY_H
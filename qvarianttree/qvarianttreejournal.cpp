@@ -0,0 +1,224 @@
+#include "qvarianttreejournal.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+
+
+namespace {
+
+template<typename Container>
+void journalItemChanges(QVariantTreeJournal* journal, const QVariantList& address,
+                        const Container& oldItems, const Container& items)
+{
+    typename Container::const_iterator it = oldItems.constBegin();
+    for (; it != oldItems.constEnd(); ++it) {
+        if (!items.contains(it.key()))
+            journal->delValue(QVariantList(address) << it.key());
+    }
+    for (it = items.constBegin(); it != items.constEnd(); ++it) {
+        typename Container::const_iterator oldIt = oldItems.constFind(it.key());
+        if (oldIt == oldItems.constEnd() || !(oldIt.value() == it.value()))
+            journal->setValue(QVariantList(address) << it.key(), it.value());
+    }
+}
+
+}
+
+
+QVariantTreeJournal::QVariantTreeJournal() :
+    _operations()
+{
+}
+
+void QVariantTreeJournal::setValue(const QVariantList& address, const QVariant& value)
+{
+    QVariantTreeTransaction::Operation operation;
+    operation.type = QVariantTreeTransaction::SetOperation;
+    operation.address = address;
+    operation.value = value;
+    _operations.append(operation);
+}
+
+void QVariantTreeJournal::insertValue(const QVariantList& address, const QVariant& value)
+{
+    QVariantTreeTransaction::Operation operation;
+    operation.type = QVariantTreeTransaction::InsertOperation;
+    operation.address = address;
+    operation.value = value;
+    _operations.append(operation);
+}
+
+void QVariantTreeJournal::delValue(const QVariantList& address)
+{
+    QVariantTreeTransaction::Operation operation;
+    operation.type = QVariantTreeTransaction::DelOperation;
+    operation.address = address;
+    _operations.append(operation);
+}
+
+void QVariantTreeJournal::setNodeChanges(const QVariantList& address,
+                                         const QVariant& oldValue, const QVariant& value)
+{
+    if (!value.isValid()) {
+        delValue(address);
+        return;
+    }
+    if (oldValue.type() != value.type()) {
+        setValue(address, value);
+        return;
+    }
+
+    if (value.type() == QVariant::List) {
+        const QVariantList oldList = oldValue.toList();
+        const QVariantList list = value.toList();
+
+        // the unchanged ends, then the changed items in between
+        int first = 0;
+        while (first < list.count() && first < oldList.count()
+               && oldList.at(first) == list.at(first))
+            first++;
+        int last = list.count();
+        int oldLast = oldList.count();
+        while (last > first && oldLast > first
+               && oldList.at(oldLast - 1) == list.at(last - 1)) {
+            last--;
+            oldLast--;
+        }
+
+        int index = first;
+        for (; index < last && index < oldLast; index++)
+            setValue(QVariantList(address) << index, list.at(index));
+        for (int i=index; i<oldLast; i++)
+            delValue(QVariantList(address) << index);
+        for (; index < last; index++)
+            insertValue(QVariantList(address) << index, list.at(index));
+    }
+    else if (value.type() == QVariant::Map)
+        journalItemChanges(this, address, oldValue.toMap(), value.toMap());
+    else if (value.type() == QVariant::Hash)
+        journalItemChanges(this, address, oldValue.toHash(), value.toHash());
+    else if (!(oldValue == value))
+        setValue(address, value);
+}
+
+//------------------------------------------------------------------------------
+
+bool QVariantTreeJournal::exists(const QString& filename)
+{
+    return QFile::exists(fileName(filename));
+}
+
+bool QVariantTreeJournal::remove(const QString& filename)
+{
+    return !exists(filename) || QFile::remove(fileName(filename));
+}
+
+bool QVariantTreeJournal::appendTo(const QString& filename) const
+{
+    // no journal, or the one of an older base file: start a new one
+    QVariantTreeJournal current;
+    qint64 validSize = 0;
+    bool isCurrent = read(filename, &current, &validSize);
+
+    QFile file(fileName(filename));
+    QIODevice::OpenMode mode = isCurrent
+            ? QIODevice::ReadWrite
+            : QIODevice::WriteOnly | QIODevice::Truncate;
+    if (!file.open(mode))
+        return false;
+
+    // after the last complete entry, or the new one would never be read
+    if (isCurrent && (!file.resize(validSize) || !file.seek(validSize)))
+        return false;
+
+    QDataStream stream(&file);
+    if (!isCurrent)
+        writeHeader(stream, filename);
+
+    // checksummed entry: a partial write is detected when read
+    QByteArray entry;
+    {
+        QDataStream entryStream(&entry, QIODevice::WriteOnly);
+        entryStream << (quint32)_operations.count();
+        QList<QVariantTreeTransaction::Operation>::const_iterator it = _operations.constBegin();
+        for (; it != _operations.constEnd(); ++it)
+            entryStream << (quint8)it->type << it->address << it->value;
+    }
+    stream << entry << qChecksum(entry.constData(), entry.size());
+
+    file.flush();
+    return stream.status() == QDataStream::Ok && file.error() == QFile::NoError;
+}
+
+bool QVariantTreeJournal::read(const QString& filename, QVariantTreeJournal* journal,
+                               qint64* validSize)
+{
+    QFile file(fileName(filename));
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    if (!readHeader(stream, filename))
+        return false;
+
+    QVariantTreeJournal result;
+    qint64 end = file.pos();
+    while (!stream.atEnd()) {
+        QByteArray entry;
+        quint16 checksum = 0;
+        stream >> entry >> checksum;
+        if (stream.status() != QDataStream::Ok ||
+                checksum != qChecksum(entry.constData(), entry.size()))
+            break;
+
+        QDataStream entryStream(entry);
+        quint32 count = 0;
+        entryStream >> count;
+        QVariantTreeJournal entryOperations;
+        for (quint32 i=0; i<count && entryStream.status() == QDataStream::Ok; i++) {
+            quint8 type = 0;
+            QVariantTreeTransaction::Operation operation;
+            entryStream >> type >> operation.address >> operation.value;
+            operation.type = (QVariantTreeTransaction::OperationType)type;
+            entryOperations._operations.append(operation);
+        }
+        if (entryStream.status() != QDataStream::Ok)
+            break;
+
+        result._operations.append(entryOperations._operations);
+        end = file.pos();
+    }
+
+    *journal = result;
+    if (validSize)
+        *validSize = end;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool QVariantTreeJournal::readHeader(QDataStream& stream, const QString& filename)
+{
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 baseSize = 0;
+    qint64 baseModified = 0;
+    stream >> magic >> version >> baseSize >> baseModified;
+
+    QFileInfo base(filename);
+    return stream.status() == QDataStream::Ok &&
+            magic == Magic && version <= Version &&
+            base.exists() &&
+            baseSize == base.size() &&
+            baseModified == base.lastModified().toMSecsSinceEpoch();
+}
+
+void QVariantTreeJournal::writeHeader(QDataStream& stream, const QString& filename)
+{
+    QFileInfo base(filename);
+    stream << Magic << Version
+           << (qint64)base.size()
+           << (qint64)base.lastModified().toMSecsSinceEpoch();
+}
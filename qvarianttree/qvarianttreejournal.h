@@ -0,0 +1,74 @@
+#ifndef QVARIANTTREEJOURNAL_H
+#define QVARIANTTREEJOURNAL_H
+
+#include <QVariant>
+#include <QList>
+
+#include "qvarianttreetransaction.h"
+
+class QDataStream;
+
+
+/**
+ * @brief Append-only log of edits, stored beside a QVariant file.
+ * Unlike a transaction, the operations are applied one after the other:
+ * each address refers to the tree as left by the previous operation.
+ * The journal header records the size and modification time of the base
+ * file, so a journal left over a rewritten base file is ignored.
+ */
+class QVariantTreeJournal
+{
+public:
+    explicit QVariantTreeJournal();
+
+    void setValue(const QVariantList& address, const QVariant& value);
+    void insertValue(const QVariantList& address, const QVariant& value);
+    void delValue(const QVariantList& address);
+    /**
+     * @brief Record the new value of the node at the address, as the edits
+     * of its items if the old value is the same kind of container.
+     * @param address Address of the node
+     * @param oldValue Value of the node before, invalid if there was none
+     * @param value Value of the node after, invalid if it is removed
+     */
+    void setNodeChanges(const QVariantList& address,
+                        const QVariant& oldValue, const QVariant& value);
+
+    QList<QVariantTreeTransaction::Operation> operations() const { return _operations; }
+    int count() const { return _operations.count(); }
+    bool isEmpty() const { return _operations.isEmpty(); }
+    void clear() { _operations.clear(); }
+
+    static QString fileName(const QString& filename) { return filename + ".journal"; }
+    static bool exists(const QString& filename);
+    static bool remove(const QString& filename);
+
+    /**
+     * @brief Append the operations, as one entry, to the journal of the file.
+     * The journal is created if needed, or replaced if it belongs to an
+     * older base file. A truncated or corrupted entry left by an interrupted
+     * save is cut before the new entry is written.
+     * @return False if the journal cannot be written.
+     */
+    bool appendTo(const QString& filename) const;
+    /**
+     * @brief Read the complete entries of the journal of the file.
+     * A truncated or corrupted entry ends the journal.
+     * @param validSize Set to the byte size of the header and the complete entries
+     * @return False if there is no journal for the current base file.
+     */
+    static bool read(const QString& filename, QVariantTreeJournal* journal,
+                     qint64* validSize = NULL);
+
+private:
+    static const quint32 Magic = 0x5156544A; // "QVTJ"
+    static const quint32 Version = 1;
+
+    static bool readHeader(QDataStream& stream, const QString& filename);
+    static void writeHeader(QDataStream& stream, const QString& filename);
+
+private:
+    QList<QVariantTreeTransaction::Operation> _operations;
+};
+
+#endif // QVARIANTTREEJOURNAL_H
@@ -0,0 +1,207 @@
+#include "qvarianttreekeyindex.h"
+
+#include <algorithm>
+
+#include "qvarianttree.h"
+
+
+QVariantTreeKeyIndex::QVariantTreeKeyIndex() :
+    _entries(),
+    _entryCount(0),
+    _revision(0),
+    _isStale(false),
+    _sortedKeys(),
+    _sortedKeysValid(true)
+{
+}
+
+void QVariantTreeKeyIndex::build(const QVariantTree& tree)
+{
+    build(tree, tree.rootContent());
+}
+
+bool QVariantTreeKeyIndex::build(const QVariantTree& tree, const QVariant& root,
+                                 const QAtomicInt* cancelled)
+{
+    clear();
+    QVariantTreeElementContainer* container = tree.containerOf(root.userType());
+    if (container == NULL)
+        return true;
+
+    // same as addItems(), with a check between the records
+    QString encodedAddress;
+    QVariantList keys = container->keys(root);
+    for (int i=0; i<keys.count(); i++) {
+        if (cancelled && cancelled->loadAcquire() != 0)
+            return false;
+
+        const QVariant& key = keys.at(i);
+        encodedAddress = encodeKey(key);
+        if (key.userType() != QVariant::Int)
+            addEntry(key.toString(), encodedAddress);
+        addItems(tree, container->item(root, key), encodedAddress);
+    }
+    return true;
+}
+
+void QVariantTreeKeyIndex::clear()
+{
+    _entries.clear();
+    _entryCount = 0;
+    _sortedKeys.clear();
+    _sortedKeysValid = true;
+    _isStale = false;
+    _revision++;
+}
+
+//------------------------------------------------------------------------------
+
+QList<QVariantList> QVariantTreeKeyIndex::addresses(const QString& key) const
+{
+    QList<QVariantList> result;
+    QHash<QString, QSet<QString> >::const_iterator it = _entries.constFind(key);
+    if (it == _entries.constEnd())
+        return result;
+
+    result.reserve(it.value().count());
+    foreach (const QString& encoded, it.value())
+        result.append(decodeAddress(encoded));
+    return result;
+}
+
+QStringList QVariantTreeKeyIndex::keys() const
+{
+    if (!_sortedKeysValid) {
+        _sortedKeys = _entries.keys();
+        std::sort(_sortedKeys.begin(), _sortedKeys.end());
+        _sortedKeysValid = true;
+    }
+    return _sortedKeys;
+}
+
+QStringList QVariantTreeKeyIndex::complete(const QString& prefix, int maximum) const
+{
+    keys();
+
+    QStringList result;
+    QStringList::const_iterator it = std::lower_bound(_sortedKeys.constBegin(),
+                                                      _sortedKeys.constEnd(), prefix);
+    for (; it != _sortedKeys.constEnd() && it->startsWith(prefix); ++it) {
+        if (maximum >= 0 && result.count() >= maximum)
+            break;
+        result.append(*it);
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeKeyIndex::nodeChanged(const QVariantTree& tree,
+                                       const QVariantList& address,
+                                       const QVariant& oldValue)
+{
+    if (_isStale)
+        return;
+    QString encodedAddress = encodeAddress(address);
+    bool hasKey = !address.isEmpty() && address.last().userType() != QVariant::Int;
+
+    if (hasKey)
+        removeEntry(address.last().toString(), encodedAddress);
+    removeItems(tree, oldValue, encodedAddress);
+
+    bool isValid = false;
+    QVariant newValue = tree.getTreeValue(address, &isValid);
+    if (isValid) {
+        if (hasKey)
+            addEntry(address.last().toString(), encodedAddress);
+        addItems(tree, newValue, encodedAddress);
+    }
+    _revision++;
+}
+
+void QVariantTreeKeyIndex::itemsChanged(const QVariantTree& tree,
+                                        const QVariantList& address,
+                                        int index,
+                                        const QVariantList& oldItems)
+{
+    if (_isStale)
+        return;
+
+    // each shifted item is indexed again under its new address
+    QVariant list = tree.getTreeValue(address);
+    QVariantTreeElementContainer* container = tree.containerOf(list.userType());
+    int count = container ? container->size(list) - index : 0;
+    if (qMax(count, oldItems.count()) > MaxShiftedItems) {
+        clear();
+        _isStale = true;
+        return;
+    }
+    QVariantTreeObserver::itemsChanged(tree, address, index, oldItems);
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeKeyIndex::addEntry(const QString& key, const QString& encodedAddress)
+{
+    QHash<QString, QSet<QString> >::iterator it = _entries.find(key);
+    if (it == _entries.end()) {
+        it = _entries.insert(key, QSet<QString>());
+        _sortedKeysValid = false;
+    }
+
+    int count = it.value().count();
+    it.value().insert(encodedAddress);
+    _entryCount += it.value().count() - count;
+}
+
+void QVariantTreeKeyIndex::removeEntry(const QString& key, const QString& encodedAddress)
+{
+    QHash<QString, QSet<QString> >::iterator it = _entries.find(key);
+    if (it == _entries.end())
+        return;
+
+    if (it.value().remove(encodedAddress))
+        _entryCount--;
+    if (it.value().isEmpty()) {
+        _entries.erase(it);
+        _sortedKeysValid = false;
+    }
+}
+
+void QVariantTreeKeyIndex::addItems(const QVariantTree& tree, const QVariant& node,
+                                    QString& encodedAddress)
+{
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container == NULL)
+        return;
+
+    int length = encodedAddress.length();
+    QVariantList keys = container->keys(node);
+    for (int i=0; i<keys.count(); i++) {
+        const QVariant& key = keys.at(i);
+        encodedAddress.append(encodeKey(key));
+        if (key.userType() != QVariant::Int)
+            addEntry(key.toString(), encodedAddress);
+        addItems(tree, container->item(node, key), encodedAddress);
+        encodedAddress.truncate(length);
+    }
+}
+
+void QVariantTreeKeyIndex::removeItems(const QVariantTree& tree, const QVariant& node,
+                                       QString& encodedAddress)
+{
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container == NULL)
+        return;
+
+    int length = encodedAddress.length();
+    QVariantList keys = container->keys(node);
+    for (int i=0; i<keys.count(); i++) {
+        const QVariant& key = keys.at(i);
+        encodedAddress.append(encodeKey(key));
+        if (key.userType() != QVariant::Int)
+            removeEntry(key.toString(), encodedAddress);
+        removeItems(tree, container->item(node, key), encodedAddress);
+        encodedAddress.truncate(length);
+    }
+}
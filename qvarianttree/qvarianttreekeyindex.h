@@ -0,0 +1,103 @@
+#ifndef QVARIANTTREEKEYINDEX_H
+#define QVARIANTTREEKEYINDEX_H
+
+#include <QVariant>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QAtomicInt>
+
+#include "qvarianttreeobserver.h"
+
+class QVariantTree;
+
+
+/**
+ * @brief Inverted index of a tree, from a map or hash key to the addresses
+ * of the nodes with that key.
+ * Once built, the index follows the edits of the tree as an observer: only
+ * the replaced subtrees are indexed again. List indexes are not indexed.
+ * The entries hold whole addresses: a list shift moves the entries of each
+ * shifted item, past MaxShiftedItems items the index is stale instead.
+ * @code
+ * QVariantTreeKeyIndex index;
+ * index.build(tree);
+ * tree.addObserver(&index);
+ * QList<QVariantList> hits = index.addresses("sensorId");
+ * @endcode
+ */
+class QVariantTreeKeyIndex : public QVariantTreeObserver
+{
+public:
+    QVariantTreeKeyIndex();
+
+    /**
+     * @brief Index the root content, indexed records of the tree are loaded.
+     */
+    void build(const QVariantTree& tree);
+    /**
+     * @brief Index a root content with the containers of the tree.
+     * @param cancelled Flag to stop between two top-level items, set from
+     * any thread. A cancelled index is incomplete.
+     * @return False if cancelled
+     */
+    bool build(const QVariantTree& tree, const QVariant& root,
+               const QAtomicInt* cancelled = NULL);
+    void clear();
+
+    bool isEmpty() const { return _entries.isEmpty(); }
+    /** @brief Number of distinct keys. */
+    int keyCount() const { return _entries.count(); }
+    /** @brief Number of indexed nodes. */
+    int entryCount() const { return _entryCount; }
+    /** @brief Incremented by each change of the index. */
+    quint64 revision() const { return _revision; }
+    /**
+     * @brief Cleared by a list shift of too many items, build() it again.
+     */
+    bool isStale() const { return _isStale; }
+
+    // items of a list shift followed by the index
+    static const int MaxShiftedItems = 256;
+
+    bool contains(const QString& key) const { return _entries.contains(key); }
+    int count(const QString& key) const { return _entries.value(key).count(); }
+    /**
+     * @brief Addresses of the nodes with the key, in no particular order.
+     */
+    QList<QVariantList> addresses(const QString& key) const;
+
+    /** @brief Distinct keys, sorted. */
+    QStringList keys() const;
+    /**
+     * @brief Sorted keys starting with the prefix.
+     * @param maximum Number of keys returned at most, -1 for all
+     */
+    QStringList complete(const QString& prefix, int maximum = -1) const;
+
+    void nodeChanged(const QVariantTree& tree,
+                     const QVariantList& address,
+                     const QVariant& oldValue);
+    void itemsChanged(const QVariantTree& tree,
+                      const QVariantList& address,
+                      int index,
+                      const QVariantList& oldItems);
+
+private:
+    void addEntry(const QString& key, const QString& encodedAddress);
+    void removeEntry(const QString& key, const QString& encodedAddress);
+    // entries of the items below the node, not of the node itself
+    void addItems(const QVariantTree& tree, const QVariant& node, QString& encodedAddress);
+    void removeItems(const QVariantTree& tree, const QVariant& node, QString& encodedAddress);
+
+private:
+    QHash<QString, QSet<QString> > _entries;
+    int _entryCount;
+    quint64 _revision;
+    bool _isStale;
+
+    mutable QStringList _sortedKeys;
+    mutable bool _sortedKeysValid;
+};
+
+#endif // QVARIANTTREEKEYINDEX_H
@@ -0,0 +1,73 @@
+#include "qvarianttreeobserver.h"
+
+#include "qvarianttree.h"
+
+
+void QVariantTreeObserver::treeReset(const QVariantTree& tree)
+{
+    // the records of an indexed tree are not decoded for the observers,
+    // it is built again once they are loaded
+    if (tree.isIndexed())
+        clear();
+    else
+        build(tree);
+}
+
+void QVariantTreeObserver::itemsChanged(const QVariantTree& tree,
+                                        const QVariantList& address,
+                                        int index,
+                                        const QVariantList& oldItems)
+{
+    QVariant list = tree.getTreeValue(address);
+    QVariantTreeElementContainer* container = tree.containerOf(list.userType());
+    int count = container ? container->size(list) : 0;
+    int oldCount = index + oldItems.count();
+
+    // the items at the same index, then the removed or the added ones
+    int i = index;
+    for (; i<count && i<oldCount; i++)
+        nodeChanged(tree, QVariantList(address) << i, oldItems.at(i - index));
+    for (int j=oldCount-1; j>=i; j--)
+        nodeChanged(tree, QVariantList(address) << j, oldItems.at(j - index));
+    for (; i<count; i++)
+        nodeChanged(tree, QVariantList(address) << i, QVariant());
+}
+
+//------------------------------------------------------------------------------
+
+QString QVariantTreeObserver::encodeKey(const QVariant& key)
+{
+    if (key.userType() == QVariant::Int)
+        return QString("#%1;").arg(key.toInt());
+    QString text = key.toString();
+    return QString("$%1:").arg(text.length()) + text;
+}
+
+QString QVariantTreeObserver::encodeAddress(const QVariantList& address)
+{
+    QString result;
+    for (int i=0; i<address.count(); i++)
+        result.append(encodeKey(address.at(i)));
+    return result;
+}
+
+QVariantList QVariantTreeObserver::decodeAddress(const QString& encoded)
+{
+    QVariantList result;
+    int position = 0;
+    while (position < encoded.length()) {
+        bool isIndex = (encoded.at(position) == QChar('#'));
+        int end = encoded.indexOf(isIndex ? QChar(';') : QChar(':'), position + 1);
+        Q_ASSERT_X(end > position, "QVariantTreeObserver", "malformed address");
+        int number = encoded.mid(position + 1, end - position - 1).toInt();
+        if (isIndex) {
+            result.append(number);
+            position = end + 1;
+        }
+        else {
+            result.append(encoded.mid(end + 1, number));
+            position = end + 1 + number;
+        }
+    }
+    return result;
+}
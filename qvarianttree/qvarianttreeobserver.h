@@ -0,0 +1,47 @@
+#ifndef QVARIANTTREEOBSERVER_H
+#define QVARIANTTREEOBSERVER_H
+
+#include <QVariant>
+
+class QVariantTree;
+
+
+// notified of the content edits of a tree, see QVariantTree::addObserver()
+// an edit replaces the subtree at an address, the new subtree is read from the tree
+// insertions and removals in a list shift the next items: they are reported
+// as the items of the list replaced from the first shifted one
+class QVariantTreeObserver
+{
+public:
+    virtual ~QVariantTreeObserver() {}
+
+    // the whole content is replaced
+    // reading the content loads the indexed records of the tree: by default
+    // the observer is cleared for an indexed tree, built again otherwise
+    virtual void treeReset(const QVariantTree& tree);
+    // the subtree at the address is replaced, missing nodes are invalid values
+    virtual void nodeChanged(const QVariantTree& tree,
+                             const QVariantList& address,
+                             const QVariant& oldValue) = 0;
+    // the items of the list at the address are replaced from the index to
+    // the end of the list, the old items are given from that index
+    // by default each item is reported by nodeChanged(), the removed items
+    // from the last one
+    virtual void itemsChanged(const QVariantTree& tree,
+                              const QVariantList& address,
+                              int index,
+                              const QVariantList& oldItems);
+
+    // the default treeReset(): from the root content, or empty
+    virtual void build(const QVariantTree& tree) = 0;
+    virtual void clear() = 0;
+
+protected:
+    // an address as a single string, to be hashed by the indexes
+    // "#index;" for list items, "$length:text" for the others
+    static QString encodeKey(const QVariant& key);
+    static QString encodeAddress(const QVariantList& address);
+    static QVariantList decodeAddress(const QString& encoded);
+};
+
+#endif // QVARIANTTREEOBSERVER_H
@@ -0,0 +1,830 @@
+#include "qvarianttreepersistent.h"
+
+#include <QVector>
+#include <QtAlgorithms>
+#include <QMetaType>
+
+#include "qvarianttree.h"
+
+
+// maximum number of items of a list leaf, children of a list node, and
+// entries of a map node
+static const int Width = 32;
+static const int Bits = 5;
+
+struct QVariantTreePersistentListNode : public QSharedData
+{
+    typedef QExplicitlySharedDataPointer<QVariantTreePersistentListNode> Pointer;
+
+    QVariantTreePersistentListNode(bool leaf) : isLeaf(leaf) {}
+
+    int width() const { return isLeaf ? items.count() : children.count(); }
+    int count() const
+    {
+        if (isLeaf)
+            return items.count();
+        int result = 0;
+        for (int i=0; i<sizes.count(); i++)
+            result += sizes.at(i);
+        return result;
+    }
+
+    // child holding the index, the index becomes relative to the child
+    // with forInsert the index may be one past the end of the child
+    int childOf(int& index, bool forInsert = false) const
+    {
+        int i = 0;
+        while (i < sizes.count() - 1
+               && (forInsert ? index > sizes.at(i) : index >= sizes.at(i))) {
+            index -= sizes.at(i);
+            i++;
+        }
+        return i;
+    }
+
+    bool isLeaf;
+    QVector<QVariant> items;
+    QVector<Pointer> children;
+    // number of items under each child
+    QVector<int> sizes;
+};
+
+typedef QVariantTreePersistentListNode ListNode;
+
+// returns the new right sibling if the node was split
+static ListNode::Pointer insertInto(ListNode::Pointer& node, int index, const QVariant& value)
+{
+    node.detach();
+    ListNode::Pointer right;
+
+    if (node->isLeaf) {
+        node->items.insert(index, value);
+        if (node->items.count() > Width) {
+            right = new ListNode(true);
+            right->items = node->items.mid(Width / 2);
+            node->items.resize(Width / 2);
+        }
+        return right;
+    }
+
+    int i = node->childOf(index, true);
+    node->sizes[i]++;
+    ListNode::Pointer split = insertInto(node->children[i], index, value);
+    if (!split)
+        return right;
+
+    node->sizes[i] = node->children.at(i)->count();
+    node->children.insert(i + 1, split);
+    node->sizes.insert(i + 1, split->count());
+    if (node->children.count() > Width) {
+        right = new ListNode(false);
+        right->children = node->children.mid(Width / 2);
+        right->sizes = node->sizes.mid(Width / 2);
+        node->children.resize(Width / 2);
+        node->sizes.resize(Width / 2);
+    }
+    return right;
+}
+
+static void removeFrom(ListNode::Pointer& node, int index)
+{
+    node.detach();
+
+    if (node->isLeaf) {
+        node->items.remove(index);
+        return;
+    }
+
+    int i = node->childOf(index);
+    node->sizes[i]--;
+    removeFrom(node->children[i], index);
+
+    if (node->sizes.at(i) == 0) {
+        node->children.remove(i);
+        node->sizes.remove(i);
+        return;
+    }
+
+    // merge an underfull child into its neighbour when both fit in one node
+    if (node->children.at(i)->width() >= Width / 4 || node->children.count() < 2)
+        return;
+    int left = (i > 0) ? i - 1 : i;
+    const ListNode::Pointer& leftChild = node->children.at(left);
+    const ListNode::Pointer& rightChild = node->children.at(left + 1);
+    if (leftChild->width() + rightChild->width() > Width)
+        return;
+
+    ListNode::Pointer merged = node->children.at(left);
+    merged.detach();
+    if (merged->isLeaf)
+        merged->items += rightChild->items;
+    else {
+        merged->children += rightChild->children;
+        merged->sizes += rightChild->sizes;
+    }
+    node->children[left] = merged;
+    node->sizes[left] += node->sizes.at(left + 1);
+    node->children.remove(left + 1);
+    node->sizes.remove(left + 1);
+}
+
+//------------------------------------------------------------------------------
+
+QVariantTreePersistentList::QVariantTreePersistentList() :
+    _root()
+{
+}
+
+QVariantTreePersistentList::QVariantTreePersistentList(const QVariantTreePersistentList& other) :
+    _root(other._root)
+{
+}
+
+QVariantTreePersistentList::~QVariantTreePersistentList()
+{
+}
+
+QVariantTreePersistentList& QVariantTreePersistentList::operator=(const QVariantTreePersistentList& other)
+{
+    _root = other._root;
+    return *this;
+}
+
+QVariantTreePersistentList QVariantTreePersistentList::fromList(const QVariantList& list)
+{
+    // build full leaves, then full levels of nodes above them
+    QVector<ListNode::Pointer> level;
+    for (int i=0; i<list.count(); i+=Width) {
+        ListNode::Pointer leaf(new ListNode(true));
+        leaf->items = list.mid(i, Width).toVector();
+        level.append(leaf);
+    }
+    while (level.count() > 1) {
+        QVector<ListNode::Pointer> parents;
+        for (int i=0; i<level.count(); i+=Width) {
+            ListNode::Pointer parent(new ListNode(false));
+            parent->children = level.mid(i, Width);
+            for (int j=0; j<parent->children.count(); j++)
+                parent->sizes.append(parent->children.at(j)->count());
+            parents.append(parent);
+        }
+        level = parents;
+    }
+
+    QVariantTreePersistentList result;
+    if (!level.isEmpty())
+        result._root = level.first();
+    return result;
+}
+
+QVariantList QVariantTreePersistentList::toList() const
+{
+    QVariantList result;
+    result.reserve(count());
+    if (!_root)
+        return result;
+
+    QVector<const ListNode*> stack;
+    stack.append(_root.constData());
+    while (!stack.isEmpty()) {
+        const ListNode* node = stack.takeLast();
+        if (node->isLeaf) {
+            for (int i=0; i<node->items.count(); i++)
+                result.append(node->items.at(i));
+        }
+        else {
+            for (int i=node->children.count()-1; i>=0; i--)
+                stack.append(node->children.at(i).constData());
+        }
+    }
+    return result;
+}
+
+int QVariantTreePersistentList::count() const
+{
+    return _root ? _root->count() : 0;
+}
+
+QVariant QVariantTreePersistentList::at(int index) const
+{
+    Q_ASSERT_X(index >= 0 && index < count(), "QVariantTreePersistentList::at", "index out of range");
+
+    const ListNode* node = _root.constData();
+    while (!node->isLeaf)
+        node = node->children.at(node->childOf(index)).constData();
+    return node->items.at(index);
+}
+
+QVariant QVariantTreePersistentList::value(int index, const QVariant& defaultValue) const
+{
+    if (index < 0 || index >= count())
+        return defaultValue;
+    return at(index);
+}
+
+QVariant& QVariantTreePersistentList::operator[](int index)
+{
+    Q_ASSERT_X(index >= 0 && index < count(), "QVariantTreePersistentList::operator[]", "index out of range");
+
+    _root.detach();
+    ListNode* node = _root.data();
+    while (!node->isLeaf) {
+        ListNode::Pointer& child = node->children[node->childOf(index)];
+        child.detach();
+        node = child.data();
+    }
+    return node->items[index];
+}
+
+void QVariantTreePersistentList::insert(int index, const QVariant& value)
+{
+    Q_ASSERT_X(index >= 0 && index <= count(), "QVariantTreePersistentList::insert", "index out of range");
+
+    if (!_root)
+        _root = new ListNode(true);
+
+    ListNode::Pointer split = insertInto(_root, index, value);
+    if (split) {
+        ListNode::Pointer root(new ListNode(false));
+        root->children << _root << split;
+        root->sizes << _root->count() << split->count();
+        _root = root;
+    }
+}
+
+void QVariantTreePersistentList::removeAt(int index)
+{
+    if (index < 0 || index >= count())
+        return;
+
+    removeFrom(_root, index);
+    while (!_root->isLeaf && _root->children.count() == 1)
+        _root = _root->children.first();
+    if (_root->count() == 0)
+        _root.reset();
+}
+
+bool QVariantTreePersistentList::operator==(const QVariantTreePersistentList& other) const
+{
+    if (_root == other._root)
+        return true;
+    return toList() == other.toList();
+}
+
+//==============================================================================
+
+struct QVariantTreePersistentMapNode : public QSharedData
+{
+    typedef QExplicitlySharedDataPointer<QVariantTreePersistentMapNode> Pointer;
+
+    // an entry holds either a key and its value, or a sub-node
+    struct Entry
+    {
+        uint hash;
+        QString key;
+        QVariant value;
+        Pointer node;
+    };
+
+    QVariantTreePersistentMapNode(bool collision) : isCollision(collision), bitmap(0) {}
+
+    // position of the key in a collision node, -1 if missing
+    int collisionOf(const QString& key) const
+    {
+        for (int i=0; i<entries.count(); i++) {
+            if (entries.at(i).key == key)
+                return i;
+        }
+        return -1;
+    }
+
+    // entries of keys sharing the same 32 bits hash, in no particular slot
+    bool isCollision;
+    quint32 bitmap;
+    QVector<Entry> entries;
+};
+
+typedef QVariantTreePersistentMapNode MapNode;
+
+static inline quint32 bitOf(uint hash, int shift)
+{
+    return 1u << ((hash >> shift) & (Width - 1));
+}
+
+static inline int positionOf(quint32 bitmap, quint32 bit)
+{
+    return qPopulationCount(bitmap & (bit - 1));
+}
+
+static const QVariant* findIn(const MapNode* node, uint hash, const QString& key)
+{
+    int shift = 0;
+    while (node) {
+        if (node->isCollision) {
+            int i = node->collisionOf(key);
+            return (i >= 0) ? &node->entries.at(i).value : NULL;
+        }
+
+        quint32 bit = bitOf(hash, shift);
+        if (!(node->bitmap & bit))
+            return NULL;
+        const MapNode::Entry& entry = node->entries.at(positionOf(node->bitmap, bit));
+        if (entry.node) {
+            node = entry.node.constData();
+            shift += Bits;
+        }
+        else if (entry.hash == hash && entry.key == key)
+            return &entry.value;
+        else
+            return NULL;
+    }
+    return NULL;
+}
+
+static void placeEntry(MapNode* node, const MapNode::Entry& entry, int shift)
+{
+    if (node->isCollision) {
+        node->entries.append(entry);
+        return;
+    }
+    quint32 bit = bitOf(entry.hash, shift);
+    node->entries.insert(positionOf(node->bitmap, bit), entry);
+    node->bitmap |= bit;
+}
+
+static QVariant& referenceIn(MapNode::Pointer& nodePointer, uint hash, const QString& key, int shift, bool* added)
+{
+    nodePointer.detach();
+    MapNode* node = nodePointer.data();
+
+    if (node->isCollision) {
+        int i = node->collisionOf(key);
+        if (i < 0) {
+            MapNode::Entry entry;
+            entry.hash = hash;
+            entry.key = key;
+            node->entries.append(entry);
+            *added = true;
+            i = node->entries.count() - 1;
+        }
+        return node->entries[i].value;
+    }
+
+    quint32 bit = bitOf(hash, shift);
+    int position = positionOf(node->bitmap, bit);
+    if (!(node->bitmap & bit)) {
+        MapNode::Entry entry;
+        entry.hash = hash;
+        entry.key = key;
+        node->entries.insert(position, entry);
+        node->bitmap |= bit;
+        *added = true;
+        return node->entries[position].value;
+    }
+
+    MapNode::Entry& entry = node->entries[position];
+    if (!entry.node) {
+        if (entry.hash == hash && entry.key == key)
+            return entry.value;
+
+        // push the existing key one level down, past the last level the
+        // remaining keys share the whole hash
+        bool collision = (shift + Bits >= 32);
+        MapNode::Pointer subNode(new MapNode(collision));
+        placeEntry(subNode.data(), entry, shift + Bits);
+        entry.key.clear();
+        entry.value.clear();
+        entry.node = subNode;
+    }
+    return referenceIn(entry.node, hash, key, shift + Bits, added);
+}
+
+static void removeIn(MapNode::Pointer& nodePointer, uint hash, const QString& key, int shift)
+{
+    nodePointer.detach();
+    MapNode* node = nodePointer.data();
+
+    if (node->isCollision) {
+        node->entries.remove(node->collisionOf(key));
+        return;
+    }
+
+    quint32 bit = bitOf(hash, shift);
+    int position = positionOf(node->bitmap, bit);
+    MapNode::Entry& entry = node->entries[position];
+    if (entry.node) {
+        removeIn(entry.node, hash, key, shift + Bits);
+        const MapNode* subNode = entry.node.constData();
+        if (!subNode->entries.isEmpty()) {
+            // lift a single remaining key into this node
+            if (subNode->entries.count() == 1 && !subNode->entries.first().node) {
+                MapNode::Entry lifted = subNode->entries.first();
+                entry = lifted;
+            }
+            return;
+        }
+    }
+    node->entries.remove(position);
+    node->bitmap &= ~bit;
+}
+
+static void collectEntries(const MapNode* node, QVector<const MapNode::Entry*>& result)
+{
+    if (!node)
+        return;
+    for (int i=0; i<node->entries.count(); i++) {
+        const MapNode::Entry& entry = node->entries.at(i);
+        if (entry.node)
+            collectEntries(entry.node.constData(), result);
+        else
+            result.append(&entry);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+QVariantTreePersistentMap::QVariantTreePersistentMap() :
+    _root(),
+    _count(0),
+    _isHash(false)
+{
+}
+
+QVariantTreePersistentMap::QVariantTreePersistentMap(const QVariantTreePersistentMap& other) :
+    _root(other._root),
+    _count(other._count),
+    _isHash(other._isHash)
+{
+}
+
+QVariantTreePersistentMap::~QVariantTreePersistentMap()
+{
+}
+
+QVariantTreePersistentMap& QVariantTreePersistentMap::operator=(const QVariantTreePersistentMap& other)
+{
+    _root = other._root;
+    _count = other._count;
+    _isHash = other._isHash;
+    return *this;
+}
+
+QVariantTreePersistentMap QVariantTreePersistentMap::fromMap(const QVariantMap& map)
+{
+    QVariantTreePersistentMap result;
+    for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it)
+        result.insert(it.key(), it.value());
+    return result;
+}
+
+QVariantTreePersistentMap QVariantTreePersistentMap::fromHash(const QVariantHash& hash)
+{
+    QVariantTreePersistentMap result;
+    for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it)
+        result.insert(it.key(), it.value());
+    result._isHash = true;
+    return result;
+}
+
+QVariantMap QVariantTreePersistentMap::toMap() const
+{
+    QVector<const MapNode::Entry*> entries;
+    collectEntries(_root.constData(), entries);
+
+    QVariantMap result;
+    for (int i=0; i<entries.count(); i++)
+        result.insert(entries.at(i)->key, entries.at(i)->value);
+    return result;
+}
+
+QVariantHash QVariantTreePersistentMap::toHash() const
+{
+    QVector<const MapNode::Entry*> entries;
+    collectEntries(_root.constData(), entries);
+
+    QVariantHash result;
+    result.reserve(entries.count());
+    for (int i=0; i<entries.count(); i++)
+        result.insert(entries.at(i)->key, entries.at(i)->value);
+    return result;
+}
+
+bool QVariantTreePersistentMap::contains(const QString& key) const
+{
+    return findIn(_root.constData(), qHash(key), key) != NULL;
+}
+
+QVariant QVariantTreePersistentMap::value(const QString& key, const QVariant& defaultValue) const
+{
+    const QVariant* result = findIn(_root.constData(), qHash(key), key);
+    return result ? *result : defaultValue;
+}
+
+QStringList QVariantTreePersistentMap::keys() const
+{
+    QVector<const MapNode::Entry*> entries;
+    collectEntries(_root.constData(), entries);
+
+    QStringList result;
+    result.reserve(entries.count());
+    for (int i=0; i<entries.count(); i++)
+        result.append(entries.at(i)->key);
+    return result;
+}
+
+QVariant& QVariantTreePersistentMap::operator[](const QString& key)
+{
+    if (!_root)
+        _root = new MapNode(false);
+
+    bool added = false;
+    QVariant& result = referenceIn(_root, qHash(key), key, 0, &added);
+    if (added)
+        _count++;
+    return result;
+}
+
+void QVariantTreePersistentMap::remove(const QString& key)
+{
+    // don't copy the path of a missing key
+    if (!contains(key))
+        return;
+
+    removeIn(_root, qHash(key), key, 0);
+    _count--;
+    if (_count == 0)
+        _root.reset();
+}
+
+bool QVariantTreePersistentMap::operator==(const QVariantTreePersistentMap& other) const
+{
+    if (_root == other._root)
+        return true;
+    if (_count != other._count)
+        return false;
+
+    QVector<const MapNode::Entry*> entries;
+    collectEntries(_root.constData(), entries);
+    for (int i=0; i<entries.count(); i++) {
+        const QVariant* value = findIn(other._root.constData(), entries.at(i)->hash, entries.at(i)->key);
+        if (!value || *value != entries.at(i)->value)
+            return false;
+    }
+    return true;
+}
+
+//==============================================================================
+
+static bool registerPersistentTypes()
+{
+    qRegisterMetaType<QVariantTreePersistentList>();
+    qRegisterMetaType<QVariantTreePersistentMap>();
+    QMetaType::registerEqualsComparator<QVariantTreePersistentList>();
+    QMetaType::registerEqualsComparator<QVariantTreePersistentMap>();
+    // plain accessors such as QVariant::toList() keep working on the nodes
+    QMetaType::registerConverter<QVariantTreePersistentList, QVariantList>(&QVariantTreePersistentList::toList);
+    QMetaType::registerConverter<QVariantTreePersistentMap, QVariantMap>(&QVariantTreePersistentMap::toMap);
+    QMetaType::registerConverter<QVariantTreePersistentMap, QVariantHash>(&QVariantTreePersistentMap::toHash);
+    return true;
+}
+
+void QVariantTreePersistent::install(QVariantTree& tree)
+{
+    static const bool registered = registerPersistentTypes();
+    Q_UNUSED(registered)
+
+    delete tree.setContainer(qMetaTypeId<QVariantTreePersistentList>(), new QVariantTreePersistentListContainer);
+    delete tree.setContainer(qMetaTypeId<QVariantTreePersistentMap>(), new QVariantTreePersistentMapContainer);
+}
+
+QVariant QVariantTreePersistent::fromVariant(const QVariant& value, int minimumSize)
+{
+    switch (value.userType()) {
+    case QVariant::List: {
+        QVariantList list = value.toList();
+        for (int i=0; i<list.count(); i++)
+            list[i] = fromVariant(list.at(i), minimumSize);
+        if (list.count() < minimumSize)
+            return list;
+        return QVariant::fromValue(QVariantTreePersistentList::fromList(list));
+    }
+    case QVariant::Map: {
+        QVariantMap map = value.toMap();
+        for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it)
+            it.value() = fromVariant(it.value(), minimumSize);
+        if (map.count() < minimumSize)
+            return map;
+        return QVariant::fromValue(QVariantTreePersistentMap::fromMap(map));
+    }
+    case QVariant::Hash: {
+        QVariantHash hash = value.toHash();
+        for (QVariantHash::iterator it = hash.begin(); it != hash.end(); ++it)
+            it.value() = fromVariant(it.value(), minimumSize);
+        if (hash.count() < minimumSize)
+            return hash;
+        return QVariant::fromValue(QVariantTreePersistentMap::fromHash(hash));
+    }
+    default:
+        return value;
+    }
+}
+
+QVariant QVariantTreePersistent::toVariant(const QVariant& value)
+{
+    if (value.userType() == qMetaTypeId<QVariantTreePersistentList>()) {
+        QVariantList list = value.value<QVariantTreePersistentList>().toList();
+        for (int i=0; i<list.count(); i++)
+            list[i] = toVariant(list.at(i));
+        return list;
+    }
+    if (value.userType() == qMetaTypeId<QVariantTreePersistentMap>()) {
+        QVariantTreePersistentMap persistentMap = value.value<QVariantTreePersistentMap>();
+        if (persistentMap.isHash()) {
+            QVariantHash hash = persistentMap.toHash();
+            for (QVariantHash::iterator it = hash.begin(); it != hash.end(); ++it)
+                it.value() = toVariant(it.value());
+            return hash;
+        }
+        QVariantMap map = persistentMap.toMap();
+        for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it)
+            it.value() = toVariant(it.value());
+        return map;
+    }
+
+    switch (value.userType()) {
+    case QVariant::List: {
+        QVariantList list = value.toList();
+        for (int i=0; i<list.count(); i++)
+            list[i] = toVariant(list.at(i));
+        return list;
+    }
+    case QVariant::Map: {
+        QVariantMap map = value.toMap();
+        for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it)
+            it.value() = toVariant(it.value());
+        return map;
+    }
+    case QVariant::Hash: {
+        QVariantHash hash = value.toHash();
+        for (QVariantHash::iterator it = hash.begin(); it != hash.end(); ++it)
+            it.value() = toVariant(it.value());
+        return hash;
+    }
+    default:
+        return value;
+    }
+}
+
+//==============================================================================
+
+QVariantList QVariantTreePersistentListContainer::keys(const QVariant& content) const
+{
+    return fromSize(size(content));
+}
+
+bool QVariantTreePersistentListContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    bool isIndex = false;
+    int index = key.toInt(&isIndex);
+    return isIndex && index >= 0 && index < size(content);
+}
+
+int QVariantTreePersistentListContainer::size(const QVariant& content) const
+{
+    return content.value<QVariantTreePersistentList>().count();
+}
+
+bool QVariantTreePersistentListContainer::isList() const
+{
+    return true;
+}
+
+QVariant* QVariantTreePersistentListContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentList>())
+        return NULL;
+
+    QVariantTreePersistentList* listContent = static_cast<QVariantTreePersistentList*>(content.data());
+    int index = key.toInt();
+    if (index >= 0 && index < listContent->count())
+        return &(*listContent)[index];
+    return NULL;
+}
+
+void QVariantTreePersistentListContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentList>()) {
+        content = delItem(content, key);
+        return;
+    }
+
+    static_cast<QVariantTreePersistentList*>(content.data())->removeAt(key.toInt());
+}
+
+bool QVariantTreePersistentListContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    bool isIndex = false;
+    int index = key.toInt(&isIndex);
+    // inserting at the size appends the item
+    if (!isIndex || index < 0 || index > size(content))
+        return false;
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentList>())
+        return false;
+
+    static_cast<QVariantTreePersistentList*>(content.data())->insert(index, value);
+    return true;
+}
+
+QVariant QVariantTreePersistentListContainer::item(const QVariant& content, const QVariant& key, const QVariant& defaultValue) const
+{
+    return content.value<QVariantTreePersistentList>().value(key.toInt(), defaultValue);
+}
+
+QVariant QVariantTreePersistentListContainer::setItem(const QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    QVariantTreePersistentList listContent = content.value<QVariantTreePersistentList>();
+    int index = key.toInt();
+    if (index >= 0 && index < listContent.count())
+        listContent[index] = value;
+    return QVariant::fromValue(listContent);
+}
+
+QVariant QVariantTreePersistentListContainer::delItem(const QVariant& content, const QVariant& key) const
+{
+    QVariantTreePersistentList listContent = content.value<QVariantTreePersistentList>();
+    listContent.removeAt(key.toInt());
+    return QVariant::fromValue(listContent);
+}
+
+//==============================================================================
+
+QVariantList QVariantTreePersistentMapContainer::keys(const QVariant& content) const
+{
+    return fromStringList(content.value<QVariantTreePersistentMap>().keys());
+}
+
+bool QVariantTreePersistentMapContainer::contains(const QVariant& content, const QVariant& key) const
+{
+    return content.value<QVariantTreePersistentMap>().contains(key.toString());
+}
+
+int QVariantTreePersistentMapContainer::size(const QVariant& content) const
+{
+    return content.value<QVariantTreePersistentMap>().count();
+}
+
+bool QVariantTreePersistentMapContainer::isList() const
+{
+    return false;
+}
+
+QVariant* QVariantTreePersistentMapContainer::itemReference(QVariant& content, const QVariant& key) const
+{
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentMap>())
+        return NULL;
+
+    QVariantTreePersistentMap* mapContent = static_cast<QVariantTreePersistentMap*>(content.data());
+    if (!mapContent->contains(key.toString()))
+        return NULL;
+    return &(*mapContent)[key.toString()];
+}
+
+void QVariantTreePersistentMapContainer::removeItem(QVariant& content, const QVariant& key) const
+{
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentMap>()) {
+        content = delItem(content, key);
+        return;
+    }
+
+    static_cast<QVariantTreePersistentMap*>(content.data())->remove(key.toString());
+}
+
+bool QVariantTreePersistentMapContainer::insertItem(QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    if (content.userType() != qMetaTypeId<QVariantTreePersistentMap>()) {
+        content = setItem(content, key, value);
+        return true;
+    }
+
+    static_cast<QVariantTreePersistentMap*>(content.data())->insert(key.toString(), value);
+    return true;
+}
+
+QVariant QVariantTreePersistentMapContainer::item(const QVariant& content, const QVariant& key, const QVariant& defaultValue) const
+{
+    return content.value<QVariantTreePersistentMap>().value(key.toString(), defaultValue);
+}
+
+QVariant QVariantTreePersistentMapContainer::setItem(const QVariant& content, const QVariant& key, const QVariant& value) const
+{
+    QVariantTreePersistentMap mapContent = content.value<QVariantTreePersistentMap>();
+    mapContent.insert(key.toString(), value);
+    return QVariant::fromValue(mapContent);
+}
+
+QVariant QVariantTreePersistentMapContainer::delItem(const QVariant& content, const QVariant& key) const
+{
+    QVariantTreePersistentMap mapContent = content.value<QVariantTreePersistentMap>();
+    mapContent.remove(key.toString());
+    return QVariant::fromValue(mapContent);
+}
@@ -0,0 +1,134 @@
+#ifndef QVARIANTTREEPERSISTENT_H
+#define QVARIANTTREEPERSISTENT_H
+
+#include <QVariant>
+#include <QStringList>
+#include <QSharedData>
+
+#include "qvarianttreeelement.h"
+
+class QVariantTree;
+struct QVariantTreePersistentListNode;
+struct QVariantTreePersistentMapNode;
+
+
+/**
+ * @brief Persistent list: a B-tree of items with size tables, like the
+ * relaxed nodes of a RRB vector.
+ * Access, set, insert and remove are O(log n). A copy is O(1), and an edit
+ * only copies the nodes along the path of the item: the copies share every
+ * other node.
+ */
+class QVariantTreePersistentList
+{
+public:
+    QVariantTreePersistentList();
+    QVariantTreePersistentList(const QVariantTreePersistentList& other);
+    ~QVariantTreePersistentList();
+    QVariantTreePersistentList& operator=(const QVariantTreePersistentList& other);
+
+    static QVariantTreePersistentList fromList(const QVariantList& list);
+    QVariantList toList() const;
+
+    int count() const;
+    bool isEmpty() const { return count() == 0; }
+    QVariant at(int index) const;
+    QVariant value(int index, const QVariant& defaultValue = QVariant()) const;
+
+    // the nodes on the path of the item are detached
+    QVariant& operator[](int index);
+    void insert(int index, const QVariant& value);
+    void removeAt(int index);
+    void append(const QVariant& value) { insert(count(), value); }
+
+    bool operator==(const QVariantTreePersistentList& other) const;
+
+private:
+    QExplicitlySharedDataPointer<QVariantTreePersistentListNode> _root;
+};
+
+//==============================================================================
+
+/**
+ * @brief Persistent map: a hash array mapped trie of string keys.
+ * Lookup, insert and remove are O(log n), with the same structural sharing
+ * as QVariantTreePersistentList. Keys are in hash order.
+ */
+class QVariantTreePersistentMap
+{
+public:
+    QVariantTreePersistentMap();
+    QVariantTreePersistentMap(const QVariantTreePersistentMap& other);
+    ~QVariantTreePersistentMap();
+    QVariantTreePersistentMap& operator=(const QVariantTreePersistentMap& other);
+
+    static QVariantTreePersistentMap fromMap(const QVariantMap& map);
+    static QVariantTreePersistentMap fromHash(const QVariantHash& hash);
+    QVariantMap toMap() const;
+    QVariantHash toHash() const;
+    /** @brief True if built from a hash, converted back into a hash. */
+    bool isHash() const { return _isHash; }
+
+    int count() const { return _count; }
+    bool isEmpty() const { return _count == 0; }
+    bool contains(const QString& key) const;
+    QVariant value(const QString& key, const QVariant& defaultValue = QVariant()) const;
+    QStringList keys() const;
+
+    // a missing key is inserted with an invalid value
+    QVariant& operator[](const QString& key);
+    void insert(const QString& key, const QVariant& value) { (*this)[key] = value; }
+    void remove(const QString& key);
+
+    bool operator==(const QVariantTreePersistentMap& other) const;
+
+private:
+    QExplicitlySharedDataPointer<QVariantTreePersistentMapNode> _root;
+    int _count;
+    bool _isHash;
+};
+
+Q_DECLARE_METATYPE(QVariantTreePersistentList)
+Q_DECLARE_METATYPE(QVariantTreePersistentMap)
+
+//==============================================================================
+
+/**
+ * @brief Persistent representation of the large collections of a tree.
+ * Plain QVariant collections are converted at load time, and back before
+ * saving:
+ * @code
+ * QVariantTreePersistent::install(tree);
+ * tree.setRootContent(QVariantTreePersistent::fromVariant(QVariantTree::fromFile(filename)));
+ * QVariantTree::toFile(filename, QVariantTreePersistent::toVariant(tree.rootContent()));
+ * @endcode
+ * QVariantTreeDiff, QVariantTreeHashCache, QVariantTreeSizeCache and
+ * QVariantTreeHistory read the persistent nodes through the containers of
+ * the tree they are given: give them a tree where install() was called.
+ */
+class QVariantTreePersistent
+{
+public:
+    /**
+     * @brief Register the meta types, their conversions into plain
+     * collections, and their containers into the tree.
+     */
+    static void install(QVariantTree& tree);
+
+    /**
+     * @brief Convert the collections of at least minimumSize items, recursively.
+     * Lists become QVariantTreePersistentList, maps and hashes become
+     * QVariantTreePersistentMap.
+     */
+    static QVariant fromVariant(const QVariant& value, int minimumSize = 1024);
+    /**
+     * @brief Convert back to plain QVariantList / QVariantMap / QVariantHash,
+     * recursively.
+     */
+    static QVariant toVariant(const QVariant& value);
+};
+
+QVARIANTTREEELEMENTCONTAINER_IMPL(PersistentList)
+QVARIANTTREEELEMENTCONTAINER_IMPL(PersistentMap)
+
+#endif // QVARIANTTREEPERSISTENT_H
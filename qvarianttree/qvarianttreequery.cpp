@@ -0,0 +1,658 @@
+#include "qvarianttreequery.h"
+
+#include <QRunnable>
+
+#include "qvarianttree.h"
+#include "qvarianttreeworkers.h"
+
+
+namespace {
+
+bool isNumeric(int type)
+{
+    return type == QVariant::Int || type == QVariant::UInt ||
+            type == QVariant::LongLong || type == QVariant::ULongLong ||
+            type == QVariant::Double;
+}
+
+bool isNameCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == QChar('_') || c == QChar('-');
+}
+
+}
+
+/**
+ * @brief Recursive descent parser of an expression into steps.
+ */
+class QVariantTreeQuery::Parser
+{
+public:
+    explicit Parser(const QString& text) :
+        _text(text), _position(0), _errorString(), _errorPosition(-1) {}
+
+    bool parse(QVector<Step>& steps)
+    {
+        skipSpaces();
+        // without "$", the expression may start with a key
+        bool isBareKey = true;
+        if (peek() == QChar('$')) {
+            _position++;
+            isBareKey = false;
+        }
+
+        while (!atEnd() && !hasError()) {
+            skipSpaces();
+            if (atEnd())
+                break;
+
+            Step step;
+            step.isRecursive = false;
+            step.start = step.end = 0;
+            step.step = 1;
+            step.hasStart = step.hasEnd = false;
+
+            if (consume("..")) {
+                step.isRecursive = true;
+                if (peek() == QChar('['))
+                    parseBracket(step);
+                else
+                    parseDotted(step);
+            }
+            else if (consume("."))
+                parseDotted(step);
+            else if (peek() == QChar('['))
+                parseBracket(step);
+            else if (isBareKey && steps.isEmpty())
+                parseDotted(step);
+            else
+                setError(QString("Expected '.' or '['"));
+
+            if (!hasError())
+                steps.append(step);
+        }
+        return !hasError();
+    }
+
+    QString errorString() const { return _errorString; }
+    int errorPosition() const { return _errorPosition; }
+
+private:
+    // .key or .*
+    void parseDotted(Step& step)
+    {
+        if (consume("*")) {
+            step.type = WildcardStep;
+            return;
+        }
+        QString name = parseName();
+        if (name.isEmpty()) {
+            setError(QString("Expected a key"));
+            return;
+        }
+        step.type = ChildStep;
+        step.keys << name;
+    }
+
+    // [*], [?(...)], ['a','b'], [0,1], [start:end:step]
+    void parseBracket(Step& step)
+    {
+        consume("[");
+        skipSpaces();
+
+        if (consume("*"))
+            step.type = WildcardStep;
+        else if (consume("?")) {
+            step.type = FilterStep;
+            skipSpaces();
+            if (!expect("("))
+                return;
+            parsePredicate(step.predicate);
+            skipSpaces();
+            if (!expect(")"))
+                return;
+        }
+        else if (peek() == QChar('\'') || peek() == QChar('"')) {
+            step.type = ChildStep;
+            do {
+                skipSpaces();
+                QString key;
+                if (!parseString(key))
+                    return;
+                step.keys << key;
+                skipSpaces();
+            } while (consume(","));
+        }
+        else {
+            // indexes or a slice
+            bool hasIndex = false;
+            int index = parseInteger(&hasIndex);
+            skipSpaces();
+            if (peek() == QChar(':')) {
+                step.type = SliceStep;
+                step.hasStart = hasIndex;
+                step.start = index;
+                consume(":");
+                skipSpaces();
+                step.end = parseInteger(&step.hasEnd);
+                skipSpaces();
+                if (consume(":")) {
+                    skipSpaces();
+                    bool hasStep = false;
+                    int value = parseInteger(&hasStep);
+                    if (hasStep)
+                        step.step = value;
+                }
+            }
+            else {
+                if (!hasIndex) {
+                    setError(QString("Expected an index, a key or '*'"));
+                    return;
+                }
+                step.type = IndexStep;
+                step.keys << index;
+                while (!hasError() && consume(",")) {
+                    skipSpaces();
+                    step.keys << parseInteger(&hasIndex);
+                    if (!hasIndex)
+                        setError(QString("Expected an index"));
+                    skipSpaces();
+                }
+            }
+        }
+
+        skipSpaces();
+        expect("]");
+    }
+
+    // and groups separated by ||, conditions separated by &&
+    void parsePredicate(QVector<QVector<Condition> >& predicate)
+    {
+        do {
+            QVector<Condition> conditions;
+            do {
+                Condition condition;
+                if (!parseCondition(condition))
+                    return;
+                conditions.append(condition);
+            } while (consume("&&"));
+            predicate.append(conditions);
+        } while (consume("||"));
+    }
+
+    bool parseCondition(Condition& condition)
+    {
+        skipSpaces();
+        if (!expect("@"))
+            return false;
+
+        // relative path, keyed lookups only
+        while (!hasError()) {
+            if (consume(".")) {
+                QString name = parseName();
+                if (name.isEmpty())
+                    setError(QString("Expected a key"));
+                condition.path << name;
+            }
+            else if (consume("[")) {
+                skipSpaces();
+                if (peek() == QChar('\'') || peek() == QChar('"')) {
+                    QString key;
+                    if (parseString(key))
+                        condition.path << key;
+                }
+                else {
+                    bool hasIndex = false;
+                    int index = parseInteger(&hasIndex);
+                    if (!hasIndex)
+                        setError(QString("Expected an index or a key"));
+                    condition.path << index;
+                }
+                skipSpaces();
+                expect("]");
+            }
+            else
+                break;
+        }
+        if (hasError())
+            return false;
+
+        skipSpaces();
+        condition.op = ExistsOperator;
+        if (consume("=="))
+            condition.op = EqualOperator;
+        else if (consume("!="))
+            condition.op = NotEqualOperator;
+        else if (consume("<="))
+            condition.op = LessEqualOperator;
+        else if (consume(">="))
+            condition.op = GreaterEqualOperator;
+        else if (consume("<"))
+            condition.op = LessOperator;
+        else if (consume(">"))
+            condition.op = GreaterOperator;
+
+        if (condition.op != ExistsOperator) {
+            skipSpaces();
+            if (!parseLiteral(condition.literal))
+                return false;
+        }
+        skipSpaces();
+        return true;
+    }
+
+    bool parseLiteral(QVariant& literal)
+    {
+        if (peek() == QChar('\'') || peek() == QChar('"')) {
+            QString text;
+            if (!parseString(text))
+                return false;
+            literal = text;
+            return true;
+        }
+        if (consume("true")) {
+            literal = true;
+            return true;
+        }
+        if (consume("false")) {
+            literal = false;
+            return true;
+        }
+
+        int start = _position;
+        while (!atEnd() && (peek().isDigit() || peek() == QChar('-') || peek() == QChar('+')
+                            || peek() == QChar('.') || peek() == QChar('e') || peek() == QChar('E')))
+            _position++;
+        bool isNumber = false;
+        double number = _text.mid(start, _position - start).toDouble(&isNumber);
+        if (!isNumber) {
+            _position = start;
+            setError(QString("Expected a number, a string, true or false"));
+            return false;
+        }
+        literal = number;
+        return true;
+    }
+
+    bool parseString(QString& text)
+    {
+        QChar quote = peek();
+        _position++;
+        while (!atEnd() && peek() != quote) {
+            if (peek() == QChar('\\') && _position + 1 < _text.length())
+                _position++;
+            text.append(peek());
+            _position++;
+        }
+        return expect(QString(quote));
+    }
+
+    QString parseName()
+    {
+        int start = _position;
+        while (!atEnd() && isNameCharacter(peek()))
+            _position++;
+        return _text.mid(start, _position - start);
+    }
+
+    int parseInteger(bool* isValid)
+    {
+        int start = _position;
+        if (peek() == QChar('-'))
+            _position++;
+        while (!atEnd() && peek().isDigit())
+            _position++;
+        int value = _text.mid(start, _position - start).toInt(isValid);
+        if (!*isValid)
+            _position = start;
+        return value;
+    }
+
+    bool expect(const QString& token)
+    {
+        if (consume(token))
+            return true;
+        setError(QString("Expected '%1'").arg(token));
+        return false;
+    }
+
+    bool consume(const QString& token)
+    {
+        if (_text.midRef(_position, token.length()) != token)
+            return false;
+        _position += token.length();
+        return true;
+    }
+
+    void skipSpaces()
+    {
+        while (!atEnd() && peek().isSpace())
+            _position++;
+    }
+
+    QChar peek() const { return atEnd() ? QChar() : _text.at(_position); }
+    bool atEnd() const { return _position >= _text.length(); }
+    bool hasError() const { return _errorPosition >= 0; }
+
+    void setError(const QString& message)
+    {
+        if (hasError())
+            return;
+        _errorString = message;
+        _errorPosition = _position;
+    }
+
+private:
+    QString _text;
+    int _position;
+    QString _errorString;
+    int _errorPosition;
+};
+
+/**
+ * @brief Evaluate a range of branches, in the calling thread of the pool.
+ */
+class QVariantTreeQuery::BranchRunner : public QRunnable
+{
+public:
+    BranchRunner(const QVariantTreeQuery& query, const QVariantTree& tree,
+                 const QList<Branch>& branches, QList<Match>* matches,
+                 const QAtomicInt* cancelled) :
+        _query(query), _tree(tree), _branches(branches),
+        _matches(matches), _cancelled(cancelled) {}
+
+    void run()
+    {
+        for (int i=0; i<_branches.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+            QVariantList address = _branches.at(i).address;
+            _query.descend(_tree, _branches.at(i).node, address, _branches.at(i).step,
+                           NULL, _matches, _cancelled);
+        }
+    }
+
+private:
+    const QVariantTreeQuery& _query;
+    const QVariantTree& _tree;
+    QList<Branch> _branches;
+    QList<Match>* _matches;
+    const QAtomicInt* _cancelled;
+};
+
+//==============================================================================
+
+QVariantTreeQuery::QVariantTreeQuery() :
+    _expression(),
+    _errorString(),
+    _errorPosition(-1),
+    _steps()
+{
+}
+
+QVariantTreeQuery::QVariantTreeQuery(const QString& expression) :
+    _expression(),
+    _errorString(),
+    _errorPosition(-1),
+    _steps()
+{
+    compile(expression);
+}
+
+bool QVariantTreeQuery::compile(const QString& expression)
+{
+    _expression = expression.isNull() ? QString("") : expression;
+    _steps.clear();
+
+    Parser parser(_expression);
+    bool isValid = parser.parse(_steps);
+    _errorString = parser.errorString();
+    _errorPosition = parser.errorPosition();
+    if (!isValid)
+        _steps.clear();
+    return isValid;
+}
+
+//------------------------------------------------------------------------------
+
+QList<QVariantTreeQuery::Match> QVariantTreeQuery::evaluate(const QVariantTree& tree,
+                                                            int workerCount) const
+{
+    return evaluate(tree, tree.rootContent(), workerCount);
+}
+
+QList<QVariantTreeQuery::Match> QVariantTreeQuery::evaluate(const QVariantTree& tree,
+                                                            const QVariant& root,
+                                                            int workerCount,
+                                                            const QAtomicInt* cancelled) const
+{
+    QList<Match> result;
+    if (!isValid())
+        return result;
+
+    workerCount = QVariantTreeWorkers::threadCount(workerCount);
+
+    QVariantList address;
+    if (workerCount <= 1) {
+        descend(tree, root, address, 0, NULL, &result, cancelled);
+        return result;
+    }
+
+    // expand the plan in place until there are branches for every worker,
+    // the order of the branches is the order of the sequential evaluation
+    QList<Branch> branches;
+    Branch first;
+    first.node = root;
+    first.step = 0;
+    branches.append(first);
+
+    bool expandable = true;
+    while (expandable && branches.count() < workerCount * QVariantTreeWorkers::ChunksPerWorker
+           && !QVariantTreeWorkers::isCancelled(cancelled)) {
+        expandable = false;
+        QList<Branch> expanded;
+        for (int i=0; i<branches.count(); i++) {
+            const Branch& branch = branches.at(i);
+            if (branch.step >= _steps.count()) {
+                expanded.append(branch);
+                continue;
+            }
+            QVariantList branchAddress = branch.address;
+            descend(tree, branch.node, branchAddress, branch.step, &expanded, NULL, cancelled);
+            expandable = true;
+        }
+        branches = expanded;
+    }
+
+    QVariantTreeWorkers workers(workerCount, branches.count());
+    QVector<QList<Match> > chunkMatches(workers.chunkCount());
+    for (int i=0; i<chunkMatches.count(); i++)
+        workers.start(new BranchRunner(*this, tree,
+                                       branches.mid(workers.chunkStart(i), workers.chunkSize()),
+                                       &chunkMatches[i], cancelled));
+    workers.waitForDone();
+
+    for (int i=0; i<chunkMatches.count(); i++)
+        result += chunkMatches.at(i);
+    return result;
+}
+
+void QVariantTreeQuery::descend(const QVariantTree& tree, const QVariant& node,
+                                QVariantList& address, int stepIndex,
+                                QList<Branch>* branches, QList<Match>* matches,
+                                const QAtomicInt* cancelled) const
+{
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        return;
+
+    if (stepIndex >= _steps.count()) {
+        Match match;
+        match.address = address;
+        match.value = node;
+        matches->append(match);
+        return;
+    }
+
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container == NULL)
+        return;
+
+    const Step& step = _steps.at(stepIndex);
+    QVariantList keys;
+    select(step, container, tree, node, keys);
+    for (int i=0; i<keys.count(); i++) {
+        address.append(keys.at(i));
+        if (branches) {
+            Branch branch;
+            branch.address = address;
+            branch.node = container->item(node, keys.at(i));
+            branch.step = stepIndex + 1;
+            branches->append(branch);
+        }
+        else
+            descend(tree, container->item(node, keys.at(i)), address, stepIndex + 1,
+                    NULL, matches, cancelled);
+        address.removeLast();
+    }
+
+    // the same step, one level below
+    if (step.isRecursive) {
+        keys = container->keys(node);
+        for (int i=0; i<keys.count(); i++) {
+            address.append(keys.at(i));
+            if (branches) {
+                Branch branch;
+                branch.address = address;
+                branch.node = container->item(node, keys.at(i));
+                branch.step = stepIndex;
+                branches->append(branch);
+            }
+            else
+                descend(tree, container->item(node, keys.at(i)), address, stepIndex,
+                        NULL, matches, cancelled);
+            address.removeLast();
+        }
+    }
+}
+
+void QVariantTreeQuery::select(const Step& step, QVariantTreeElementContainer* container,
+                               const QVariantTree& tree, const QVariant& node,
+                               QVariantList& keys) const
+{
+    switch (step.type) {
+    case ChildStep:
+        for (int i=0; i<step.keys.count(); i++) {
+            if (container->contains(node, step.keys.at(i)))
+                keys.append(step.keys.at(i));
+        }
+        break;
+    case IndexStep: {
+        int size = container->size(node);
+        for (int i=0; i<step.keys.count(); i++) {
+            int index = step.keys.at(i).toInt();
+            if (index < 0)
+                index += size;
+            if (index >= 0 && index < size && container->contains(node, index))
+                keys.append(index);
+        }
+        break;
+    }
+    case SliceStep: {
+        // python semantic, bounds from the end if negative, lists only:
+        // the keys of a map or a hash are not positions
+        if (step.step == 0 || !container->isList())
+            break;
+        // 64 bits, a large step does not overflow past the bounds
+        qint64 size = container->size(node);
+        qint64 start = step.hasStart ? step.start : (step.step > 0 ? 0 : size - 1);
+        qint64 end = step.hasEnd ? step.end : (step.step > 0 ? size : -size - 1);
+        if (start < 0)
+            start += size;
+        if (end < 0)
+            end += size;
+        if (step.step > 0) {
+            start = qBound(Q_INT64_C(0), start, size);
+            end = qBound(Q_INT64_C(0), end, size);
+            for (qint64 index = start; index < end; index += step.step) {
+                if (container->contains(node, (int)index))
+                    keys.append((int)index);
+            }
+        }
+        else {
+            start = qBound(Q_INT64_C(-1), start, size - 1);
+            end = qBound(Q_INT64_C(-1), end, size - 1);
+            for (qint64 index = start; index > end; index += step.step) {
+                if (container->contains(node, (int)index))
+                    keys.append((int)index);
+            }
+        }
+        break;
+    }
+    case WildcardStep:
+        keys = container->keys(node);
+        break;
+    case FilterStep: {
+        QVariantList allKeys = container->keys(node);
+        for (int i=0; i<allKeys.count(); i++) {
+            if (matches(step.predicate, tree, container->item(node, allKeys.at(i))))
+                keys.append(allKeys.at(i));
+        }
+        break;
+    }
+    }
+}
+
+bool QVariantTreeQuery::matches(const QVector<QVector<Condition> >& predicate,
+                                const QVariantTree& tree, const QVariant& item) const
+{
+    for (int i=0; i<predicate.count(); i++) {
+        bool allMatch = true;
+        for (int j=0; j<predicate.at(i).count() && allMatch; j++) {
+            const Condition& condition = predicate.at(i).at(j);
+            bool isValid = false;
+            QVariant value = tree.getTreeValue(item, condition.path, &isValid);
+            allMatch = isValid && compare(value, condition.op, condition.literal);
+        }
+        if (allMatch)
+            return true;
+    }
+    return false;
+}
+
+bool QVariantTreeQuery::compare(const QVariant& value, Operator op, const QVariant& literal)
+{
+    if (op == ExistsOperator)
+        return true;
+
+    // numbers with numbers, strings with strings, booleans for equality
+    int order = 0;
+    if (isNumeric(literal.userType()) && isNumeric(value.userType())) {
+        double left = value.toDouble();
+        double right = literal.toDouble();
+        order = (left < right) ? -1 : (left > right ? 1 : 0);
+    }
+    else if (literal.userType() == QVariant::String && value.userType() == QVariant::String)
+        order = value.toString().compare(literal.toString());
+    else if (literal.userType() == QVariant::Bool && value.userType() == QVariant::Bool)
+        order = (value.toBool() == literal.toBool()) ? 0 : 1;
+    else
+        return op == NotEqualOperator;
+
+    if (literal.userType() == QVariant::Bool && op != EqualOperator && op != NotEqualOperator)
+        return false;
+
+    switch (op) {
+    case EqualOperator:
+        return order == 0;
+    case NotEqualOperator:
+        return order != 0;
+    case LessOperator:
+        return order < 0;
+    case LessEqualOperator:
+        return order <= 0;
+    case GreaterOperator:
+        return order > 0;
+    case GreaterEqualOperator:
+        return order >= 0;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef QVARIANTTREEQUERY_H
+#define QVARIANTTREEQUERY_H
+
+#include <QVariant>
+#include <QVector>
+#include <QList>
+#include <QAtomicInt>
+
+class QVariantTree;
+class QVariantTreeElementContainer;
+
+
+/**
+ * @brief Path expression over a tree, compiled once then evaluated on any
+ * root content. The syntax follows JSONPath:
+ * - `$` the root, optional: "records[0]" is "$.records[0]"
+ * - `.key`, `['key']`, `['a','b']` items by key
+ * - `[0]`, `[-1]`, `[0,2]` list items by index, from the end if negative
+ * - `[start:end:step]` slice of a list, each bound optional
+ * - `.*`, `[*]` every item
+ * - `..key`, `..*`, `..[0]` the step applied at any depth below
+ * - `[?(@.key > 10 && @.name == 'a' || @.flag)]` items matching a predicate,
+ *   `@` is the item, a path alone checks its existence
+ *
+ * Keys and indexes are looked up in the containers, only wildcards,
+ * descents and predicates enumerate the items.
+ * @code
+ * QVariantTreeQuery query("$.records[*].temperature");
+ * foreach (const QVariantTreeQuery::Match& match, query.evaluate(tree))
+ *     qDebug() << match.address << match.value;
+ * @endcode
+ */
+class QVariantTreeQuery
+{
+public:
+    struct Match
+    {
+        QVariantList address;
+        QVariant value;
+    };
+
+    QVariantTreeQuery();
+    explicit QVariantTreeQuery(const QString& expression);
+
+    /**
+     * @brief Compile the expression into the evaluation plan.
+     * @return False on a syntax error, see errorString()
+     */
+    bool compile(const QString& expression);
+    bool isValid() const { return _errorString.isEmpty() && !_expression.isNull(); }
+    QString expression() const { return _expression; }
+    QString errorString() const { return _errorString; }
+    /** @brief Character of the syntax error, -1 if none. */
+    int errorPosition() const { return _errorPosition; }
+
+    /**
+     * @brief Evaluate on the root content of the tree.
+     * Indexed records of the tree are loaded.
+     */
+    QList<Match> evaluate(const QVariantTree& tree, int workerCount = 0) const;
+    /**
+     * @brief Evaluate on a root content with the containers of the tree.
+     * Once the plan fans out, the branches are evaluated from a thread pool.
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param cancelled Flag to stop the evaluation, set from any thread
+     * @return The matching nodes, in the order of a sequential evaluation
+     */
+    QList<Match> evaluate(const QVariantTree& tree, const QVariant& root,
+                          int workerCount = 0,
+                          const QAtomicInt* cancelled = NULL) const;
+
+private:
+    enum StepType {
+        ChildStep,
+        IndexStep,
+        SliceStep,
+        WildcardStep,
+        FilterStep
+    };
+    enum Operator {
+        ExistsOperator,
+        EqualOperator,
+        NotEqualOperator,
+        LessOperator,
+        LessEqualOperator,
+        GreaterOperator,
+        GreaterEqualOperator
+    };
+
+    struct Condition
+    {
+        QVariantList path; // from the item
+        Operator op;
+        QVariant literal;
+    };
+
+    struct Step
+    {
+        StepType type;
+        bool isRecursive;
+        QVariantList keys; // keys or indexes
+        int start, end, step;
+        bool hasStart, hasEnd;
+        QVector<QVector<Condition> > predicate; // or of ands
+    };
+
+    /** @brief A node reached by the evaluation, with the steps left. */
+    struct Branch
+    {
+        QVariantList address;
+        QVariant node;
+        int step;
+    };
+
+    class Parser;
+    class BranchRunner;
+
+    // evaluate the steps from a node, or only expand it into branches
+    void descend(const QVariantTree& tree, const QVariant& node,
+                 QVariantList& address, int stepIndex,
+                 QList<Branch>* branches, QList<Match>* matches,
+                 const QAtomicInt* cancelled) const;
+    void select(const Step& step, QVariantTreeElementContainer* container,
+                const QVariantTree& tree, const QVariant& node, QVariantList& keys) const;
+    bool matches(const QVector<QVector<Condition> >& predicate,
+                 const QVariantTree& tree, const QVariant& item) const;
+    static bool compare(const QVariant& value, Operator op, const QVariant& literal);
+
+private:
+    QString _expression;
+    QString _errorString;
+    int _errorPosition;
+    QVector<Step> _steps;
+};
+
+#endif // QVARIANTTREEQUERY_H
@@ -0,0 +1,169 @@
+#include "qvarianttreerecordindex.h"
+
+#include <QIODevice>
+#include <QDataStream>
+
+#include "qvarianttreecontainer.h"
+#include "qvarianttreecompressed.h"
+
+
+QVariantTreeRecordIndex::QVariantTreeRecordIndex() :
+    _records()
+{
+}
+
+QVariantTreeRecordIndex QVariantTreeRecordIndex::build(QIODevice* device)
+{
+    QVariantTreeRecordIndex index;
+    Q_ASSERT_X(!device->isSequential(), "QVariantTreeRecordIndex", "cannot index a sequential device");
+
+    // records of a compressed file have no byte offset
+    if (QVariantTreeCompressed::isCompressed(device))
+        return index;
+
+    // container: direct access to its index, else scan its records
+    int remaining = -1;
+    if (QVariantTreeContainer::isContainer(device)) {
+        qint64 start = device->pos();
+        if (QVariantTreeContainer::readIndex(device, &index))
+            return index;
+        device->seek(start);
+    }
+
+    QDataStream stream(device);
+    if (QVariantTreeContainer::isContainer(device))
+        remaining = QVariantTreeContainer::readHeader(stream);
+
+    while (!stream.atEnd() && remaining != 0) {
+        Record record;
+        record.offset = device->pos();
+
+        // unknown layout: decode the record to find its end
+        if (!skipVariant(stream, &record.type)) {
+            stream.resetStatus();
+            if (!device->seek(record.offset))
+                break;
+            QVariant value;
+            stream >> value;
+            record.type = value.userType();
+        }
+        if (stream.status() != QDataStream::Ok)
+            break;
+
+        record.size = device->pos() - record.offset;
+        index._records.append(record);
+        if (remaining > 0)
+            remaining--;
+    }
+
+    return index;
+}
+
+QVariant QVariantTreeRecordIndex::load(QIODevice* device, int index) const
+{
+    QVariant result;
+    if (index < 0 || index >= _records.count() ||
+            !device->seek(_records.at(index).offset))
+        return result;
+
+    QDataStream stream(device);
+    stream >> result;
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool QVariantTreeRecordIndex::skipVariant(QDataStream& stream, uint* type)
+{
+    quint32 typeId = QVariant::Invalid;
+    stream >> typeId;
+    if (stream.version() >= QDataStream::Qt_4_2) {
+        qint8 isNull = 0;
+        stream >> isNull;
+    }
+    if (type)
+        *type = typeId;
+
+    // user types are followed by their name and an unknown payload
+    if (typeId >= QVariant::UserType || stream.status() != QDataStream::Ok)
+        return false;
+    return skipPayload(stream, typeId);
+}
+
+bool QVariantTreeRecordIndex::skipPayload(QDataStream& stream, uint type)
+{
+    int size = -1;
+    quint32 count = 0;
+
+    switch (type)
+    {
+    case QVariant::Invalid:
+        size = (stream.version() >= QDataStream::Qt_5_0) ? 0 : -1;
+        break;
+    case QVariant::Bool:
+        size = 1;
+        break;
+    case QVariant::Char:
+        size = 2;
+        break;
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::Time:
+        size = 4;
+        break;
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+        size = 8;
+        break;
+    case QVariant::Double:
+        size = (stream.floatingPointPrecision() == QDataStream::DoublePrecision) ? 8 : 4;
+        break;
+    case QVariant::Date:
+        size = (stream.version() >= QDataStream::Qt_5_0) ? 8 : -1;
+        break;
+    case QVariant::String:
+    case QVariant::ByteArray:
+        return skipBytes(stream);
+    case QVariant::StringList:
+        stream >> count;
+        for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; i++) {
+            if (!skipBytes(stream))
+                return false;
+        }
+        return stream.status() == QDataStream::Ok;
+    case QVariant::List:
+        stream >> count;
+        for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; i++) {
+            if (!skipVariant(stream))
+                return false;
+        }
+        return stream.status() == QDataStream::Ok;
+    case QVariant::Map:
+    case QVariant::Hash:
+        stream >> count;
+        for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; i++) {
+            if (!skipBytes(stream) || !skipVariant(stream))
+                return false;
+        }
+        return stream.status() == QDataStream::Ok;
+    default:
+        break;
+    }
+
+    if (size < 0)
+        return false;
+    return stream.skipRawData(size) == size;
+}
+
+bool QVariantTreeRecordIndex::skipBytes(QDataStream& stream)
+{
+    quint32 length = 0;
+    stream >> length;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    // null string / byte array
+    if (length == 0xFFFFFFFF)
+        return true;
+    return stream.skipRawData(length) == (int)length;
+}
@@ -0,0 +1,55 @@
+#ifndef QVARIANTTREERECORDINDEX_H
+#define QVARIANTTREERECORDINDEX_H
+
+#include <QVariant>
+#include <QVector>
+
+class QIODevice;
+class QDataStream;
+
+
+/**
+ * @brief Byte offsets, sizes and types of the top-level records of a
+ * QVariant file.
+ * The index is built by skipping the records payload whenever the type
+ * layout is known, so a record is decoded only when loaded.
+ */
+class QVariantTreeRecordIndex
+{
+public:
+    struct Record {
+        qint64 offset;
+        qint64 size;
+        uint type;
+    };
+
+    explicit QVariantTreeRecordIndex();
+
+    /**
+     * @brief Scan the device from its current position.
+     * The footer index of a container is read instead, if valid.
+     * The device must not be sequential.
+     */
+    static QVariantTreeRecordIndex build(QIODevice* device);
+
+    int count() const { return _records.count(); }
+    bool isEmpty() const { return _records.isEmpty(); }
+    Record record(int index) const { return _records.at(index); }
+    void append(const Record& record) { _records.append(record); }
+    void clear() { _records.clear(); }
+
+    /**
+     * @brief Decode the record at the given index.
+     */
+    QVariant load(QIODevice* device, int index) const;
+
+private:
+    static bool skipVariant(QDataStream& stream, uint* type = 0);
+    static bool skipPayload(QDataStream& stream, uint type);
+    static bool skipBytes(QDataStream& stream);
+
+private:
+    QVector<Record> _records;
+};
+
+#endif // QVARIANTTREERECORDINDEX_H
@@ -0,0 +1,94 @@
+#include "qvarianttreerecordreader.h"
+
+#include <QIODevice>
+
+#include "qvarianttreecontainer.h"
+#include "qvarianttreecompressed.h"
+
+#include <climits>
+
+
+QVariantTreeRecordReader::QVariantTreeRecordReader(QIODevice* device) :
+    _device(device),
+    _stream(device),
+    _record(),
+    _recordIndex(-1),
+    _recordOffset(-1),
+    _recordSize(-1),
+    _remaining(-1),
+    _blocksRemaining(-1),
+    _blockRecords(),
+    _blockPosition(0)
+{
+    // the footer of a container is not a record
+    if (QVariantTreeContainer::isContainer(_device))
+        _remaining = qMax(0, QVariantTreeContainer::readHeader(_stream));
+    else if (QVariantTreeCompressed::isCompressed(_device))
+        _blocksRemaining = qMax(0, QVariantTreeCompressed::readHeader(_stream));
+}
+
+bool QVariantTreeRecordReader::atEnd() const
+{
+    if (_blocksRemaining >= 0)
+        return _blocksRemaining == 0 && _blockPosition >= _blockRecords.count();
+    return _remaining == 0 || _stream.atEnd();
+}
+
+bool QVariantTreeRecordReader::readNext()
+{
+    _record.clear();
+    if (atEnd() || _stream.status() != QDataStream::Ok)
+        return false;
+
+    // records of a compressed file come from the current block
+    if (_blocksRemaining >= 0) {
+        if (_blockPosition >= _blockRecords.count() && !readNextBlock())
+            return false;
+        _record = _blockRecords.at(_blockPosition);
+        _blockRecords[_blockPosition++] = QVariant();
+        _recordIndex++;
+        return true;
+    }
+
+    bool isSequential = _device->isSequential();
+    qint64 startOffset = isSequential ? -1 : _device->pos();
+
+    _stream >> _record;
+    if (_stream.status() != QDataStream::Ok) {
+        _record.clear();
+        return false;
+    }
+
+    _recordIndex++;
+    if (_remaining > 0)
+        _remaining--;
+    _recordOffset = startOffset;
+    _recordSize = isSequential ? -1 : _device->pos() - startOffset;
+    return true;
+}
+
+bool QVariantTreeRecordReader::readNextBlock()
+{
+    quint32 size = 0;
+    quint32 recordCount = 0;
+    _stream >> size >> recordCount;
+    if (_stream.status() != QDataStream::Ok || size > INT_MAX) {
+        _stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+
+    QByteArray data((int)size, Qt::Uninitialized);
+    if (_stream.readRawData(data.data(), (int)size) != (int)size) {
+        _stream.setStatus(QDataStream::ReadPastEnd);
+        return false;
+    }
+
+    _blocksRemaining--;
+    _blockRecords = QVariantTreeCompressed::decodeBlock(data, recordCount);
+    _blockPosition = 0;
+    if ((quint32)_blockRecords.count() != recordCount) {
+        _stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+    return !_blockRecords.isEmpty();
+}
@@ -0,0 +1,60 @@
+#ifndef QVARIANTTREERECORDREADER_H
+#define QVARIANTTREERECORDREADER_H
+
+#include <QVariant>
+#include <QDataStream>
+
+class QIODevice;
+
+
+/**
+ * @brief Read the top-level records of a QVariant file one at a time.
+ * Only the current record is kept in memory, the reading can stop at any
+ * record.
+ * Plain files, containers (QVariantTreeContainer) and block-compressed files
+ * (QVariantTreeCompressed) are read.
+ */
+class QVariantTreeRecordReader
+{
+public:
+    explicit QVariantTreeRecordReader(QIODevice* device);
+
+    /**
+     * @brief Read the next record.
+     * @return False at the end of the device or on a corrupted record.
+     */
+    bool readNext();
+    bool atEnd() const;
+    QDataStream::Status status() const { return _stream.status(); }
+
+    QVariant record() const { return _record; }
+    /** @brief Index of the current record, -1 before the first one. */
+    int recordIndex() const { return _recordIndex; }
+    /** @brief Byte offset of the current record, -1 on a sequential device
+     * or in a compressed file. */
+    qint64 recordOffset() const { return _recordOffset; }
+    /** @brief Byte size of the current record, -1 on a sequential device
+     * or in a compressed file. */
+    qint64 recordSize() const { return _recordSize; }
+
+private:
+    bool readNextBlock();
+
+private:
+    QIODevice* _device;
+    QDataStream _stream;
+
+    QVariant _record;
+    int _recordIndex;
+    qint64 _recordOffset;
+    qint64 _recordSize;
+    /** @brief Records left in a container, -1 for a plain file. */
+    int _remaining;
+
+    /** @brief Blocks left in a compressed file, -1 for an uncompressed one. */
+    int _blocksRemaining;
+    QVariantList _blockRecords;
+    int _blockPosition;
+};
+
+#endif // QVARIANTTREERECORDREADER_H
@@ -0,0 +1,303 @@
+#include "qvarianttreesearch.h"
+
+#include <QRunnable>
+#include <QVector>
+#include <QHash>
+
+#include "qvarianttree.h"
+#include "qvarianttreeflat.h"
+#include "qvarianttreeworkers.h"
+
+
+namespace {
+
+bool isNumeric(int type)
+{
+    return type == QVariant::Int || type == QVariant::UInt ||
+            type == QVariant::LongLong || type == QVariant::ULongLong ||
+            type == QVariant::Double;
+}
+
+/**
+ * @brief Search the subtrees of a range of top-level keys.
+ */
+class SearchChunk : public QRunnable
+{
+public:
+    SearchChunk(const QVariantTreeSearch& search,
+                const QVariantTree& tree,
+                const QVariant& root,
+                const QVariantList& keys,
+                QList<QVariantList>* hits,
+                const QAtomicInt* cancelled,
+                QVariantTreeSearch::Receiver* receiver) :
+        _search(search), _tree(tree), _root(root), _keys(keys),
+        _hits(hits), _cancelled(cancelled), _receiver(receiver) {}
+
+    void run()
+    {
+        QVariantTreeElementContainer* container = _tree.containerOf(_root.userType());
+        QVariantList address;
+        for (int i=0; i<_keys.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+            address.append(_keys.at(i));
+            _search.search(_tree, container->item(_root, _keys.at(i)), address, *_hits, _cancelled);
+            address.removeLast();
+        }
+        if (_receiver && !_hits->isEmpty() && !QVariantTreeWorkers::isCancelled(_cancelled))
+            _receiver->found(*_hits);
+    }
+
+private:
+    const QVariantTreeSearch& _search;
+    const QVariantTree& _tree;
+    QVariant _root;
+    QVariantList _keys;
+    QList<QVariantList>* _hits;
+    const QAtomicInt* _cancelled;
+    QVariantTreeSearch::Receiver* _receiver;
+};
+
+/**
+ * @brief Search a range of contiguous subtrees of a flat tree.
+ */
+class FlatSearchChunk : public QRunnable
+{
+public:
+    FlatSearchChunk(const QVariantTreeSearch& search,
+                    const QVariantTreeFlat& flat,
+                    int first, int end,
+                    QList<QVariantList>* hits,
+                    const QAtomicInt* cancelled,
+                    QVariantTreeSearch::Receiver* receiver) :
+        _search(search), _flat(flat), _first(first), _end(end),
+        _hits(hits), _cancelled(cancelled), _receiver(receiver) {}
+
+    void run()
+    {
+        _search.search(_flat, _first, _end, *_hits, _cancelled);
+        if (_receiver && !_hits->isEmpty() && !QVariantTreeWorkers::isCancelled(_cancelled))
+            _receiver->found(*_hits);
+    }
+
+private:
+    const QVariantTreeSearch& _search;
+    const QVariantTreeFlat& _flat;
+    int _first;
+    int _end;
+    QList<QVariantList>* _hits;
+    const QAtomicInt* _cancelled;
+    QVariantTreeSearch::Receiver* _receiver;
+};
+
+}
+
+
+QVariantTreeSearch::QVariantTreeSearch() :
+    _text(),
+    _cs(Qt::CaseInsensitive),
+    _targets(KeyTarget | ValueTarget),
+    _hasRange(false),
+    _minimum(0),
+    _maximum(0),
+    _type(-1)
+{
+}
+
+void QVariantTreeSearch::setText(const QString& text, Qt::CaseSensitivity cs)
+{
+    _text = text;
+    _cs = cs;
+}
+
+void QVariantTreeSearch::setRange(double minimum, double maximum)
+{
+    _hasRange = true;
+    _minimum = minimum;
+    _maximum = maximum;
+}
+
+bool QVariantTreeSearch::matches(const QVariant& key, const QVariant& value, bool isContainer) const
+{
+    if (isEmpty())
+        return false;
+
+    if (_type >= 0 && value.userType() != _type)
+        return false;
+
+    if (_hasRange) {
+        if (isContainer || !isNumeric(value.userType()))
+            return false;
+        double number = value.toDouble();
+        if (number < _minimum || number > _maximum)
+            return false;
+    }
+
+    if (!_text.isEmpty()) {
+        // list indexes are not text
+        bool textMatch = (_targets & KeyTarget) && key.userType() == QVariant::String
+                && key.toString().contains(_text, _cs);
+        if (!textMatch && (_targets & ValueTarget) && !isContainer
+                && value.canConvert<QString>())
+            textMatch = value.toString().contains(_text, _cs);
+        if (!textMatch)
+            return false;
+    }
+
+    return true;
+}
+
+bool QVariantTreeSearch::search(const QVariantTree& tree, const QVariant& node,
+                                QVariantList& address, QList<QVariantList>& hits,
+                                const QAtomicInt* cancelled) const
+{
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        return false;
+
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (matches(address.isEmpty() ? QVariant() : address.last(), node, container != NULL))
+        hits.append(address);
+
+    if (container) {
+        QVariantList keys = container->keys(node);
+        for (int i=0; i<keys.count(); i++) {
+            address.append(keys.at(i));
+            bool completed = search(tree, container->item(node, keys.at(i)), address, hits, cancelled);
+            address.removeLast();
+            if (!completed)
+                return false;
+        }
+    }
+    return true;
+}
+
+QList<QVariantList> QVariantTreeSearch::find(const QVariantTree& tree, const QVariant& root,
+                                             int workerCount,
+                                             const QAtomicInt* cancelled,
+                                             Receiver* receiver) const
+{
+    QList<QVariantList> result;
+    if (isEmpty())
+        return result;
+
+    workerCount = QVariantTreeWorkers::threadCount(workerCount);
+
+    QVariantTreeElementContainer* container = tree.containerOf(root.userType());
+    if (!container || workerCount <= 1) {
+        QVariantList address;
+        search(tree, root, address, result, cancelled);
+        if (receiver && !result.isEmpty() && !QVariantTreeWorkers::isCancelled(cancelled))
+            receiver->found(result);
+        return result;
+    }
+
+    // the root itself, then its items
+    if (matches(QVariant(), root, true)) {
+        result.append(QVariantList());
+        if (receiver)
+            receiver->found(result);
+    }
+
+    QVariantList keys = container->keys(root);
+    QVariantTreeWorkers workers(workerCount, keys.count());
+    QVector<QList<QVariantList> > chunkHits(workers.chunkCount());
+    for (int i=0; i<chunkHits.count(); i++)
+        workers.start(new SearchChunk(*this, tree, root,
+                                      keys.mid(workers.chunkStart(i), workers.chunkSize()),
+                                      &chunkHits[i], cancelled, receiver));
+    workers.waitForDone();
+
+    for (int i=0; i<chunkHits.count(); i++)
+        result += chunkHits.at(i);
+    return result;
+}
+
+bool QVariantTreeSearch::search(const QVariantTreeFlat& flat, int first, int end,
+                                QList<QVariantList>& hits, const QAtomicInt* cancelled) const
+{
+    // each distinct key is matched once, keys repeat across records
+    QHash<qint32, bool> keyMatches;
+    for (int i=first; i<end; i++) {
+        if (QVariantTreeWorkers::isCancelled(cancelled))
+            return false;
+
+        const QVariantTreeFlat::Node& node = flat.node(i);
+        if (_type >= 0 && (int)node.type != _type)
+            continue;
+
+        bool isContainer = flat.isContainer(i);
+        if (_hasRange) {
+            if (isContainer || !isNumeric(node.type))
+                continue;
+            double number = flat.value(i).toDouble();
+            if (number < _minimum || number > _maximum)
+                continue;
+        }
+
+        if (!_text.isEmpty()) {
+            bool textMatch = false;
+            if ((_targets & KeyTarget) && node.parent >= 0 && !node.keyIsIndex()) {
+                QHash<qint32, bool>::const_iterator it = keyMatches.constFind(node.keyOffset);
+                if (it == keyMatches.constEnd())
+                    it = keyMatches.insert(node.keyOffset, flat.keyRef(i).contains(_text, _cs));
+                textMatch = it.value();
+            }
+            if (!textMatch && (_targets & ValueTarget) && !isContainer) {
+                if (node.type == QVariant::String)
+                    textMatch = flat.textRef(i).contains(_text, _cs);
+                else {
+                    QVariant value = flat.value(i);
+                    textMatch = value.canConvert<QString>() && value.toString().contains(_text, _cs);
+                }
+            }
+            if (!textMatch)
+                continue;
+        }
+
+        hits.append(flat.address(i));
+    }
+    return true;
+}
+
+QList<QVariantList> QVariantTreeSearch::find(const QVariantTreeFlat& flat,
+                                             int workerCount,
+                                             const QAtomicInt* cancelled,
+                                             Receiver* receiver) const
+{
+    QList<QVariantList> result;
+    if (isEmpty() || flat.isEmpty())
+        return result;
+
+    workerCount = QVariantTreeWorkers::threadCount(workerCount);
+
+    const QVariantTreeFlat::Node& root = flat.node(0);
+    if (root.childCount == 0 || workerCount <= 1) {
+        search(flat, 0, flat.count(), result, cancelled);
+        if (receiver && !result.isEmpty() && !QVariantTreeWorkers::isCancelled(cancelled))
+            receiver->found(result);
+        return result;
+    }
+
+    // the root itself, then its items: each subtree is a range of nodes
+    search(flat, 0, 1, result, cancelled);
+    if (receiver && !result.isEmpty())
+        receiver->found(result);
+
+    QVariantTreeWorkers workers(workerCount, root.childCount);
+    QVector<QList<QVariantList> > chunkHits(workers.chunkCount());
+    int child = root.firstChild;
+    for (int i=0; i<chunkHits.count(); i++) {
+        int first = child;
+        int end = first;
+        for (int j=0; j<workers.chunkSize() && child >= 0; j++) {
+            end = flat.node(child).subtreeEnd;
+            child = flat.node(child).nextSibling;
+        }
+        workers.start(new FlatSearchChunk(*this, flat, first, end,
+                                          &chunkHits[i], cancelled, receiver));
+    }
+    workers.waitForDone();
+
+    for (int i=0; i<chunkHits.count(); i++)
+        result += chunkHits.at(i);
+    return result;
+}
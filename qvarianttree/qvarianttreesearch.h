@@ -0,0 +1,125 @@
+#ifndef QVARIANTTREESEARCH_H
+#define QVARIANTTREESEARCH_H
+
+#include <QVariant>
+#include <QList>
+#include <QAtomicInt>
+
+class QVariantTree;
+class QVariantTreeFlat;
+
+
+/**
+ * @brief Search of the nodes of a tree by key text, value text, numeric
+ * range and type. Every criterion set must match.
+ * The top-level items are searched in parallel: they are split into many
+ * small chunks queued to a thread pool, so idle workers take the remaining
+ * chunks of large subtrees. Hits are handed as soon as a chunk is done.
+ * A QVariantTreeFlat of the root is scanned linearly instead, for the
+ * repeated searches of an unchanged content.
+ * @code
+ * QVariantTreeSearch search;
+ * search.setText("sensor");
+ * QList<QVariantList> hits = search.find(tree, tree.rootContent());
+ * @endcode
+ */
+class QVariantTreeSearch
+{
+public:
+    enum Target {
+        KeyTarget = 0x1,   // text of map and hash keys
+        ValueTarget = 0x2  // text of leaf values
+    };
+
+    /**
+     * @brief Receives the hits of each chunk, called from the worker threads.
+     */
+    class Receiver
+    {
+    public:
+        virtual ~Receiver() {}
+        virtual void found(const QList<QVariantList>& addresses) = 0;
+    };
+
+    QVariantTreeSearch();
+
+    void setText(const QString& text, Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+    QString text() const { return _text; }
+    void setTargets(int targets) { _targets = targets; }
+    int targets() const { return _targets; }
+
+    /** @brief Only numeric leaves within [minimum, maximum]. */
+    void setRange(double minimum, double maximum);
+    void clearRange() { _hasRange = false; }
+    bool hasRange() const { return _hasRange; }
+
+    /** @brief Only nodes of the type, -1 for any type. */
+    void setType(int type) { _type = type; }
+    int type() const { return _type; }
+
+    /** @brief True without any criterion, nothing matches. */
+    bool isEmpty() const { return _text.isEmpty() && !_hasRange && _type < 0; }
+
+    /**
+     * @brief Check a node against the criteria.
+     * @param key Key of the node in its parent, invalid for the root
+     * @param value Content of the node
+     * @param isContainer True if the value holds items
+     */
+    bool matches(const QVariant& key, const QVariant& value, bool isContainer) const;
+
+    /**
+     * @brief Search the subtree of a node, in the calling thread.
+     * @param address Address of the node, restored on return
+     * @param hits Addresses of the matching nodes, in depth-first order
+     * @param cancelled Flag to stop the search, set from any thread
+     * @return False if cancelled
+     */
+    bool search(const QVariantTree& tree, const QVariant& node,
+                QVariantList& address, QList<QVariantList>& hits,
+                const QAtomicInt* cancelled = NULL) const;
+
+    /**
+     * @brief Search the whole root, the top-level items in parallel.
+     * The root must be loaded, see QVariantTree::rootContent().
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param cancelled Flag to stop the search, set from any thread
+     * @param receiver Optional receiver of the hits while searching
+     * @return Addresses of the matching nodes, in depth-first order
+     */
+    QList<QVariantList> find(const QVariantTree& tree, const QVariant& root,
+                             int workerCount = 0,
+                             const QAtomicInt* cancelled = NULL,
+                             Receiver* receiver = NULL) const;
+
+    /**
+     * @brief Search a range of nodes of a flat tree, in the calling thread.
+     * @param first Index of the first node
+     * @param end Index past the last node
+     * @param hits Addresses of the matching nodes, in depth-first order
+     * @param cancelled Flag to stop the search, set from any thread
+     * @return False if cancelled
+     */
+    bool search(const QVariantTreeFlat& flat, int first, int end,
+                QList<QVariantList>& hits, const QAtomicInt* cancelled = NULL) const;
+
+    /**
+     * @brief Search a flat tree, the subtrees of the top-level items in parallel.
+     * @see QVariantTreeSearch::find()
+     */
+    QList<QVariantList> find(const QVariantTreeFlat& flat,
+                             int workerCount = 0,
+                             const QAtomicInt* cancelled = NULL,
+                             Receiver* receiver = NULL) const;
+
+private:
+    QString _text;
+    Qt::CaseSensitivity _cs;
+    int _targets;
+    bool _hasRange;
+    double _minimum;
+    double _maximum;
+    int _type;
+};
+
+#endif // QVARIANTTREESEARCH_H
@@ -0,0 +1,419 @@
+#include "qvarianttreesizecache.h"
+
+#include <QRunnable>
+#include <QDataStream>
+
+#include "qvarianttree.h"
+#include "qvarianttreediff.h"
+#include "qvarianttreeworkers.h"
+
+
+namespace {
+
+// type and null flag of a QVariant
+const qint64 VariantHeaderSize = 5;
+// number of items of a list, a map or a hash
+const qint64 CountSize = 4;
+
+qint64 stringSize(const QString& text)
+{
+    // a null string is only its marker
+    return text.isNull() ? 4 : 4 + 2 * (qint64)text.length();
+}
+
+}
+
+/**
+ * @brief Measure the subtrees of a range of top-level keys.
+ */
+class QVariantTreeSizeCache::SizeChunk : public QRunnable
+{
+public:
+    SizeChunk(const QVariantTree& tree,
+              const QVariant& root,
+              const QVariantList& keys,
+              Size* items,
+              const QAtomicInt* cancelled) :
+        _tree(tree), _root(root), _keys(keys),
+        _items(items), _cancelled(cancelled) {}
+
+    void run()
+    {
+        QVariantTreeElementContainer* container = _tree.containerOf(_root.userType());
+        for (int i=0; i<_keys.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+            _items[i] = QVariantTreeSizeCache::measure(_tree, container->item(_root, _keys.at(i)));
+            _items[i].key = QVariantTreeDiff::keyHash(_keys.at(i));
+        }
+    }
+
+private:
+    const QVariantTree& _tree;
+    QVariant _root;
+    QVariantList _keys;
+    Size* _items;
+    const QAtomicInt* _cancelled;
+};
+
+//==============================================================================
+
+QVariantTreeSizeCache::QVariantTreeSizeCache() :
+    _root(),
+    _rootType(QVariant::Invalid),
+    _isEmpty(true)
+{
+}
+
+void QVariantTreeSizeCache::build(const QVariantTree& tree)
+{
+    build(tree, tree.rootContent());
+}
+
+bool QVariantTreeSizeCache::build(const QVariantTree& tree, const QVariant& root,
+                                  int workerCount, const QAtomicInt* cancelled)
+{
+    clear();
+    workerCount = QVariantTreeWorkers::threadCount(workerCount);
+
+    Size result;
+    if (!isSummed(tree, root.userType()) || workerCount <= 1) {
+        result = measure(tree, root);
+    }
+    else {
+        QVariantList keys = container->keys(root);
+        QVariantTreeElementContainer* container = tree.containerOf(root.userType());
+        result.items.resize(keys.count());
+        QVariantTreeWorkers workers(workerCount, keys.count());
+        for (int i=0; i<workers.chunkCount(); i++)
+            workers.start(new SizeChunk(tree, root, keys.mid(workers.chunkStart(i), workers.chunkSize()),
+                                        result.items.data() + workers.chunkStart(i), cancelled));
+        workers.waitForDone();
+
+        result.value = VariantHeaderSize + CountSize;
+        for (int i=0; i<keys.count(); i++)
+            result.value += keySize(keys.at(i)) + result.items.at(i).value;
+        QVariantTreeDiff::indexItems(result, container->isList());
+    }
+    if (QVariantTreeWorkers::isCancelled(cancelled))
+        return false;
+
+    _root = result;
+    _rootType = root.userType();
+    _isEmpty = false;
+    return true;
+}
+
+void QVariantTreeSizeCache::clear()
+{
+    _root = Size();
+    _rootType = QVariant::Invalid;
+    _isEmpty = true;
+}
+
+//------------------------------------------------------------------------------
+
+qint64 QVariantTreeSizeCache::size(const QVariantList& address, bool* isValid) const
+{
+    const Size* node = &_root;
+    bool trueValid = !_isEmpty;
+    for (int depth=0; depth<address.count() && trueValid; depth++) {
+        const QVariant& key = address.at(depth);
+        int position = QVariantTreeDiff::itemOf(*node, key, QVariantTreeDiff::keyHash(key));
+        if (position < 0)
+            trueValid = false;
+        else
+            node = &node->items.at(position);
+    }
+
+    if (isValid)
+        *isValid = trueValid;
+    return trueValid ? node->value : 0;
+}
+
+qint64 QVariantTreeSizeCache::fileSize() const
+{
+    // nothing is written for an invalid root
+    if (_isEmpty || _rootType == QVariant::Invalid)
+        return 0;
+    if (_rootType == QVariant::List)
+        return _root.value - VariantHeaderSize - CountSize;
+    return _root.value;
+}
+
+qint64 QVariantTreeSizeCache::serializedSize(const QVariant& value)
+{
+    switch (value.userType()) {
+    case QVariant::Invalid:
+        return VariantHeaderSize;
+    case QVariant::Bool:
+        return VariantHeaderSize + 1;
+    case QVariant::Int:
+    case QVariant::UInt:
+        return VariantHeaderSize + 4;
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+        return VariantHeaderSize + 8;
+    case QVariant::String:
+        return VariantHeaderSize + stringSize(value.toString());
+    case QVariant::List: {
+        qint64 result = VariantHeaderSize + CountSize;
+        const QVariantList list = value.toList();
+        for (int i=0; i<list.count(); i++)
+            result += serializedSize(list.at(i));
+        return result;
+    }
+    case QVariant::Map: {
+        qint64 result = VariantHeaderSize + CountSize;
+        const QVariantMap map = value.toMap();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it)
+            result += stringSize(it.key()) + serializedSize(it.value());
+        return result;
+    }
+    case QVariant::Hash: {
+        qint64 result = VariantHeaderSize + CountSize;
+        const QVariantHash hash = value.toHash();
+        for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it)
+            result += stringSize(it.key()) + serializedSize(it.value());
+        return result;
+    }
+    default: {
+        // other types are measured on their serialization
+        QByteArray bytes;
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream << value;
+        return bytes.size();
+    }
+    }
+}
+
+QVariantTreeSizeCache::Size QVariantTreeSizeCache::measure(const QVariantTree& tree, const QVariant& value)
+{
+    Size result;
+    switch (value.userType()) {
+    case QVariant::List: {
+        const QVariantList list = value.toList();
+        result.value = VariantHeaderSize + CountSize;
+        result.items.resize(list.count());
+        for (int i=0; i<list.count(); i++) {
+            result.items[i] = measure(tree, list.at(i));
+            result.items[i].key = QVariantTreeDiff::keyHash(i);
+            result.value += result.items.at(i).value;
+        }
+        break;
+    }
+    case QVariant::Map: {
+        const QVariantMap map = value.toMap();
+        result.value = VariantHeaderSize + CountSize;
+        result.items.resize(map.count());
+        int i = 0;
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it, ++i) {
+            result.items[i] = measure(tree, it.value());
+            result.items[i].key = QVariantTreeDiff::keyHash(it.key());
+            result.value += stringSize(it.key()) + result.items.at(i).value;
+        }
+        QVariantTreeDiff::indexItems(result, false);
+        break;
+    }
+    case QVariant::Hash: {
+        const QVariantHash hash = value.toHash();
+        result.value = VariantHeaderSize + CountSize;
+        result.items.resize(hash.count());
+        int i = 0;
+        for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it, ++i) {
+            result.items[i] = measure(tree, it.value());
+            result.items[i].key = QVariantTreeDiff::keyHash(it.key());
+            result.value += stringSize(it.key()) + result.items.at(i).value;
+        }
+        QVariantTreeDiff::indexItems(result, false);
+        break;
+    }
+    default: {
+        // user type containers, as the persistent ones, are written as the
+        // plain collections they convert to
+        if (!isSummed(tree, value.userType())) {
+            result.value = serializedSize(value);
+            break;
+        }
+        QVariantTreeElementContainer* container = tree.containerOf(value.userType());
+        QVariantList keys = container->keys(value);
+        result.value = VariantHeaderSize + CountSize;
+        result.items.resize(keys.count());
+        for (int i=0; i<keys.count(); i++) {
+            result.items[i] = measure(tree, container->item(value, keys.at(i)));
+            result.items[i].key = QVariantTreeDiff::keyHash(keys.at(i));
+            result.value += keySize(keys.at(i)) + result.items.at(i).value;
+        }
+        QVariantTreeDiff::indexItems(result, container->isList());
+        break;
+    }
+    }
+    return result;
+}
+
+qint64 QVariantTreeSizeCache::keySize(const QVariant& key)
+{
+    // list indexes are not written
+    if (key.userType() == QVariant::Int)
+        return 0;
+    return stringSize(key.toString());
+}
+
+bool QVariantTreeSizeCache::isSummed(const QVariantTree& tree, int type)
+{
+    // a string list is written without a header per item, as a whole
+    if (type == QVariant::List || type == QVariant::Map || type == QVariant::Hash)
+        return true;
+    return type >= QMetaType::User && tree.containerOf(type) != NULL;
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeSizeCache::nodeChanged(const QVariantTree& tree,
+                                        const QVariantList& address,
+                                        const QVariant& oldValue)
+{
+    Q_UNUSED(oldValue)
+    if (_isEmpty)
+        return;
+    QVariant node = tree.rootContent(address);
+    if (address.isEmpty() || !isSummed(tree, node.userType())) {
+        build(tree);
+        return;
+    }
+
+    // down to the parent of the changed node, an edit inside a value
+    // measured as a whole changes that value
+    QVector<Size*> spine;
+    Size* parent = &_root;
+    int depth = 0;
+    for (; depth<address.count()-1; depth++) {
+        const QVariant& key = address.at(depth);
+        int position = QVariantTreeDiff::itemOf(*parent, key, QVariantTreeDiff::keyHash(key));
+        QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+        // not the measured tree
+        if (position < 0 || !container) {
+            build(tree);
+            return;
+        }
+        QVariant item = container->item(node, key);
+        if (!isSummed(tree, item.userType()))
+            break;
+        spine.append(parent);
+        parent = &parent->items[position];
+        node = item;
+    }
+
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (!container) {
+        build(tree);
+        return;
+    }
+
+    // the changed node is replaced, added or removed
+    const QVariant& key = address.at(depth);
+    quint64 keyHash = QVariantTreeDiff::keyHash(key);
+    int position = QVariantTreeDiff::itemOf(*parent, key, keyHash);
+    bool isPresent = container->contains(node, key);
+    if (position < 0 && !isPresent)
+        return;
+
+    qint64 delta = 0;
+    if (position >= 0)
+        delta -= keySize(key) + parent->items.at(position).value;
+    if (isPresent) {
+        Size item = measure(tree, container->item(node, key));
+        item.key = keyHash;
+        delta += keySize(key) + item.value;
+        if (position >= 0)
+            parent->items[position] = item;
+        else
+            QVariantTreeDiff::appendItem(*parent, item, container->isList());
+    }
+    else {
+        QVariantTreeDiff::removeItem(*parent, position, container->isList());
+    }
+
+    // the sizes are sums: each ancestor grows by the same amount
+    parent->value += delta;
+    for (int i=0; i<spine.count(); i++)
+        spine.at(i)->value += delta;
+}
+
+void QVariantTreeSizeCache::itemsChanged(const QVariantTree& tree,
+                                         const QVariantList& address,
+                                         int index,
+                                         const QVariantList& oldItems)
+{
+    if (_isEmpty)
+        return;
+
+    // down to the list
+    QVector<Size*> spine;
+    Size* list = &_root;
+    QVariant node = tree.rootContent(address);
+    for (int depth=0; depth<address.count(); depth++) {
+        const QVariant& key = address.at(depth);
+        int position = QVariantTreeDiff::itemOf(*list, key, QVariantTreeDiff::keyHash(key));
+        QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+        // not the measured tree
+        if (position < 0 || !container) {
+            build(tree);
+            return;
+        }
+        QVariant item = container->item(node, key);
+        // the list is inside a value measured as a whole
+        if (!isSummed(tree, item.userType())) {
+            nodeChanged(tree, address.mid(0, depth+1), QVariant());
+            return;
+        }
+        spine.append(list);
+        list = &list->items[position];
+        node = item;
+    }
+
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    int count = container ? container->size(node) : 0;
+    if (!container || !container->isList() || index > count
+            || list->items.count() != index + oldItems.count()) {
+        build(tree);
+        return;
+    }
+
+    // the items equal at both ends are kept, shared items compare at once
+    int oldCount = oldItems.count();
+    int newCount = count - index;
+    int suffix = 0;
+    while (suffix < oldCount && suffix < newCount
+           && oldItems.at(oldCount-1-suffix) == container->item(node, count-1-suffix))
+        suffix++;
+    int prefix = 0;
+    while (prefix < oldCount-suffix && prefix < newCount-suffix
+           && oldItems.at(prefix) == container->item(node, index+prefix))
+        prefix++;
+
+    // only the items in between are measured, list indexes are not written
+    int first = index + prefix;
+    int removed = oldCount - suffix - prefix;
+    int added = newCount - suffix - prefix;
+    qint64 delta = 0;
+    for (int i=first; i<first+removed; i++)
+        delta -= list->items.at(i).value;
+    list->items.remove(first, removed);
+    list->items.insert(first, added, Size());
+    for (int i=first; i<first+added; i++) {
+        Size& item = list->items[i];
+        item = measure(tree, container->item(node, i));
+        item.key = QVariantTreeDiff::keyHash(i);
+        delta += item.value;
+    }
+
+    // the shifted ones are keyed again by their index
+    if (added != removed) {
+        for (int i=first+added; i<list->items.count(); i++)
+            list->items[i].key = QVariantTreeDiff::keyHash(i);
+    }
+
+    list->value += delta;
+    for (int i=0; i<spine.count(); i++)
+        spine.at(i)->value += delta;
+}
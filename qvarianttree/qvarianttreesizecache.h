@@ -0,0 +1,105 @@
+#ifndef QVARIANTTREESIZECACHE_H
+#define QVARIANTTREESIZECACHE_H
+
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+
+#include "qvarianttreeobserver.h"
+
+class QVariantTree;
+
+
+/**
+ * @brief Serialized size of every subtree of a tree, kept up to date with
+ * the edits.
+ * The sizes are the exact number of bytes written by a QDataStream for
+ * each QVariant, the same as in the files of QVariantTree::toFile().
+ * The containers of the tree are summed from their items, the other
+ * values are measured as a whole. Another container, as a persistent one,
+ * is measured as the plain collection it is written as. Once built, the cache follows the edits of the
+ * tree as an observer: the replaced subtree is measured again, then the
+ * difference is added to each of its ancestors. The items shifted in a
+ * list are only keyed again.
+ * @code
+ * QVariantTreeSizeCache sizes;
+ * sizes.build(tree);
+ * tree.addObserver(&sizes);
+ * qint64 bytes = sizes.size(QVariantList() << "records" << 12);
+ * @endcode
+ */
+class QVariantTreeSizeCache : public QVariantTreeObserver
+{
+public:
+    QVariantTreeSizeCache();
+
+    /**
+     * @brief Measure the root content, indexed records of the tree are loaded.
+     */
+    void build(const QVariantTree& tree);
+    /**
+     * @brief Measure a root content, the top-level items from a thread pool.
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param cancelled Flag to stop the build, set from any thread.
+     * A cancelled cache is empty.
+     * @return False if cancelled
+     */
+    bool build(const QVariantTree& tree, const QVariant& root,
+               int workerCount = 0, const QAtomicInt* cancelled = NULL);
+    void clear();
+
+    bool isEmpty() const { return _isEmpty; }
+    /**
+     * @brief Serialized size of the QVariant at an address.
+     * @param isValid Set to false if there is no node at the address
+     */
+    qint64 size(const QVariantList& address, bool* isValid = NULL) const;
+    /**
+     * @brief Size of the file written by QVariantTree::toFile() for the
+     * root: the records of a root list are written without the list.
+     */
+    qint64 fileSize() const;
+
+    /**
+     * @brief Serialized size of a value, without writing it.
+     */
+    static qint64 serializedSize(const QVariant& value);
+
+    void nodeChanged(const QVariantTree& tree,
+                     const QVariantList& address,
+                     const QVariant& oldValue);
+    // the shifted items keep their sizes under their new keys
+    void itemsChanged(const QVariantTree& tree,
+                      const QVariantList& address,
+                      int index,
+                      const QVariantList& oldItems);
+
+private:
+    /**
+     * @brief Size of a subtree and of each of its items.
+     */
+    struct Size
+    {
+        qint64 value;
+        quint64 key; // hash of the key in the parent, 0 for a root
+        QVector<Size> items;
+        QHash<quint64, int> positions; // see QVariantTreeDiff::indexItems()
+
+        Size() : value(0), key(0) {}
+    };
+
+    class SizeChunk;
+
+    static Size measure(const QVariantTree& tree, const QVariant& value);
+    static qint64 keySize(const QVariant& key);
+    // the Qt collections and the user type containers are summed from their items
+    static bool isSummed(const QVariantTree& tree, int type);
+
+private:
+    Size _root;
+    int _rootType;
+    bool _isEmpty;
+};
+
+#endif // QVARIANTTREESIZECACHE_H
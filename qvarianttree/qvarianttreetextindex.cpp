@@ -0,0 +1,365 @@
+#include "qvarianttreetextindex.h"
+
+#include <algorithm>
+#include <QRunnable>
+
+#include "qvarianttree.h"
+#include "qvarianttreeworkers.h"
+
+
+namespace {
+
+// removed entries kept before a compaction, at least
+const int CompactMinimum = 4096;
+
+struct Hit
+{
+    int rank;
+    int length;
+    qint32 id;
+};
+
+bool hitBefore(const Hit& left, const Hit& right)
+{
+    if (left.rank != right.rank)
+        return left.rank < right.rank;
+    if (left.length != right.length)
+        return left.length < right.length;
+    return left.id < right.id;
+}
+
+bool sizeBefore(const QVector<qint32>* left, const QVector<qint32>* right)
+{
+    return left->count() < right->count();
+}
+
+// 0 equal, 1 prefix, 2 word, 3 anywhere
+int matchRank(const QString& value, const QString& text)
+{
+    if (value.compare(text, Qt::CaseInsensitive) == 0)
+        return 0;
+    if (value.startsWith(text, Qt::CaseInsensitive))
+        return 1;
+    for (int i = value.indexOf(text, 0, Qt::CaseInsensitive); i >= 0;
+         i = value.indexOf(text, i + 1, Qt::CaseInsensitive)) {
+        if (!value.at(i-1).isLetterOrNumber())
+            return 2;
+    }
+    return 3;
+}
+
+}
+
+/**
+ * @brief Index the subtrees of a range of top-level keys, with local ids.
+ */
+class QVariantTreeTextIndex::BuildChunk : public QRunnable
+{
+public:
+    BuildChunk(const QVariantTree& tree, const QVariant& root, const QVariantList& keys,
+               const QAtomicInt* cancelled) :
+        _tree(tree), _root(root), _keys(keys), _cancelled(cancelled)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        QVariantTreeElementContainer* container = _tree.containerOf(_root.userType());
+        for (int i=0; i<_keys.count() && !QVariantTreeWorkers::isCancelled(_cancelled); i++) {
+            QString encodedAddress = encodeKey(_keys.at(i));
+            collect(container->item(_root, _keys.at(i)), encodedAddress);
+        }
+    }
+
+    QVector<Entry> entries;
+    Postings postings;
+
+private:
+    void collect(const QVariant& node, QString& encodedAddress)
+    {
+        QVariantTreeElementContainer* container = _tree.containerOf(node.userType());
+        if (container) {
+            int length = encodedAddress.length();
+            QVariantList keys = container->keys(node);
+            for (int i=0; i<keys.count(); i++) {
+                encodedAddress.append(encodeKey(keys.at(i)));
+                collect(container->item(node, keys.at(i)), encodedAddress);
+                encodedAddress.truncate(length);
+            }
+        }
+        else if (node.userType() == QVariant::String) {
+            Entry entry;
+            entry.address = encodedAddress;
+            entry.text = node.toString();
+            entry.isRemoved = false;
+            appendTrigrams(postings, entry.text, entries.count());
+            entries.append(entry);
+        }
+    }
+
+private:
+    const QVariantTree& _tree;
+    QVariant _root;
+    QVariantList _keys;
+    const QAtomicInt* _cancelled;
+};
+
+//==============================================================================
+
+QVariantTreeTextIndex::QVariantTreeTextIndex() :
+    _entries(),
+    _ids(),
+    _postings()
+{
+}
+
+void QVariantTreeTextIndex::build(const QVariantTree& tree)
+{
+    build(tree, tree.rootContent());
+}
+
+bool QVariantTreeTextIndex::build(const QVariantTree& tree, const QVariant& root,
+                                  int workerCount, const QAtomicInt* cancelled)
+{
+    clear();
+
+    QVariantTreeElementContainer* container = tree.containerOf(root.userType());
+    if (container == NULL) {
+        QString encodedAddress;
+        addLeaves(tree, root, encodedAddress);
+        return true;
+    }
+
+    QVariantList keys = container->keys(root);
+    QVariantTreeWorkers workers(workerCount, keys.count());
+    QList<BuildChunk*> chunks;
+    for (int i=0; i<workers.chunkCount(); i++) {
+        chunks.append(new BuildChunk(tree, root, keys.mid(workers.chunkStart(i), workers.chunkSize()),
+                                     cancelled));
+        workers.start(chunks.last());
+    }
+    workers.waitForDone();
+
+    // chunks in order: the merged lists stay sorted
+    if (!QVariantTreeWorkers::isCancelled(cancelled)) {
+        foreach (BuildChunk* chunk, chunks) {
+            qint32 offset = _entries.count();
+            _entries += chunk->entries;
+            for (int i=0; i<chunk->entries.count(); i++)
+                _ids.insert(chunk->entries.at(i).address, offset + i);
+
+            for (Postings::const_iterator it = chunk->postings.constBegin();
+                 it != chunk->postings.constEnd(); ++it) {
+                QVector<qint32>& ids = _postings[it.key()];
+                ids.reserve(ids.count() + it.value().count());
+                for (int i=0; i<it.value().count(); i++)
+                    ids.append(it.value().at(i) + offset);
+            }
+            delete chunk;
+        }
+        return true;
+    }
+
+    qDeleteAll(chunks);
+    return false;
+}
+
+void QVariantTreeTextIndex::clear()
+{
+    _entries.clear();
+    _ids.clear();
+    _postings.clear();
+}
+
+qint64 QVariantTreeTextIndex::memoryUsage() const
+{
+    qint64 result = (qint64)_entries.capacity() * sizeof(Entry);
+    for (int i=0; i<_entries.count(); i++)
+        result += (qint64)(_entries.at(i).address.capacity() + _entries.at(i).text.capacity())
+                * sizeof(QChar);
+
+    // the keys share the addresses of the entries
+    result += (qint64)_ids.count() * (2 * sizeof(void*) + sizeof(uint) + sizeof(QString) + sizeof(qint32));
+
+    for (Postings::const_iterator it = _postings.constBegin(); it != _postings.constEnd(); ++it)
+        result += 2 * sizeof(void*) + sizeof(uint) + sizeof(quint64) + sizeof(QVector<qint32>)
+                + 16 + (qint64)it.value().capacity() * sizeof(qint32);
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+QList<QVariantList> QVariantTreeTextIndex::find(const QString& text, int maximum) const
+{
+    QList<QVariantList> result;
+    if (text.isEmpty())
+        return result;
+
+    QString folded = text.toCaseFolded();
+    QVector<qint32> ids;
+    if (folded.length() < 3) {
+        ids.reserve(_entries.count());
+        for (qint32 id=0; id<_entries.count(); id++)
+            ids.append(id);
+    }
+    else
+        ids = candidates(folded);
+
+    // candidates hold every trigram, not always in sequence
+    QVector<Hit> hits;
+    for (int i=0; i<ids.count(); i++) {
+        const Entry& entry = _entries.at(ids.at(i));
+        if (entry.isRemoved || !entry.text.contains(text, Qt::CaseInsensitive))
+            continue;
+        Hit hit;
+        hit.rank = matchRank(entry.text, text);
+        hit.length = entry.text.length();
+        hit.id = ids.at(i);
+        hits.append(hit);
+    }
+    std::sort(hits.begin(), hits.end(), hitBefore);
+
+    int count = (maximum < 0) ? hits.count() : qMin(maximum, hits.count());
+    result.reserve(count);
+    for (int i=0; i<count; i++)
+        result.append(decodeAddress(_entries.at(hits.at(i).id).address));
+    return result;
+}
+
+QVector<qint32> QVariantTreeTextIndex::candidates(const QString& folded) const
+{
+    QVector<const QVector<qint32>*> lists;
+    for (int i=0; i+3<=folded.length(); i++) {
+        Postings::const_iterator it = _postings.constFind(trigram(folded.constData() + i));
+        if (it == _postings.constEnd())
+            return QVector<qint32>();
+        if (!lists.contains(&it.value()))
+            lists.append(&it.value());
+    }
+
+    // the shortest lists first, the intersection only shrinks
+    std::sort(lists.begin(), lists.end(), sizeBefore);
+    QVector<qint32> result = *lists.first();
+    for (int i=1; i<lists.count() && !result.isEmpty(); i++) {
+        QVector<qint32> intersection(qMin(result.count(), lists.at(i)->count()));
+        QVector<qint32>::iterator end = std::set_intersection(
+                    result.constBegin(), result.constEnd(),
+                    lists.at(i)->constBegin(), lists.at(i)->constEnd(),
+                    intersection.begin());
+        intersection.resize(end - intersection.begin());
+        result = intersection;
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeTextIndex::nodeChanged(const QVariantTree& tree,
+                                        const QVariantList& address,
+                                        const QVariant& oldValue)
+{
+    QString encodedAddress = encodeAddress(address);
+    removeLeaves(tree, oldValue, encodedAddress);
+
+    bool isValid = false;
+    QVariant newValue = tree.getTreeValue(address, &isValid);
+    if (isValid)
+        addLeaves(tree, newValue, encodedAddress);
+
+    int removedCount = _entries.count() - _ids.count();
+    if (removedCount > qMax(CompactMinimum, _ids.count()))
+        compact();
+}
+
+void QVariantTreeTextIndex::addLeaves(const QVariantTree& tree, const QVariant& node,
+                                      QString& encodedAddress)
+{
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container) {
+        int length = encodedAddress.length();
+        QVariantList keys = container->keys(node);
+        for (int i=0; i<keys.count(); i++) {
+            encodedAddress.append(encodeKey(keys.at(i)));
+            addLeaves(tree, container->item(node, keys.at(i)), encodedAddress);
+            encodedAddress.truncate(length);
+        }
+    }
+    else if (node.userType() == QVariant::String) {
+        Entry entry;
+        entry.address = encodedAddress;
+        entry.text = node.toString();
+        entry.isRemoved = false;
+
+        // new ids are the highest: the lists stay sorted
+        qint32 id = _entries.count();
+        appendTrigrams(_postings, entry.text, id);
+        _entries.append(entry);
+        _ids.insert(entry.address, id);
+    }
+}
+
+void QVariantTreeTextIndex::removeLeaves(const QVariantTree& tree, const QVariant& node,
+                                         QString& encodedAddress)
+{
+    QVariantTreeElementContainer* container = tree.containerOf(node.userType());
+    if (container) {
+        int length = encodedAddress.length();
+        QVariantList keys = container->keys(node);
+        for (int i=0; i<keys.count(); i++) {
+            encodedAddress.append(encodeKey(keys.at(i)));
+            removeLeaves(tree, container->item(node, keys.at(i)), encodedAddress);
+            encodedAddress.truncate(length);
+        }
+    }
+    else if (node.userType() == QVariant::String) {
+        // the lists keep the id until the next compaction
+        QHash<QString, qint32>::iterator it = _ids.find(encodedAddress);
+        if (it == _ids.end())
+            return;
+        Entry& entry = _entries[it.value()];
+        entry.isRemoved = true;
+        entry.address.clear();
+        entry.text.clear();
+        _ids.erase(it);
+    }
+}
+
+void QVariantTreeTextIndex::compact()
+{
+    QVector<Entry> entries;
+    entries.reserve(_ids.count());
+    _ids.clear();
+    _postings.clear();
+
+    for (int i=0; i<_entries.count(); i++) {
+        const Entry& entry = _entries.at(i);
+        if (entry.isRemoved)
+            continue;
+        qint32 id = entries.count();
+        appendTrigrams(_postings, entry.text, id);
+        _ids.insert(entry.address, id);
+        entries.append(entry);
+    }
+    _entries = entries;
+}
+
+//------------------------------------------------------------------------------
+
+void QVariantTreeTextIndex::appendTrigrams(Postings& postings, const QString& text, qint32 id)
+{
+    QString folded = text.toCaseFolded();
+    for (int i=0; i+3<=folded.length(); i++) {
+        // ids are appended in increasing order, a repeated trigram is the last one
+        QVector<qint32>& ids = postings[trigram(folded.constData() + i)];
+        if (ids.isEmpty() || ids.last() != id)
+            ids.append(id);
+    }
+}
+
+quint64 QVariantTreeTextIndex::trigram(const QChar* folded)
+{
+    return ((quint64)folded[0].unicode() << 32)
+            | ((quint64)folded[1].unicode() << 16)
+            | (quint64)folded[2].unicode();
+}
@@ -0,0 +1,97 @@
+#ifndef QVARIANTTREETEXTINDEX_H
+#define QVARIANTTREETEXTINDEX_H
+
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+
+#include "qvarianttreeobserver.h"
+
+class QVariantTree;
+
+
+/**
+ * @brief Trigram index of the string values of a tree, for substring search.
+ * Each sequence of 3 characters (case folded) lists the string leaves holding
+ * it: a query only verifies the leaves holding all of its trigrams.
+ * Once built, the index follows the edits of the tree as an observer. Removed
+ * leaves are only marked, the lists are compacted once they are mostly stale.
+ * @code
+ * QVariantTreeTextIndex index;
+ * index.build(tree, tree.rootContent());
+ * tree.addObserver(&index);
+ * QList<QVariantList> hits = index.find("timeout", 100);
+ * @endcode
+ */
+class QVariantTreeTextIndex : public QVariantTreeObserver
+{
+public:
+    QVariantTreeTextIndex();
+
+    /**
+     * @brief Index the root content, indexed records of the tree are loaded.
+     */
+    void build(const QVariantTree& tree);
+    /**
+     * @brief Index a root content with the containers of the tree.
+     * The top-level items are indexed from a thread pool.
+     * @param workerCount Number of threads, <= 0 for the ideal count
+     * @param cancelled Flag to stop the build, set from any thread.
+     * A cancelled index is empty.
+     * @return False if cancelled
+     */
+    bool build(const QVariantTree& tree, const QVariant& root,
+               int workerCount = 0, const QAtomicInt* cancelled = NULL);
+    void clear();
+
+    bool isEmpty() const { return _ids.isEmpty(); }
+    /** @brief Number of indexed string values. */
+    int count() const { return _ids.count(); }
+    /** @brief Number of distinct trigrams. */
+    int trigramCount() const { return _postings.count(); }
+    /** @brief Estimated bytes held by the index. */
+    qint64 memoryUsage() const;
+
+    /**
+     * @brief Addresses of the string values containing the text, case
+     * insensitive. Exact matches come first, then the values starting with
+     * the text, then the ones containing it as a word, each group by
+     * increasing length.
+     * Texts shorter than a trigram are looked for in every value.
+     * @param maximum Number of addresses returned at most, -1 for all
+     */
+    QList<QVariantList> find(const QString& text, int maximum = -1) const;
+
+    void nodeChanged(const QVariantTree& tree,
+                     const QVariantList& address,
+                     const QVariant& oldValue);
+
+private:
+    struct Entry
+    {
+        QString address; // encoded
+        QString text;
+        bool isRemoved;
+    };
+    typedef QHash<quint64, QVector<qint32> > Postings;
+
+    class BuildChunk;
+
+    static void appendTrigrams(Postings& postings, const QString& text, qint32 id);
+    static quint64 trigram(const QChar* folded);
+
+    void addLeaves(const QVariantTree& tree, const QVariant& node, QString& encodedAddress);
+    void removeLeaves(const QVariantTree& tree, const QVariant& node, QString& encodedAddress);
+    QVector<qint32> candidates(const QString& folded) const;
+    void compact();
+
+private:
+    QVector<Entry> _entries;
+    /** @brief Entry of each indexed address, removed ones excluded. */
+    QHash<QString, qint32> _ids;
+    /** @brief Sorted entries of each trigram. */
+    Postings _postings;
+};
+
+#endif // QVARIANTTREETEXTINDEX_H
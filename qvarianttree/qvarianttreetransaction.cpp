@@ -0,0 +1,57 @@
+#include "qvarianttreetransaction.h"
+
+
+QVariantTreeTransaction::QVariantTreeTransaction() :
+    _operations()
+{
+}
+
+void QVariantTreeTransaction::setValue(const QVariantList& address, const QVariant& value)
+{
+    Operation operation;
+    operation.type = SetOperation;
+    operation.address = address;
+    operation.value = value;
+    _operations.append(operation);
+}
+
+void QVariantTreeTransaction::insertValue(const QVariantList& address, const QVariant& value)
+{
+    Operation operation;
+    operation.type = InsertOperation;
+    operation.address = address;
+    operation.value = value;
+    _operations.append(operation);
+}
+
+void QVariantTreeTransaction::delValue(const QVariantList& address)
+{
+    Operation operation;
+    operation.type = DelOperation;
+    operation.address = address;
+    _operations.append(operation);
+}
+
+//==============================================================================
+
+QVariantTreeChangeSet::QVariantTreeChangeSet() :
+    _changed(),
+    _failed(),
+    _applied()
+{
+}
+
+bool QVariantTreeChangeSet::affects(const QVariantList& address) const
+{
+    QList<QVariantList>::const_iterator it = _changed.constBegin();
+    for (; it != _changed.constEnd(); ++it) {
+        const QVariantList& changed = *it;
+        int depth = qMin(changed.count(), address.count());
+        bool isPrefix = true;
+        for (int i=0; isPrefix && i<depth; i++)
+            isPrefix = (changed.at(i) == address.at(i));
+        if (isPrefix)
+            return true;
+    }
+    return false;
+}
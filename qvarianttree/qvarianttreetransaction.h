@@ -0,0 +1,79 @@
+#ifndef QVARIANTTREETRANSACTION_H
+#define QVARIANTTREETRANSACTION_H
+
+#include <QVariant>
+#include <QList>
+
+
+/**
+ * @brief Record of set/insert/delete operations, applied at once by
+ * QVariantTree::apply().
+ * All addresses refer to the tree as it is before the transaction:
+ * list indexes are not shifted by the insertions / deletions recorded before.
+ */
+class QVariantTreeTransaction
+{
+public:
+    enum OperationType {
+        SetOperation,
+        InsertOperation,
+        DelOperation
+    };
+
+    struct Operation {
+        OperationType type;
+        QVariantList address;
+        QVariant value;
+    };
+
+    explicit QVariantTreeTransaction();
+
+    void setValue(const QVariantList& address, const QVariant& value);
+    void insertValue(const QVariantList& address, const QVariant& value);
+    void delValue(const QVariantList& address);
+
+    QList<Operation> operations() const { return _operations; }
+    int count() const { return _operations.count(); }
+    bool isEmpty() const { return _operations.isEmpty(); }
+    void clear() { _operations.clear(); }
+
+private:
+    QList<Operation> _operations;
+};
+
+//==============================================================================
+
+/**
+ * @brief Consolidated result of a transaction.
+ */
+class QVariantTreeChangeSet
+{
+    friend class QVariantTree;
+
+public:
+    explicit QVariantTreeChangeSet();
+
+    QList<QVariantList> changedAddresses() const { return _changed; }
+    QList<QVariantList> failedAddresses() const { return _failed; }
+    bool isEmpty() const { return _changed.isEmpty(); }
+
+    /**
+     * @brief The operations that succeeded, in the order they were applied:
+     * each address refers to the tree as left by the previous operation,
+     * as QVariantTreeJournal replays them.
+     */
+    QList<QVariantTreeTransaction::Operation> appliedOperations() const { return _applied; }
+
+    /**
+     * @brief Check if the node at the given address is modified, either
+     * directly, by one of its ancestors or by one of its children.
+     */
+    bool affects(const QVariantList& address) const;
+
+private:
+    QList<QVariantList> _changed;
+    QList<QVariantList> _failed;
+    QList<QVariantTreeTransaction::Operation> _applied;
+};
+
+#endif // QVARIANTTREETRANSACTION_H
@@ -0,0 +1,36 @@
+#include "qvarianttreeworkers.h"
+
+#include <QThread>
+#include <QRunnable>
+
+
+const int QVariantTreeWorkers::ChunksPerWorker;
+
+QVariantTreeWorkers::QVariantTreeWorkers(int workerCount, int itemCount) :
+    _pool(),
+    _workerCount(threadCount(workerCount)),
+    _chunkSize(qMax(1, itemCount / (_workerCount * ChunksPerWorker))),
+    _chunkCount((itemCount + _chunkSize - 1) / _chunkSize)
+{
+    _pool.setMaxThreadCount(_workerCount);
+}
+
+void QVariantTreeWorkers::start(QRunnable* chunk)
+{
+    _pool.start(chunk);
+}
+
+void QVariantTreeWorkers::waitForDone()
+{
+    _pool.waitForDone();
+}
+
+int QVariantTreeWorkers::threadCount(int workerCount)
+{
+    return workerCount > 0 ? workerCount : QThread::idealThreadCount();
+}
+
+bool QVariantTreeWorkers::isCancelled(const QAtomicInt* cancelled)
+{
+    return cancelled && cancelled->loadAcquire() != 0;
+}
@@ -0,0 +1,60 @@
+#ifndef QVARIANTTREEWORKERS_H
+#define QVARIANTTREEWORKERS_H
+
+#include <QAtomicInt>
+#include <QThreadPool>
+
+class QRunnable;
+
+
+/**
+ * @brief Worker threads running the chunks of a parallel pass.
+ * The items of a pass are split in more chunks than workers, small chunks
+ * balance uneven subtrees. The chunks are started in order, the results of
+ * a chunk are merged by the caller once the workers are done.
+ * @code
+ * QVariantTreeWorkers workers(workerCount, keys.count());
+ * for (int i=0; i<workers.chunkCount(); i++)
+ *     workers.start(new Chunk(keys.mid(workers.chunkStart(i), workers.chunkSize())));
+ * workers.waitForDone();
+ * @endcode
+ */
+class QVariantTreeWorkers
+{
+public:
+    // chunks per worker
+    static const int ChunksPerWorker = 8;
+
+    /**
+     * @param workerCount Number of threads, 0 for the ideal thread count
+     * @param itemCount Number of items split in chunks
+     */
+    QVariantTreeWorkers(int workerCount, int itemCount);
+
+    int workerCount() const { return _workerCount; }
+    int chunkSize() const { return _chunkSize; }
+    int chunkCount() const { return _chunkCount; }
+    int chunkStart(int chunk) const { return chunk * _chunkSize; }
+
+    /**
+     * @brief Run a chunk on a worker, deleted once done if auto-deleted.
+     */
+    void start(QRunnable* chunk);
+    void waitForDone();
+
+    /**
+     * @brief Number of threads, the ideal thread count for 0 or less.
+     */
+    static int threadCount(int workerCount);
+    static bool isCancelled(const QAtomicInt* cancelled);
+
+private:
+    Q_DISABLE_COPY(QVariantTreeWorkers)
+
+    QThreadPool _pool;
+    int _workerCount;
+    int _chunkSize;
+    int _chunkCount;
+};
+
+#endif // QVARIANTTREEWORKERS_H
@@ -1,6 +1,20 @@
 #include "tst_treegsd.h"
 
 #include <QDebug>
+#include <QBuffer>
+#include <QTemporaryFile>
+
+#include "qvarianttreerecordreader.h"
+#include "qvarianttreecompressed.h"
+#include "qvarianttreehistory.h"
+#include "qvarianttreepersistent.h"
+#include "qvarianttreeflat.h"
+#include "qvarianttreesearch.h"
+#include "qvarianttreekeyindex.h"
+#include "qvarianttreetextindex.h"
+#include "qvarianttreequery.h"
+#include "qvarianttreehashcache.h"
+#include "qvarianttreesizecache.h"
 
 QTEST_APPLESS_MAIN(TreeGSD)
 
@@ -14,6 +28,26 @@ TreeGSD::~TreeGSD()
 {
 }
 
+QVariantList TreeGSD::makeRecords(int count)
+{
+    QVariantList records;
+    records.reserve(count);
+    for (int i=0; i<count; i++) {
+        QVariantMap record;
+        record.insert("id", i);
+        record.insert("sensorId", QString("sensor-%1").arg(i));
+        record.insert("temperature", i / 10.0);
+        record.insert("date", QDate(2020, 1, 1).addDays(i));
+        QVariantHash position;
+        position.insert("x", i);
+        position.insert("y", -i);
+        record.insert("position", position);
+        record.insert("tags", QStringList() << "raw" << (i % 2 ? "odd" : "even"));
+        records << record;
+    }
+    return records;
+}
+
 
 void TreeGSD::init()
 {
@@ -194,3 +228,1734 @@ void TreeGSD::test07DelContainerList()
     QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), addr, &isValid) == QVariant(false));
     QVERIFY(isValid);
 }
+
+
+void TreeGSD::test08GetContainerMapHash()
+{
+    QVariantHash hash;
+    hash.insert(QLatin1String("key"), QVariant(QLatin1String("in hash")));
+    QVariantMap map;
+    map.insert(QLatin1String("first"), QVariant(42));
+    map.insert(QLatin1String("second"), QVariant(hash));
+    map.insert(QLatin1String("third"), QVariant(QStringList() << QLatin1String("a") << QLatin1String("b")));
+    m_tree.setRootContent(map);
+
+    QVERIFY(m_tree.isValid());
+    QVERIFY(m_tree.nodeType() == QVariant::Map);
+    QVERIFY(m_tree.nodeIsContainer());
+
+    // check valid
+    bool isValid = false;
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("first")), &isValid) == QVariant(42));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("second")) << QVariant(QLatin1String("key")), &isValid) == QVariant(QLatin1String("in hash")));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("third")) << QVariant(1), &isValid) == QVariant(QLatin1String("b")));
+    QVERIFY(isValid);
+
+    // check invalid
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("fourth")), &isValid).isValid() == false);
+    QVERIFY(isValid == false);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("second")) << QVariant(QLatin1String("none")), &isValid).isValid() == false);
+    QVERIFY(isValid == false);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("third")) << QVariant(2), &isValid).isValid() == false);
+    QVERIFY(isValid == false);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("third")) << QVariant(QLatin1String("x")), &isValid).isValid() == false);
+    QVERIFY(isValid == false);
+
+    // set through map and hash
+    m_tree.setTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("second")) << QVariant(QLatin1String("key")), QVariant(7), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(QLatin1String("second")) << QVariant(QLatin1String("key")), &isValid) == QVariant(7));
+    QVERIFY(isValid);
+}
+
+
+void TreeGSD::test09SetDelInPlace()
+{
+    QVariantMap map;
+    map.insert(QLatin1String("names"), QVariant(QStringList() << QLatin1String("a") << QLatin1String("b")));
+    map.insert(QLatin1String("values"), QVariant(QVariantList() << QVariant(1) << QVariant(2)));
+    QVariantList list;
+    list.append(QVariant(map));
+    list.append(QVariant(QLatin1String("sibling")));
+    m_tree.setRootContent(list);
+
+    // a snapshot must not see in place modifications
+    QVariant snapshot = m_tree.rootContent();
+
+    bool isValid = false;
+    QVariantList addr;
+    addr << QVariant(0) << QVariant(QLatin1String("values")) << QVariant(1);
+    m_tree.setTreeValue(addr, QVariant(QLatin1String("two")), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), addr, &isValid) == QVariant(QLatin1String("two")));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(snapshot, addr, &isValid) == QVariant(2));
+    QVERIFY(isValid);
+
+    // string list is edited through the container fallback
+    addr.clear();
+    addr << QVariant(0) << QVariant(QLatin1String("names")) << QVariant(0);
+    m_tree.setTreeValue(addr, QVariant(QLatin1String("z")), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), addr, &isValid) == QVariant(QLatin1String("z")));
+    QVERIFY(isValid);
+    m_tree.delTreeValue(addr, &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), addr, &isValid) == QVariant(QLatin1String("b")));
+    QVERIFY(isValid);
+
+    // delete inside the map
+    addr.clear();
+    addr << QVariant(0) << QVariant(QLatin1String("values"));
+    m_tree.delTreeValue(addr, &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), addr, &isValid).isValid() == false);
+    QVERIFY(isValid == false);
+    QVERIFY(m_tree.getTreeValue(snapshot, addr, &isValid).isValid());
+    QVERIFY(isValid);
+
+    // invalid address leaves the tree untouched
+    addr.clear();
+    addr << QVariant(5) << QVariant(0);
+    m_tree.setTreeValue(addr, QVariant(0), &isValid);
+    QVERIFY(isValid == false);
+    m_tree.delTreeValue(addr, &isValid);
+    QVERIFY(isValid == false);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(1), &isValid) == QVariant(QLatin1String("sibling")));
+    QVERIFY(isValid);
+}
+
+
+void TreeGSD::test10NodeCursor()
+{
+    QVariantMap map;
+    map.insert(QLatin1String("inner"), QVariant(QVariantList() << QVariant(1) << QVariant(2) << QVariant(3)));
+    QVariantList list;
+    list.append(QVariant(map));
+    list.append(QVariant(QVariantList() << QVariant(QLatin1String("other"))));
+    m_tree.setRootContent(list);
+
+    // move down
+    m_tree.moveToNode(QVariant(0));
+    QVERIFY(m_tree.nodeType() == QVariant::Map);
+    m_tree.moveToNode(QVariant(QLatin1String("inner")));
+    QVERIFY(m_tree.nodeType() == QVariant::List);
+    QVERIFY(m_tree.nodeValue() == QVariant(QVariantList() << QVariant(1) << QVariant(2) << QVariant(3)));
+    QVERIFY(m_tree.address() == (QVariantList() << QVariant(0) << QVariant(QLatin1String("inner"))));
+
+    // edit below the cursor refreshes the nodes
+    m_tree.setItemContainer(QVariant(1), QVariant(20));
+    QVERIFY(m_tree.getItemContainer(QVariant(1)) == QVariant(20));
+    m_tree.delItemContainer(QVariant(0));
+    QVERIFY(m_tree.nodeValue() == QVariant(QVariantList() << QVariant(20) << QVariant(3)));
+    m_tree.setNodeValue(QVariant(QLatin1String("leaf")));
+    QVERIFY(m_tree.nodeType() == QVariant::String);
+    QVERIFY(m_tree.nodeValue() == QVariant(QLatin1String("leaf")));
+
+    // edit in another branch keeps the node
+    bool isValid = false;
+    m_tree.setTreeValue(QVariantList() << QVariant(1) << QVariant(0), QVariant(5), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.nodeValue() == QVariant(QLatin1String("leaf")));
+
+    // edit of an ancestor invalidates the node
+    m_tree.setTreeValue(QVariantList() << QVariant(0), QVariant(false), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.nodeValue().isValid() == false);
+
+    // move up
+    m_tree.moveToParent();
+    QVERIFY(m_tree.nodeValue() == QVariant(false));
+    m_tree.moveToParent();
+    QVERIFY(m_tree.nodeIsRoot());
+    QVERIFY(m_tree.nodeValue() == m_tree.rootContent());
+
+    // removal shifts list siblings under the cursor
+    m_tree.moveToNode(QVariant(1));
+    m_tree.moveToParent();
+    m_tree.moveToNode(QVariant(1));
+    m_tree.delTreeValue(QVariantList() << QVariant(0), &isValid);
+    QVERIFY(isValid);
+    QVERIFY(m_tree.nodeValue().isValid() == false);
+    m_tree.moveToRoot();
+    QVERIFY(m_tree.nodeValue() == QVariant(QVariantList() << QVariant(QVariantList() << QVariant(5))));
+}
+
+
+void TreeGSD::test11RegisterContainer()
+{
+    const uint customType = QVariant::UserType + 10;
+
+    QVERIFY(m_tree.typeIsContainer(customType) == false);
+    QVERIFY(m_tree.setContainer(customType, new QVariantTreeListContainer) == NULL);
+    QVERIFY(m_tree.typeIsContainer(customType));
+
+    // unregister
+    delete m_tree.setContainer(customType, NULL);
+    QVERIFY(m_tree.typeIsContainer(customType) == false);
+    QVERIFY(m_tree.typeIsContainer(QVariant::List));
+}
+
+
+void TreeGSD::test12Transaction()
+{
+    QVariantMap map;
+    map.insert(QLatin1String("a"), QVariant(1));
+    map.insert(QLatin1String("b"), QVariant(QVariantList() << QVariant(10) << QVariant(20) << QVariant(30)));
+    QVariantList list;
+    list.append(QVariant(map));
+    list.append(QVariant(QLatin1String("x")));
+    list.append(QVariant(QLatin1String("y")));
+    m_tree.setRootContent(list);
+    m_tree.moveToNode(QVariant(0));
+
+    // addresses refer to the tree before the transaction
+    QVariantTreeTransaction transaction;
+    transaction.setValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("a")), QVariant(2));
+    transaction.delValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("b")) << QVariant(0));
+    transaction.insertValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("b")) << QVariant(3), QVariant(40));
+    transaction.insertValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("b")) << QVariant(1), QVariant(15));
+    transaction.setValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("b")) << QVariant(2), QVariant(300));
+    transaction.insertValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("c")), QVariant(true));
+    transaction.delValue(QVariantList() << QVariant(1));
+    transaction.setValue(QVariantList() << QVariant(5), QVariant(0));
+    QVERIFY(transaction.count() == 8);
+
+    QVariantTreeChangeSet changeSet = m_tree.apply(transaction);
+    QVERIFY(changeSet.isEmpty() == false);
+    QVERIFY(changeSet.failedAddresses() == (QList<QVariantList>() << (QVariantList() << QVariant(5))));
+    QVERIFY(changeSet.affects(QVariantList() << QVariant(0) << QVariant(QLatin1String("b"))));
+
+    bool isValid = false;
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(0) << QVariant(QLatin1String("a")), &isValid) == QVariant(2));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(0) << QVariant(QLatin1String("b")), &isValid)
+            == QVariant(QVariantList() << QVariant(15) << QVariant(20) << QVariant(300) << QVariant(40)));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(0) << QVariant(QLatin1String("c")), &isValid) == QVariant(true));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(1), &isValid) == QVariant(QLatin1String("y")));
+    QVERIFY(isValid);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(2), &isValid).isValid() == false);
+
+    // the cursor follows the transaction
+    QVERIFY(m_tree.getItemContainer(QVariant(QLatin1String("c"))) == QVariant(true));
+
+    // an isolated change doesn't affect its siblings
+    transaction.clear();
+    transaction.setValue(QVariantList() << QVariant(0) << QVariant(QLatin1String("a")), QVariant(3));
+    changeSet = m_tree.apply(transaction);
+    QVERIFY(changeSet.affects(QVariantList() << QVariant(0)));
+    QVERIFY(changeSet.affects(QVariantList() << QVariant(1)) == false);
+
+    // map keys that look like numbers are plain strings
+    QVariantMap numbers;
+    numbers.insert(QLatin1String("2"), QVariant(2));
+    numbers.insert(QLatin1String("10"), QVariant(10));
+    numbers.insert(QLatin1String("1a"), QVariant(1));
+    m_tree.setRootContent(numbers);
+    transaction.clear();
+    transaction.delValue(QVariantList() << QVariant(QLatin1String("2")));
+    transaction.delValue(QVariantList() << QVariant(QLatin1String("10")));
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("1a")), QVariant(3));
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("20")), QVariant(20));
+    changeSet = m_tree.apply(transaction);
+    QVERIFY(changeSet.failedAddresses().isEmpty());
+    QVariantMap expected;
+    expected.insert(QLatin1String("1a"), QVariant(3));
+    expected.insert(QLatin1String("20"), QVariant(20));
+    QVERIFY(m_tree.rootContent() == QVariant(expected));
+
+    // on the same map key, the last recorded operation wins
+    transaction.clear();
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("k")), QVariant(1));
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("k")), QVariant(2));
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("20")), QVariant(21));
+    transaction.delValue(QVariantList() << QVariant(QLatin1String("20")));
+    transaction.delValue(QVariantList() << QVariant(QLatin1String("1a")));
+    transaction.insertValue(QVariantList() << QVariant(QLatin1String("1a")), QVariant(4));
+    changeSet = m_tree.apply(transaction);
+    QVERIFY(changeSet.failedAddresses().isEmpty());
+    expected.clear();
+    expected.insert(QLatin1String("k"), QVariant(2));
+    expected.insert(QLatin1String("1a"), QVariant(4));
+    QVERIFY(m_tree.rootContent() == QVariant(expected));
+
+    // an integer key and a string key are distinct steps of the batch
+    m_tree.setRootContent(QVariantList() << QVariant(QVariantList() << QVariant(0))
+                                         << QVariant(QVariantList() << QVariant(1)));
+    transaction.clear();
+    transaction.setValue(QVariantList() << QVariant(1) << QVariant(0), QVariant(10));
+    transaction.setValue(QVariantList() << QVariant(QLatin1String("1")) << QVariant(0), QVariant(11));
+    changeSet = m_tree.apply(transaction);
+    QVERIFY(changeSet.failedAddresses().isEmpty());
+    QCOMPARE(changeSet.appliedOperations().count(), 2);
+    QVERIFY(m_tree.getTreeValue(m_tree.rootContent(), QVariantList() << QVariant(1) << QVariant(0)) == QVariant(11));
+}
+
+
+void TreeGSD::test13RecordReader()
+{
+    QVariantList records;
+    records << QVariant(1) << QVariant(QLatin1String("second")) << QVariant(QVariantList() << QVariant(true));
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&buffer, records);
+    buffer.close();
+
+    // all records, with contiguous offsets
+    buffer.open(QIODevice::ReadOnly);
+    QVariantTreeRecordReader reader(&buffer);
+    qint64 offset = 0;
+    int count = 0;
+    while (reader.readNext()) {
+        QVERIFY(reader.recordIndex() == count);
+        QVERIFY(reader.record() == records.value(count));
+        QVERIFY(reader.recordOffset() == offset);
+        QVERIFY(reader.recordSize() > 0);
+        offset += reader.recordSize();
+        count++;
+    }
+    QVERIFY(count == records.count());
+    QVERIFY(offset == buffer.size());
+    QVERIFY(reader.atEnd());
+    buffer.close();
+
+    // early termination
+    buffer.open(QIODevice::ReadOnly);
+    QVariantTreeRecordReader partialReader(&buffer);
+    QVERIFY(partialReader.readNext());
+    QVERIFY(partialReader.record() == QVariant(1));
+    QVERIFY(partialReader.atEnd() == false);
+    buffer.close();
+
+    // fromFile is built on the reader
+    buffer.open(QIODevice::ReadOnly);
+    QVERIFY(QVariantTree::fromFile(&buffer) == QVariant(records));
+    buffer.close();
+}
+
+
+void TreeGSD::test14IndexedRecords()
+{
+    QVariantMap map;
+    map.insert(QLatin1String("list"), QVariant(QVariantList() << QVariant(1.5) << QVariant(QString())));
+    map.insert(QLatin1String("names"), QVariant(QStringList() << QLatin1String("a")));
+    QVariantList records;
+    records << QVariant(7) << QVariant(map)
+            << QVariant(QDateTime(QDate(2015, 5, 12), QTime(19, 11)))
+            << QVariant(QLatin1String("last"));
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&buffer, records);
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    m_tree.setFromFileIndexed(&buffer);
+    QVERIFY(m_tree.isIndexed());
+    QVERIFY(m_tree.nodeType() == QVariant::List);
+
+    // the index matches the streamed records
+    QVariantTreeRecordIndex index = m_tree.recordIndex();
+    QVERIFY(index.count() == records.count());
+    qint64 offset = 0;
+    for (int i=0; i<index.count(); i++) {
+        QVERIFY(index.record(i).offset == offset);
+        QVERIFY(index.record(i).type == (uint)records.at(i).type());
+        QVERIFY(m_tree.recordIsLoaded(i) == false);
+        offset += index.record(i).size;
+    }
+    QVERIFY(offset == buffer.size());
+
+    // records are decoded on access
+    m_tree.moveToNode(QVariant(1));
+    QVERIFY(m_tree.recordIsLoaded(1));
+    QVERIFY(m_tree.recordIsLoaded(0) == false);
+    QVERIFY(m_tree.nodeValue() == QVariant(map));
+    m_tree.moveToParent();
+
+    m_tree.setTreeValue(QVariantList() << QVariant(3), QVariant(QLatin1String("edited")));
+    QVERIFY(m_tree.recordIsLoaded(3));
+
+    // a failed root edit keeps the records in the file
+    QVariantTreeTransaction transaction;
+    transaction.insertValue(QVariantList(), QVariant(1));
+    QVERIFY(m_tree.apply(transaction).failedAddresses() == (QList<QVariantList>() << QVariantList()));
+    QVERIFY(m_tree.isIndexed());
+    QVERIFY(m_tree.recordIsLoaded(0) == false);
+
+    // snapshots do not decode the records, undo reads them again
+    QVariantTreeHistory history;
+    history.reset(m_tree);
+    m_tree.setTreeValue(QVariantList() << QVariant(2), QVariant(2));
+    history.commit(m_tree, QVariantList() << QVariant(2));
+    QVERIFY(m_tree.recordIsLoaded(0) == false);
+    history.undo(m_tree);
+    QVERIFY(m_tree.recordIsLoaded(2) == false);
+    QVERIFY(m_tree.getTreeValue(QVariantList() << QVariant(2)) == records.at(2));
+    QVERIFY(m_tree.recordIsLoaded(0) == false);
+
+    // whole content loads everything
+    records[3] = QVariant(QLatin1String("edited"));
+    QVERIFY(m_tree.rootContent() == QVariant(records));
+    QVERIFY(m_tree.isIndexed() == false);
+    buffer.close();
+}
+
+
+void TreeGSD::test15MappedFile()
+{
+    QVariantList records;
+    records << QVariant(QLatin1String("mapped")) << QVariant(QVariantList() << QVariant(3) << QVariant(4));
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVariantTree::toFile(&file, records);
+    file.close();
+
+    QVERIFY(QVariantTree::fromFileMapped(file.fileName()) == QVariant(records));
+
+    // a buffer cannot be mapped: buffered reading
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&buffer, records);
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    QVERIFY(QVariantTree::fromFileMapped(&buffer) == QVariant(records));
+    buffer.close();
+
+    // empty file
+    QTemporaryFile emptyFile;
+    QVERIFY(emptyFile.open());
+    emptyFile.close();
+    QVERIFY(QVariantTree::fromFileMapped(emptyFile.fileName()).isValid() == false);
+}
+
+
+void TreeGSD::test16ParallelDecoding()
+{
+    QVariantList records = makeRecords(50);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVariantTree::toFile(&file, records);
+    file.close();
+
+    // original order whatever the number of workers
+    QVERIFY(QVariantTree::fromFileParallel(file.fileName(), 1) == QVariant(records));
+    QVERIFY(QVariantTree::fromFileParallel(file.fileName(), 3) == QVariant(records));
+    QVERIFY(QVariantTree::fromFileParallel(file.fileName()) == QVariant(records));
+
+    // not mappable device
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&buffer, records);
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    QVERIFY(QVariantTree::fromFileParallel(&buffer, 4) == QVariant(records));
+    buffer.close();
+
+    // a single record is the root itself
+    buffer.setData(QByteArray());
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&buffer, QVariant(QLatin1String("single")));
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    QVERIFY(QVariantTree::fromFileParallel(&buffer, 4) == QVariant(QLatin1String("single")));
+    buffer.close();
+}
+
+
+void TreeGSD::test17ParallelSerialization()
+{
+    QVariantList records;
+    for (int i=0; i<1000; i++)
+        records << QVariant(QVariantList() << QVariant(i) << QVariant(QString::number(i)));
+
+    QBuffer serialBuffer;
+    serialBuffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&serialBuffer, records);
+    serialBuffer.close();
+
+    // byte identical, whatever the number of workers
+    QList<int> workerCounts;
+    workerCounts << 1 << 3 << 0;
+    Q_FOREACH(int workerCount, workerCounts) {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        QVariantTree::toFileParallel(&buffer, records, workerCount);
+        buffer.close();
+        QVERIFY(buffer.data() == serialBuffer.data());
+    }
+
+    // not a list
+    serialBuffer.setData(QByteArray());
+    serialBuffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFile(&serialBuffer, QVariant(12));
+    serialBuffer.close();
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVariantTree::toFileParallel(&buffer, QVariant(12), 2);
+    buffer.close();
+    QVERIFY(buffer.data() == serialBuffer.data());
+}
+
+void TreeGSD::test18ContainerFormat()
+{
+    QVariantList records;
+    records << QVariant(1) << QVariant("two")
+            << QVariant(QVariantList() << QVariant(3) << QVariant(4.5));
+
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    QVariantTree::toContainerFile(&buffer, records);
+    buffer.seek(0);
+    QVERIFY(QVariantTree::fileFormat(&buffer) == QVariantTree::ContainerFormat);
+
+    // sequential reading stops before the footer
+    QVERIFY(QVariantTree::fromFile(&buffer) == QVariant(records));
+
+    // random access from the footer index
+    buffer.seek(0);
+    QVariantTreeRecordIndex index = QVariantTreeRecordIndex::build(&buffer);
+    QCOMPARE(index.count(), 3);
+    QCOMPARE(index.record(2).type, (uint)QVariant::List);
+    QVERIFY(index.load(&buffer, 2) == records.at(2));
+    QVERIFY(index.load(&buffer, 0) == records.at(0));
+
+    buffer.seek(0);
+    QVERIFY(QVariantTree::fromFileParallel(&buffer, 2) == QVariant(records));
+
+    // conversion both ways, plain files are unchanged
+    QTemporaryFile plainFile;
+    QVERIFY(plainFile.open());
+    QVariantTree::toFile(&plainFile, records);
+    plainFile.close();
+    QByteArray plainBytes;
+    {
+        QFile file(plainFile.fileName());
+        QVERIFY(file.open(QFile::ReadOnly));
+        plainBytes = file.readAll();
+    }
+    QVERIFY(QVariantTree::fileFormat(plainFile.fileName()) == QVariantTree::PlainFormat);
+
+    QVERIFY(QVariantTree::convertFile(plainFile.fileName(), plainFile.fileName(),
+                                      QVariantTree::ContainerFormat));
+    QVERIFY(QVariantTree::fileFormat(plainFile.fileName()) == QVariantTree::ContainerFormat);
+    QVERIFY(QVariantTree::fromFile(plainFile.fileName()) == QVariant(records));
+
+    QVERIFY(QVariantTree::convertFile(plainFile.fileName(), plainFile.fileName(),
+                                      QVariantTree::PlainFormat));
+    QFile file(plainFile.fileName());
+    QVERIFY(file.open(QFile::ReadOnly));
+    QVERIFY(file.readAll() == plainBytes);
+}
+
+void TreeGSD::test19CompressedFormat()
+{
+    // enough records for several blocks
+    QVariantList records = makeRecords(5000);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    QVariantTree::toCompressedFile(&buffer, records, 3);
+    buffer.seek(0);
+    QVERIFY(QVariantTree::fileFormat(&buffer) == QVariantTree::CompressedFormat);
+
+    QVERIFY(QVariantTree::fromFile(&buffer) == QVariant(records));
+    buffer.seek(0);
+    QVERIFY(QVariantTree::fromFileParallel(&buffer, 3) == QVariant(records));
+
+    // random access to a single block
+    buffer.seek(0);
+    QVector<QVariantTreeCompressed::Block> blocks;
+    QVERIFY(QVariantTreeCompressed::readIndex(&buffer, &blocks));
+    QVERIFY(blocks.count() > 1);
+    int blockIndex = QVariantTreeCompressed::blockOf(blocks, 4321);
+    QVERIFY(blockIndex > 0);
+    QVERIFY(QVariantTreeCompressed::blockOf(blocks, 5000) == -1);
+    const QVariantTreeCompressed::Block& block = blocks.at(blockIndex);
+    QVariantList blockRecords = QVariantTreeCompressed::readBlock(&buffer, block);
+    QCOMPARE(blockRecords.count(), block.recordCount);
+    QVERIFY(blockRecords.at(4321 - block.firstRecord) == records.at(4321));
+
+    // data after other bytes: the offsets are positions in the device
+    QBuffer shiftedBuffer;
+    shiftedBuffer.open(QIODevice::ReadWrite);
+    shiftedBuffer.write("prefix");
+    QVariantTree::toCompressedFile(&shiftedBuffer, records, 3);
+    shiftedBuffer.seek(6);
+    QVector<QVariantTreeCompressed::Block> shiftedBlocks;
+    QVERIFY(QVariantTreeCompressed::readIndex(&shiftedBuffer, &shiftedBlocks));
+    QCOMPARE(shiftedBlocks.at(blockIndex).offset, block.offset + 6);
+    QVERIFY(QVariantTreeCompressed::readBlock(&shiftedBuffer, shiftedBlocks.at(blockIndex)) == blockRecords);
+    shiftedBuffer.seek(6);
+    QVERIFY(QVariantTree::fromFileParallel(&shiftedBuffer, 3) == QVariant(records));
+
+    // same bytes whatever the number of workers
+    QBuffer serialBuffer;
+    serialBuffer.open(QIODevice::ReadWrite);
+    QVariantTree::toCompressedFile(&serialBuffer, records, 1);
+    QVERIFY(serialBuffer.data() == buffer.data());
+
+    // conversion both ways
+    QTemporaryFile plainFile;
+    QVERIFY(plainFile.open());
+    QVariantTree::toFile(&plainFile, records);
+    plainFile.close();
+    qint64 plainSize = QFileInfo(plainFile.fileName()).size();
+
+    QVERIFY(QVariantTree::convertFile(plainFile.fileName(), plainFile.fileName(),
+                                      QVariantTree::CompressedFormat));
+    QVERIFY(QVariantTree::fileFormat(plainFile.fileName()) == QVariantTree::CompressedFormat);
+    QVERIFY(QFileInfo(plainFile.fileName()).size() < plainSize);
+
+    QVERIFY(QVariantTree::convertFile(plainFile.fileName(), plainFile.fileName(),
+                                      QVariantTree::PlainFormat));
+    QVERIFY(QVariantTree::fromFile(plainFile.fileName()) == QVariant(records));
+    QCOMPARE(QFileInfo(plainFile.fileName()).size(), plainSize);
+}
+
+void TreeGSD::test20Journal()
+{
+    QVariantList records;
+    records << QVariant(1) << QVariant(2)
+            << QVariant(QVariantList() << QVariant("a") << QVariant("b"));
+
+    QTemporaryFile baseFile;
+    QVERIFY(baseFile.open());
+    QVariantTree::toFile(&baseFile, records);
+    baseFile.close();
+    const QString filename = baseFile.fileName();
+    QVERIFY(!QVariantTreeJournal::exists(filename));
+
+    // two saves, each address follows the previous operations
+    QVariantTreeJournal journal;
+    journal.delValue(QVariantList() << 0);
+    journal.setValue(QVariantList() << 1 << 0, QVariant("c"));
+    QVERIFY(journal.appendTo(filename));
+    journal.clear();
+    journal.insertValue(QVariantList() << 0, QVariant(5));
+    QVERIFY(journal.appendTo(filename));
+
+    QVariantList expected;
+    expected << QVariant(5) << QVariant(2)
+             << QVariant(QVariantList() << QVariant("c") << QVariant("b"));
+
+    QVariantTreeJournal read;
+    QVERIFY(QVariantTreeJournal::read(filename, &read));
+    QCOMPARE(read.count(), 3);
+    m_tree.setFromFileJournaled(filename);
+    QVERIFY(m_tree.rootContent() == QVariant(expected));
+
+    // a partial entry is ignored
+    {
+        QFile file(QVariantTreeJournal::fileName(filename));
+        QVERIFY(file.open(QFile::WriteOnly | QFile::Append));
+        file.write(QByteArray("\x00\x00\x01\x00garbage", 11));
+    }
+    QVERIFY(QVariantTreeJournal::read(filename, &read));
+    QCOMPARE(read.count(), 3);
+
+    // a torn last entry is cut by the next save, which still replays
+    {
+        QFile file(QVariantTreeJournal::fileName(filename));
+        QVERIFY(file.resize(file.size() - 11 - 3));
+    }
+    QVERIFY(QVariantTreeJournal::read(filename, &read));
+    QCOMPARE(read.count(), 2);
+    journal.clear();
+    journal.insertValue(QVariantList() << 0, QVariant(5));
+    QVERIFY(journal.appendTo(filename));
+    QVERIFY(QVariantTreeJournal::read(filename, &read));
+    QCOMPARE(read.count(), 3);
+    m_tree.setFromFileJournaled(filename);
+    QVERIFY(m_tree.rootContent() == QVariant(expected));
+
+    // folded into the base file
+    QVERIFY(QVariantTree::compactFile(filename));
+    QVERIFY(!QVariantTreeJournal::exists(filename));
+    QVERIFY(QVariantTree::fromFile(filename) == QVariant(expected));
+
+    // journal of an older base file
+    QVERIFY(journal.appendTo(filename));
+    records << QVariant(3);
+    QVariantTree::toFile(filename, records);
+    QVERIFY(!QVariantTreeJournal::read(filename, &read));
+    m_tree.setFromFileJournaled(filename);
+    QVERIFY(m_tree.rootContent() == QVariant(records));
+    QVERIFY(QVariantTreeJournal::remove(filename));
+
+    // the applied operations of a transaction replay one after the other
+    QVariantTree before;
+    before.setRootContent(QVariant(records));
+    QVariantTreeTransaction transaction;
+    transaction.delValue(QVariantList() << 0);
+    transaction.insertValue(QVariantList() << 1, QVariant(7));
+    transaction.insertValue(QVariantList() << 1, QVariant(8));
+    transaction.setValue(QVariantList() << 2 << 1, QVariant("d"));
+    transaction.delValue(QVariantList() << 2 << 0);
+    transaction.insertValue(QVariantList() << 3, QVariant(9));
+    transaction.setValue(QVariantList() << 10, QVariant(0));
+    QVariantTreeChangeSet changeSet = m_tree.apply(transaction);
+    QCOMPARE(changeSet.failedAddresses().count(), 1);
+
+    QList<QVariantTreeTransaction::Operation> applied = changeSet.appliedOperations();
+    QCOMPARE(applied.count(), 6);
+    QVariantTreeJournal transactionJournal;
+    Q_FOREACH(const QVariantTreeTransaction::Operation& operation, applied) {
+        // only the items, never a whole container
+        QVERIFY(!operation.address.isEmpty());
+        if (operation.type == QVariantTreeTransaction::SetOperation)
+            transactionJournal.setValue(operation.address, operation.value);
+        else if (operation.type == QVariantTreeTransaction::InsertOperation)
+            transactionJournal.insertValue(operation.address, operation.value);
+        else
+            transactionJournal.delValue(operation.address);
+    }
+    QVERIFY(before.replay(transactionJournal));
+    QVERIFY(before.rootContent() == m_tree.rootContent());
+}
+
+void TreeGSD::test21History()
+{
+    QVariantList big;
+    for (int i=0; i<1000; i++)
+        big << QVariant(i);
+    QVariantMap map;
+    map.insert("big", big);
+    map.insert("small", QVariantList() << QVariant(1) << QVariant(2));
+    QVariant original = map;
+
+    QVariantTree tree;
+    tree.setRootContent(original);
+    QVariantTreeHistory history;
+    history.reset(tree);
+    QVERIFY(!history.canUndo());
+
+    // edit inside "small", from its node
+    tree.moveToNode("small");
+    tree.setTreeValue(QVariantList() << "small" << 0, QVariant(10));
+    history.commit(tree, QVariantList() << "small");
+    QVariant edited = tree.rootContent();
+    tree.moveToRoot();
+    tree.delTreeValue(QVariantList() << "small");
+    history.commit(tree, QVariantList());
+    QCOMPARE(history.undoCount(), 2);
+
+    // the untouched subtree is shared between the snapshots
+    const QVariantList originalBig = original.toMap().value("big").toList();
+    const QVariantList editedBig = edited.toMap().value("big").toList();
+    QVERIFY(&originalBig.at(0) == &editedBig.at(0));
+    QVERIFY(history.usedBytes() > 0);
+    QVERIFY(history.usedBytes() < QVariantTreeHistory::deepCost(original.toMap().value("big")));
+
+    // the replaced items count, whatever their depth
+    QVariantMap replaced = map;
+    replaced.insert("small", QString(100000, QChar('x')));
+    QVERIFY(QVariantTreeHistory::spineCost(tree, original, replaced, QVariantList()) >= 200000);
+    QVERIFY(QVariantTreeHistory::spineCost(tree, original, map, QVariantList()) < 1000);
+    QVariantList shifted = big;
+    shifted.insert(0, QVariant(-1));
+    QVERIFY(QVariantTreeHistory::spineCost(tree, QVariant(big), QVariant(shifted), QVariantList())
+            < 2 * QVariantTreeHistory::deepCost(QVariant(big)));
+
+    // a persistent list only copies the path of the edited item
+    QVariantTree persistentTree;
+    QVariantTreePersistent::install(persistentTree);
+    QVariant persistentBig = QVariantTreePersistent::fromVariant(QVariant(big), 1);
+    QVariantTreePersistentList persistentEdited = persistentBig.value<QVariantTreePersistentList>();
+    persistentEdited[5] = QVariant(-5);
+    qint64 persistentCost = QVariantTreeHistory::spineCost(persistentTree, persistentBig,
+                                                           QVariant::fromValue(persistentEdited),
+                                                           QVariantList() << 5);
+    QVERIFY(persistentCost > (qint64)(2 * sizeof(QVariant)));
+    QVERIFY(persistentCost < QVariantTreeHistory::deepCost(QVariant(big)) / 4);
+
+    // cursor of the edit time
+    QVariant beforeUndo = tree.rootContent();
+    QCOMPARE(history.undo(tree), QVariantList());
+    QVERIFY(tree.rootContent() == edited);
+    QVERIFY(tree.address().isEmpty());
+
+    // an undone root step is journaled as its items
+    QVariantTreeJournal journal;
+    journal.setNodeChanges(QVariantList(), beforeUndo, tree.rootContent());
+    QCOMPARE(journal.count(), 1);
+    QCOMPARE(journal.operations().first().address, QVariantList() << "small");
+    QVariantTree replayed;
+    replayed.setRootContent(beforeUndo);
+    QVERIFY(replayed.replay(journal));
+    QVERIFY(replayed.rootContent() == edited);
+
+    QVariantTreeJournal listJournal;
+    listJournal.setNodeChanges(QVariantList(), QVariant(shifted), QVariant(big));
+    QCOMPARE(listJournal.count(), 1);
+    QCOMPARE(listJournal.operations().first().type, QVariantTreeTransaction::DelOperation);
+    replayed.setRootContent(QVariant(shifted));
+    QVERIFY(replayed.replay(listJournal));
+    QVERIFY(replayed.rootContent() == QVariant(big));
+    QCOMPARE(history.undo(tree), QVariantList() << "small");
+    QVERIFY(tree.rootContent() == original);
+    QCOMPARE(tree.address(), QVariantList() << "small");
+    QVERIFY(tree.nodeValue() == map.value("small"));
+    QVERIFY(!history.canUndo());
+
+    QCOMPARE(history.redo(tree), QVariantList() << "small");
+    QVERIFY(tree.rootContent() == edited);
+    QCOMPARE(history.redoCount(), 1);
+
+    // a new edit drops the redo steps
+    tree.moveToRoot();
+    tree.setTreeValue(QVariantList() << "other", QVariant(true));
+    history.commit(tree, QVariantList());
+    QVERIFY(!history.canRedo());
+    QCOMPARE(history.undoCount(), 2);
+
+    // oldest steps dropped beyond the budget
+    history.setBudget(0);
+    QVERIFY(history.usedBytes() <= 0);
+    QVERIFY(!history.canUndo());
+    QVERIFY(tree.rootContent().toMap().value("other") == QVariant(true));
+}
+
+void TreeGSD::test22Persistent()
+{
+    // lists deep enough for several levels of nodes
+    QVariantTreePersistentList list;
+    QVariantList referenceList;
+    for (int i=0; i<5000; i++) {
+        int index = (i * 7919) % (referenceList.count() + 1);
+        list.insert(index, QVariant(i));
+        referenceList.insert(index, QVariant(i));
+    }
+    QVERIFY(list.toList() == referenceList);
+    QVariantTreePersistentList listSnapshot = list;
+    for (int i=0; i<4000; i++) {
+        int index = (i * 104729) % referenceList.count();
+        list.removeAt(index);
+        referenceList.removeAt(index);
+    }
+    list[10] = QVariant("edited");
+    referenceList[10] = QVariant("edited");
+    QCOMPARE(list.count(), referenceList.count());
+    QVERIFY(list.toList() == referenceList);
+    QCOMPARE(listSnapshot.count(), 5000);
+    QVERIFY(QVariantTreePersistentList::fromList(referenceList) == list);
+
+    QVariantTreePersistentMap map;
+    QVariantMap referenceMap;
+    for (int i=0; i<5000; i++) {
+        map.insert(QString::number(i), QVariant(i));
+        referenceMap.insert(QString::number(i), QVariant(i));
+    }
+    QVariantTreePersistentMap mapSnapshot = map;
+    for (int i=0; i<5000; i+=3) {
+        map.remove(QString::number(i));
+        referenceMap.remove(QString::number(i));
+    }
+    QCOMPARE(map.count(), referenceMap.count());
+    QVERIFY(map.toMap() == referenceMap);
+    QVERIFY(!map.contains("0"));
+    QVERIFY(mapSnapshot.contains("0"));
+    QCOMPARE(mapSnapshot.count(), 5000);
+
+    // edits through the tree, on converted content
+    QVariantList records = makeRecords(2000);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("small", QVariantList() << QVariant(1));
+
+    QVariantTree tree;
+    QVariantTreePersistent::install(tree);
+    QVariant persistent = QVariantTreePersistent::fromVariant(content, 1000);
+    QVERIFY(persistent.userType() == QVariant::Map);
+    QVERIFY(persistent.toMap().value("records").userType() == qMetaTypeId<QVariantTreePersistentList>());
+    QVERIFY(persistent.toMap().value("small").userType() == QVariant::List);
+    tree.setRootContent(persistent);
+    QVariant snapshot = tree.rootContent();
+
+    QCOMPARE(tree.getTreeValue(tree.rootContent(), QVariantList() << "records" << 1500 << "id"), QVariant(1500));
+    tree.setTreeValue(QVariantList() << "records" << 1500 << "id", QVariant(-1));
+    tree.delTreeValue(QVariantList() << "records" << 0);
+    QVariantTreeTransaction transaction;
+    transaction.insertValue(QVariantList() << "records" << 100, QVariant("inserted"));
+    tree.apply(transaction);
+
+    QVariantMap expectedRecord = records.at(1500).toMap();
+    expectedRecord.insert("id", -1);
+    records[1500] = expectedRecord;
+    records.removeAt(0);
+    records.insert(100, QVariant("inserted"));
+    content.insert("records", records);
+    QVERIFY(QVariantTreePersistent::toVariant(tree.rootContent()) == QVariant(content));
+
+    // the snapshot shares the untouched nodes and keeps its values
+    QCOMPARE(tree.getTreeValue(snapshot, QVariantList() << "records" << 1500 << "id"), QVariant(1500));
+    QCOMPARE(tree.getTreeValue(snapshot, QVariantList() << "records").toList().count(), 2000);
+    tree.moveToNode("records");
+    QVERIFY(tree.nodeIsContainer());
+    QCOMPARE(tree.itemContainerKeys().count(), 2000);
+}
+
+void TreeGSD::test23Flat()
+{
+    QVariantList records = makeRecords(100);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("tags", QStringList() << "first" << "second");
+    content.insert("empty", QVariantMap());
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+    QVariantTreeFlat flat = QVariantTreeFlat::fromTree(tree);
+
+    // root, 3 items, 100 records of 6 values with 2 coordinates and 2 tags, 2 tags
+    QCOMPARE(flat.count(), 1 + 3 + 100 * (1 + 6 + 2 + 2) + 2);
+    QCOMPARE(flat.node(0).subtreeEnd, flat.count());
+    QCOMPARE(flat.node(0).childCount, 3);
+    QCOMPARE(flat.typeCounts().value(QVariant::Map), 1 + 1 + 100);
+    QCOMPARE(flat.typeCounts().value(QVariant::Date), 100);
+
+    // every node maps back to the content through its address
+    for (int i=0; i<flat.count(); i++) {
+        QVariantList address = flat.address(i);
+        QCOMPARE(flat.indexOf(address), i);
+        QVariant expected = tree.getTreeValue(content, address);
+        if (!tree.typeIsContainer(expected.userType()))
+            QVERIFY(flat.value(i) == expected);
+        QCOMPARE((int)flat.node(i).type, expected.userType());
+    }
+    QCOMPARE(flat.indexOf(QVariantList() << "records" << 100), -1);
+
+    int sensorId = flat.indexOf(QVariantList() << "records" << 42 << "sensorId");
+    QCOMPARE(flat.key(sensorId), QVariant("sensorId"));
+    QCOMPARE(flat.text(sensorId), QString("sensor-42"));
+    QCOMPARE(flat.keyText(flat.node(sensorId).parent), QString("42"));
+
+    // each key is stored once in the arena
+    QCOMPARE(flat.node(sensorId).keyOffset,
+             flat.node(flat.indexOf(QVariantList() << "records" << 7 << "sensorId")).keyOffset);
+
+    QVector<int> hits = flat.findText("sensor-4");
+    QCOMPARE(hits.count(), 11);
+    QCOMPARE(flat.findText("RECORDS", Qt::CaseInsensitive).count(), 1);
+    QVERIFY(flat.memoryUsage() > 0);
+
+    // cancelled build
+    QAtomicInt cancelled(1);
+    QVERIFY(QVariantTreeFlat::fromVariant(tree, tree.rootContent(), &cancelled).isEmpty());
+}
+
+namespace {
+
+class CountingReceiver : public QVariantTreeSearch::Receiver
+{
+public:
+    CountingReceiver() : count(0) {}
+    void found(const QList<QVariantList>& addresses) { count.fetchAndAddOrdered(addresses.count()); }
+    QAtomicInt count;
+};
+
+}
+
+void TreeGSD::test24Search()
+{
+    QVariantList records = makeRecords(500);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("name", QString("Sensors"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    // keys only
+    QVariantTreeSearch search;
+    search.setText("sensorid");
+    search.setTargets(QVariantTreeSearch::KeyTarget);
+    QList<QVariantList> hits = search.find(tree, tree.rootContent(), 1);
+    QCOMPARE(hits.count(), 500);
+    QCOMPARE(hits.first(), QVariantList() << "records" << 0 << "sensorId");
+
+    // same hits in the same order from several threads
+    CountingReceiver receiver;
+    QList<QVariantList> parallelHits = search.find(tree, tree.rootContent(), 4, NULL, &receiver);
+    QCOMPARE(parallelHits, hits);
+    QCOMPARE((int)receiver.count.load(), 500);
+
+    // values, case sensitive
+    search.setText("Sensor", Qt::CaseSensitive);
+    search.setTargets(QVariantTreeSearch::KeyTarget | QVariantTreeSearch::ValueTarget);
+    hits = search.find(tree, tree.rootContent(), 4);
+    QCOMPARE(hits.count(), 1);
+    QCOMPARE(hits.first(), QVariantList() << "name");
+    search.setText("odd");
+    QCOMPARE(search.find(tree, tree.rootContent(), 4).count(), 250);
+
+    // numeric range, type: temperatures, ids and x coordinates
+    QVariantTreeSearch range;
+    range.setRange(10.0, 12.0);
+    hits = range.find(tree, tree.rootContent(), 4);
+    QCOMPARE(hits.count(), 21 + 3 + 3);
+    range.setType(QVariant::Double);
+    hits = range.find(tree, tree.rootContent(), 4);
+    QCOMPARE(hits.count(), 21);
+    foreach (const QVariantList& address, hits)
+        QCOMPARE(address.last(), QVariant("temperature"));
+    range.setType(QVariant::Bool);
+    QVERIFY(range.find(tree, tree.rootContent(), 4).isEmpty());
+
+    QVariantTreeSearch type;
+    type.setType(QVariant::StringList);
+    QCOMPARE(type.find(tree, tree.rootContent(), 4).count(), 500);
+    type.setType(QVariant::Map);
+    QCOMPARE(type.find(tree, tree.rootContent(), 4).first(), QVariantList());
+
+    // same hits from the flat form
+    QVariantTreeFlat flat = QVariantTreeFlat::fromTree(tree);
+    QCOMPARE(search.find(flat, 4), search.find(tree, tree.rootContent(), 1));
+    QCOMPARE(search.find(flat, 1), search.find(tree, tree.rootContent(), 1));
+    QCOMPARE(range.find(flat, 4), range.find(tree, tree.rootContent(), 1));
+    QCOMPARE(type.find(flat, 4), type.find(tree, tree.rootContent(), 1));
+    QVariantTreeSearch keys;
+    keys.setText("TEMP");
+    receiver.count.store(0);
+    QCOMPARE(keys.find(flat, 4, NULL, &receiver), keys.find(tree, tree.rootContent(), 4));
+    QCOMPARE((int)receiver.count.load(), 500);
+
+    // cancelled before starting
+    QAtomicInt cancelled(1);
+    QVERIFY(type.find(tree, tree.rootContent(), 4, &cancelled).count() <= 1);
+    QVERIFY(type.find(flat, 4, &cancelled).count() <= 1);
+    QVERIFY(QVariantTreeSearch().find(tree, tree.rootContent()).isEmpty());
+}
+
+namespace {
+
+// last edit reported to an observer
+class RecordingObserver : public QVariantTreeObserver
+{
+public:
+    RecordingObserver() : index(-2) {}
+    void treeReset(const QVariantTree&) {}
+    void build(const QVariantTree&) {}
+    void clear() {}
+    void nodeChanged(const QVariantTree&, const QVariantList& changedAddress, const QVariant&)
+    {
+        address = changedAddress;
+        index = -1;
+    }
+    void itemsChanged(const QVariantTree&, const QVariantList& listAddress, int firstIndex,
+                      const QVariantList& items)
+    {
+        address = listAddress;
+        index = firstIndex;
+        oldItems = items;
+    }
+
+    QVariantList address;
+    int index;
+    QVariantList oldItems;
+};
+
+// same entries as an index built from scratch
+bool matchesRebuilt(const QVariantTreeKeyIndex& index, const QVariantTree& tree)
+{
+    QVariantTreeKeyIndex rebuilt;
+    rebuilt.build(tree);
+    if (index.keys() != rebuilt.keys() || index.entryCount() != rebuilt.entryCount())
+        return false;
+    foreach (const QString& key, rebuilt.keys()) {
+        QList<QVariantList> addresses = index.addresses(key);
+        foreach (const QVariantList& address, rebuilt.addresses(key)) {
+            if (!addresses.contains(address))
+                return false;
+        }
+    }
+    return true;
+}
+
+}
+
+void TreeGSD::test25KeyIndex()
+{
+    QVariantList records = makeRecords(100);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("name", QString("Sensors"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    QVariantTreeKeyIndex index;
+    index.build(tree);
+    QCOMPARE(index.keyCount(), 2 + 6 + 2);
+    QCOMPARE(index.entryCount(), 2 + 100 * (6 + 2));
+    QCOMPARE(index.count("sensorId"), 100);
+    QVERIFY(index.addresses("x").contains(QVariantList() << "records" << 42 << "position" << "x"));
+    QVERIFY(!index.contains("0"));
+    QCOMPARE(index.complete("s"), QStringList() << "sensorId");
+    QCOMPARE(index.complete("", 3), QStringList() << "date" << "id" << "name");
+
+    // followed edits
+    tree.addObserver(&index);
+    tree.moveToNode("records");
+    tree.moveToNode(3);
+    tree.setItemContainer("unit", QString("C"));
+    QCOMPARE(index.addresses("unit"), QList<QVariantList>() << (QVariantList() << "records" << 3 << "unit"));
+    tree.delItemContainer("position");
+    QCOMPARE(index.count("x"), 99);
+    QVERIFY(matchesRebuilt(index, tree));
+
+    // a removed list item shifts the next ones
+    tree.moveToParent();
+    tree.delItemContainer(0);
+    QVERIFY(index.addresses("unit").contains(QVariantList() << "records" << 2 << "unit"));
+    QVERIFY(matchesRebuilt(index, tree));
+
+    // reported from the first shifted item, whatever the type of the key
+    RecordingObserver recorder;
+    QVariantTree list;
+    list.setRootContent(QVariantList() << "a" << "b" << "c" << "d");
+    list.addObserver(&recorder);
+    list.delItemContainer(2);
+    QCOMPARE(recorder.address, QVariantList());
+    QCOMPARE(recorder.index, 2);
+    QCOMPARE(recorder.oldItems, QVariantList() << "c" << "d");
+    QVariantTreeTransaction listTransaction;
+    listTransaction.insertValue(QVariantList() << 3, QString("e"));
+    list.apply(listTransaction);
+    QCOMPARE(recorder.index, 3);
+    QVERIFY(recorder.oldItems.isEmpty());
+    listTransaction.clear();
+    listTransaction.delValue(QVariantList() << QString("1"));
+    listTransaction.setValue(QVariantList() << 2, QString("f"));
+    list.apply(listTransaction);
+    QCOMPARE(recorder.index, 1);
+    QCOMPARE(recorder.oldItems, QVariantList() << "b" << "d" << "e");
+    list.setTreeValue(QVariantList() << 0, QString("g"));
+    QCOMPARE(recorder.address, QVariantList() << 0);
+    QCOMPARE(recorder.index, -1);
+    list.removeObserver(&recorder);
+
+    QVariantTreeTransaction transaction;
+    transaction.setValue(QVariantList() << "records" << 10 << "sensorId", QString("renamed"));
+    transaction.delValue(QVariantList() << "records" << 20 << "position");
+    transaction.insertValue(QVariantList() << "records" << 0, QVariantMap());
+    transaction.setValue(QVariantList() << "name", QVariantMap());
+    tree.apply(transaction);
+    QVERIFY(matchesRebuilt(index, tree));
+
+    // undo restores a snapshot, only the edited node is indexed again
+    QVariantTreeHistory history;
+    history.reset(tree);
+    quint64 revision = index.revision();
+    tree.setTreeValue(QVariantList() << "records" << 5 << "sensorId", 5);
+    history.commit(tree, QVariantList() << "records" << 5);
+    history.undo(tree);
+    QVERIFY(index.revision() > revision);
+    QVERIFY(matchesRebuilt(index, tree));
+
+    tree.setRootContent(QVariantMap());
+    QVERIFY(index.isEmpty());
+    tree.removeObserver(&index);
+    tree.setRootContent(content);
+    QVERIFY(index.isEmpty());
+
+    // cancelled build
+    QAtomicInt cancelled(1);
+    QVERIFY(!index.build(tree, tree.rootContent(), &cancelled));
+    QVERIFY(index.build(tree, tree.rootContent()));
+    QCOMPARE(index.entryCount(), 2 + 100 * (6 + 2));
+
+    // a long shift leaves the index stale until it is built again
+    QVariantList longRecords;
+    for (int i=0; i<=QVariantTreeKeyIndex::MaxShiftedItems + 1; i++)
+        longRecords << records.at(i % records.count());
+    QVariantTree longTree;
+    longTree.setRootContent(longRecords);
+    index.build(longTree);
+    longTree.addObserver(&index);
+    longTree.delItemContainer(longRecords.count() - 10);
+    QVERIFY(!index.isStale());
+    QVERIFY(matchesRebuilt(index, longTree));
+    longTree.delItemContainer(0);
+    QVERIFY(index.isStale());
+    QVERIFY(index.isEmpty());
+    longTree.setTreeValue(QVariantList() << 0 << "unit", QString("C"));
+    QVERIFY(index.isEmpty());
+    index.build(longTree);
+    QVERIFY(!index.isStale());
+    QVERIFY(matchesRebuilt(index, longTree));
+    longTree.removeObserver(&index);
+}
+
+void TreeGSD::test26TextIndex()
+{
+    QVariantList messages;
+    for (int i=0; i<300; i++) {
+        QVariantMap message;
+        message.insert("text", QString("Connection %1 timeout after %2 ms").arg(i).arg(i * 10));
+        message.insert("level", i % 3 ? QString("info") : QString("ERROR"));
+        message.insert("code", i);
+        messages << message;
+    }
+    QVariantMap content;
+    content.insert("messages", messages);
+    content.insert("title", QString("Timeout"));
+    content.insert("tags", QStringList() << "net" << "timeouts");
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    QVariantTreeTextIndex index;
+    QVERIFY(index.build(tree, tree.rootContent(), 4));
+    QCOMPARE(index.count(), 300 * 2 + 1 + 2);
+    QVERIFY(index.memoryUsage() > 0);
+
+    // ranked: exact, prefix, then word matches
+    QList<QVariantList> hits = index.find("TIMEOUT");
+    QCOMPARE(hits.count(), 300 + 2);
+    QCOMPARE(hits.at(0), QVariantList() << "title");
+    QCOMPARE(hits.at(1), QVariantList() << "tags" << 1);
+    QCOMPARE(index.find("timeout", 5).count(), 5);
+    QCOMPARE(index.find("error").count(), 100);
+    QCOMPARE(index.find("n 12 t").first(), QVariantList() << "messages" << 12 << "text");
+    QVERIFY(index.find("timeout before").isEmpty());
+    // shorter than a trigram
+    QCOMPARE(index.find("ne").count(), 300 + 1);
+
+    // followed edits
+    tree.addObserver(&index);
+    tree.moveToNode("messages");
+    tree.moveToNode(7);
+    tree.setItemContainer("text", QString("Disk full"));
+    QCOMPARE(index.find("disk"), QList<QVariantList>() << (QVariantList() << "messages" << 7 << "text"));
+    QCOMPARE(index.find("timeout").count(), 300 + 1);
+    tree.moveToParent();
+    tree.delItemContainer(0);
+    QCOMPARE(index.find("disk"), QList<QVariantList>() << (QVariantList() << "messages" << 6 << "text"));
+    QCOMPARE(index.count(), 299 * 2 + 1 + 2);
+
+    // the edits leave removed entries, results stay the same
+    for (int i=0; i<50; i++)
+        tree.setItemContainer(i, QVariant(i));
+    QCOMPARE(index.count(), 249 * 2 + 1 + 2);
+    QCOMPARE(index.find("timeout").count(), 249 + 2);
+
+    QVariantTreeTextIndex rebuilt;
+    rebuilt.build(tree, tree.rootContent(), 1);
+    QCOMPARE(index.find("connection 1"), rebuilt.find("connection 1"));
+
+    // dropped
+    tree.removeObserver(&index);
+    index.clear();
+    QVERIFY(index.isEmpty());
+    QVERIFY(index.find("timeout").isEmpty());
+
+    QAtomicInt cancelled(1);
+    QVERIFY(!index.build(tree, tree.rootContent(), 4, &cancelled));
+    QVERIFY(index.isEmpty());
+}
+
+namespace {
+
+QList<QVariantList> matchAddresses(const QList<QVariantTreeQuery::Match>& matches)
+{
+    QList<QVariantList> addresses;
+    foreach (const QVariantTreeQuery::Match& match, matches)
+        addresses << match.address;
+    return addresses;
+}
+
+}
+
+void TreeGSD::test27Query()
+{
+    QVariantList records = makeRecords(40);
+    QVariantMap calibration;
+    calibration.insert("temperature", -1.0);
+    for (int i=0; i<records.count(); i+=10) {
+        QVariantMap record = records.at(i).toMap();
+        record.insert("calibration", calibration);
+        records[i] = record;
+    }
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("unit", QString("C"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    // keyed steps, wildcard
+    QVariantTreeQuery query("$.records[*].temperature");
+    QVERIFY(query.isValid());
+    QList<QVariantTreeQuery::Match> matches = query.evaluate(tree, tree.rootContent(), 1);
+    QCOMPARE(matches.count(), 40);
+    QCOMPARE(matches.at(3).address, QVariantList() << "records" << 3 << "temperature");
+    QCOMPARE(matches.at(3).value, QVariant(3 / 10.0));
+
+    // the same matches in the same order from several threads
+    QCOMPARE(matchAddresses(query.evaluate(tree, tree.rootContent(), 4)), matchAddresses(matches));
+
+    // recursive descent
+    query.compile("$..temperature");
+    QCOMPARE(query.evaluate(tree, tree.rootContent(), 1).count(), 44);
+    QCOMPARE(matchAddresses(query.evaluate(tree, tree.rootContent(), 4)),
+             matchAddresses(query.evaluate(tree, tree.rootContent(), 1)));
+    query.compile("..calibration.temperature");
+    QCOMPARE(query.evaluate(tree, tree.rootContent(), 4).count(), 4);
+
+    // indexes, unions and slices
+    query.compile("records[-1].id");
+    QCOMPARE(query.evaluate(tree).first().value, QVariant(39));
+    query.compile("$['records'][0, 2]['id','sensorId']");
+    QCOMPARE(query.evaluate(tree).count(), 4);
+    query.compile("$.records[1:10:3].id");
+    matches = query.evaluate(tree, tree.rootContent(), 4);
+    QCOMPARE(matches.count(), 3);
+    QCOMPARE(matches.at(2).value, QVariant(7));
+    query.compile("$.records[::-1]");
+    QCOMPARE(query.evaluate(tree).first().address, QVariantList() << "records" << 39);
+    query.compile("$.records[38:]");
+    QCOMPARE(query.evaluate(tree).count(), 2);
+
+    // out of range bounds are clamped, a large step does not wrap around
+    query.compile("$.records[30:1000]");
+    QCOMPARE(query.evaluate(tree).count(), 10);
+    query.compile("$.records[-1000:2]");
+    QCOMPARE(query.evaluate(tree).count(), 2);
+    query.compile("$.records[1000:-1000:-1]");
+    matches = query.evaluate(tree);
+    QCOMPARE(matches.count(), 40);
+    QCOMPARE(matches.first().address, QVariantList() << "records" << 39);
+    query.compile("$.records[1::2147483647]");
+    QCOMPARE(matchAddresses(query.evaluate(tree)), QList<QVariantList>() << (QVariantList() << "records" << 1));
+    query.compile("$.records[50:60]");
+    QVERIFY(query.evaluate(tree).isEmpty());
+
+    // a map is not sliced, even with integer-like keys
+    QVariantMap numbered;
+    numbered.insert("0", QString("zero"));
+    numbered.insert("1", QString("one"));
+    content.insert("numbered", numbered);
+    tree.setRootContent(content);
+    query.compile("$.numbered[0:2]");
+    QVERIFY(query.evaluate(tree).isEmpty());
+    query.compile("$[:]");
+    QVERIFY(query.evaluate(tree).isEmpty());
+
+    // predicates
+    query.compile("$.records[?(@.temperature >= 3.6 && @.id != 37 || @.sensorId == 'sensor-1')].id");
+    matches = query.evaluate(tree, tree.rootContent(), 4);
+    QCOMPARE(matches.count(), 4);
+    QCOMPARE(matches.first().value, QVariant(1));
+    query.compile("$.records[?(@.calibration)]");
+    QCOMPARE(query.evaluate(tree).count(), 4);
+    query.compile("$.records[?(@['calibration'].temperature < 0)].sensorId");
+    QCOMPARE(query.evaluate(tree).last().value, QVariant(QString("sensor-30")));
+
+    // missing keys and leaves select nothing
+    query.compile("$.unit.length");
+    QVERIFY(query.evaluate(tree).isEmpty());
+    query.compile("$.records.sensorId");
+    QVERIFY(query.evaluate(tree).isEmpty());
+    query.compile("$");
+    QCOMPARE(query.evaluate(tree).first().address, QVariantList());
+
+    // syntax errors
+    QVERIFY(!query.compile("$.records["));
+    QVERIFY(!query.isValid());
+    QVERIFY(!query.errorString().isEmpty());
+    QCOMPARE(query.errorPosition(), 10);
+    QVERIFY(!query.compile("$records"));
+    QVERIFY(!query.compile("$.records[?(@.id > )]"));
+    QVERIFY(query.evaluate(tree).isEmpty());
+}
+
+namespace {
+
+// differences as comparable lists of the type then the address
+QVariantList differenceList(const QList<QVariantTreeDiff::Difference>& differences)
+{
+    QVariantList result;
+    foreach (const QVariantTreeDiff::Difference& difference, differences)
+        result << QVariant(QVariantList() << (int)difference.type << QVariant(difference.address));
+    return result;
+}
+
+QVariant difference(QVariantTreeDiff::Type type, const QVariantList& address)
+{
+    return QVariantList() << (int)type << QVariant(address);
+}
+
+}
+
+void TreeGSD::test28Diff()
+{
+    QVariantList records = makeRecords(40);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("unit", QString("C"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    // identical contents
+    QVERIFY(tree.diff(content).isEmpty());
+    QVERIFY(QVariantTreeDiff::compare(tree, content, content, 4).isEmpty());
+
+    // leaves, keys added and removed, one type change
+    QVariantMap edited = content;
+    QVariantList editedRecords = records;
+    QVariantMap record = editedRecords.at(5).toMap();
+    record.insert("sensorId", QString("renamed"));
+    record.remove("tags");
+    record.insert("spare", true);
+    editedRecords[5] = record;
+    record = editedRecords.at(31).toMap();
+    record.insert("id", QString("31"));
+    editedRecords[31] = record;
+    editedRecords << QVariantMap();
+    edited.insert("records", editedRecords);
+    edited.remove("unit");
+    edited.insert("owner", QString("lab"));
+
+    QVariantList expected;
+    expected << difference(QVariantTreeDiff::Changed, QVariantList() << "records" << 5 << "sensorId")
+             << difference(QVariantTreeDiff::Removed, QVariantList() << "records" << 5 << "tags")
+             << difference(QVariantTreeDiff::Added, QVariantList() << "records" << 5 << "spare")
+             << difference(QVariantTreeDiff::Changed, QVariantList() << "records" << 31 << "id")
+             << difference(QVariantTreeDiff::Added, QVariantList() << "records" << 40)
+             << difference(QVariantTreeDiff::Removed, QVariantList() << "unit")
+             << difference(QVariantTreeDiff::Added, QVariantList() << "owner");
+    QCOMPARE(differenceList(tree.diff(edited, 1)), expected);
+    // the same differences in the same order from several threads
+    QCOMPARE(differenceList(tree.diff(edited, 4)), expected);
+
+    // the other way round
+    QList<QVariantTreeDiff::Difference> differences = QVariantTreeDiff::compare(tree, edited, content, 4);
+    QCOMPARE(differences.count(), expected.count());
+    QCOMPARE(differenceList(differences).at(5),
+             difference(QVariantTreeDiff::Removed, QVariantList() << "records" << 40));
+
+    // the hash of a hash does not depend on the insertion order
+    QVariantHash forward;
+    QVariantHash backward;
+    for (int i=0; i<100; i++) {
+        forward.insert(QString::number(i), i);
+        backward.insert(QString::number(99 - i), 99 - i);
+    }
+    QCOMPARE(QVariantTreeDiff::hash(tree, forward).value, QVariantTreeDiff::hash(tree, backward).value);
+    QCOMPARE(QVariantTreeDiff::hashParallel(tree, forward, 4).value,
+             QVariantTreeDiff::hash(tree, forward).value);
+
+    // containers of another type, root leaves
+    QCOMPARE(differenceList(QVariantTreeDiff::compare(tree, forward, QVariantMap())),
+             QVariantList() << difference(QVariantTreeDiff::Changed, QVariantList()));
+    QVERIFY(QVariantTreeDiff::compare(tree, 1.5, 1.5).isEmpty());
+    QCOMPARE(QVariantTreeDiff::compare(tree, 1, 1.0).count(), 1);
+}
+
+void TreeGSD::test29HashCache()
+{
+    QVariantList records = makeRecords(100);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("name", QString("Sensors"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    QVariantTreeHashCache cache;
+    QVERIFY(cache.isEmpty());
+    cache.build(tree);
+    QVERIFY(!cache.isEmpty());
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, content).value);
+    bool isValid = false;
+    QCOMPARE(cache.hash(QVariantList() << "records" << 7 << "position", &isValid),
+             QVariantTreeDiff::hash(tree, records.at(7).toMap().value("position")).value);
+    QVERIFY(isValid);
+    cache.hash(QVariantList() << "records" << 100, &isValid);
+    QVERIFY(!isValid);
+
+    // followed edits, the same hashes as a full build
+    tree.addObserver(&cache);
+    QVariantTreeDiff::Hash saved = cache.snapshot();
+    quint64 savedHash = saved.value;
+    QVariantList address = QVariantList() << "records" << 3 << "sensorId";
+    tree.setTreeValue(address, QString("renamed"));
+    QVERIFY(cache.rootHash() != savedHash);
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+    QCOMPARE(cache.dirtyAddresses(tree, saved), QList<QVariantList>() << address);
+
+    // the reverse edit restores the saved hash
+    tree.setTreeValue(address, QString("sensor-3"));
+    QCOMPARE(cache.rootHash(), savedHash);
+    QVERIFY(cache.dirtyAddresses(tree, saved).isEmpty());
+
+    // the snapshot is not changed by the edits
+    tree.setTreeValue(QVariantList() << "records" << 5 << "position" << "x", 50);
+    QCOMPARE(saved.value, savedHash);
+    QCOMPARE(saved.items.count(), 2);
+    QCOMPARE(cache.dirtyAddresses(tree, saved),
+             QList<QVariantList>() << (QVariantList() << "records" << 5 << "position" << "x"));
+
+    // added and removed keys, through the cursor
+    tree.moveToNode("records");
+    tree.moveToNode(8);
+    tree.setItemContainer("unit", QString("C"));
+    tree.delItemContainer("position");
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+    QList<QVariantList> dirty = cache.dirtyAddresses(tree, saved);
+    QCOMPARE(dirty.count(), 2);
+    QVERIFY(dirty.contains(QVariantList() << "records" << 8));
+
+    // a removed list item shifts the next ones
+    tree.moveToParent();
+    tree.delItemContainer(0);
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+    QCOMPARE(cache.hash(QVariantList() << "records" << 50),
+             QVariantTreeDiff::hash(tree, tree.getTreeValue(QVariantList() << "records" << 50)).value);
+    tree.delItemContainer(0);
+    tree.delItemContainer(97);
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+
+    // the items of a large map are looked up in their table
+    QVariantMap sensors;
+    for (int i=0; i<40; i++)
+        sensors.insert(QString("sensor-%1").arg(i), i);
+    tree.setTreeValue(QVariantList() << "sensors", sensors);
+    tree.delTreeValue(QVariantList() << "sensors" << "sensor-2");
+    tree.setTreeValue(QVariantList() << "sensors" << "sensor-40", 40);
+    QCOMPARE(cache.hash(QVariantList() << "sensors" << "sensor-39"), QVariantTreeDiff::hash(tree, 39).value);
+    QCOMPARE(cache.hash(QVariantList() << "sensors" << "sensor-40"), QVariantTreeDiff::hash(tree, 40).value);
+    cache.hash(QVariantList() << "sensors" << "sensor-2", &isValid);
+    QVERIFY(!isValid);
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+
+    QVariantTreeTransaction transaction;
+    transaction.setValue(QVariantList() << "records" << 10 << "sensorId", QString("renamed"));
+    transaction.delValue(QVariantList() << "records" << 20 << "position");
+    transaction.insertValue(QVariantList() << "records" << 0, QVariantMap());
+    transaction.setValue(QVariantList() << "name", QVariantMap());
+    tree.apply(transaction);
+    QCOMPARE(cache.rootHash(), QVariantTreeDiff::hash(tree, tree.rootContent()).value);
+
+    // undo restores a snapshot
+    QVariantTreeHistory history;
+    history.reset(tree);
+    quint64 hash = cache.rootHash();
+    tree.setTreeValue(QVariantList() << "records" << 5 << "sensorId", 5);
+    history.commit(tree, QVariantList() << "records" << 5);
+    history.undo(tree);
+    QCOMPARE(cache.rootHash(), hash);
+
+    // a new content is hashed again
+    tree.setRootContent(content);
+    QCOMPARE(cache.rootHash(), savedHash);
+    QVERIFY(cache.dirtyAddresses(tree, saved).isEmpty());
+    tree.removeObserver(&cache);
+
+    // cancelled build
+    QAtomicInt cancelled(1);
+    QVERIFY(!cache.build(tree, tree.rootContent(), 4, &cancelled));
+    QVERIFY(cache.isEmpty());
+    QVERIFY(cache.build(tree, tree.rootContent(), 4));
+    QCOMPARE(cache.rootHash(), savedHash);
+}
+
+void TreeGSD::test30SizeCache()
+{
+    // the sizes are the bytes of a QDataStream
+    QVariantList values;
+    values << QVariant() << true << 12 << 12u << (qlonglong)-3 << 2.5
+           << QString() << QString("text") << (QStringList() << "a" << "bc")
+           << QByteArray("bytes") << QDateTime(QDate(2020, 1, 2));
+    QVariantMap map;
+    map.insert("list", QVariantList() << 1 << QString("two"));
+    map.insert("hash", QVariantHash());
+    values << map;
+    for (int i=0; i<values.count(); i++) {
+        QByteArray bytes;
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream << values.at(i);
+        QCOMPARE(QVariantTreeSizeCache::serializedSize(values.at(i)), (qint64)bytes.size());
+    }
+
+    QVariantList records = makeRecords(50);
+    QVariantMap content;
+    content.insert("records", records);
+    content.insert("name", QString("Sensors"));
+
+    QVariantTree tree;
+    tree.setRootContent(content);
+
+    QVariantTreeSizeCache cache;
+    QVERIFY(cache.isEmpty());
+    cache.build(tree);
+    QVERIFY(!cache.isEmpty());
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(content));
+    bool isValid = false;
+    QCOMPARE(cache.size(QVariantList() << "records" << 7 << "position", &isValid),
+             QVariantTreeSizeCache::serializedSize(records.at(7).toMap().value("position")));
+    QVERIFY(isValid);
+    cache.size(QVariantList() << "records" << 100, &isValid);
+    QVERIFY(!isValid);
+    // a string list is measured as a whole
+    QCOMPARE(cache.size(QVariantList() << "records" << 7 << "tags"),
+             QVariantTreeSizeCache::serializedSize(records.at(7).toMap().value("tags")));
+    cache.size(QVariantList() << "records" << 7 << "tags" << 0, &isValid);
+    QVERIFY(!isValid);
+
+    // the file size, a root list is written without the list
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    tree.toFile(&buffer);
+    QCOMPARE(cache.fileSize(), (qint64)buffer.size());
+    QVariantTree listTree;
+    listTree.setRootContent(records);
+    QVariantTreeSizeCache listCache;
+    listCache.build(listTree);
+    QBuffer listBuffer;
+    listBuffer.open(QIODevice::WriteOnly);
+    listTree.toFile(&listBuffer);
+    QCOMPARE(listCache.fileSize(), (qint64)listBuffer.size());
+
+    // followed edits, the same sizes as a full build
+    tree.addObserver(&cache);
+    tree.setTreeValue(QVariantList() << "records" << 3 << "sensorId", QString("a longer name"));
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+    QCOMPARE(cache.size(QVariantList() << "records" << 3),
+             QVariantTreeSizeCache::serializedSize(tree.getTreeValue(tree.rootContent(), QVariantList() << "records" << 3)));
+
+    // an edit inside a value measured as a whole
+    tree.setTreeValue(QVariantList() << "records" << 4 << "tags" << 1, QString("calibrated"));
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+
+    // added and removed keys, through the cursor
+    tree.moveToNode("records");
+    tree.moveToNode(8);
+    tree.setItemContainer("unit", QString("C"));
+    tree.delItemContainer("position");
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+    cache.size(QVariantList() << "records" << 8 << "position", &isValid);
+    QVERIFY(!isValid);
+
+    // a removed list item shifts the next ones
+    tree.moveToParent();
+    tree.delItemContainer(0);
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+    QCOMPARE(cache.size(QVariantList() << "records" << 0),
+             QVariantTreeSizeCache::serializedSize(tree.getTreeValue(tree.rootContent(), QVariantList() << "records" << 0)));
+    tree.delItemContainer(48);
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+    cache.size(QVariantList() << "records" << 48, &isValid);
+    QVERIFY(!isValid);
+
+    // the items of a large map are looked up in their table
+    QVariantMap sensors;
+    for (int i=0; i<40; i++)
+        sensors.insert(QString("sensor-%1").arg(i), QString::number(i));
+    tree.setTreeValue(QVariantList() << "sensors", sensors);
+    tree.delTreeValue(QVariantList() << "sensors" << "sensor-2");
+    tree.setTreeValue(QVariantList() << "sensors" << "sensor-40", QString("forty"));
+    QCOMPARE(cache.size(QVariantList() << "sensors" << "sensor-39"),
+             QVariantTreeSizeCache::serializedSize(QString("39")));
+    QCOMPARE(cache.size(QVariantList() << "sensors" << "sensor-40"),
+             QVariantTreeSizeCache::serializedSize(QString("forty")));
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+
+    QVariantTreeTransaction transaction;
+    transaction.setValue(QVariantList() << "records" << 10 << "sensorId", 10);
+    transaction.delValue(QVariantList() << "records" << 20 << "tags");
+    transaction.insertValue(QVariantList() << "records" << 0, QVariantMap());
+    transaction.setValue(QVariantList() << "name", QVariantHash());
+    tree.apply(transaction);
+    QCOMPARE(cache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(tree.rootContent()));
+
+    QVariantTreeSizeCache rebuilt;
+    rebuilt.build(tree, tree.rootContent(), 4);
+    QCOMPARE(cache.size(QVariantList() << "records" << 20), rebuilt.size(QVariantList() << "records" << 20));
+    QCOMPARE(cache.fileSize(), rebuilt.fileSize());
+
+    // a new content is measured again
+    tree.setRootContent(records);
+    QCOMPARE(cache.fileSize(), listCache.fileSize());
+    tree.removeObserver(&cache);
+
+    // cancelled build
+    QAtomicInt cancelled(1);
+    QVERIFY(!cache.build(tree, tree.rootContent(), 4, &cancelled));
+    QVERIFY(cache.isEmpty());
+    QCOMPARE(cache.fileSize(), (qint64)0);
+
+    // persistent nodes are measured as the collections they are written as
+    QVariantTree persistentTree;
+    QVariantTreePersistent::install(persistentTree);
+    persistentTree.setRootContent(QVariantTreePersistent::fromVariant(content, 1));
+    QVariantTreeSizeCache persistentCache;
+    persistentCache.build(persistentTree);
+    QCOMPARE(persistentCache.size(QVariantList()), QVariantTreeSizeCache::serializedSize(content));
+    QCOMPARE(persistentCache.size(QVariantList() << "records" << 7),
+             QVariantTreeSizeCache::serializedSize(records.at(7)));
+}
+
+void TreeGSD::test31AppendRecords()
+{
+    QVariantList records;
+    for (int i=0; i<2500; i++)
+        records << QVariant(QString("record %1").arg(i));
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVariantTree::toFile(&file, records);
+    file.seek(0);
+
+    // batches of a background open, appended as they come
+    QVariantTree tree;
+    tree.setRootContent(QVariantList());
+    QVariantTreeRecordReader reader(&file);
+    QVariantList batch;
+    int batchCount = 0;
+    while (reader.readNext()) {
+        batch << reader.record();
+        if (batch.count() == 1000 || reader.recordIndex() == records.count() - 1) {
+            QVERIFY(tree.appendRecords(batch));
+            batch.clear();
+            batchCount++;
+        }
+    }
+    QCOMPARE(batchCount, 3);
+    QCOMPARE(tree.rootContent().toList().count(), records.count());
+    QVERIFY(tree.rootContent() == QVariant(records));
+
+    // reported as items added at the end, the cursor stays on its node
+    RecordingObserver recorder;
+    tree.addObserver(&recorder);
+    tree.moveToNode(3);
+    QVERIFY(tree.appendRecords(QVariantList() << QString("appended")));
+    QCOMPARE(recorder.address, QVariantList());
+    QCOMPARE(recorder.index, records.count());
+    QVERIFY(recorder.oldItems.isEmpty());
+    QCOMPARE(tree.nodeValue(), QVariant(QString("record 3")));
+    QCOMPARE(tree.getTreeValue(tree.rootContent(), QVariantList() << records.count()),
+             QVariant(QString("appended")));
+    tree.moveToRoot();
+    tree.removeObserver(&recorder);
+
+    // only a list has an end
+    QVariantMap map;
+    map.insert("a", 1);
+    tree.setRootContent(map);
+    QVERIFY(!tree.appendRecords(QVariantList() << 2));
+    QVERIFY(tree.rootContent() == QVariant(map));
+
+    // a single record is the root if it is a container
+    QVERIFY(tree.containerRoot(map) == QVariant(map));
+    QVERIFY(tree.containerRoot(QVariant(3)) == QVariant(QVariantList() << 3));
+    QVERIFY(tree.containerRoot(QVariant()) == QVariant(QVariantList()));
+}
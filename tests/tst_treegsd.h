@@ -30,6 +30,30 @@ private Q_SLOTS:
     void test05SetContainerList();
     void test06DelWithoutContainer();
     void test07DelContainerList();
+    void test08GetContainerMapHash();
+    void test09SetDelInPlace();
+    void test10NodeCursor();
+    void test11RegisterContainer();
+    void test12Transaction();
+    void test13RecordReader();
+    void test14IndexedRecords();
+    void test15MappedFile();
+    void test16ParallelDecoding();
+    void test17ParallelSerialization();
+    void test18ContainerFormat();
+    void test19CompressedFormat();
+    void test20Journal();
+    void test21History();
+    void test22Persistent();
+    void test23Flat();
+    void test24Search();
+    void test25KeyIndex();
+    void test26TextIndex();
+    void test27Query();
+    void test28Diff();
+    void test29HashCache();
+    void test30SizeCache();
+    void test31AppendRecords();
 
 private:
     template <typename T>
@@ -41,6 +65,10 @@ private:
         QVERIFY(m_tree.nodeIsContainer() == false);
     }
 
+    // sensor records shared by the tests, the values of record i depend on i:
+    // id, sensorId, temperature, date, position {x, y} and tags [raw, odd/even]
+    static QVariantList makeRecords(int count);
+
 private:
     QVariantTree m_tree;
 };